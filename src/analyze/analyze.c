@@ -36,6 +36,7 @@
 #include "hashmap.h"
 #include "locale-util.h"
 #include "log.h"
+#include "logs-show.h"
 #include "pager.h"
 #include "parse-util.h"
 #if HAVE_SECCOMP
@@ -1007,6 +1008,158 @@ static int analyze_blame(sd_bus *bus) {
         return 0;
 }
 
+struct generator_time {
+        const char *path;
+        usec_t duration;
+        int status;
+};
+
+static int compare_generator_time(const void *a, const void *b) {
+        const struct generator_time *x = a, *y = b;
+
+        if (x->duration < y->duration)
+                return 1;
+        if (x->duration > y->duration)
+                return -1;
+
+        return strcmp(x->path, y->path);
+}
+
+static int analyze_generator_blame(sd_bus *bus) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_free_ struct generator_time *times = NULL;
+        size_t n = 0, n_allocated = 0, i;
+        const char *path;
+        uint64_t start, duration;
+        int32_t status;
+        int r;
+
+        r = sd_bus_get_property(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "GeneratorTimings",
+                        &error,
+                        &reply,
+                        "a(stti)");
+        if (r < 0) {
+                log_error("Failed to get generator timings: %s", bus_error_message(&error, -r));
+                return r;
+        }
+
+        r = sd_bus_message_enter_container(reply, 'a', "(stti)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = sd_bus_message_read(reply, "(stti)", &path, &start, &duration, &status)) > 0) {
+                if (!GREEDY_REALLOC(times, n_allocated, n + 1))
+                        return log_oom();
+
+                times[n++] = (struct generator_time) {
+                        .path = path,
+                        .duration = duration,
+                        .status = status,
+                };
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        qsort_safe(times, n, sizeof(struct generator_time), compare_generator_time);
+
+        pager_open(arg_no_pager, false);
+
+        for (i = 0; i < n; i++) {
+                char ts[FORMAT_TIMESPAN_MAX];
+
+                printf("%16s %s%s\n",
+                       format_timespan(ts, sizeof(ts), times[i].duration, USEC_PER_MSEC),
+                       basename(times[i].path),
+                       times[i].status != 0 ? " (failed)" : "");
+        }
+
+        return 0;
+}
+
+static void trace_print_event(
+                const char *category,
+                const char *name,
+                const char *object,
+                const char *phase,
+                uint64_t id,
+                uint64_t ts,
+                uint64_t duration) {
+
+        _cleanup_free_ char *label = NULL;
+
+        label = isempty(object) ? strdup(name) : strjoin(name, " ", object);
+        if (!label) {
+                log_oom();
+                return;
+        }
+
+        fputs(",\n{\"name\":", stdout);
+        json_escape(stdout, label, strlen(label), OUTPUT_SHOW_ALL);
+        printf(",\"cat\":\"%s\",\"ph\":\"%s\",\"pid\":1,\"tid\":1,\"ts\":%" PRIu64, category, phase, ts);
+
+        if (streq(phase, "X"))
+                printf(",\"dur\":%" PRIu64, duration);
+        else
+                printf(",\"id\":%" PRIu64, id);
+
+        fputs("}", stdout);
+}
+
+static int analyze_trace(sd_bus *bus) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        const char *category, *name, *object;
+        uint64_t begin, duration, id = 0;
+        int r;
+
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "GetTrace",
+                        &error,
+                        &reply,
+                        "");
+        if (r < 0)
+                return log_error_errno(r, "Failed to get trace: %s", bus_error_message(&error, r));
+
+        r = sd_bus_message_enter_container(reply, 'a', "(ssstt)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        /* Output the events in the Chrome trace event format, as understood by chrome://tracing and Perfetto.
+         * Timestamps are in µs of CLOCK_MONOTONIC. The work of the manager itself happens on its main thread and
+         * is properly nested, hence is shown as complete events on one track. Waiting and running jobs as well as
+         * generators overlap each other, hence they are shown as asynchronous events. */
+
+        fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+              "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"systemd\"}}", stdout);
+
+        while ((r = sd_bus_message_read(reply, "(ssstt)", &category, &name, &object, &begin, &duration)) > 0) {
+
+                if (streq(category, "manager"))
+                        trace_print_event(category, name, object, "X", 0, begin, duration);
+                else {
+                        id++;
+                        trace_print_event(category, name, object, "b", id, begin, 0);
+                        trace_print_event(category, name, object, "e", id, begin + duration, 0);
+                }
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        fputs("\n]}\n", stdout);
+
+        return 0;
+}
+
 static int analyze_time(sd_bus *bus) {
         _cleanup_free_ char *buf = NULL;
         int r;
@@ -1484,8 +1637,10 @@ static void help(void) {
                "Commands:\n"
                "  time                     Print time spent in the kernel\n"
                "  blame                    Print list of running units ordered by time to init\n"
+               "  generator-blame          Print list of generators ordered by their runtime\n"
                "  critical-chain           Print a tree of the time critical chain of units\n"
                "  plot                     Output SVG graphic showing service initialization\n"
+               "  trace                    Output trace of recent work of the manager in Chrome JSON\n"
                "  dot                      Output dependency graph in man:dot(1) format\n"
                "  set-log-level LEVEL      Set logging threshold for manager\n"
                "  set-log-target TARGET    Set logging target for manager\n"
@@ -1666,10 +1821,14 @@ int main(int argc, char *argv[]) {
                         r = analyze_time(bus);
                 else if (streq(argv[optind], "blame"))
                         r = analyze_blame(bus);
+                else if (streq(argv[optind], "generator-blame"))
+                        r = analyze_generator_blame(bus);
                 else if (streq(argv[optind], "critical-chain"))
                         r = analyze_critical_chain(bus, argv+optind+1);
                 else if (streq(argv[optind], "plot"))
                         r = analyze_plot(bus);
+                else if (streq(argv[optind], "trace"))
+                        r = analyze_trace(bus);
                 else if (streq(argv[optind], "dot"))
                         r = dot(bus, argv+optind+1);
                 else if (streq(argv[optind], "dump"))
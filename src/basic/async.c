@@ -19,7 +19,6 @@
 ***/
 
 #include <errno.h>
-#include <pthread.h>
 #include <stddef.h>
 #include <unistd.h>
 
@@ -29,49 +28,54 @@
 #include "macro.h"
 #include "util.h"
 
-int asynchronous_job(void* (*func)(void *p), void *arg) {
-        pthread_attr_t a;
-        pthread_t t;
-        int r;
+int asynchronous_job(thread_job_func_t func, void *arg) {
+        ThreadPool *p;
 
         /* It kinda sucks that we have to resort to threads to
          * implement an asynchronous sync(), but well, such is
          * life.
          *
+         * Jobs are run on the process-wide default thread pool, so
+         * that a burst of them neither results in a burst of thread
+         * creations nor in unbounded concurrency.
+         *
          * Note that issuing this command right before exiting a
          * process will cause the process to wait for the sync() to
          * complete. This function hence is nicely asynchronous really
          * only in long running processes. */
 
-        r = pthread_attr_init(&a);
-        if (r > 0)
-                return -r;
+        p = thread_pool_default();
+        if (!p)
+                return -ENOMEM;
+
+        return thread_pool_submit(p, func, arg, NULL);
+}
+
+static int asynchronous_sync_job(thread_job_func_t func, void *arg) {
+        ThreadPool *p;
 
-        r = pthread_attr_setdetachstate(&a, PTHREAD_CREATE_DETACHED);
-        if (r > 0)
-                goto finish;
+        /* close() and sync() get a pool of their own, so that they are never stuck behind long running jobs
+         * submitted with asynchronous_job() */
 
-        r = pthread_create(&t, &a, func, arg);
+        p = thread_pool_sync();
+        if (!p)
+                return -ENOMEM;
 
-finish:
-        pthread_attr_destroy(&a);
-        return -r;
+        return thread_pool_submit(p, func, arg, NULL);
 }
 
-static void *sync_thread(void *p) {
+static void sync_thread(void *p) {
         sync();
-        return NULL;
 }
 
 int asynchronous_sync(void) {
-        log_debug("Spawning new thread for sync");
+        log_debug("Queuing job for sync");
 
-        return asynchronous_job(sync_thread, NULL);
+        return asynchronous_sync_job(sync_thread, NULL);
 }
 
-static void *close_thread(void *p) {
+static void close_thread(void *p) {
         assert_se(close_nointr(PTR_TO_FD(p)) != -EBADF);
-        return NULL;
 }
 
 int asynchronous_close(int fd) {
@@ -86,7 +90,7 @@ int asynchronous_close(int fd) {
         if (fd >= 0) {
                 PROTECT_ERRNO;
 
-                r = asynchronous_job(close_thread, FD_TO_PTR(fd));
+                r = asynchronous_sync_job(close_thread, FD_TO_PTR(fd));
                 if (r < 0)
                          assert_se(close_nointr(fd) != -EBADF);
         }
@@ -20,7 +20,9 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
-int asynchronous_job(void* (*func)(void *p), void *arg);
+#include "thread-pool.h"
+
+int asynchronous_job(thread_job_func_t func, void *arg);
 
 int asynchronous_sync(void);
 int asynchronous_close(int fd);
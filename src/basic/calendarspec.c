@@ -132,6 +132,33 @@ static void normalize_chain(CalendarComponent **c) {
         *c = next;
 }
 
+static uint64_t chain_bits(const CalendarComponent *c, int scale, int max) {
+        uint64_t bits = 0;
+
+        /* Returns the values matched by the chain, divided by scale, as bitmask. Values beyond max are never
+         * valid, and are left out. Returns 0 if the chain is empty, or matches values that aren't multiples of
+         * scale. */
+
+        for (; c; c = c->next) {
+                int v;
+
+                if (c->start < 0 || c->start % scale != 0 || c->repeat % scale != 0)
+                        return 0;
+
+                for (v = c->start; v / scale <= max; v += c->repeat) {
+                        if (c->stop >= 0 && v > c->stop)
+                                break;
+
+                        bits |= UINT64_C(1) << (v / scale);
+
+                        if (c->repeat <= 0)
+                                break;
+                }
+        }
+
+        return bits;
+}
+
 static void fix_year(CalendarComponent *c) {
         /* Turns 12 → 2012, 89 → 1989 */
 
@@ -170,6 +197,12 @@ int calendar_spec_normalize(CalendarSpec *c) {
         normalize_chain(&c->minute);
         normalize_chain(&c->microsecond);
 
+        c->month_bits = chain_bits(c->month, 1, 12);
+        c->day_bits = c->end_of_month ? 0 : chain_bits(c->day, 1, 31);
+        c->hour_bits = chain_bits(c->hour, 1, 23);
+        c->minute_bits = chain_bits(c->minute, 1, 59);
+        c->second_bits = chain_bits(c->microsecond, USEC_PER_SEC, 59);
+
         return 0;
 }
 
@@ -1118,7 +1151,27 @@ static int find_end_of_month(struct tm *tm, bool utc, int day) {
         return t.tm_mday;
 }
 
-static int find_matching_component(const CalendarSpec *spec, const CalendarComponent *c,
+static int find_matching_bit(uint64_t bits, int scale, int *val) {
+        int v, d;
+
+        /* Looks up the first value >= *val in a bitmask, as set up by chain_bits() */
+
+        v = DIV_ROUND_UP(*val, scale);
+        if (v >= 64)
+                return -ENOENT;
+
+        bits &= UINT64_MAX << v;
+        if (bits == 0)
+                return -ENOENT;
+
+        d = __builtin_ctzll(bits) * scale;
+
+        v = *val != d;
+        *val = d;
+        return v;
+}
+
+static int find_matching_component(const CalendarSpec *spec, const CalendarComponent *c, uint64_t bits, int scale,
                                    struct tm *tm, int *val) {
         const CalendarComponent *p = c;
         int start, stop, d = -1;
@@ -1130,6 +1183,9 @@ static int find_matching_component(const CalendarSpec *spec, const CalendarCompo
         if (!c)
                 return 0;
 
+        if (bits != 0)
+                return find_matching_bit(bits, scale, val);
+
         while (c) {
                 start = c->start;
                 stop = c->stop;
@@ -1171,13 +1227,46 @@ static int find_matching_component(const CalendarSpec *spec, const CalendarCompo
         return r;
 }
 
-static bool tm_out_of_bounds(const struct tm *tm, bool utc) {
+/* find_next() usually checks the same broken-down time several times in a row, as long as the fields it looks at
+ * already match. Converting local time is not cheap, as glibc checks whether the time zone file changed on each
+ * call of mktime(), hence remember the last conversion. */
+typedef struct TmCache {
+        struct tm tm;
+        struct tm normalized;
+        time_t t;
+        bool valid;
+} TmCache;
+
+static time_t tm_normalize(TmCache *cache, struct tm *tm, bool utc) {
+        assert(cache);
+        assert(tm);
+
+        /* Only these fields are used by mktime() */
+        if (!cache->valid ||
+            cache->tm.tm_year != tm->tm_year ||
+            cache->tm.tm_mon != tm->tm_mon ||
+            cache->tm.tm_mday != tm->tm_mday ||
+            cache->tm.tm_hour != tm->tm_hour ||
+            cache->tm.tm_min != tm->tm_min ||
+            cache->tm.tm_sec != tm->tm_sec ||
+            cache->tm.tm_isdst != tm->tm_isdst) {
+
+                cache->tm = cache->normalized = *tm;
+                cache->t = mktime_or_timegm(&cache->normalized, utc);
+                cache->valid = true;
+        }
+
+        *tm = cache->normalized;
+        return cache->t;
+}
+
+static bool tm_out_of_bounds(TmCache *cache, const struct tm *tm, bool utc) {
         struct tm t;
         assert(tm);
 
         t = *tm;
 
-        if (mktime_or_timegm(&t, utc) < 0)
+        if (tm_normalize(cache, &t, utc) < 0)
                 return true;
 
         /*
@@ -1198,7 +1287,7 @@ static bool tm_out_of_bounds(const struct tm *tm, bool utc) {
                 t.tm_sec != tm->tm_sec;
 }
 
-static bool matches_weekday(int weekdays_bits, const struct tm *tm, bool utc) {
+static bool matches_weekday(TmCache *cache, int weekdays_bits, const struct tm *tm, bool utc) {
         struct tm t;
         int k;
 
@@ -1206,14 +1295,14 @@ static bool matches_weekday(int weekdays_bits, const struct tm *tm, bool utc) {
                 return true;
 
         t = *tm;
-        if (mktime_or_timegm(&t, utc) < 0)
+        if (tm_normalize(cache, &t, utc) < 0)
                 return false;
 
         k = t.tm_wday == 0 ? 6 : t.tm_wday - 1;
         return (weekdays_bits & (1 << k));
 }
 
-static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
+static int find_next(const CalendarSpec *spec, TmCache *cache, struct tm *tm, usec_t *usec) {
         struct tm c;
         int tm_usec;
         int r;
@@ -1226,11 +1315,11 @@ static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
 
         for (;;) {
                 /* Normalize the current date */
-                (void) mktime_or_timegm(&c, spec->utc);
+                (void) tm_normalize(cache, &c, spec->utc);
                 c.tm_isdst = spec->dst;
 
                 c.tm_year += 1900;
-                r = find_matching_component(spec, spec->year, &c, &c.tm_year);
+                r = find_matching_component(spec, spec->year, 0, 1, &c, &c.tm_year);
                 c.tm_year -= 1900;
 
                 if (r > 0) {
@@ -1240,18 +1329,18 @@ static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
                 }
                 if (r < 0)
                         return r;
-                if (tm_out_of_bounds(&c, spec->utc))
+                if (tm_out_of_bounds(cache, &c, spec->utc))
                         return -ENOENT;
 
                 c.tm_mon += 1;
-                r = find_matching_component(spec, spec->month, &c, &c.tm_mon);
+                r = find_matching_component(spec, spec->month, spec->month_bits, 1, &c, &c.tm_mon);
                 c.tm_mon -= 1;
 
                 if (r > 0) {
                         c.tm_mday = 1;
                         c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
                 }
-                if (r < 0 || tm_out_of_bounds(&c, spec->utc)) {
+                if (r < 0 || tm_out_of_bounds(cache, &c, spec->utc)) {
                         c.tm_year++;
                         c.tm_mon = 0;
                         c.tm_mday = 1;
@@ -1259,46 +1348,46 @@ static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
                         continue;
                 }
 
-                r = find_matching_component(spec, spec->day, &c, &c.tm_mday);
+                r = find_matching_component(spec, spec->day, spec->day_bits, 1, &c, &c.tm_mday);
                 if (r > 0)
                         c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
-                if (r < 0 || tm_out_of_bounds(&c, spec->utc)) {
+                if (r < 0 || tm_out_of_bounds(cache, &c, spec->utc)) {
                         c.tm_mon++;
                         c.tm_mday = 1;
                         c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
                         continue;
                 }
 
-                if (!matches_weekday(spec->weekdays_bits, &c, spec->utc)) {
+                if (!matches_weekday(cache, spec->weekdays_bits, &c, spec->utc)) {
                         c.tm_mday++;
                         c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
                         continue;
                 }
 
-                r = find_matching_component(spec, spec->hour, &c, &c.tm_hour);
+                r = find_matching_component(spec, spec->hour, spec->hour_bits, 1, &c, &c.tm_hour);
                 if (r > 0)
                         c.tm_min = c.tm_sec = tm_usec = 0;
-                if (r < 0 || tm_out_of_bounds(&c, spec->utc)) {
+                if (r < 0 || tm_out_of_bounds(cache, &c, spec->utc)) {
                         c.tm_mday++;
                         c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
                         continue;
                 }
 
-                r = find_matching_component(spec, spec->minute, &c, &c.tm_min);
+                r = find_matching_component(spec, spec->minute, spec->minute_bits, 1, &c, &c.tm_min);
                 if (r > 0)
                         c.tm_sec = tm_usec = 0;
-                if (r < 0 || tm_out_of_bounds(&c, spec->utc)) {
+                if (r < 0 || tm_out_of_bounds(cache, &c, spec->utc)) {
                         c.tm_hour++;
                         c.tm_min = c.tm_sec = tm_usec = 0;
                         continue;
                 }
 
                 c.tm_sec = c.tm_sec * USEC_PER_SEC + tm_usec;
-                r = find_matching_component(spec, spec->microsecond, &c, &c.tm_sec);
+                r = find_matching_component(spec, spec->microsecond, spec->second_bits, USEC_PER_SEC, &c, &c.tm_sec);
                 tm_usec = c.tm_sec % USEC_PER_SEC;
                 c.tm_sec /= USEC_PER_SEC;
 
-                if (r < 0 || tm_out_of_bounds(&c, spec->utc)) {
+                if (r < 0 || tm_out_of_bounds(cache, &c, spec->utc)) {
                         c.tm_min++;
                         c.tm_sec = tm_usec = 0;
                         continue;
@@ -1311,6 +1400,7 @@ static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
 }
 
 static int calendar_spec_next_usec_impl(const CalendarSpec *spec, usec_t usec, usec_t *next) {
+        TmCache cache = {};
         struct tm tm;
         time_t t;
         int r;
@@ -1327,11 +1417,11 @@ static int calendar_spec_next_usec_impl(const CalendarSpec *spec, usec_t usec, u
         assert_se(localtime_or_gmtime_r(&t, &tm, spec->utc));
         tm_usec = usec % USEC_PER_SEC;
 
-        r = find_next(spec, &tm, &tm_usec);
+        r = find_next(spec, &cache, &tm, &tm_usec);
         if (r < 0)
                 return r;
 
-        t = mktime_or_timegm(&tm, spec->utc);
+        t = tm_normalize(&cache, &tm, spec->utc);
         if (t < 0)
                 return -EINVAL;
 
@@ -24,6 +24,7 @@
  * time, a la cron */
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "time-util.h"
 #include "util.h"
@@ -50,6 +51,14 @@ typedef struct CalendarSpec {
         CalendarComponent *hour;
         CalendarComponent *minute;
         CalendarComponent *microsecond;
+
+        /* The values matched by the components above as bitmasks, set up by calendar_spec_normalize(), so that
+         * the next match can be looked up directly. Zero if a component cannot be expressed this way. */
+        uint16_t month_bits;
+        uint32_t day_bits;
+        uint32_t hour_bits;
+        uint64_t minute_bits;
+        uint64_t second_bits;
 } CalendarSpec;
 
 CalendarSpec* calendar_spec_free(CalendarSpec *c);
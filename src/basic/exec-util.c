@@ -22,17 +22,22 @@
 #include <errno.h>
 #include <sys/prctl.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <stdio.h>
 
 #include "alloc-util.h"
 #include "conf-files.h"
+#include "def.h"
 #include "env-util.h"
+#include "escape.h"
 #include "exec-util.h"
+#include "extract-word.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "hashmap.h"
 #include "macro.h"
+#include "parse-util.h"
 #include "process-util.h"
 #include "set.h"
 #include "signal-util.h"
@@ -88,23 +93,90 @@ static int do_spawn(const char *path, char *argv[], int stdout_fd, pid_t *pid) {
         return 1;
 }
 
+static unsigned exec_parallel_max(void) {
+        long n;
+
+        /* Generators and friends mostly wait for the disk, hence allow somewhat more of them to run at the same
+         * time than we have CPUs, but don't fork off an unbounded number of processes at once either. */
+
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n <= 0)
+                n = 1;
+
+        return CLAMP((unsigned) n * 2, 4U, 64U);
+}
+
+static void exec_timing_write(FILE *f, const ExecTiming *t) {
+        _cleanup_free_ char *escaped = NULL;
+
+        if (!f)
+                return;
+
+        escaped = xescape(t->path, WHITESPACE);
+        if (!escaped)
+                return;
+
+        /* Flush right away, so that the records of the binaries that finished survive the timeout */
+        fprintf(f, USEC_FMT " " USEC_FMT " %i %s\n", t->start, t->duration, t->status, escaped);
+        (void) fflush(f);
+}
+
+static int exec_wait_any(Hashmap *pids, ExecTiming *timings, FILE *timing_f) {
+        siginfo_t si = {};
+        ExecTiming *t;
+        unsigned idx;
+
+        /* Waits for whichever child finishes first, so that the timings are accurate and a slot in the pool
+         * frees up as early as possible */
+
+        for (;;) {
+                if (waitid(P_ALL, 0, &si, WEXITED|WNOWAIT) >= 0)
+                        break;
+                if (errno != EINTR)
+                        return -errno;
+        }
+
+        idx = PTR_TO_UINT(hashmap_remove(pids, PID_TO_PTR(si.si_pid)));
+        if (idx == 0) {
+                /* Not one of ours, just reap it */
+                (void) wait_for_terminate(si.si_pid, NULL);
+                return 0;
+        }
+
+        t = timings + idx - 1;
+        t->status = wait_for_terminate_and_warn(t->path, si.si_pid, true);
+        t->duration = now(CLOCK_MONOTONIC) - t->start;
+
+        exec_timing_write(timing_f, t);
+        return 0;
+}
+
 static int do_execute(
                 char **directories,
                 usec_t timeout,
                 gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
                 void* const callback_args[_STDOUT_CONSUME_MAX],
                 int output_fd,
+                int timing_fd,
                 char *argv[]) {
 
-        _cleanup_hashmap_free_free_ Hashmap *pids = NULL;
+        _cleanup_hashmap_free_ Hashmap *pids = NULL;
         _cleanup_strv_free_ char **paths = NULL;
+        _cleanup_fclose_ FILE *timing_f = NULL;
+        ExecTiming *timings = NULL; /* this is only used in the forked process, no cleanup here */
+        size_t n_timings = 0, n_allocated = 0;
+        unsigned parallel_max;
         char **path;
         int r;
 
         /* We fork this all off from a child process so that we can somewhat cleanly make
          * use of SIGALRM to set a time limit.
          *
-         * If callbacks is nonnull, execution is serial. Otherwise, we default to parallel.
+         * If callbacks is nonnull, execution is serial. Otherwise, we default to parallel, with at most
+         * exec_parallel_max() binaries running at a time.
+         *
+         * If timing_fd is not negative, a record with the runtime and exit status of each binary is written to
+         * it as soon as the binary finishes.
          */
 
         (void) reset_all_signal_handlers();
@@ -122,6 +194,14 @@ static int do_execute(
                         return log_oom();
         }
 
+        if (timing_fd >= 0) {
+                timing_f = fdopen(timing_fd, "we");
+                if (!timing_f)
+                        return log_error_errno(errno, "Failed to open timing fd: %m");
+        }
+
+        parallel_max = exec_parallel_max();
+
         /* Abort execution of this process after the timout. We simply rely on SIGALRM as
          * default action terminating the process, and turn on alarm(). */
 
@@ -129,31 +209,47 @@ static int do_execute(
                 alarm((timeout + USEC_PER_SEC - 1) / USEC_PER_SEC);
 
         STRV_FOREACH(path, paths) {
-                _cleanup_free_ char *t = NULL;
                 _cleanup_close_ int fd = -1;
+                ExecTiming *t;
+                usec_t start;
                 pid_t pid;
 
-                t = strdup(*path);
-                if (!t)
-                        return log_oom();
-
                 if (callbacks) {
                         fd = open_serialization_fd(basename(*path));
                         if (fd < 0)
                                 return log_error_errno(fd, "Failed to open serialization file: %m");
                 }
 
-                r = do_spawn(t, argv, fd, &pid);
+                while (hashmap_size(pids) >= parallel_max) {
+                        r = exec_wait_any(pids, timings, timing_f);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to wait for child: %m");
+                }
+
+                if (!GREEDY_REALLOC(timings, n_allocated, n_timings + 1))
+                        return log_oom();
+
+                start = now(CLOCK_MONOTONIC);
+
+                r = do_spawn(*path, argv, fd, &pid);
                 if (r <= 0)
                         continue;
 
+                t = timings + n_timings++;
+                *t = (ExecTiming) {
+                        .path = *path,
+                        .start = start,
+                };
+
                 if (pids) {
-                        r = hashmap_put(pids, PID_TO_PTR(pid), t);
+                        r = hashmap_put(pids, PID_TO_PTR(pid), UINT_TO_PTR(n_timings));
                         if (r < 0)
                                 return log_oom();
-                        t = NULL;
                 } else {
-                        r = wait_for_terminate_and_warn(t, pid, true);
+                        r = wait_for_terminate_and_warn(*path, pid, true);
+                        t->status = r;
+                        t->duration = now(CLOCK_MONOTONIC) - t->start;
+                        exec_timing_write(timing_f, t);
                         if (r < 0)
                                 continue;
 
@@ -174,19 +270,85 @@ static int do_execute(
         }
 
         while (!hashmap_isempty(pids)) {
-                _cleanup_free_ char *t = NULL;
-                pid_t pid;
+                r = exec_wait_any(pids, timings, timing_f);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to wait for child: %m");
+        }
 
-                pid = PTR_TO_PID(hashmap_first_key(pids));
-                assert(pid > 0);
+        return 0;
+}
+
+static int exec_timing_read(int fd, ExecTiming **ret, size_t *ret_n) {
+        _cleanup_fclose_ FILE *f = NULL;
+        ExecTiming *timings = NULL;
+        size_t n_timings = 0, n_allocated = 0;
+        int r;
+
+        /* fd is always consumed, even on error */
+
+        f = fdopen(fd, "re");
+        if (!f) {
+                safe_close(fd);
+                return -errno;
+        }
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL, *start = NULL, *duration = NULL, *status = NULL, *path = NULL;
+                ExecTiming t = {};
+                const char *p;
+
+                r = read_line(f, LONG_LINE_MAX, &line);
+                if (r < 0)
+                        goto fail;
+                if (r == 0)
+                        break;
+
+                p = line;
+                r = extract_many_words(&p, NULL, EXTRACT_CUNESCAPE, &start, &duration, &status, &path, NULL);
+                if (r < 0)
+                        goto fail;
+                if (r < 4) {
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
+                r = safe_atou64(start, &t.start);
+                if (r < 0)
+                        goto fail;
+                r = safe_atou64(duration, &t.duration);
+                if (r < 0)
+                        goto fail;
+                r = safe_atoi(status, &t.status);
+                if (r < 0)
+                        goto fail;
 
-                t = hashmap_remove(pids, PID_TO_PTR(pid));
-                assert(t);
+                if (!GREEDY_REALLOC(timings, n_allocated, n_timings + 1)) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
 
-                wait_for_terminate_and_warn(t, pid, true);
+                t.path = path;
+                path = NULL;
+
+                timings[n_timings++] = t;
         }
 
+        *ret = timings;
+        *ret_n = n_timings;
         return 0;
+
+fail:
+        exec_timing_free_many(timings, n_timings);
+        return r;
+}
+
+void exec_timing_free_many(ExecTiming *t, size_t n) {
+        size_t i;
+
+        for (i = 0; i < n; i++)
+                free(t[i].path);
+
+        free(t);
 }
 
 int execute_directories(
@@ -194,15 +356,18 @@ int execute_directories(
                 usec_t timeout,
                 gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
                 void* const callback_args[_STDOUT_CONSUME_MAX],
-                char *argv[]) {
+                char *argv[],
+                ExecTiming **ret_timings,
+                size_t *ret_n_timings) {
 
         pid_t executor_pid;
         char *name;
         char **dirs = (char**) directories;
-        _cleanup_close_ int fd = -1;
-        int r;
+        _cleanup_close_ int fd = -1, timing_fd = -1;
+        int r, q;
 
         assert(!strv_isempty(dirs));
+        assert(!ret_timings == !ret_n_timings);
 
         name = basename(dirs[0]);
         assert(!isempty(name));
@@ -218,20 +383,41 @@ int execute_directories(
                         return log_error_errno(fd, "Failed to open serialization file: %m");
         }
 
+        if (ret_timings) {
+                timing_fd = open_serialization_fd("exec-timing");
+                if (timing_fd < 0)
+                        return log_error_errno(timing_fd, "Failed to open timing file: %m");
+        }
+
         /* Executes all binaries in the directories serially or in parallel and waits for
          * them to finish. Optionally a timeout is applied. If a file with the same name
-         * exists in more than one directory, the earliest one wins. */
+         * exists in more than one directory, the earliest one wins.
+         *
+         * If ret_timings is non-NULL, it is set to an array with the start time, runtime and exit status of
+         * each binary that finished, in the order they finished. */
 
         executor_pid = fork();
         if (executor_pid < 0)
                 return log_error_errno(errno, "Failed to fork: %m");
 
         if (executor_pid == 0) {
-                r = do_execute(dirs, timeout, callbacks, callback_args, fd, argv);
+                r = do_execute(dirs, timeout, callbacks, callback_args, fd, timing_fd, argv);
                 _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
         }
 
         r = wait_for_terminate_and_warn(name, executor_pid, true);
+
+        /* Pass on whatever we got, also if the executor was killed due to the timeout */
+        if (ret_timings) {
+                if (lseek(timing_fd, 0, SEEK_SET) < 0)
+                        return log_error_errno(errno, "Failed to rewind timing fd: %m");
+
+                q = exec_timing_read(timing_fd, ret_timings, ret_n_timings);
+                timing_fd = -1;
+                if (q < 0)
+                        return log_error_errno(q, "Failed to parse timing data: %m");
+        }
+
         if (r < 0)
                 return log_error_errno(r, "Execution failed: %m");
         if (r > 0) {
@@ -1,4 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
 /***
   This file is part of systemd.
 
@@ -31,11 +33,22 @@ enum {
         _STDOUT_CONSUME_MAX,
 };
 
+typedef struct ExecTiming {
+        char *path;
+        usec_t start;     /* CLOCK_MONOTONIC */
+        usec_t duration;
+        int status;       /* The exit status, or a negative errno if the binary was killed */
+} ExecTiming;
+
+void exec_timing_free_many(ExecTiming *t, size_t n);
+
 int execute_directories(
                 const char* const* directories,
                 usec_t timeout,
                 gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
                 void* const callback_args[_STDOUT_CONSUME_MAX],
-                char *argv[]);
+                char *argv[],
+                ExecTiming **ret_timings,
+                size_t *ret_n_timings);
 
 extern const gather_stdout_callback_t gather_environment[_STDOUT_CONSUME_MAX];
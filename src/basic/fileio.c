@@ -241,12 +241,13 @@ int verify_file(const char *fn, const char *blob, bool accept_extra_nl) {
         return 1;
 }
 
-int read_full_stream(FILE *f, char **contents, size_t *size) {
+int read_full_stream_limit(FILE *f, size_t limit, char **contents, size_t *size) {
         size_t n, l;
         _cleanup_free_ char *buf = NULL;
         struct stat st;
 
         assert(f);
+        assert(limit > 0);
         assert(contents);
 
         if (fstat(fileno(f), &st) < 0)
@@ -257,7 +258,7 @@ int read_full_stream(FILE *f, char **contents, size_t *size) {
         if (S_ISREG(st.st_mode)) {
 
                 /* Safety check */
-                if (st.st_size > READ_FULL_BYTES_MAX)
+                if ((uint64_t) st.st_size > limit)
                         return -E2BIG;
 
                 /* Start with the right file size, but be prepared for files from /proc which generally report a file
@@ -294,10 +295,10 @@ int read_full_stream(FILE *f, char **contents, size_t *size) {
                 assert(l == n);
 
                 /* Safety check */
-                if (n >= READ_FULL_BYTES_MAX)
+                if (n >= limit)
                         return -E2BIG;
 
-                n = MIN(n * 2, READ_FULL_BYTES_MAX);
+                n = n > limit / 2 ? limit : n * 2;
         }
 
         buf[l] = 0;
@@ -310,6 +311,10 @@ int read_full_stream(FILE *f, char **contents, size_t *size) {
         return 0;
 }
 
+int read_full_stream(FILE *f, char **contents, size_t *size) {
+        return read_full_stream_limit(f, READ_FULL_BYTES_MAX, contents, size);
+}
+
 int read_full_file(const char *fn, char **contents, size_t *size) {
         _cleanup_fclose_ FILE *f = NULL;
 
@@ -49,6 +49,7 @@ static inline int write_string_file(const char *fn, const char *line, WriteStrin
 int read_one_line_file(const char *fn, char **line);
 int read_full_file(const char *fn, char **contents, size_t *size);
 int read_full_stream(FILE *f, char **contents, size_t *size);
+int read_full_stream_limit(FILE *f, size_t limit, char **contents, size_t *size);
 
 int verify_file(const char *fn, const char *blob, bool accept_extra_nl);
 
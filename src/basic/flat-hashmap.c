@@ -0,0 +1,658 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "alloc-util.h"
+#include "flat-hashmap.h"
+#include "macro.h"
+#include "random-util.h"
+#include "siphash24.h"
+#include "unaligned.h"
+
+/*
+ * Implementation of flat hashmaps.
+ * Addressing: open
+ * Collision resolution: none, deleted entries leave tombstones behind
+ * Probe sequence: triangular, over groups of buckets
+ *
+ * Each bucket has a control byte. It is either CTRL_EMPTY, CTRL_DELETED, or, for occupied buckets, the lowest
+ * 7 bits of the hash of the key stored in it. The remaining bits of the hash select the bucket the probe
+ * sequence starts at. A lookup loads the control bytes of a whole group of buckets starting there, and
+ * compares them against the 7 bit tag of the key in one go. Only the buckets that match are looked at, and
+ * only those whose cached hash is equal are compared with the key comparison function. The lookup ends at
+ * the first group with an empty bucket.
+ *
+ * The control bytes of the first group are mirrored at the end of the control byte array, so that a group
+ * may be loaded starting at any bucket without having to wrap around.
+ *
+ * References:
+ * Kulukundis, M. 2017. Designing a Fast, Efficient, Cache-friendly Hash Table, Step by Step.
+ * CppCon 2017. https://www.youtube.com/watch?v=ncHmEUmJZf4
+ */
+
+#define CTRL_EMPTY   ((uint8_t) 0x80U)
+#define CTRL_DELETED ((uint8_t) 0xfeU)
+
+#define IDX_FIRST _IDX_ITERATOR_FIRST
+#define IDX_NIL   UINT_MAX
+
+/* MAX_LOAD = 1 / (1 - max_load_factor)
+ * e.g. 1 / (1 - 0.875) = 8 ... keep one eighth of the buckets empty. */
+#define MAX_LOAD 8U
+
+struct flat_hashmap_slot {
+        uint64_t hash;
+        const void *key;
+        void *value;
+};
+
+struct FlatHashmap {
+        const struct hash_ops *hash_ops;
+
+        struct flat_hashmap_slot *slots;
+        uint8_t *ctrl;                 /* n_buckets + GROUP_WIDTH control bytes, stored after the slots */
+
+        unsigned n_buckets;            /* 0 or a power of two, at least GROUP_WIDTH */
+        unsigned n_entries;
+        unsigned n_deleted;            /* number of tombstones */
+        unsigned idx_lowest_entry;     /* Index below which all buckets are free */
+
+        uint8_t hash_key[HASH_KEY_SIZE];
+};
+
+#if defined(__SSE2__)
+
+/* One bit per control byte */
+#define GROUP_WIDTH 16U
+typedef uint32_t group_mask_t;
+
+static inline group_mask_t group_match(const uint8_t *g, uint8_t c) {
+        __m128i v = _mm_loadu_si128((const __m128i*) g);
+
+        return (group_mask_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char) c)));
+}
+
+static inline group_mask_t group_match_empty_or_deleted(const uint8_t *g) {
+        /* Tags are 7 bits, hence only empty and deleted buckets have the high bit set */
+        return (group_mask_t) _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) g));
+}
+
+static inline unsigned mask_first(group_mask_t m) {
+        return __builtin_ctz(m);
+}
+
+static inline unsigned mask_leading(group_mask_t m) {
+        return m ? __builtin_clz(m) - (32 - GROUP_WIDTH) : GROUP_WIDTH;
+}
+
+static inline unsigned mask_trailing(group_mask_t m) {
+        return m ? __builtin_ctz(m) : GROUP_WIDTH;
+}
+
+#else
+
+/* The portable version: the high bit of each byte in a 64 bit word */
+#define GROUP_WIDTH 8U
+typedef uint64_t group_mask_t;
+
+#define LSBS UINT64_C(0x0101010101010101)
+#define MSBS UINT64_C(0x8080808080808080)
+
+static inline group_mask_t group_match(const uint8_t *g, uint8_t c) {
+        uint64_t x, t;
+
+        /* Sets the high bit of each byte that is zero after xoring, without false positives */
+        x = unaligned_read_le64(g) ^ (LSBS * c);
+        t = (x & ~MSBS) + ~MSBS;
+        return ~(t | x | ~MSBS);
+}
+
+static inline group_mask_t group_match_empty_or_deleted(const uint8_t *g) {
+        return unaligned_read_le64(g) & MSBS;
+}
+
+static inline unsigned mask_first(group_mask_t m) {
+        return __builtin_ctzll(m) / 8;
+}
+
+static inline unsigned mask_leading(group_mask_t m) {
+        return m ? __builtin_clzll(m) / 8 : GROUP_WIDTH;
+}
+
+static inline unsigned mask_trailing(group_mask_t m) {
+        return m ? __builtin_ctzll(m) / 8 : GROUP_WIDTH;
+}
+
+#endif
+
+static inline group_mask_t group_match_empty(const uint8_t *g) {
+        return group_match(g, CTRL_EMPTY);
+}
+
+static inline bool ctrl_is_full(uint8_t c) {
+        return !(c & 0x80U);
+}
+
+static inline uint8_t hash_tag(uint64_t hash) {
+        return hash & 0x7fU;
+}
+
+static inline unsigned hash_bucket(FlatHashmap *h, uint64_t hash) {
+        return (hash >> 7) & (h->n_buckets - 1);
+}
+
+static unsigned capacity(unsigned n_buckets) {
+        return n_buckets - n_buckets / MAX_LOAD;
+}
+
+static uint64_t flat_hashmap_hash(FlatHashmap *h, const void *key) {
+        struct siphash state;
+
+        siphash24_init(&state, h->hash_key);
+        h->hash_ops->hash(key, &state);
+
+        return siphash24_finalize(&state);
+}
+
+static void set_ctrl(FlatHashmap *h, unsigned idx, uint8_t c) {
+        h->ctrl[idx] = c;
+
+        /* Keep the mirror of the first group in sync */
+        if (idx < GROUP_WIDTH)
+                h->ctrl[h->n_buckets + idx] = c;
+}
+
+FlatHashmap *flat_hashmap_new(const struct hash_ops *hash_ops) {
+        FlatHashmap *h;
+
+        h = new0(FlatHashmap, 1);
+        if (!h)
+                return NULL;
+
+        h->hash_ops = hash_ops ?: &trivial_hash_ops;
+        random_bytes(h->hash_key, sizeof(h->hash_key));
+
+        return h;
+}
+
+int flat_hashmap_ensure_allocated(FlatHashmap **h, const struct hash_ops *hash_ops) {
+        FlatHashmap *q;
+
+        assert(h);
+
+        if (*h)
+                return 0;
+
+        q = flat_hashmap_new(hash_ops);
+        if (!q)
+                return -ENOMEM;
+
+        *h = q;
+        return 0;
+}
+
+void flat_hashmap_clear(FlatHashmap *h) {
+        if (!h)
+                return;
+
+        h->slots = mfree(h->slots);
+        h->ctrl = NULL;
+        h->n_buckets = h->n_entries = h->n_deleted = h->idx_lowest_entry = 0;
+}
+
+void flat_hashmap_clear_free(FlatHashmap *h) {
+        unsigned idx;
+
+        if (!h)
+                return;
+
+        for (idx = 0; idx < h->n_buckets; idx++)
+                if (ctrl_is_full(h->ctrl[idx]))
+                        free(h->slots[idx].value);
+
+        flat_hashmap_clear(h);
+}
+
+FlatHashmap *flat_hashmap_free(FlatHashmap *h) {
+        if (h) {
+                flat_hashmap_clear(h);
+                free(h);
+        }
+
+        return NULL;
+}
+
+FlatHashmap *flat_hashmap_free_free(FlatHashmap *h) {
+        if (h) {
+                flat_hashmap_clear_free(h);
+                free(h);
+        }
+
+        return NULL;
+}
+
+static unsigned find_entry(FlatHashmap *h, const void *key, uint64_t hash) {
+        unsigned pos, step = 0, mask;
+        uint8_t tag;
+
+        if (!h || h->n_entries == 0)
+                return IDX_NIL;
+
+        mask = h->n_buckets - 1;
+        pos = hash_bucket(h, hash);
+        tag = hash_tag(hash);
+
+        for (;;) {
+                const uint8_t *g = h->ctrl + pos;
+                group_mask_t m;
+
+                for (m = group_match(g, tag); m; m &= m - 1) {
+                        unsigned idx = (pos + mask_first(m)) & mask;
+                        struct flat_hashmap_slot *s = h->slots + idx;
+
+                        if (s->hash == hash && h->hash_ops->compare(s->key, key) == 0)
+                                return idx;
+                }
+
+                /* An empty bucket ends every probe sequence that reached this group, hence the key can't be
+                 * further down the line. */
+                if (group_match_empty(g))
+                        return IDX_NIL;
+
+                step += GROUP_WIDTH;
+                pos = (pos + step) & mask;
+        }
+}
+
+static unsigned find_free_bucket(FlatHashmap *h, uint64_t hash) {
+        unsigned pos, step = 0, mask;
+
+        /* The table is never full, hence this always succeeds */
+
+        mask = h->n_buckets - 1;
+        pos = hash_bucket(h, hash);
+
+        for (;;) {
+                group_mask_t m;
+
+                m = group_match_empty_or_deleted(h->ctrl + pos);
+                if (m)
+                        return (pos + mask_first(m)) & mask;
+
+                step += GROUP_WIDTH;
+                pos = (pos + step) & mask;
+        }
+}
+
+static void put_at(FlatHashmap *h, unsigned idx, uint64_t hash, const void *key, void *value) {
+        if (h->ctrl[idx] == CTRL_DELETED)
+                h->n_deleted--;
+
+        set_ctrl(h, idx, hash_tag(hash));
+        h->slots[idx] = (struct flat_hashmap_slot) {
+                .hash = hash,
+                .key = key,
+                .value = value,
+        };
+
+        h->n_entries++;
+        if (idx < h->idx_lowest_entry)
+                h->idx_lowest_entry = idx;
+}
+
+static int resize(FlatHashmap *h, unsigned new_n_buckets) {
+        struct flat_hashmap_slot *old_slots;
+        uint8_t *old_ctrl;
+        unsigned old_n_buckets, idx;
+        void *storage;
+
+        assert(h);
+        assert(new_n_buckets >= GROUP_WIDTH);
+        assert((new_n_buckets & (new_n_buckets - 1)) == 0);
+        assert(capacity(new_n_buckets) >= h->n_entries);
+
+        if (new_n_buckets > (SIZE_MAX - GROUP_WIDTH) / (sizeof(struct flat_hashmap_slot) + 1))
+                return -ENOMEM;
+
+        storage = malloc(new_n_buckets * sizeof(struct flat_hashmap_slot) + new_n_buckets + GROUP_WIDTH);
+        if (!storage)
+                return -ENOMEM;
+
+        old_slots = h->slots;
+        old_ctrl = h->ctrl;
+        old_n_buckets = h->n_buckets;
+
+        h->slots = storage;
+        h->ctrl = (uint8_t*) (h->slots + new_n_buckets);
+        h->n_buckets = new_n_buckets;
+        h->n_entries = h->n_deleted = 0;
+        h->idx_lowest_entry = new_n_buckets;
+        memset(h->ctrl, CTRL_EMPTY, new_n_buckets + GROUP_WIDTH);
+
+        /* The hashes are cached, no need to call into the hash function again */
+        for (idx = 0; idx < old_n_buckets; idx++) {
+                struct flat_hashmap_slot *s = old_slots + idx;
+
+                if (!ctrl_is_full(old_ctrl[idx]))
+                        continue;
+
+                put_at(h, find_free_bucket(h, s->hash), s->hash, s->key, s->value);
+        }
+
+        free(old_slots);
+        return 0;
+}
+
+static int reserve_for(FlatHashmap *h, unsigned entries_add) {
+        unsigned n, new_n_buckets;
+
+        n = h->n_entries + entries_add;
+        if (_unlikely_(n < entries_add))
+                return -ENOMEM;
+
+        if (h->n_buckets > 0 && n + h->n_deleted <= capacity(h->n_buckets))
+                return 0;
+
+        /* If the table is clogged with tombstones, but not actually full, rehash it at the same size.
+         * Otherwise grow until the new entries fit. */
+        new_n_buckets = MAX(h->n_buckets, GROUP_WIDTH);
+        while (capacity(new_n_buckets) < n) {
+                if (new_n_buckets > UINT_MAX / 2)
+                        return -ENOMEM;
+                new_n_buckets *= 2;
+        }
+
+        return resize(h, new_n_buckets);
+}
+
+int flat_hashmap_reserve(FlatHashmap *h, unsigned entries_add) {
+        assert(h);
+
+        return reserve_for(h, entries_add);
+}
+
+static int put_boldly(FlatHashmap *h, uint64_t hash, const void *key, void *value) {
+        int r;
+
+        /* Grow before placing the entry, so that there's always an empty bucket left */
+        r = reserve_for(h, 1);
+        if (r < 0)
+                return r;
+
+        put_at(h, find_free_bucket(h, hash), hash, key, value);
+        return 1;
+}
+
+int flat_hashmap_put(FlatHashmap *h, const void *key, void *value) {
+        uint64_t hash;
+        unsigned idx;
+
+        assert(h);
+
+        hash = flat_hashmap_hash(h, key);
+        idx = find_entry(h, key, hash);
+        if (idx != IDX_NIL) {
+                if (h->slots[idx].value == value)
+                        return 0;
+                return -EEXIST;
+        }
+
+        return put_boldly(h, hash, key, value);
+}
+
+int flat_hashmap_replace(FlatHashmap *h, const void *key, void *value) {
+        uint64_t hash;
+        unsigned idx;
+
+        assert(h);
+
+        hash = flat_hashmap_hash(h, key);
+        idx = find_entry(h, key, hash);
+        if (idx != IDX_NIL) {
+                h->slots[idx].key = key;
+                h->slots[idx].value = value;
+                return 0;
+        }
+
+        return put_boldly(h, hash, key, value);
+}
+
+int flat_hashmap_update(FlatHashmap *h, const void *key, void *value) {
+        unsigned idx;
+
+        assert(h);
+
+        idx = find_entry(h, key, flat_hashmap_hash(h, key));
+        if (idx == IDX_NIL)
+                return -ENOENT;
+
+        h->slots[idx].value = value;
+        return 0;
+}
+
+void *flat_hashmap_get2(FlatHashmap *h, const void *key, void **rkey) {
+        unsigned idx;
+
+        if (!h || h->n_entries == 0)
+                return NULL;
+
+        idx = find_entry(h, key, flat_hashmap_hash(h, key));
+        if (idx == IDX_NIL)
+                return NULL;
+
+        if (rkey)
+                *rkey = (void*) h->slots[idx].key;
+
+        return h->slots[idx].value;
+}
+
+void *flat_hashmap_get(FlatHashmap *h, const void *key) {
+        return flat_hashmap_get2(h, key, NULL);
+}
+
+bool flat_hashmap_contains(FlatHashmap *h, const void *key) {
+        if (!h || h->n_entries == 0)
+                return false;
+
+        return find_entry(h, key, flat_hashmap_hash(h, key)) != IDX_NIL;
+}
+
+static void remove_entry(FlatHashmap *h, unsigned idx) {
+        unsigned mask = h->n_buckets - 1;
+        group_mask_t before, after;
+
+        assert(ctrl_is_full(h->ctrl[idx]));
+
+        /* Don't keep stale pointers around */
+        h->slots[idx] = (struct flat_hashmap_slot) {};
+        h->n_entries--;
+
+        if (h->n_entries == 0) {
+                /* Start from scratch, dropping all tombstones */
+                memset(h->ctrl, CTRL_EMPTY, h->n_buckets + GROUP_WIDTH);
+                h->n_deleted = 0;
+                h->idx_lowest_entry = 0;
+                return;
+        }
+
+        /* If no group of buckets containing this one was ever completely occupied, no probe sequence ever
+         * continued past it, and the bucket may be marked as empty right away instead of leaving a tombstone
+         * behind. That's the case if the occupied buckets around it don't span a whole group. */
+        before = group_match_empty(h->ctrl + ((idx - GROUP_WIDTH) & mask));
+        after = group_match_empty(h->ctrl + idx);
+
+        if (mask_leading(before) + mask_trailing(after) < GROUP_WIDTH)
+                set_ctrl(h, idx, CTRL_EMPTY);
+        else {
+                set_ctrl(h, idx, CTRL_DELETED);
+                h->n_deleted++;
+        }
+}
+
+void *flat_hashmap_remove2(FlatHashmap *h, const void *key, void **rkey) {
+        unsigned idx;
+        void *value;
+
+        if (!h || h->n_entries == 0) {
+                if (rkey)
+                        *rkey = NULL;
+                return NULL;
+        }
+
+        idx = find_entry(h, key, flat_hashmap_hash(h, key));
+        if (idx == IDX_NIL) {
+                if (rkey)
+                        *rkey = NULL;
+                return NULL;
+        }
+
+        value = h->slots[idx].value;
+        if (rkey)
+                *rkey = (void*) h->slots[idx].key;
+
+        remove_entry(h, idx);
+        return value;
+}
+
+void *flat_hashmap_remove(FlatHashmap *h, const void *key) {
+        return flat_hashmap_remove2(h, key, NULL);
+}
+
+void *flat_hashmap_remove_value(FlatHashmap *h, const void *key, void *value) {
+        unsigned idx;
+
+        if (!h || h->n_entries == 0)
+                return NULL;
+
+        idx = find_entry(h, key, flat_hashmap_hash(h, key));
+        if (idx == IDX_NIL)
+                return NULL;
+
+        if (h->slots[idx].value != value)
+                return NULL;
+
+        remove_entry(h, idx);
+        return value;
+}
+
+unsigned flat_hashmap_size(FlatHashmap *h) {
+        return h ? h->n_entries : 0;
+}
+
+unsigned flat_hashmap_buckets(FlatHashmap *h) {
+        return h ? h->n_buckets : 0;
+}
+
+static unsigned skip_free_buckets(FlatHashmap *h, unsigned idx) {
+        for (; idx < h->n_buckets; idx++)
+                if (ctrl_is_full(h->ctrl[idx]))
+                        return idx;
+
+        return IDX_NIL;
+}
+
+bool flat_hashmap_iterate(FlatHashmap *h, Iterator *i, void **value, const void **key) {
+        unsigned idx;
+
+        assert(i);
+
+        /* Removing entries doesn't move other entries around, hence removing the current entry while
+         * iterating is safe without further ado */
+
+        if (!h || h->n_entries == 0 || i->idx == IDX_NIL)
+                goto at_end;
+
+        idx = skip_free_buckets(h, i->idx == IDX_FIRST ? h->idx_lowest_entry : i->idx);
+        if (idx == IDX_NIL)
+                goto at_end;
+
+        i->idx = idx + 1 < h->n_buckets ? idx + 1 : IDX_NIL;
+
+        if (value)
+                *value = h->slots[idx].value;
+        if (key)
+                *key = h->slots[idx].key;
+
+        return true;
+
+at_end:
+        i->idx = IDX_NIL;
+
+        if (value)
+                *value = NULL;
+        if (key)
+                *key = NULL;
+
+        return false;
+}
+
+static unsigned find_first_entry(FlatHashmap *h) {
+        unsigned idx;
+
+        if (!h || h->n_entries == 0)
+                return IDX_NIL;
+
+        idx = skip_free_buckets(h, h->idx_lowest_entry);
+        assert(idx != IDX_NIL);
+
+        /* Makes "while ((x = flat_hashmap_steal_first(h)))" loops O(n) */
+        h->idx_lowest_entry = idx;
+        return idx;
+}
+
+void *flat_hashmap_first(FlatHashmap *h) {
+        unsigned idx;
+
+        idx = find_first_entry(h);
+        if (idx == IDX_NIL)
+                return NULL;
+
+        return h->slots[idx].value;
+}
+
+void *flat_hashmap_first_key(FlatHashmap *h) {
+        unsigned idx;
+
+        idx = find_first_entry(h);
+        if (idx == IDX_NIL)
+                return NULL;
+
+        return (void*) h->slots[idx].key;
+}
+
+void *flat_hashmap_steal_first(FlatHashmap *h) {
+        unsigned idx;
+        void *value;
+
+        idx = find_first_entry(h);
+        if (idx == IDX_NIL)
+                return NULL;
+
+        value = h->slots[idx].value;
+        remove_entry(h, idx);
+
+        return value;
+}
@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+
+#include "hash-funcs.h"
+#include "hashmap.h"
+#include "macro.h"
+
+/*
+ * A hash table optimized for large maps that are looked up very frequently, for example the manager's table
+ * of all units by name. Compared to Hashmap it trades some memory for lookup speed: the full hash of each key
+ * is cached next to it, so that the key comparison function is called only for entries that are almost
+ * certainly equal, and that growing the table does not need to rehash the keys. Buckets are probed in groups,
+ * using a byte of metadata per bucket, which is matched against a whole group at once with SIMD instructions
+ * where available.
+ *
+ * The API follows the one of Hashmap, including the semantics of the return values, so that users can switch
+ * over easily. As for Hashmap, a NULL FlatHashmap is treated as an empty one for all read operations, and it
+ * is safe to remove the current entry while iterating. Entries are iterated in unpredictable order.
+ */
+
+typedef struct FlatHashmap FlatHashmap;
+
+FlatHashmap *flat_hashmap_new(const struct hash_ops *hash_ops);
+FlatHashmap *flat_hashmap_free(FlatHashmap *h);
+FlatHashmap *flat_hashmap_free_free(FlatHashmap *h);
+int flat_hashmap_ensure_allocated(FlatHashmap **h, const struct hash_ops *hash_ops);
+
+int flat_hashmap_put(FlatHashmap *h, const void *key, void *value);
+int flat_hashmap_update(FlatHashmap *h, const void *key, void *value);
+int flat_hashmap_replace(FlatHashmap *h, const void *key, void *value);
+
+void *flat_hashmap_get(FlatHashmap *h, const void *key);
+void *flat_hashmap_get2(FlatHashmap *h, const void *key, void **rkey);
+bool flat_hashmap_contains(FlatHashmap *h, const void *key);
+
+void *flat_hashmap_remove(FlatHashmap *h, const void *key);
+void *flat_hashmap_remove2(FlatHashmap *h, const void *key, void **rkey);
+void *flat_hashmap_remove_value(FlatHashmap *h, const void *key, void *value);
+
+int flat_hashmap_reserve(FlatHashmap *h, unsigned entries_add);
+
+unsigned flat_hashmap_size(FlatHashmap *h) _pure_;
+static inline bool flat_hashmap_isempty(FlatHashmap *h) {
+        return flat_hashmap_size(h) == 0;
+}
+unsigned flat_hashmap_buckets(FlatHashmap *h) _pure_;
+
+bool flat_hashmap_iterate(FlatHashmap *h, Iterator *i, void **value, const void **key);
+
+void flat_hashmap_clear(FlatHashmap *h);
+void flat_hashmap_clear_free(FlatHashmap *h);
+
+void *flat_hashmap_first(FlatHashmap *h);
+void *flat_hashmap_first_key(FlatHashmap *h);
+void *flat_hashmap_steal_first(FlatHashmap *h);
+
+#define FLAT_HASHMAP_FOREACH(e, h, i) \
+        for ((i) = ITERATOR_FIRST; flat_hashmap_iterate((h), &(i), (void**)&(e), NULL); )
+
+#define FLAT_HASHMAP_FOREACH_KEY(e, k, h, i) \
+        for ((i) = ITERATOR_FIRST; flat_hashmap_iterate((h), &(i), (void**)&(e), (const void**) &(k)); )
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(FlatHashmap*, flat_hashmap_free);
+DEFINE_TRIVIAL_CLEANUP_FUNC(FlatHashmap*, flat_hashmap_free_free);
+
+#define _cleanup_flat_hashmap_free_ _cleanup_(flat_hashmap_freep)
+#define _cleanup_flat_hashmap_free_free_ _cleanup_(flat_hashmap_free_freep)
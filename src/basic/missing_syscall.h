@@ -322,6 +322,67 @@ static inline ssize_t copy_file_range(int fd_in, loff_t *off_in,
 
 /* ======================================================================= */
 
+#if !HAVE_CLOSE_RANGE
+#  ifndef __NR_close_range
+#    if defined __alpha__
+#      define __NR_close_range 546
+#    elif defined _MIPS_SIM
+#      if _MIPS_SIM == _MIPS_SIM_ABI32
+#        define __NR_close_range 4436
+#      endif
+#      if _MIPS_SIM == _MIPS_SIM_NABI32
+#        define __NR_close_range 6436
+#      endif
+#      if _MIPS_SIM == _MIPS_SIM_ABI64
+#        define __NR_close_range 5436
+#      endif
+#    else
+#      define __NR_close_range 436
+#    endif
+#  endif
+
+static inline int close_range(unsigned first_fd, unsigned end_fd, unsigned flags) {
+#  ifdef __NR_close_range
+        return syscall(__NR_close_range, first_fd, end_fd, flags);
+#  else
+        errno = ENOSYS;
+        return -1;
+#  endif
+}
+#endif
+
+/* ======================================================================= */
+
+#ifndef __NR_io_uring_setup
+#  if defined __alpha__
+#    define __NR_io_uring_setup 535
+#    define __NR_io_uring_enter 536
+#    define __NR_io_uring_register 537
+#  elif defined _MIPS_SIM
+#    if _MIPS_SIM == _MIPS_SIM_ABI32
+#      define __NR_io_uring_setup 4425
+#      define __NR_io_uring_enter 4426
+#      define __NR_io_uring_register 4427
+#    endif
+#    if _MIPS_SIM == _MIPS_SIM_NABI32
+#      define __NR_io_uring_setup 6425
+#      define __NR_io_uring_enter 6426
+#      define __NR_io_uring_register 6427
+#    endif
+#    if _MIPS_SIM == _MIPS_SIM_ABI64
+#      define __NR_io_uring_setup 5425
+#      define __NR_io_uring_enter 5426
+#      define __NR_io_uring_register 5427
+#    endif
+#  else
+#    define __NR_io_uring_setup 425
+#    define __NR_io_uring_enter 426
+#    define __NR_io_uring_register 427
+#  endif
+#endif
+
+/* ======================================================================= */
+
 #if !HAVE_BPF
 #  ifndef __NR_bpf
 #    if defined __i386__
@@ -359,6 +359,19 @@ char *path_kill_slashes(char *path) {
         return path;
 }
 
+static inline const char *skip_slashes(const char *p) {
+        while (*p == '/')
+                p++;
+
+        return p;
+}
+
+static inline size_t component_length(const char *p) {
+        /* Equivalent to strcspn(p, "/"), but strchrnul() is the vectorized primitive in the C library,
+         * and we save the detour through the generic set matching. */
+        return strchrnul(p, '/') - p;
+}
+
 char* path_startswith(const char *path, const char *prefix) {
         assert(path);
         assert(prefix);
@@ -379,8 +392,8 @@ char* path_startswith(const char *path, const char *prefix) {
         for (;;) {
                 size_t a, b;
 
-                path += strspn(path, "/");
-                prefix += strspn(prefix, "/");
+                path = skip_slashes(path);
+                prefix = skip_slashes(prefix);
 
                 if (*prefix == 0)
                         return (char*) path;
@@ -388,8 +401,8 @@ char* path_startswith(const char *path, const char *prefix) {
                 if (*path == 0)
                         return NULL;
 
-                a = strcspn(path, "/");
-                b = strcspn(prefix, "/");
+                a = component_length(path);
+                b = component_length(prefix);
 
                 if (a != b)
                         return NULL;
@@ -418,8 +431,8 @@ int path_compare(const char *a, const char *b) {
         for (;;) {
                 size_t j, k;
 
-                a += strspn(a, "/");
-                b += strspn(b, "/");
+                a = skip_slashes(a);
+                b = skip_slashes(b);
 
                 if (*a == 0 && *b == 0)
                         return 0;
@@ -430,8 +443,8 @@ int path_compare(const char *a, const char *b) {
                 if (*b == 0)
                         return 1;
 
-                j = strcspn(a, "/");
-                k = strcspn(b, "/");
+                j = component_length(a);
+                k = component_length(b);
 
                 /* Alphabetical sort: "/foo/aaa" before "/foo/b" */
                 d = memcmp(a, b, MIN(j, k));
@@ -449,6 +462,10 @@ int path_compare(const char *a, const char *b) {
 }
 
 bool path_equal(const char *a, const char *b) {
+        /* Most paths we compare are normalized already, hence take the shortcut if they are identical */
+        if (streq(a, b))
+                return true;
+
         return path_compare(a, b) == 0;
 }
 
@@ -162,23 +162,42 @@ static unsigned shuffle_down(Prioq *q, unsigned idx) {
         return idx;
 }
 
+int prioq_reserve(Prioq *q, unsigned n) {
+        struct prioq_item *j;
+
+        assert(q);
+
+        /* Makes sure that the next prioq_put() calls don't fail, as long as there are no more than n items in the
+         * queue. Grows geometrically, so that reserving one more entry for each item added stays cheap. */
+
+        if (n <= q->n_allocated)
+                return 0;
+
+        if (q->n_allocated > UINT_MAX / 2)
+                return -ENOMEM;
+
+        n = MAX3(n, q->n_allocated * 2, 16u);
+        j = realloc(q->items, sizeof(struct prioq_item) * n);
+        if (!j)
+                return -ENOMEM;
+
+        q->items = j;
+        q->n_allocated = n;
+
+        return 0;
+}
+
 int prioq_put(Prioq *q, void *data, unsigned *idx) {
         struct prioq_item *i;
         unsigned k;
+        int r;
 
         assert(q);
 
         if (q->n_items >= q->n_allocated) {
-                unsigned n;
-                struct prioq_item *j;
-
-                n = MAX((q->n_items+1) * 2, 16u);
-                j = realloc(q->items, sizeof(struct prioq_item) * n);
-                if (!j)
-                        return -ENOMEM;
-
-                q->items = j;
-                q->n_allocated = n;
+                r = prioq_reserve(q, q->n_items+1);
+                if (r < 0)
+                        return r;
         }
 
         k = q->n_items++;
@@ -33,6 +33,7 @@ Prioq *prioq_new(compare_func_t compare);
 Prioq *prioq_free(Prioq *q);
 int prioq_ensure_allocated(Prioq **q, compare_func_t compare_func);
 
+int prioq_reserve(Prioq *q, unsigned n);
 int prioq_put(Prioq *q, void *data, unsigned *idx);
 int prioq_remove(Prioq *q, void *data, unsigned *idx);
 int prioq_reshuffle(Prioq *q, void *data, unsigned *idx);
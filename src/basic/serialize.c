@@ -0,0 +1,514 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "def.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "serialize.h"
+#include "string-util.h"
+#include "strv.h"
+#include "util.h"
+
+/* The first byte is NUL, which never shows up in the text encoding, so that the two are easily told apart */
+static const char binary_magic[8] = { 0, 'S', 'D', 'S', 'T', 'A', 'T', 'E' };
+
+/* Record types of the binary encoding */
+enum {
+        RECORD_KEY = 'K',    /* <length> <key>: defines the next key index */
+        RECORD_ITEM = 'I',   /* <key index> <length> <value>: a "key=value" item */
+        RECORD_LINE = 'L',   /* <length> <line>: a line without "=", e.g. a unit name */
+        RECORD_END = 'E',    /* end of section, i.e. an empty line */
+};
+
+/* Upper limit for a single record, to protect against corrupted streams */
+#define RECORD_SIZE_MAX LONG_LINE_MAX
+
+typedef struct Serializer {
+        FILE *out;
+
+        /* The interned keys, in order of their index, and an open addressing table with linear probing on
+         * top, whose slots store the index plus one. The keys are all generated by us, hence a cheap hash
+         * function is good enough here. */
+        char **keys;
+        size_t n_keys, n_keys_allocated;
+        unsigned *table;
+        unsigned table_size;
+
+        /* Units of the same type serialize the same keys in the same order, hence the key following the last
+         * one is a good guess for the next key, and saves us hashing it */
+        unsigned last_key;
+
+        /* The current line, until we see its newline */
+        char *line;
+        size_t n_line, n_line_allocated;
+} Serializer;
+
+struct Deserializer {
+        FILE *f;
+        bool binary;
+
+        char **keys;
+        size_t n_keys, n_keys_allocated;
+
+        char *buffer;
+        size_t n_buffer_allocated;
+
+        char line[LINE_MAX];
+};
+
+static void write_varint(FILE *f, uint64_t v) {
+        while (v >= 0x80) {
+                fputc_unlocked((int) (v & 0x7f) | 0x80, f);
+                v >>= 7;
+        }
+
+        fputc_unlocked((int) v, f);
+}
+
+static int read_varint(FILE *f, uint64_t *ret) {
+        uint64_t v = 0;
+        unsigned shift;
+
+        for (shift = 0; shift < 64; shift += 7) {
+                int c;
+
+                c = getc_unlocked(f);
+                if (c == EOF)
+                        return ferror_unlocked(f) ? -EIO : -EBADMSG;
+
+                v |= (uint64_t) (c & 0x7f) << shift;
+                if (!(c & 0x80)) {
+                        *ret = v;
+                        return 0;
+                }
+        }
+
+        return -EBADMSG;
+}
+
+static void write_string(FILE *f, const char *s, size_t n) {
+        write_varint(f, n);
+        fwrite_unlocked(s, 1, n, f);
+}
+
+static unsigned key_hash(const char *k, size_t n) {
+        unsigned h = 2166136261U;
+        size_t i;
+
+        /* FNV-1a */
+        for (i = 0; i < n; i++)
+                h = (h ^ (uint8_t) k[i]) * 16777619U;
+
+        return h;
+}
+
+static int serializer_intern_key(Serializer *s, const char *k, size_t n, unsigned *ret) {
+        unsigned slot;
+
+        if (s->last_key + 1 < s->n_keys) {
+                const char *c = s->keys[s->last_key + 1];
+
+                if (strneq(c, k, n) && c[n] == 0) {
+                        *ret = ++s->last_key;
+                        return 0;
+                }
+        }
+
+        if (s->n_keys * 2 >= s->table_size) {
+                unsigned *t, m, i;
+
+                m = s->table_size > 0 ? s->table_size * 2 : 64;
+                t = new0(unsigned, m);
+                if (!t)
+                        return -ENOMEM;
+
+                for (i = 0; i < s->n_keys; i++) {
+                        for (slot = key_hash(s->keys[i], strlen(s->keys[i])) & (m - 1); t[slot] != 0; slot = (slot + 1) & (m - 1))
+                                ;
+                        t[slot] = i + 1;
+                }
+
+                free(s->table);
+                s->table = t;
+                s->table_size = m;
+        }
+
+        for (slot = key_hash(k, n) & (s->table_size - 1); s->table[slot] != 0; slot = (slot + 1) & (s->table_size - 1)) {
+                const char *c = s->keys[s->table[slot] - 1];
+
+                if (strneq(c, k, n) && c[n] == 0) {
+                        *ret = s->last_key = s->table[slot] - 1;
+                        return 0;
+                }
+        }
+
+        /* Not seen before, define a new key */
+        if (!GREEDY_REALLOC(s->keys, s->n_keys_allocated, s->n_keys + 2))
+                return -ENOMEM;
+
+        s->keys[s->n_keys] = strndup(k, n);
+        if (!s->keys[s->n_keys])
+                return -ENOMEM;
+
+        s->keys[s->n_keys + 1] = NULL;
+        s->table[slot] = s->n_keys + 1;
+
+        fputc_unlocked(RECORD_KEY, s->out);
+        write_string(s->out, k, n);
+
+        *ret = s->last_key = s->n_keys++;
+        return 0;
+}
+
+static int serializer_emit_line(Serializer *s, const char *l, size_t n) {
+        const char *eq;
+        unsigned idx;
+        int r;
+
+        /* Strip the line like the text parser does, so that both encodings result in the same items */
+        while (n > 0 && strchr(WHITESPACE, l[0])) {
+                l++;
+                n--;
+        }
+        while (n > 0 && strchr(WHITESPACE, l[n-1]))
+                n--;
+
+        if (n == 0) {
+                fputc_unlocked(RECORD_END, s->out);
+                return 0;
+        }
+
+        eq = memchr(l, '=', n);
+        if (!eq) {
+                fputc_unlocked(RECORD_LINE, s->out);
+                write_string(s->out, l, n);
+                return 0;
+        }
+
+        r = serializer_intern_key(s, l, eq - l, &idx);
+        if (r < 0)
+                return r;
+
+        fputc_unlocked(RECORD_ITEM, s->out);
+        write_varint(s->out, idx);
+        write_string(s->out, eq + 1, n - (eq - l) - 1);
+
+        return 0;
+}
+
+static ssize_t serializer_write(void *cookie, const char *buf, size_t size) {
+        Serializer *s = cookie;
+        const char *p = buf, *e = buf + size;
+        int r;
+
+        while (p < e) {
+                const char *nl;
+                size_t n;
+
+                nl = memchr(p, '\n', e - p);
+                n = (nl ?: e) - p;
+
+                if (!nl || s->n_line > 0) {
+                        /* Keep partial lines around until their newline arrives */
+                        if (!GREEDY_REALLOC(s->line, s->n_line_allocated, s->n_line + n)) {
+                                errno = ENOMEM;
+                                return -1;
+                        }
+
+                        memcpy(s->line + s->n_line, p, n);
+                        s->n_line += n;
+
+                        if (!nl)
+                                break;
+
+                        r = serializer_emit_line(s, s->line, s->n_line);
+                        s->n_line = 0;
+                } else
+                        r = serializer_emit_line(s, p, n);
+                if (r < 0) {
+                        errno = -r;
+                        return -1;
+                }
+
+                p = nl + 1;
+        }
+
+        if (ferror_unlocked(s->out)) {
+                errno = EIO;
+                return -1;
+        }
+
+        return (ssize_t) size;
+}
+
+static int serializer_close(void *cookie) {
+        Serializer *s = cookie;
+        int r = 0;
+
+        /* A trailing line without newline is written out nonetheless, like the text parser would read it */
+        if (s->n_line > 0)
+                r = serializer_emit_line(s, s->line, s->n_line);
+
+        if (fclose(s->out) != 0 && r >= 0)
+                r = -errno;
+
+        strv_free(s->keys);
+        free(s->table);
+        free(s->line);
+        free(s);
+
+        if (r < 0) {
+                errno = -r;
+                return -1;
+        }
+
+        return 0;
+}
+
+int serialize_open_binary(int fd, FILE **ret) {
+        static const cookie_io_functions_t functions = {
+                .write = serializer_write,
+                .close = serializer_close,
+        };
+        _cleanup_fclose_ FILE *out = NULL;
+        _cleanup_close_ int copy = -1;
+        Serializer *s;
+        FILE *f;
+
+        assert(fd >= 0);
+        assert(ret);
+
+        /* Returns a stream that accepts the text encoding of serialized state, and writes it out to fd in the
+         * binary encoding. Make sure to check the return value of fclose() on it, as encoding errors are only
+         * reported there. */
+
+        copy = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+        if (copy < 0)
+                return -errno;
+
+        out = fdopen(copy, "we");
+        if (!out)
+                return -errno;
+        copy = -1;
+
+        fwrite_unlocked(binary_magic, 1, sizeof(binary_magic), out);
+        fputc_unlocked(SERIALIZE_BINARY_VERSION, out);
+
+        s = new0(Serializer, 1);
+        if (!s)
+                return -ENOMEM;
+
+        f = fopencookie(s, "we", functions);
+        if (!f) {
+                free(s);
+                return -errno;
+        }
+
+        s->out = out;
+        out = NULL;
+
+        *ret = f;
+        return 0;
+}
+
+int deserializer_new(FILE *f, Deserializer **ret) {
+        _cleanup_deserializer_free_ Deserializer *d = NULL;
+        int c;
+
+        assert(f);
+        assert(ret);
+
+        d = new0(Deserializer, 1);
+        if (!d)
+                return -ENOMEM;
+
+        d->f = f;
+
+        /* Figure out which encoding is used, by looking at the first byte */
+        c = getc(f);
+        if (c == 0) {
+                char magic[sizeof(binary_magic) - 1];
+
+                if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) ||
+                    memcmp(magic, binary_magic + 1, sizeof(magic)) != 0)
+                        return -EBADMSG;
+
+                c = getc(f);
+                if (c == EOF)
+                        return -EBADMSG;
+                if (c != SERIALIZE_BINARY_VERSION)
+                        return -EPROTONOSUPPORT;
+
+                d->binary = true;
+
+        } else if (c != EOF) {
+                if (ungetc(c, f) == EOF)
+                        return -EIO;
+        }
+
+        *ret = d;
+        d = NULL;
+
+        return 0;
+}
+
+Deserializer *deserializer_free(Deserializer *d) {
+        if (!d)
+                return NULL;
+
+        strv_free(d->keys);
+        free(d->buffer);
+
+        return mfree(d);
+}
+
+bool deserializer_is_binary(Deserializer *d) {
+        assert(d);
+
+        return d->binary;
+}
+
+static int deserializer_read_string(Deserializer *d, char **ret) {
+        uint64_t n;
+        int r;
+
+        r = read_varint(d->f, &n);
+        if (r < 0)
+                return r;
+        if (n > RECORD_SIZE_MAX)
+                return -EBADMSG;
+
+        if (!GREEDY_REALLOC(d->buffer, d->n_buffer_allocated, n + 1))
+                return -ENOMEM;
+
+        if (fread_unlocked(d->buffer, 1, n, d->f) != n)
+                return ferror_unlocked(d->f) ? -EIO : -EBADMSG;
+
+        d->buffer[n] = 0;
+
+        *ret = d->buffer;
+        return 0;
+}
+
+static int deserializer_read_binary(Deserializer *d, const char **ret_key, const char **ret_value) {
+        char *s;
+        int r;
+
+        for (;;) {
+                uint64_t idx;
+                int c;
+
+                c = getc_unlocked(d->f);
+                if (c == EOF)
+                        return ferror_unlocked(d->f) ? -EIO : 0;
+
+                switch (c) {
+
+                case RECORD_KEY:
+                        r = deserializer_read_string(d, &s);
+                        if (r < 0)
+                                return r;
+
+                        if (!GREEDY_REALLOC(d->keys, d->n_keys_allocated, d->n_keys + 2))
+                                return -ENOMEM;
+
+                        d->keys[d->n_keys] = strdup(s);
+                        if (!d->keys[d->n_keys])
+                                return -ENOMEM;
+
+                        d->keys[++d->n_keys] = NULL;
+                        break;
+
+                case RECORD_ITEM:
+                        r = read_varint(d->f, &idx);
+                        if (r < 0)
+                                return r;
+                        if (idx >= d->n_keys)
+                                return -EBADMSG;
+
+                        r = deserializer_read_string(d, &s);
+                        if (r < 0)
+                                return r;
+
+                        *ret_key = d->keys[idx];
+                        *ret_value = s;
+                        return 1;
+
+                case RECORD_LINE:
+                        r = deserializer_read_string(d, &s);
+                        if (r < 0)
+                                return r;
+
+                        *ret_key = s;
+                        *ret_value = s + strlen(s);
+                        return 1;
+
+                case RECORD_END:
+                        *ret_key = *ret_value = "";
+                        return 1;
+
+                default:
+                        return -EBADMSG;
+                }
+        }
+}
+
+int deserializer_read(Deserializer *d, const char **ret_key, const char **ret_value) {
+        char *l;
+        size_t k;
+
+        assert(d);
+        assert(ret_key);
+        assert(ret_value);
+
+        /* Reads the next item. Returns > 0 if an item was read, and 0 at the end of the stream. The end of a
+         * section is returned as item with an empty key. Lines without "=" are returned as key with an empty
+         * value. The returned strings are valid until the next call. */
+
+        if (d->binary)
+                return deserializer_read_binary(d, ret_key, ret_value);
+
+        if (!fgets(d->line, sizeof(d->line), d->f)) {
+                if (feof(d->f))
+                        return 0;
+
+                return errno > 0 ? -errno : -EIO;
+        }
+
+        char_array_0(d->line);
+        l = strstrip(d->line);
+
+        k = strcspn(l, "=");
+        if (l[k] == '=') {
+                l[k] = 0;
+                *ret_value = l + k + 1;
+        } else
+                *ret_value = l + k;
+
+        *ret_key = l;
+        return 1;
+}
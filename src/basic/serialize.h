@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+
+#include "macro.h"
+
+/*
+ * State serialization streams, as used when reloading or reexecuting the service manager.
+ *
+ * Serialized state is a sequence of "key=value" items, grouped into sections that are terminated by empty lines.
+ * The classic encoding is plain text with one item per line. This is what we pass on when reexecuting, as the
+ * new binary might be a different version that only knows the text encoding.
+ *
+ * When the state does not leave the process, for example on daemon-reload, the binary encoding is used instead:
+ * the stream begins with a magic and a version byte, and each item is a length-prefixed record. Keys are interned:
+ * each key is written out once, and referred to by index afterwards, hence reading an item requires no searching
+ * for delimiters, stripping or copying of the key.
+ *
+ * serialize_open_binary() returns a regular stdio stream, which accepts the text lines as written by all the
+ * existing serialization code, and encodes them on the fly. A Deserializer reads both encodings, and returns
+ * one item at a time.
+ */
+
+#define SERIALIZE_BINARY_VERSION 1
+
+int serialize_open_binary(int fd, FILE **ret);
+
+typedef struct Deserializer Deserializer;
+
+int deserializer_new(FILE *f, Deserializer **ret);
+Deserializer *deserializer_free(Deserializer *d);
+
+int deserializer_read(Deserializer *d, const char **ret_key, const char **ret_value);
+bool deserializer_is_binary(Deserializer *d) _pure_;
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(Deserializer*, deserializer_free);
+#define _cleanup_deserializer_free_ _cleanup_(deserializer_freep)
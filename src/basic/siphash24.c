@@ -29,23 +29,28 @@ static inline uint64_t rotate_left(uint64_t x, uint8_t b) {
         return (x << b) | (x >> (64 - b));
 }
 
+#define SIPROUND(v0, v1, v2, v3)                        \
+        do {                                            \
+                v0 += v1;                               \
+                v1 = rotate_left(v1, 13);               \
+                v1 ^= v0;                               \
+                v0 = rotate_left(v0, 32);               \
+                v2 += v3;                               \
+                v3 = rotate_left(v3, 16);               \
+                v3 ^= v2;                               \
+                v0 += v3;                               \
+                v3 = rotate_left(v3, 21);               \
+                v3 ^= v0;                               \
+                v2 += v1;                               \
+                v1 = rotate_left(v1, 17);               \
+                v1 ^= v2;                               \
+                v2 = rotate_left(v2, 32);               \
+        } while (false)
+
 static inline void sipround(struct siphash *state) {
         assert(state);
 
-        state->v0 += state->v1;
-        state->v1 = rotate_left(state->v1, 13);
-        state->v1 ^= state->v0;
-        state->v0 = rotate_left(state->v0, 32);
-        state->v2 += state->v3;
-        state->v3 = rotate_left(state->v3, 16);
-        state->v3 ^= state->v2;
-        state->v0 += state->v3;
-        state->v3 = rotate_left(state->v3, 21);
-        state->v3 ^= state->v0;
-        state->v2 += state->v1;
-        state->v1 = rotate_left(state->v1, 17);
-        state->v1 ^= state->v2;
-        state->v2 = rotate_left(state->v2, 32);
+        SIPROUND(state->v0, state->v1, state->v2, state->v3);
 }
 
 void siphash24_init(struct siphash *state, const uint8_t k[16]) {
@@ -108,19 +113,31 @@ void siphash24_compress(const void *_in, size_t inlen, struct siphash *state) {
 
         end -= (state->inlen % sizeof(uint64_t));
 
-        for ( ; in < end; in += 8) {
-                m = unaligned_read_le64(in);
+        if (in < end) {
+                /* Keep the state in local variables while going through the input word by word. The input is
+                 * accessed through a byte pointer, which may alias anything, hence if we operated on *state
+                 * directly the compiler would have to write it back to memory and reload it for every word. */
+                uint64_t v0 = state->v0, v1 = state->v1, v2 = state->v2, v3 = state->v3;
+
+                for ( ; in < end; in += 8) {
+                        m = unaligned_read_le64(in);
 #ifdef DEBUG
-                printf("(%3zu) v0 %08x %08x\n", state->inlen, (uint32_t) (state->v0 >> 32), (uint32_t) state->v0);
-                printf("(%3zu) v1 %08x %08x\n", state->inlen, (uint32_t) (state->v1 >> 32), (uint32_t) state->v1);
-                printf("(%3zu) v2 %08x %08x\n", state->inlen, (uint32_t) (state->v2 >> 32), (uint32_t) state->v2);
-                printf("(%3zu) v3 %08x %08x\n", state->inlen, (uint32_t) (state->v3 >> 32), (uint32_t) state->v3);
-                printf("(%3zu) compress %08x %08x\n", state->inlen, (uint32_t) (m >> 32), (uint32_t) m);
+                        printf("(%3zu) v0 %08x %08x\n", state->inlen, (uint32_t) (v0 >> 32), (uint32_t) v0);
+                        printf("(%3zu) v1 %08x %08x\n", state->inlen, (uint32_t) (v1 >> 32), (uint32_t) v1);
+                        printf("(%3zu) v2 %08x %08x\n", state->inlen, (uint32_t) (v2 >> 32), (uint32_t) v2);
+                        printf("(%3zu) v3 %08x %08x\n", state->inlen, (uint32_t) (v3 >> 32), (uint32_t) v3);
+                        printf("(%3zu) compress %08x %08x\n", state->inlen, (uint32_t) (m >> 32), (uint32_t) m);
 #endif
-                state->v3 ^= m;
-                sipround(state);
-                sipround(state);
-                state->v0 ^= m;
+                        v3 ^= m;
+                        SIPROUND(v0, v1, v2, v3);
+                        SIPROUND(v0, v1, v2, v3);
+                        v0 ^= m;
+                }
+
+                state->v0 = v0;
+                state->v1 = v1;
+                state->v2 = v2;
+                state->v3 = v3;
         }
 
         left = state->inlen & 7;
@@ -38,8 +38,9 @@ char *strv_find(char **l, const char *name) {
 
         assert(name);
 
+        /* Compare the first character inline, most entries differ right there and we save the call */
         STRV_FOREACH(i, l)
-                if (streq(*i, name))
+                if ((*i)[0] == name[0] && streq(*i, name))
                         return *i;
 
         return NULL;
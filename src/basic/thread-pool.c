@@ -0,0 +1,446 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "list.h"
+#include "macro.h"
+#include "process-util.h"
+#include "thread-pool.h"
+#include "time-util.h"
+
+/* A small pool of worker threads for blocking work such as fsync(), close() or recursive removal of
+ * directories. Threads are spawned lazily, up to n_threads_max, and exit again after being idle for a while,
+ * so that a quiescent process does not keep threads around. Jobs are executed in FIFO order.
+ *
+ * There are two kinds of jobs:
+ *
+ *     - Fire-and-forget jobs: no job handle is requested, the job is freed by the worker thread as soon as it
+ *       finished.
+ *
+ *     - Joinable jobs: a job handle is returned, and the caller must pass it to thread_job_join() eventually,
+ *       which waits for the job to finish and frees it.
+ *
+ * Pools are not inherited by forked off children, as the worker threads aren't. Use of a pool in a child
+ * results in -ECHILD, except for the default pools, which are transparently reset.
+ *
+ * There are two process-wide default pools: thread_pool_default() for jobs that might take a long time, such as
+ * removing a directory tree, and thread_pool_sync() for close() and sync(), so that those never queue up behind
+ * the former.
+ *
+ * Note that there is a single FIFO queue per pool, protected by one mutex, rather than a deque per worker thread
+ * with work stealing: the jobs submitted here are few and mostly block in the kernel, so the queue is never
+ * contended enough for per-thread queues to pay off, and FIFO order keeps jobs finishing roughly in submission
+ * order. */
+
+#define THREAD_POOL_DEFAULT_THREADS_MAX 32U
+#define THREAD_POOL_SYNC_THREADS_MAX 16U
+#define THREAD_POOL_IDLE_USEC (5 * USEC_PER_SEC)
+
+struct ThreadJob {
+        ThreadPool *pool;
+
+        thread_job_func_t func;
+        void *userdata;
+
+        bool joinable;
+        bool finished;
+
+        LIST_FIELDS(ThreadJob, jobs);
+};
+
+struct ThreadPool {
+        pthread_mutex_t mutex;
+
+        /* Signalled when a job is queued, or the pool is freed */
+        pthread_cond_t queued_cond;
+
+        /* Broadcast when a joinable job finished, or a worker thread exits */
+        pthread_cond_t finished_cond;
+
+        LIST_HEAD(ThreadJob, queue);
+        ThreadJob *queue_tail;
+
+        unsigned n_threads;
+        unsigned n_threads_max;
+        unsigned n_idle;
+        unsigned n_queued;
+
+        unsigned long long n_submitted;
+        unsigned long long n_spawned;
+
+        pid_t original_pid;
+
+        bool exiting:1;
+};
+
+static ThreadPool *default_pool = NULL;
+static ThreadPool *sync_pool = NULL;
+
+int thread_pool_new(ThreadPool **ret, unsigned n_threads_max) {
+        _cleanup_free_ ThreadPool *p = NULL;
+        pthread_condattr_t a;
+        int r;
+
+        assert(ret);
+        assert(n_threads_max > 0);
+
+        p = new0(ThreadPool, 1);
+        if (!p)
+                return -ENOMEM;
+
+        p->n_threads_max = n_threads_max;
+        p->original_pid = getpid_cached();
+
+        r = pthread_mutex_init(&p->mutex, NULL);
+        if (r > 0)
+                return -r;
+
+        /* Idle timeouts are measured on CLOCK_MONOTONIC, so that they aren't affected by clock changes */
+        r = pthread_condattr_init(&a);
+        if (r > 0)
+                goto fail_mutex;
+
+        r = pthread_condattr_setclock(&a, CLOCK_MONOTONIC);
+        if (r > 0)
+                goto fail_attr;
+
+        r = pthread_cond_init(&p->queued_cond, &a);
+        if (r > 0)
+                goto fail_attr;
+
+        r = pthread_cond_init(&p->finished_cond, NULL);
+        if (r > 0) {
+                pthread_cond_destroy(&p->queued_cond);
+                goto fail_attr;
+        }
+
+        pthread_condattr_destroy(&a);
+
+        *ret = p;
+        p = NULL;
+
+        return 0;
+
+fail_attr:
+        pthread_condattr_destroy(&a);
+fail_mutex:
+        pthread_mutex_destroy(&p->mutex);
+        return -r;
+}
+
+static bool pool_origin_changed(ThreadPool *p) {
+        assert(p);
+
+        return p->original_pid != getpid_cached();
+}
+
+static void job_list_free(ThreadJob *head) {
+        ThreadJob *j;
+
+        while ((j = head)) {
+                LIST_REMOVE(jobs, head, j);
+                free(j);
+        }
+}
+
+static void thread_pool_forget(ThreadPool *p) {
+        assert(p);
+
+        /* Releases a pool inherited from our parent. The worker threads did not come with us across fork(),
+         * and the mutex might have been held by one of them, hence don't touch either. Queued jobs are
+         * dropped without running them, they are the parent's business. */
+
+        job_list_free(p->queue);
+        free(p);
+}
+
+ThreadPool* thread_pool_free(ThreadPool *p) {
+        if (!p)
+                return NULL;
+
+        if (pool_origin_changed(p)) {
+                thread_pool_forget(p);
+                return NULL;
+        }
+
+        /* Let the workers finish the queued jobs, and wait for them to exit. Joinable jobs must have been
+         * joined by now, their handles become invalid. */
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        p->exiting = true;
+        assert_se(pthread_cond_broadcast(&p->queued_cond) == 0);
+        while (p->n_threads > 0)
+                assert_se(pthread_cond_wait(&p->finished_cond, &p->mutex) == 0);
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        /* If no thread could ever be spawned, some jobs might still be queued */
+        job_list_free(p->queue);
+
+        pthread_cond_destroy(&p->finished_cond);
+        pthread_cond_destroy(&p->queued_cond);
+        pthread_mutex_destroy(&p->mutex);
+
+        return mfree(p);
+}
+
+static ThreadPool* default_pool_get(ThreadPool **pool, unsigned n_threads_max) {
+        ThreadPool *p, *n;
+
+        assert(pool);
+
+        p = *pool;
+        if (p && !pool_origin_changed(p))
+                return p;
+
+        /* Either the default pool hasn't been allocated yet, or we have been forked off since, and need a
+         * new one. This may be called from multiple threads, hence install the new pool atomically. */
+
+        if (thread_pool_new(&n, n_threads_max) < 0)
+                return NULL;
+
+        if (!__sync_bool_compare_and_swap(pool, p, n)) {
+                thread_pool_free(n);
+                return *pool;
+        }
+
+        if (p)
+                thread_pool_forget(p);
+
+        return n;
+}
+
+ThreadPool* thread_pool_default(void) {
+        return default_pool_get(&default_pool, THREAD_POOL_DEFAULT_THREADS_MAX);
+}
+
+ThreadPool* thread_pool_sync(void) {
+        return default_pool_get(&sync_pool, THREAD_POOL_SYNC_THREADS_MAX);
+}
+
+static ThreadJob *queue_pop(ThreadPool *p) {
+        ThreadJob *j;
+
+        assert(p);
+
+        j = p->queue;
+        if (!j)
+                return NULL;
+
+        LIST_REMOVE(jobs, p->queue, j);
+        if (p->queue_tail == j)
+                p->queue_tail = NULL;
+
+        assert(p->n_queued > 0);
+        p->n_queued--;
+
+        return j;
+}
+
+static void job_finished(ThreadPool *p, ThreadJob *j) {
+        assert(p);
+        assert(j);
+
+        if (j->joinable) {
+                j->finished = true;
+                assert_se(pthread_cond_broadcast(&p->finished_cond) == 0);
+        } else
+                free(j);
+}
+
+static void *worker_thread(void *userdata) {
+        ThreadPool *p = userdata;
+        ThreadJob *j;
+        int r;
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        for (;;) {
+                j = queue_pop(p);
+                if (!j) {
+                        struct timespec ts;
+
+                        if (p->exiting)
+                                break;
+
+                        timespec_store(&ts, now(CLOCK_MONOTONIC) + THREAD_POOL_IDLE_USEC);
+
+                        p->n_idle++;
+                        r = pthread_cond_timedwait(&p->queued_cond, &p->mutex, &ts);
+                        p->n_idle--;
+
+                        if (r == ETIMEDOUT && !p->queue)
+                                break;
+
+                        continue;
+                }
+
+                assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+                j->func(j->userdata);
+
+                assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+                job_finished(p, j);
+        }
+
+        assert(p->n_threads > 0);
+        p->n_threads--;
+        assert_se(pthread_cond_broadcast(&p->finished_cond) == 0);
+
+        /* Don't touch the pool after this, it might be freed right away */
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        return NULL;
+}
+
+static int spawn_worker(ThreadPool *p) {
+        sigset_t ss, saved_ss;
+        pthread_attr_t a;
+        pthread_t t;
+        int r, k;
+
+        assert(p);
+
+        r = pthread_attr_init(&a);
+        if (r > 0)
+                return -r;
+
+        r = pthread_attr_setdetachstate(&a, PTHREAD_CREATE_DETACHED);
+        if (r > 0)
+                goto finish;
+
+        /* Workers inherit the signal mask of the thread spawning them, block everything while doing so, so that
+         * asynchronous signals are always delivered to the threads of the caller instead. */
+        assert_se(sigfillset(&ss) >= 0);
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                goto finish;
+
+        r = pthread_create(&t, &a, worker_thread, p);
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r == 0 && k > 0)
+                r = k;
+
+        if (r == 0) {
+                p->n_threads++;
+                p->n_spawned++;
+        }
+
+finish:
+        pthread_attr_destroy(&a);
+        return -r;
+}
+
+int thread_pool_submit(ThreadPool *p, thread_job_func_t func, void *userdata, ThreadJob **ret_job) {
+        ThreadJob *j;
+        int r = 0;
+
+        assert_return(p, -EINVAL);
+        assert_return(func, -EINVAL);
+        assert_return(!pool_origin_changed(p), -ECHILD);
+
+        j = new0(ThreadJob, 1);
+        if (!j)
+                return -ENOMEM;
+
+        j->pool = p;
+        j->func = func;
+        j->userdata = userdata;
+        j->joinable = !!ret_job;
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        if (p->exiting) {
+                r = -ESHUTDOWN;
+                goto finish;
+        }
+
+        LIST_INSERT_AFTER(jobs, p->queue, p->queue_tail, j);
+        p->queue_tail = j;
+        p->n_queued++;
+        p->n_submitted++;
+
+        /* Wake up an idle worker if there is one, otherwise spawn a new one, as long as we are below the
+         * limit. If spawning fails, the job remains queued for the existing workers, unless there are none. */
+        if (p->n_queued <= p->n_idle)
+                assert_se(pthread_cond_signal(&p->queued_cond) == 0);
+        else if (p->n_threads < p->n_threads_max) {
+                r = spawn_worker(p);
+                if (r < 0 && p->n_threads > 0)
+                        r = 0;
+                if (r < 0) {
+                        p->queue_tail = j->jobs_prev;
+                        LIST_REMOVE(jobs, p->queue, j);
+                        p->n_queued--;
+                        p->n_submitted--;
+                        goto finish;
+                }
+        }
+
+        if (ret_job)
+                *ret_job = j;
+        j = NULL;
+
+finish:
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+        free(j);
+        return r;
+}
+
+int thread_job_join(ThreadJob *j) {
+        ThreadPool *p;
+
+        assert_return(j, -EINVAL);
+        assert_return(j->joinable, -EINVAL);
+
+        p = j->pool;
+        assert_return(!pool_origin_changed(p), -ECHILD);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        while (!j->finished)
+                assert_se(pthread_cond_wait(&p->finished_cond, &p->mutex) == 0);
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        free(j);
+        return 0;
+}
+
+void thread_pool_get_stats(ThreadPool *p, ThreadPoolStats *ret) {
+        assert(p);
+        assert(ret);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        *ret = (ThreadPoolStats) {
+                .n_threads = p->n_threads,
+                .n_threads_max = p->n_threads_max,
+                .n_idle = p->n_idle,
+                .n_queued = p->n_queued,
+                .n_submitted = p->n_submitted,
+                .n_spawned = p->n_spawned,
+        };
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+}
@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+
+#include "macro.h"
+
+typedef struct ThreadPool ThreadPool;
+typedef struct ThreadJob ThreadJob;
+
+typedef void (*thread_job_func_t)(void *userdata);
+
+typedef struct ThreadPoolStats {
+        unsigned n_threads;
+        unsigned n_threads_max;
+        unsigned n_idle;
+        unsigned n_queued;
+        unsigned long long n_submitted;
+        unsigned long long n_spawned;
+} ThreadPoolStats;
+
+int thread_pool_new(ThreadPool **ret, unsigned n_threads_max);
+ThreadPool* thread_pool_free(ThreadPool *p);
+
+ThreadPool* thread_pool_default(void);
+ThreadPool* thread_pool_sync(void);
+
+int thread_pool_submit(ThreadPool *p, thread_job_func_t func, void *userdata, ThreadJob **ret_job);
+int thread_job_join(ThreadJob *j);
+
+void thread_pool_get_stats(ThreadPool *p, ThreadPoolStats *ret);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(ThreadPool*, thread_pool_free);
+#define _cleanup_thread_pool_free_ _cleanup_(thread_pool_freep)
@@ -654,7 +654,7 @@ fail:
         automount_enter_dead(a, AUTOMOUNT_FAILURE_RESOURCES);
 }
 
-static void *expire_thread(void *p) {
+static void expire_thread(void *p) {
         struct autofs_dev_ioctl param;
         _cleanup_(expire_data_freep) struct expire_data *data = (struct expire_data*)p;
         int r;
@@ -671,8 +671,6 @@ static void *expire_thread(void *p) {
 
         if (errno != EAGAIN)
                 log_warning_errno(errno, "Failed to expire automount, ignoring: %m");
-
-        return NULL;
 }
 
 static int automount_dispatch_expire(sd_event_source *source, usec_t usec, void *userdata) {
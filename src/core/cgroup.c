@@ -463,12 +463,96 @@ static uint64_t cgroup_context_cpu_shares(CGroupContext *c, ManagerState state)
                 return CGROUP_CPU_SHARES_DEFAULT;
 }
 
+static CGroupMask cgroup_attribute_to_mask(const char *attribute) {
+        CGroupController c;
+
+        for (c = 0; c < _CGROUP_CONTROLLER_MAX; c++) {
+                const char *e;
+
+                e = startswith(attribute, cgroup_controller_to_string(c));
+                if (e && *e == '.')
+                        return CGROUP_CONTROLLER_TO_MASK(c);
+        }
+
+        return 0;
+}
+
+static void unit_flush_cgroup_attribute_cache(Unit *u, CGroupMask mask) {
+        const char *attribute;
+        char *value;
+        Iterator i;
+
+        assert(u);
+
+        /* Forgets the values written to the attributes of the controllers in the mask */
+
+        HASHMAP_FOREACH_KEY(value, attribute, u->cgroup_attribute_cache, i) {
+                if (!(cgroup_attribute_to_mask(attribute) & mask))
+                        continue;
+
+                hashmap_remove(u->cgroup_attribute_cache, attribute);
+                free((char*) attribute);
+                free(value);
+        }
+}
+
+static int unit_set_cgroup_attribute(Unit *u, const char *controller, const char *attribute, const char *key, const char *value) {
+        _cleanup_free_ char *k = NULL, *v = NULL;
+        char *cached, *cached_key;
+        const char *cache_key;
+        int r;
+
+        assert(u);
+        assert(controller);
+        assert(attribute);
+        assert(value);
+
+        /* Writes an attribute of the unit's cgroup, unless the same value was written there before already. For
+         * attributes with one value per device, 'key' identifies the device. This must only be used for attributes
+         * where writing the same value twice is a NOP, i.e. not for the devices lists. */
+
+        cache_key = key ? strjoina(attribute, " ", key) : attribute;
+
+        cached = hashmap_get2(u->cgroup_attribute_cache, cache_key, (void**) &cached_key);
+        if (streq_ptr(cached, value)) {
+                u->manager->n_cgroup_attribute_writes_skipped++;
+                return 0;
+        }
+
+        if (cached) {
+                hashmap_remove(u->cgroup_attribute_cache, cache_key);
+                free(cached_key);
+                free(cached);
+        }
+
+        r = cg_set_attribute(controller, u->cgroup_path, attribute, value);
+        if (r < 0)
+                return r;
+
+        u->manager->n_cgroup_attribute_writes++;
+
+        /* If we can't remember the value, it's simply written again next time */
+        if (hashmap_ensure_allocated(&u->cgroup_attribute_cache, &string_hash_ops) < 0)
+                return 0;
+
+        k = strdup(cache_key);
+        v = strdup(value);
+        if (!k || !v)
+                return 0;
+
+        if (hashmap_put(u->cgroup_attribute_cache, k, v) < 0)
+                return 0;
+
+        k = v = NULL;
+        return 0;
+}
+
 static void cgroup_apply_unified_cpu_config(Unit *u, uint64_t weight, uint64_t quota) {
         char buf[MAX(DECIMAL_STR_MAX(uint64_t) + 1, (DECIMAL_STR_MAX(usec_t) + 1) * 2)];
         int r;
 
         xsprintf(buf, "%" PRIu64 "\n", weight);
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.weight", buf);
+        r = unit_set_cgroup_attribute(u, "cpu", "cpu.weight", NULL, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.weight: %m");
@@ -479,7 +563,7 @@ static void cgroup_apply_unified_cpu_config(Unit *u, uint64_t weight, uint64_t q
         else
                 xsprintf(buf, "max " USEC_FMT "\n", CGROUP_CPU_QUOTA_PERIOD_USEC);
 
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.max", buf);
+        r = unit_set_cgroup_attribute(u, "cpu", "cpu.max", NULL, buf);
 
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
@@ -491,22 +575,22 @@ static void cgroup_apply_legacy_cpu_config(Unit *u, uint64_t shares, uint64_t qu
         int r;
 
         xsprintf(buf, "%" PRIu64 "\n", shares);
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.shares", buf);
+        r = unit_set_cgroup_attribute(u, "cpu", "cpu.shares", NULL, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.shares: %m");
 
         xsprintf(buf, USEC_FMT "\n", CGROUP_CPU_QUOTA_PERIOD_USEC);
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.cfs_period_us", buf);
+        r = unit_set_cgroup_attribute(u, "cpu", "cpu.cfs_period_us", NULL, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.cfs_period_us: %m");
 
         if (quota != USEC_INFINITY) {
                 xsprintf(buf, USEC_FMT "\n", quota * CGROUP_CPU_QUOTA_PERIOD_USEC / USEC_PER_SEC);
-                r = cg_set_attribute("cpu", u->cgroup_path, "cpu.cfs_quota_us", buf);
+                r = unit_set_cgroup_attribute(u, "cpu", "cpu.cfs_quota_us", NULL, buf);
         } else
-                r = cg_set_attribute("cpu", u->cgroup_path, "cpu.cfs_quota_us", "-1");
+                r = unit_set_cgroup_attribute(u, "cpu", "cpu.cfs_quota_us", NULL, "-1");
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.cfs_quota_us: %m");
@@ -569,7 +653,7 @@ static uint64_t cgroup_weight_io_to_blkio(uint64_t io_weight) {
 }
 
 static void cgroup_apply_io_device_weight(Unit *u, const char *dev_path, uint64_t io_weight) {
-        char buf[DECIMAL_STR_MAX(dev_t)*2+2+DECIMAL_STR_MAX(uint64_t)+1];
+        char buf[DECIMAL_STR_MAX(dev_t)*2+2+DECIMAL_STR_MAX(uint64_t)+1], key[DECIMAL_STR_MAX(dev_t)*2+2];
         dev_t dev;
         int r;
 
@@ -577,15 +661,16 @@ static void cgroup_apply_io_device_weight(Unit *u, const char *dev_path, uint64_
         if (r < 0)
                 return;
 
-        xsprintf(buf, "%u:%u %" PRIu64 "\n", major(dev), minor(dev), io_weight);
-        r = cg_set_attribute("io", u->cgroup_path, "io.weight", buf);
+        xsprintf(key, "%u:%u", major(dev), minor(dev));
+        xsprintf(buf, "%s %" PRIu64 "\n", key, io_weight);
+        r = unit_set_cgroup_attribute(u, "io", "io.weight", key, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set io.weight: %m");
 }
 
 static void cgroup_apply_blkio_device_weight(Unit *u, const char *dev_path, uint64_t blkio_weight) {
-        char buf[DECIMAL_STR_MAX(dev_t)*2+2+DECIMAL_STR_MAX(uint64_t)+1];
+        char buf[DECIMAL_STR_MAX(dev_t)*2+2+DECIMAL_STR_MAX(uint64_t)+1], key[DECIMAL_STR_MAX(dev_t)*2+2];
         dev_t dev;
         int r;
 
@@ -593,8 +678,9 @@ static void cgroup_apply_blkio_device_weight(Unit *u, const char *dev_path, uint
         if (r < 0)
                 return;
 
-        xsprintf(buf, "%u:%u %" PRIu64 "\n", major(dev), minor(dev), blkio_weight);
-        r = cg_set_attribute("blkio", u->cgroup_path, "blkio.weight_device", buf);
+        xsprintf(key, "%u:%u", major(dev), minor(dev));
+        xsprintf(buf, "%s %" PRIu64 "\n", key, blkio_weight);
+        r = unit_set_cgroup_attribute(u, "blkio", "blkio.weight_device", key, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set blkio.weight_device: %m");
@@ -602,7 +688,7 @@ static void cgroup_apply_blkio_device_weight(Unit *u, const char *dev_path, uint
 
 static unsigned cgroup_apply_io_device_limit(Unit *u, const char *dev_path, uint64_t *limits) {
         char limit_bufs[_CGROUP_IO_LIMIT_TYPE_MAX][DECIMAL_STR_MAX(uint64_t)];
-        char buf[DECIMAL_STR_MAX(dev_t)*2+2+(6+DECIMAL_STR_MAX(uint64_t)+1)*4];
+        char buf[DECIMAL_STR_MAX(dev_t)*2+2+(6+DECIMAL_STR_MAX(uint64_t)+1)*4], key[DECIMAL_STR_MAX(dev_t)*2+2];
         CGroupIOLimitType type;
         dev_t dev;
         unsigned n = 0;
@@ -621,10 +707,11 @@ static unsigned cgroup_apply_io_device_limit(Unit *u, const char *dev_path, uint
                 }
         }
 
-        xsprintf(buf, "%u:%u rbps=%s wbps=%s riops=%s wiops=%s\n", major(dev), minor(dev),
+        xsprintf(key, "%u:%u", major(dev), minor(dev));
+        xsprintf(buf, "%s rbps=%s wbps=%s riops=%s wiops=%s\n", key,
                  limit_bufs[CGROUP_IO_RBPS_MAX], limit_bufs[CGROUP_IO_WBPS_MAX],
                  limit_bufs[CGROUP_IO_RIOPS_MAX], limit_bufs[CGROUP_IO_WIOPS_MAX]);
-        r = cg_set_attribute("io", u->cgroup_path, "io.max", buf);
+        r = unit_set_cgroup_attribute(u, "io", "io.max", key, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set io.max: %m");
@@ -632,7 +719,7 @@ static unsigned cgroup_apply_io_device_limit(Unit *u, const char *dev_path, uint
 }
 
 static unsigned cgroup_apply_blkio_device_limit(Unit *u, const char *dev_path, uint64_t rbps, uint64_t wbps) {
-        char buf[DECIMAL_STR_MAX(dev_t)*2+2+DECIMAL_STR_MAX(uint64_t)+1];
+        char buf[DECIMAL_STR_MAX(dev_t)*2+2+DECIMAL_STR_MAX(uint64_t)+1], key[DECIMAL_STR_MAX(dev_t)*2+2];
         dev_t dev;
         unsigned n = 0;
         int r;
@@ -641,18 +728,20 @@ static unsigned cgroup_apply_blkio_device_limit(Unit *u, const char *dev_path, u
         if (r < 0)
                 return 0;
 
+        xsprintf(key, "%u:%u", major(dev), minor(dev));
+
         if (rbps != CGROUP_LIMIT_MAX)
                 n++;
-        sprintf(buf, "%u:%u %" PRIu64 "\n", major(dev), minor(dev), rbps);
-        r = cg_set_attribute("blkio", u->cgroup_path, "blkio.throttle.read_bps_device", buf);
+        sprintf(buf, "%s %" PRIu64 "\n", key, rbps);
+        r = unit_set_cgroup_attribute(u, "blkio", "blkio.throttle.read_bps_device", key, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set blkio.throttle.read_bps_device: %m");
 
         if (wbps != CGROUP_LIMIT_MAX)
                 n++;
-        sprintf(buf, "%u:%u %" PRIu64 "\n", major(dev), minor(dev), wbps);
-        r = cg_set_attribute("blkio", u->cgroup_path, "blkio.throttle.write_bps_device", buf);
+        sprintf(buf, "%s %" PRIu64 "\n", key, wbps);
+        r = unit_set_cgroup_attribute(u, "blkio", "blkio.throttle.write_bps_device", key, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set blkio.throttle.write_bps_device: %m");
@@ -671,7 +760,7 @@ static void cgroup_apply_unified_memory_limit(Unit *u, const char *file, uint64_
         if (v != CGROUP_LIMIT_MAX)
                 xsprintf(buf, "%" PRIu64 "\n", v);
 
-        r = cg_set_attribute("memory", u->cgroup_path, file, buf);
+        r = unit_set_cgroup_attribute(u, "memory", file, NULL, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set %s: %m", file);
@@ -790,7 +879,7 @@ static void cgroup_context_apply(
                                 weight = CGROUP_WEIGHT_DEFAULT;
 
                         xsprintf(buf, "default %" PRIu64 "\n", weight);
-                        r = cg_set_attribute("io", path, "io.weight", buf);
+                        r = unit_set_cgroup_attribute(u, "io", "io.weight", "default", buf);
                         if (r < 0)
                                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                                               "Failed to set io.weight: %m");
@@ -867,7 +956,7 @@ static void cgroup_context_apply(
                                 weight = CGROUP_BLKIO_WEIGHT_DEFAULT;
 
                         xsprintf(buf, "%" PRIu64 "\n", weight);
-                        r = cg_set_attribute("blkio", path, "blkio.weight", buf);
+                        r = unit_set_cgroup_attribute(u, "blkio", "blkio.weight", NULL, buf);
                         if (r < 0)
                                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                                               "Failed to set blkio.weight: %m");
@@ -946,7 +1035,7 @@ static void cgroup_context_apply(
                         else
                                 xsprintf(buf, "%" PRIu64 "\n", val);
 
-                        r = cg_set_attribute("memory", path, "memory.limit_in_bytes", buf);
+                        r = unit_set_cgroup_attribute(u, "memory", "memory.limit_in_bytes", NULL, buf);
                         if (r < 0)
                                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                                               "Failed to set memory.limit_in_bytes: %m");
@@ -1023,9 +1112,9 @@ static void cgroup_context_apply(
                         char buf[DECIMAL_STR_MAX(uint64_t) + 2];
 
                         sprintf(buf, "%" PRIu64 "\n", c->tasks_max);
-                        r = cg_set_attribute("pids", path, "pids.max", buf);
+                        r = unit_set_cgroup_attribute(u, "pids", "pids.max", NULL, buf);
                 } else
-                        r = cg_set_attribute("pids", path, "pids.max", "max");
+                        r = unit_set_cgroup_attribute(u, "pids", "pids.max", NULL, "max");
 
                 if (r < 0)
                         log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
@@ -1118,11 +1207,10 @@ CGroupMask unit_get_members_mask(Unit *u) {
         u->cgroup_members_mask = 0;
 
         if (u->type == UNIT_SLICE) {
-                void *v;
                 Unit *member;
                 Iterator i;
 
-                HASHMAP_FOREACH_KEY(v, member, u->dependencies[UNIT_BEFORE], i) {
+                UNIT_DEPENDENCY_SET_FOREACH(member, u->dependencies[UNIT_BEFORE], i) {
 
                         if (member == u)
                                 continue;
@@ -1444,6 +1532,10 @@ static int unit_create_cgroup(
         if (r < 0)
                 return log_unit_error_errno(u, r, "Failed to create cgroup %s: %m", u->cgroup_path);
 
+        /* A new group, and the controllers we don't use (anymore), start out with the kernel defaults, hence forget
+         * what we wrote to them before */
+        unit_flush_cgroup_attribute_cache(u, r > 0 ? _CGROUP_MASK_ALL : ~target_mask);
+
         /* Start watching it */
         (void) unit_watch_cgroup(u);
 
@@ -1551,6 +1643,7 @@ static void unit_remove_from_cgroup_realize_queue(Unit *u) {
 static int unit_realize_cgroup_now(Unit *u, ManagerState state) {
         CGroupMask target_mask, enable_mask;
         bool needs_bpf, apply_bpf;
+        usec_t ts;
         int r;
 
         assert(u);
@@ -1576,6 +1669,8 @@ static int unit_realize_cgroup_now(Unit *u, ManagerState state) {
                         return r;
         }
 
+        ts = now(CLOCK_MONOTONIC);
+
         /* And then do the real work */
         r = unit_create_cgroup(u, target_mask, enable_mask, needs_bpf);
         if (r < 0)
@@ -1585,6 +1680,8 @@ static int unit_realize_cgroup_now(Unit *u, ManagerState state) {
         cgroup_context_apply(u, target_mask, apply_bpf, state);
         cgroup_xattr_apply(u);
 
+        trace_span(&u->manager->trace, "cgroup-realize", u->id, ts);
+
         return 0;
 }
 
@@ -1598,6 +1695,8 @@ unsigned manager_dispatch_cgroup_realize_queue(Manager *m) {
 
         state = manager_state(m);
 
+        m->cgroup_realize_iteration++;
+
         while ((i = m->cgroup_realize_queue)) {
                 assert(i->in_cgroup_realize_queue);
 
@@ -1625,11 +1724,25 @@ static void unit_add_siblings_to_cgroup_realize_queue(Unit *u) {
          * neither the specified unit itself nor the parents.) */
 
         while ((slice = UNIT_DEREF(u->slice))) {
+                CGroupMask members_mask;
                 Iterator i;
                 Unit *m;
-                void *v;
 
-                HASHMAP_FOREACH_KEY(v, m, u->dependencies[UNIT_BEFORE], i) {
+                /* When many units in the same slice are started at once, each of them would go through all
+                 * the others. Skip that if the members of this slice were queued already since the queue was
+                 * dispatched last, and their masks didn't change since. Members which need to be realized
+                 * again for other reasons are queued by unit_invalidate_cgroup(). */
+                members_mask = unit_get_members_mask(slice);
+                if (slice->cgroup_siblings_queued_iteration == u->manager->cgroup_realize_iteration &&
+                    slice->cgroup_siblings_queued_mask == members_mask) {
+                        u = slice;
+                        continue;
+                }
+
+                slice->cgroup_siblings_queued_iteration = u->manager->cgroup_realize_iteration;
+                slice->cgroup_siblings_queued_mask = members_mask;
+
+                UNIT_DEPENDENCY_SET_FOREACH(m, u->dependencies[UNIT_BEFORE], i) {
                         if (m == u)
                                 continue;
 
@@ -1688,6 +1801,8 @@ void unit_release_cgroup(Unit *u) {
 
         /* Forgets all cgroup details for this cgroup */
 
+        u->cgroup_attribute_cache = hashmap_free_free_free(u->cgroup_attribute_cache);
+
         if (u->cgroup_path) {
                 (void) hashmap_remove(u->manager->cgroup_unit, u->cgroup_path);
                 u->cgroup_path = mfree(u->cgroup_path);
@@ -1826,6 +1941,8 @@ static int unit_watch_pids_in_path(Unit *u, const char *path) {
 }
 
 int unit_watch_all_pids(Unit *u) {
+        uint64_t iteration;
+        bool have_iteration;
         int r;
 
         assert(u);
@@ -1844,7 +1961,18 @@ int unit_watch_all_pids(Unit *u) {
         if (r > 0) /* On unified we can use proper notifications */
                 return 0;
 
-        return unit_watch_pids_in_path(u, u->cgroup_path);
+        /* A unit usually goes through several states in one event loop iteration when stopped, and each of them
+         * asks for this. Reading all of the cgroup's cgroup.procs files once per iteration is enough: processes
+         * forked off in the meantime have a parent we watch already. */
+        have_iteration = sd_event_get_iteration(u->manager->event, &iteration) >= 0;
+        if (have_iteration && u->watch_all_pids_iteration == iteration + 1)
+                return 0;
+
+        r = unit_watch_pids_in_path(u, u->cgroup_path);
+        if (r >= 0 && have_iteration)
+                u->watch_all_pids_iteration = iteration + 1;
+
+        return r;
 }
 
 static int on_cgroup_empty_event(sd_event_source *s, void *userdata) {
@@ -1924,27 +2052,44 @@ void unit_add_to_cgroup_empty_queue(Unit *u) {
 }
 
 static int on_cgroup_inotify_event(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        /* Too large for the stack, and only ever used from the event loop of the manager */
+        static union {
+                struct inotify_event ev;
+                uint8_t raw[INOTIFY_EVENT_MAX * 64];
+        } buffer;
+        _cleanup_set_free_ Set *units = NULL;
         Manager *m = userdata;
+        bool overflow = false;
+        Iterator i;
+        Unit *u;
 
         assert(s);
         assert(fd >= 0);
         assert(m);
 
+        /* When many scopes go away at once, each cgroup.events file is usually modified more than once, and
+         * checking each cgroup once is enough. Hence read all queued events first, with a buffer big enough for
+         * many of them, and then check each unit once. If the event queue overflowed we lost events, and need to
+         * check all cgroups we watch. */
+
         for (;;) {
-                union inotify_event_buffer buffer;
                 struct inotify_event *e;
                 ssize_t l;
 
                 l = read(fd, &buffer, sizeof(buffer));
                 if (l < 0) {
                         if (IN_SET(errno, EINTR, EAGAIN))
-                                return 0;
+                                break;
 
                         return log_error_errno(errno, "Failed to read control group inotify events: %m");
                 }
 
                 FOREACH_INOTIFY_EVENT(e, buffer, l) {
-                        Unit *u;
+
+                        if (e->mask & IN_Q_OVERFLOW) {
+                                overflow = true;
+                                continue;
+                        }
 
                         if (e->wd < 0)
                                 /* Queue overflow has no watch descriptor */
@@ -1962,9 +2107,23 @@ static int on_cgroup_inotify_event(sd_event_source *s, int fd, uint32_t revents,
                                  * this here safely. */
                                 continue;
 
-                        unit_add_to_cgroup_empty_queue(u);
+                        if (set_ensure_allocated(&units, NULL) < 0 ||
+                            set_put(units, u) < 0)
+                                /* Can't remember it, queue it right away then */
+                                unit_add_to_cgroup_empty_queue(u);
                 }
         }
+
+        if (overflow) {
+                log_debug("Control group inotify event queue overflowed, checking all control groups.");
+
+                HASHMAP_FOREACH(u, m->cgroup_inotify_wd_unit, i)
+                        unit_add_to_cgroup_empty_queue(u);
+        } else
+                SET_FOREACH(u, units, i)
+                        unit_add_to_cgroup_empty_queue(u);
+
+        return 0;
 }
 
 int manager_setup_cgroup(Manager *m) {
@@ -2182,7 +2341,7 @@ Unit *manager_get_unit_by_pid(Manager *m, pid_t pid) {
                 return NULL;
 
         if (pid == 1)
-                return hashmap_get(m->units, SPECIAL_INIT_SCOPE);
+                return flat_hashmap_get(m->units, SPECIAL_INIT_SCOPE);
 
         u = hashmap_get(m->watch_pids1, PID_TO_PTR(pid));
         if (u)
@@ -2476,9 +2635,8 @@ void unit_invalidate_cgroup_bpf(Unit *u) {
         if (u->type == UNIT_SLICE) {
                 Unit *member;
                 Iterator i;
-                void *v;
 
-                HASHMAP_FOREACH_KEY(v, member, u->dependencies[UNIT_BEFORE], i) {
+                UNIT_DEPENDENCY_SET_FOREACH(member, u->dependencies[UNIT_BEFORE], i) {
                         if (member == u)
                                 continue;
 
@@ -186,6 +186,26 @@ static int send_changed_signal(sd_bus *bus, void *userdata) {
         return sd_bus_emit_properties_changed(bus, p, "org.freedesktop.systemd1.Job", "State", NULL);
 }
 
+static int send_or_defer_change_signal(sd_bus *bus, void *userdata) {
+        Job *j = userdata;
+
+        assert(bus);
+        assert(j);
+
+        /* Hold the signal back if this connection is busy. If that fails, just send it right away. */
+        if (bus_defer_change_signal(j->manager, bus, BUS_OBJECT_JOB, j, !j->sent_dbus_new_signal) > 0)
+                return 0;
+
+        return j->sent_dbus_new_signal ? send_changed_signal(bus, j) : send_new_signal(bus, j);
+}
+
+int bus_job_send_pending_change_signal(Job *j, sd_bus *bus, bool new) {
+        assert(j);
+        assert(bus);
+
+        return new ? send_new_signal(bus, j) : send_changed_signal(bus, j);
+}
+
 void bus_job_send_change_signal(Job *j) {
         int r;
 
@@ -196,7 +216,7 @@ void bus_job_send_change_signal(Job *j) {
                 j->in_dbus_queue = false;
         }
 
-        r = bus_foreach_bus(j->manager, j->bus_track, j->sent_dbus_new_signal ? send_changed_signal : send_new_signal, j);
+        r = bus_foreach_bus(j->manager, j->bus_track, send_or_defer_change_signal, j);
         if (r < 0)
                 log_debug_errno(r, "Failed to send job change signal for %u: %m", j->id);
 
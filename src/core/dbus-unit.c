@@ -102,10 +102,9 @@ static int property_get_dependencies(
                 void *userdata,
                 sd_bus_error *error) {
 
-        Hashmap *h = *(Hashmap**) userdata;
+        UnitDependencySet *s = *(UnitDependencySet**) userdata;
         Iterator j;
         Unit *u;
-        void *v;
         int r;
 
         assert(bus);
@@ -115,7 +114,7 @@ static int property_get_dependencies(
         if (r < 0)
                 return r;
 
-        HASHMAP_FOREACH_KEY(v, u, h, j) {
+        UNIT_DEPENDENCY_SET_FOREACH(u, s, j) {
                 r = sd_bus_message_append(reply, "s", u->id);
                 if (r < 0)
                         return r;
@@ -1195,6 +1194,26 @@ static int send_changed_signal(sd_bus *bus, void *userdata) {
                         NULL);
 }
 
+static int send_or_defer_change_signal(sd_bus *bus, void *userdata) {
+        Unit *u = userdata;
+
+        assert(bus);
+        assert(u);
+
+        /* Hold the signal back if this connection is busy. If that fails, just send it right away. */
+        if (bus_defer_change_signal(u->manager, bus, BUS_OBJECT_UNIT, u, !u->sent_dbus_new_signal) > 0)
+                return 0;
+
+        return u->sent_dbus_new_signal ? send_changed_signal(bus, u) : send_new_signal(bus, u);
+}
+
+int bus_unit_send_pending_change_signal(Unit *u, sd_bus *bus, bool new) {
+        assert(u);
+        assert(bus);
+
+        return new ? send_new_signal(bus, u) : send_changed_signal(bus, u);
+}
+
 void bus_unit_send_change_signal(Unit *u) {
         int r;
         assert(u);
@@ -1207,7 +1226,7 @@ void bus_unit_send_change_signal(Unit *u) {
         if (!u->id)
                 return;
 
-        r = bus_foreach_bus(u->manager, u->bus_track, u->sent_dbus_new_signal ? send_changed_signal : send_new_signal, u);
+        r = bus_foreach_bus(u->manager, u->bus_track, send_or_defer_change_signal, u);
         if (r < 0)
                 log_unit_debug_errno(u, r, "Failed to send unit change signal for %s: %m", u->id);
 
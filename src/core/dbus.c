@@ -49,6 +49,13 @@
 
 #define CONNECTIONS_MAX 4096
 
+/* If more than this many messages are queued for sending on a bus connection, don't generate any more change signals
+ * for it for now, until its client has caught up */
+#define BUS_BUSY_THRESHOLD 1024LU
+
+#define DEFERRED_CHANGED INT_TO_PTR(1)
+#define DEFERRED_NEW INT_TO_PTR(2)
+
 static void destroy_bus(Manager *m, sd_bus **bus);
 
 int bus_send_queued_message(Manager *m) {
@@ -511,11 +518,11 @@ static int bus_unit_enumerate(sd_bus *bus, const char *path, void *userdata, cha
         Iterator i;
         Unit *u;
 
-        l = new0(char*, hashmap_size(m->units)+1);
+        l = new0(char*, flat_hashmap_size(m->units)+1);
         if (!l)
                 return -ENOMEM;
 
-        HASHMAP_FOREACH(u, m->units, i) {
+        FLAT_HASHMAP_FOREACH(u, m->units, i) {
                 l[k] = unit_dbus_path(u);
                 if (!l[k])
                         return -ENOMEM;
@@ -1040,6 +1047,18 @@ int bus_init(Manager *m, bool try_bus_connect) {
         return 0;
 }
 
+static BusDeferredSignals* bus_deferred_signals_free(BusDeferredSignals *d) {
+        BusObjectKind k;
+
+        if (!d)
+                return NULL;
+
+        for (k = 0; k < _BUS_OBJECT_KIND_MAX; k++)
+                hashmap_free(d->objects[k]);
+
+        return mfree(d);
+}
+
 static void destroy_bus(Manager *m, sd_bus **bus) {
         Iterator i;
         Unit *u;
@@ -1074,6 +1093,9 @@ static void destroy_bus(Manager *m, sd_bus **bus) {
         if (m->queued_message && sd_bus_message_get_bus(m->queued_message) == *bus)
                 m->queued_message = sd_bus_message_unref(m->queued_message);
 
+        /* And of the change signals held back for it */
+        bus_deferred_signals_free(hashmap_remove(m->deferred_signals, *bus));
+
         /* Possibly flush unwritten data, but only if we are
          * unprivileged, since we don't want to sync here */
         if (!MANAGER_IS_SYSTEM(m))
@@ -1097,6 +1119,7 @@ void bus_done(Manager *m) {
                 destroy_bus(m, &b);
 
         m->private_buses = set_free(m->private_buses);
+        m->deferred_signals = hashmap_free(m->deferred_signals);
 
         m->subscribed = sd_bus_track_unref(m->subscribed);
         m->deserialized_subscribed = strv_free(m->deserialized_subscribed);
@@ -1177,6 +1200,130 @@ int bus_foreach_bus(
         return ret;
 }
 
+bool bus_is_busy(sd_bus *bus) {
+        uint64_t n;
+
+        assert(bus);
+
+        if (sd_bus_get_n_queued_write(bus, &n) < 0)
+                return false;
+
+        return n > BUS_BUSY_THRESHOLD;
+}
+
+int bus_defer_change_signal(Manager *m, sd_bus *bus, BusObjectKind kind, void *object, bool new) {
+        BusDeferredSignals *d;
+        void *v;
+        int r;
+
+        assert(m);
+        assert(bus);
+        assert(kind >= 0);
+        assert(kind < _BUS_OBJECT_KIND_MAX);
+        assert(object);
+
+        /* Checks whether the change signal for the specified unit or job should be held back on this connection. If
+         * so, records it, so that it is sent later by bus_dispatch_deferred_signals(), once the client caught up,
+         * and returns > 0. Further changes to the same object are coalesced into the recorded entry. Once an object
+         * is held back on a connection it stays held back until flushed, even if the connection drained in the
+         * meantime, so that its signals are never reordered. Only the slow connection is affected by this, all
+         * others get the signal right away. */
+
+        d = hashmap_get(m->deferred_signals, bus);
+        v = d ? hashmap_get(d->objects[kind], object) : NULL;
+
+        if (!v && !bus_is_busy(bus))
+                return 0;
+
+        if (v == DEFERRED_NEW)
+                new = true;
+
+        if (!d) {
+                r = hashmap_ensure_allocated(&m->deferred_signals, NULL);
+                if (r < 0)
+                        return r;
+
+                d = new0(BusDeferredSignals, 1);
+                if (!d)
+                        return -ENOMEM;
+
+                r = hashmap_put(m->deferred_signals, bus, d);
+                if (r < 0) {
+                        free(d);
+                        return r;
+                }
+        }
+
+        r = hashmap_ensure_allocated(&d->objects[kind], NULL);
+        if (r < 0)
+                return r;
+
+        r = hashmap_replace(d->objects[kind], object, new ? DEFERRED_NEW : DEFERRED_CHANGED);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
+unsigned bus_dispatch_deferred_signals(Manager *m, unsigned budget) {
+        BusDeferredSignals *d;
+        unsigned n = 0;
+        Iterator i;
+        sd_bus *b;
+
+        assert(m);
+
+        /* Sends the change signals held back on connections that aren't busy anymore, at most 'budget' of them.
+         * Returns how many were sent. */
+
+        HASHMAP_FOREACH_KEY(d, b, m->deferred_signals, i) {
+                BusObjectKind k;
+                int r;
+
+                for (k = 0; k < _BUS_OBJECT_KIND_MAX; k++) {
+                        void *object, *v;
+
+                        while (n < budget && !bus_is_busy(b) && (object = hashmap_first_key(d->objects[k]))) {
+                                v = hashmap_remove(d->objects[k], object);
+
+                                if (k == BUS_OBJECT_UNIT)
+                                        r = bus_unit_send_pending_change_signal(object, b, v == DEFERRED_NEW);
+                                else
+                                        r = bus_job_send_pending_change_signal(object, b, v == DEFERRED_NEW);
+                                if (r < 0)
+                                        log_debug_errno(r, "Failed to send deferred change signal, ignoring: %m");
+
+                                n++;
+                        }
+
+                        if (!hashmap_isempty(d->objects[k]))
+                                break;
+                }
+
+                if (k >= _BUS_OBJECT_KIND_MAX)
+                        bus_deferred_signals_free(hashmap_remove(m->deferred_signals, b));
+
+                if (n >= budget)
+                        break;
+        }
+
+        return n;
+}
+
+void bus_drop_deferred_signals(Manager *m, BusObjectKind kind, void *object) {
+        BusDeferredSignals *d;
+        Iterator i;
+
+        assert(m);
+        assert(kind >= 0);
+        assert(kind < _BUS_OBJECT_KIND_MAX);
+
+        /* Forgets about the change signals held back for a unit or job that is going away */
+
+        HASHMAP_FOREACH(d, m->deferred_signals, i)
+                hashmap_remove(d->objects[kind], object);
+}
+
 void bus_track_serialize(sd_bus_track *t, FILE *f, const char *prefix) {
         const char *n;
 
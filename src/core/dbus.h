@@ -22,6 +22,19 @@
 
 #include "manager.h"
 
+typedef enum BusObjectKind {
+        BUS_OBJECT_UNIT,
+        BUS_OBJECT_JOB,
+        _BUS_OBJECT_KIND_MAX,
+} BusObjectKind;
+
+/* The units and jobs whose change signals are held back on one connection, because its client doesn't keep up with
+ * reading them. Maps the object to whether the UnitNew/JobNew signal is still outstanding for it, or only the
+ * PropertiesChanged signal. */
+typedef struct BusDeferredSignals {
+        Hashmap *objects[_BUS_OBJECT_KIND_MAX];
+} BusDeferredSignals;
+
 int bus_send_queued_message(Manager *m);
 
 int bus_init(Manager *m, bool try_bus_connect);
@@ -36,6 +49,11 @@ int manager_sync_bus_names(Manager *m, sd_bus *bus);
 
 int bus_foreach_bus(Manager *m, sd_bus_track *subscribed2, int (*send_message)(sd_bus *bus, void *userdata), void *userdata);
 
+bool bus_is_busy(sd_bus *bus);
+int bus_defer_change_signal(Manager *m, sd_bus *bus, BusObjectKind kind, void *object, bool new);
+unsigned bus_dispatch_deferred_signals(Manager *m, unsigned budget);
+void bus_drop_deferred_signals(Manager *m, BusObjectKind kind, void *object);
+
 int bus_verify_manage_units_async(Manager *m, sd_bus_message *call, sd_bus_error *error);
 int bus_verify_manage_unit_files_async(Manager *m, sd_bus_message *call, sd_bus_error *error);
 int bus_verify_reload_daemon_async(Manager *m, sd_bus_message *call, sd_bus_error *error);
@@ -330,12 +330,11 @@ static bool device_is_bound_by_mounts(Device *d, struct udev_device *dev) {
 static int device_upgrade_mount_deps(Unit *u) {
         Unit *other;
         Iterator i;
-        void *v;
         int r;
 
         /* Let's upgrade Requires= to BindsTo= on us. (Used when SYSTEMD_MOUNT_DEVICE_BOUND is set) */
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REQUIRED_BY], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_REQUIRED_BY], i) {
                 if (other->type != UNIT_MOUNT)
                         continue;
 
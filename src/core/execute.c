@@ -1585,6 +1585,41 @@ static int apply_lock_personality(const Unit* u, const ExecContext *c) {
         return seccomp_lock_personality(personality);
 }
 
+static void compile_seccomp_filters(Unit *u, const ExecCommand *command, const ExecContext *c, const ExecParameters *p) {
+        bool needs_ambient_hack;
+
+        assert(u);
+        assert(command);
+        assert(c);
+        assert(p);
+
+        /* Compiling the filters with libseccomp is the expensive part of applying them, hence do it once here, before
+         * forking, for all processes of the service. The child then finds the compiled filters in the cache, and
+         * only installs them. Failures are ignored here, the child will try again and report them properly. */
+
+        if (!(p->flags & EXEC_APPLY_SANDBOXING) || (command->flags & EXEC_COMMAND_FULLY_PRIVILEGED))
+                return;
+
+        needs_ambient_hack = (command->flags & EXEC_COMMAND_AMBIENT_MAGIC) && !ambient_capabilities_supported();
+
+        seccomp_set_compile_only(true);
+
+        (void) apply_address_families(u, c);
+        (void) apply_memory_deny_write_execute(u, c);
+        (void) apply_restrict_realtime(u, c);
+        (void) apply_restrict_namespaces(u, c);
+        (void) apply_protect_sysctl(u, c);
+        (void) apply_protect_kernel_modules(u, c);
+        (void) apply_private_devices(u, c);
+        (void) apply_lock_personality(u, c);
+
+        /* The ambient capabilities hack modifies the filter set, leave that to the child */
+        if (!needs_ambient_hack)
+                (void) apply_syscall_filter(u, c, false);
+
+        seccomp_set_compile_only(false);
+}
+
 #endif
 
 static void do_idle_pipe_dance(int idle_pipe[4]) {
@@ -3448,6 +3483,7 @@ int exec_spawn(Unit *unit,
         int socket_fd, r;
         int named_iofds[3] = { -1, -1, -1 };
         char **argv;
+        usec_t ts;
         pid_t pid;
 
         assert(unit);
@@ -3457,6 +3493,8 @@ int exec_spawn(Unit *unit,
         assert(params);
         assert(params->fds || (params->n_storage_fds + params->n_socket_fds <= 0));
 
+        ts = now(CLOCK_MONOTONIC);
+
         if (context->std_input == EXEC_INPUT_SOCKET ||
             context->std_output == EXEC_OUTPUT_SOCKET ||
             context->std_error == EXEC_OUTPUT_SOCKET) {
@@ -3499,6 +3537,15 @@ int exec_spawn(Unit *unit,
                    LOG_UNIT_INVOCATION_ID(unit),
                    NULL);
 
+#if HAVE_SECCOMP
+        compile_seccomp_filters(unit, command, context, params);
+#endif
+
+        /* Only the parent's side is traced, the child cannot add to our trace. Its setup shows up as the time until
+         * the job is done. */
+        trace_span(&unit->manager->trace, "exec-prepare", unit->id, ts);
+        ts = now(CLOCK_MONOTONIC);
+
         pid = fork();
         if (pid < 0)
                 return log_unit_error_errno(unit, errno, "Failed to fork: %m");
@@ -3547,6 +3594,8 @@ int exec_spawn(Unit *unit,
         if (params->cgroup_path)
                 (void) cg_attach(SYSTEMD_CGROUP_CONTROLLER, params->cgroup_path, pid);
 
+        trace_span(&unit->manager->trace, "exec-fork", unit->id, ts);
+
         exec_status_start(&command->exec_status, pid);
 
         *ret = pid;
@@ -4692,11 +4741,10 @@ int exec_runtime_deserialize_item(Unit *u, ExecRuntime **rt, const char *key, co
         return 1;
 }
 
-static void *remove_tmpdir_thread(void *p) {
+static void remove_tmpdir_thread(void *p) {
         _cleanup_free_ char *path = p;
 
         (void) rm_rf(path, REMOVE_ROOT|REMOVE_PHYSICAL);
-        return NULL;
 }
 
 void exec_runtime_destroy(ExecRuntime *rt) {
@@ -4710,7 +4758,7 @@ void exec_runtime_destroy(ExecRuntime *rt) {
                 return;
 
         if (rt->tmp_dir) {
-                log_debug("Spawning thread to nuke %s", rt->tmp_dir);
+                log_debug("Queuing job to nuke %s", rt->tmp_dir);
 
                 r = asynchronous_job(remove_tmpdir_thread, rt->tmp_dir);
                 if (r < 0) {
@@ -4722,7 +4770,7 @@ void exec_runtime_destroy(ExecRuntime *rt) {
         }
 
         if (rt->var_tmp_dir) {
-                log_debug("Spawning thread to nuke %s", rt->var_tmp_dir);
+                log_debug("Queuing job to nuke %s", rt->var_tmp_dir);
 
                 r = asynchronous_job(remove_tmpdir_thread, rt->var_tmp_dir);
                 if (r < 0) {
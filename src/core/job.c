@@ -91,6 +91,8 @@ void job_free(Job *j) {
         if (j->in_dbus_queue)
                 LIST_REMOVE(dbus_queue, j->manager->dbus_job_queue, j);
 
+        bus_drop_deferred_signals(j->manager, BUS_OBJECT_JOB, j);
+
         if (j->in_gc_queue)
                 LIST_REMOVE(gc_queue, j->manager->gc_job_queue, j);
 
@@ -438,7 +440,6 @@ int job_type_merge_and_collapse(JobType *a, JobType b, Unit *u) {
 static bool job_is_runnable(Job *j) {
         Iterator i;
         Unit *other;
-        void *v;
 
         assert(j);
         assert(j->installed);
@@ -466,7 +467,7 @@ static bool job_is_runnable(Job *j) {
                  * dependencies, regardless whether they are
                  * starting or stopping something. */
 
-                HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER], i)
+                UNIT_DEPENDENCY_SET_FOREACH(other, j->unit->dependencies[UNIT_AFTER], i)
                         if (other->job)
                                 return false;
         }
@@ -474,7 +475,7 @@ static bool job_is_runnable(Job *j) {
         /* Also, if something else is being stopped and we should
          * change state after it, then let's wait. */
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE], i)
+        UNIT_DEPENDENCY_SET_FOREACH(other, j->unit->dependencies[UNIT_BEFORE], i)
                 if (other->job &&
                     IN_SET(other->job->type, JOB_STOP, JOB_RESTART))
                         return false;
@@ -833,11 +834,10 @@ static void job_emit_status_message(Unit *u, JobType t, JobResult result) {
 static void job_fail_dependencies(Unit *u, UnitDependency d) {
         Unit *other;
         Iterator i;
-        void *v;
 
         assert(u);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[d], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[d], i) {
                 Job *j = other->job;
 
                 if (!j)
@@ -849,12 +849,29 @@ static void job_fail_dependencies(Unit *u, UnitDependency d) {
         }
 }
 
+static void job_trace(Job *j) {
+        usec_t n;
+
+        assert(j);
+
+        /* Records how long the job waited in the queue, and how long it ran */
+
+        n = now(CLOCK_MONOTONIC);
+
+        if (j->begin_usec > 0)
+                trace_add(&j->manager->trace, TRACE_JOB, "job-wait", j->unit->id,
+                          j->begin_usec, (j->begin_running_usec > 0 ? j->begin_running_usec : n) - j->begin_usec);
+
+        if (j->begin_running_usec > 0)
+                trace_add(&j->manager->trace, TRACE_JOB, "job-run", j->unit->id,
+                          j->begin_running_usec, n - j->begin_running_usec);
+}
+
 int job_finish_and_invalidate(Job *j, JobResult result, bool recursive, bool already) {
         Unit *u;
         Unit *other;
         JobType t;
         Iterator i;
-        void *v;
 
         assert(j);
         assert(j->installed);
@@ -865,6 +882,8 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive, bool alr
 
         j->result = result;
 
+        job_trace(j);
+
         log_unit_debug(u, "Job %s/%s finished, result=%s", u->id, job_type_to_string(t), job_result_to_string(result));
 
         /* If this job did nothing to respective unit we don't log the status message */
@@ -922,12 +941,12 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive, bool alr
 
 finish:
         /* Try to start the next jobs that can be started */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_AFTER], i)
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_AFTER], i)
                 if (other->job) {
                         job_add_to_run_queue(other->job);
                         job_add_to_gc_queue(other->job);
                 }
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BEFORE], i)
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_BEFORE], i)
                 if (other->job) {
                         job_add_to_run_queue(other->job);
                         job_add_to_gc_queue(other->job);
@@ -1067,35 +1086,23 @@ int job_serialize(Job *j, FILE *f) {
         return 0;
 }
 
-int job_deserialize(Job *j, FILE *f) {
+int job_deserialize(Job *j, Deserializer *d) {
+        int r;
+
         assert(j);
-        assert(f);
+        assert(d);
 
         for (;;) {
-                char line[LINE_MAX], *l, *v;
-                size_t k;
-
-                if (!fgets(line, sizeof(line), f)) {
-                        if (feof(f))
-                                return 0;
-                        return -errno;
-                }
+                const char *l, *v;
 
-                char_array_0(line);
-                l = strstrip(line);
+                r = deserializer_read(d, &l, &v);
+                if (r <= 0)
+                        return r;
 
                 /* End marker */
                 if (l[0] == 0)
                         return 0;
 
-                k = strcspn(l, "=");
-
-                if (l[k] == '=') {
-                        l[k] = 0;
-                        v = l+k+1;
-                } else
-                        v = l+k;
-
                 if (streq(l, "job-id")) {
 
                         if (safe_atou32(v, &j->id) < 0)
@@ -1276,7 +1283,6 @@ int job_get_timeout(Job *j, usec_t *timeout) {
 bool job_check_gc(Job *j) {
         Unit *other;
         Iterator i;
-        void *v;
 
         assert(j);
 
@@ -1305,7 +1311,7 @@ bool job_check_gc(Job *j) {
 
         /* If a job is ordered after ours, and is to be started, then it needs to wait for us, regardless if we stop or
          * start, hence let's not GC in that case. */
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(other, j->unit->dependencies[UNIT_BEFORE], i) {
                 if (!other->job)
                         continue;
 
@@ -1318,7 +1324,7 @@ bool job_check_gc(Job *j) {
 
         /* If we are going down, but something else is ordered After= us, then it needs to wait for us */
         if (IN_SET(j->type, JOB_STOP, JOB_RESTART))
-                HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER], i) {
+                UNIT_DEPENDENCY_SET_FOREACH(other, j->unit->dependencies[UNIT_AFTER], i) {
                         if (!other->job)
                                 continue;
 
@@ -1396,7 +1402,6 @@ int job_get_before(Job *j, Job*** ret) {
         size_t n = 0, n_allocated = 0;
         Unit *other = NULL;
         Iterator i;
-        void *v;
 
         /* Returns a list of all pending jobs that need to finish before this job may be started. */
 
@@ -1410,7 +1415,7 @@ int job_get_before(Job *j, Job*** ret) {
 
         if (IN_SET(j->type, JOB_START, JOB_VERIFY_ACTIVE, JOB_RELOAD)) {
 
-                HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER], i) {
+                UNIT_DEPENDENCY_SET_FOREACH(other, j->unit->dependencies[UNIT_AFTER], i) {
                         if (!other->job)
                                 continue;
 
@@ -1420,7 +1425,7 @@ int job_get_before(Job *j, Job*** ret) {
                 }
         }
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(other, j->unit->dependencies[UNIT_BEFORE], i) {
                 if (!other->job)
                         continue;
 
@@ -1444,7 +1449,6 @@ int job_get_after(Job *j, Job*** ret) {
         _cleanup_free_ Job** list = NULL;
         size_t n = 0, n_allocated = 0;
         Unit *other = NULL;
-        void *v;
         Iterator i;
 
         assert(j);
@@ -1452,7 +1456,7 @@ int job_get_after(Job *j, Job*** ret) {
 
         /* Returns a list of all pending jobs that are waiting for this job to finish. */
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(other, j->unit->dependencies[UNIT_BEFORE], i) {
                 if (!other->job)
                         continue;
 
@@ -1469,7 +1473,7 @@ int job_get_after(Job *j, Job*** ret) {
 
         if (IN_SET(j->type, JOB_STOP, JOB_RESTART)) {
 
-                HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER], i) {
+                UNIT_DEPENDENCY_SET_FOREACH(other, j->unit->dependencies[UNIT_AFTER], i) {
                         if (!other->job)
                                 continue;
 
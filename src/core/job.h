@@ -25,6 +25,7 @@
 #include "sd-event.h"
 
 #include "list.h"
+#include "serialize.h"
 #include "unit-name.h"
 
 typedef struct Job Job;
@@ -184,7 +185,7 @@ int job_install_deserialized(Job *j);
 void job_uninstall(Job *j);
 void job_dump(Job *j, FILE*f, const char *prefix);
 int job_serialize(Job *j, FILE *f);
-int job_deserialize(Job *j, FILE *f);
+int job_deserialize(Job *j, Deserializer *d);
 int job_coldplug(Job *j);
 
 JobDependency* job_dependency_new(Job *subject, Job *object, bool matters, bool conflicts);
@@ -20,9 +20,11 @@
 
 
 #include "conf-parser.h"
+#include "fd-util.h"
 #include "fs-util.h"
 #include "load-dropin.h"
 #include "load-fragment.h"
+#include "load-prepare.h"
 #include "log.h"
 #include "stat-util.h"
 #include "string-util.h"
@@ -155,11 +157,28 @@ int unit_load_dropin(Unit *u) {
                         return log_oom();
         }
 
-        STRV_FOREACH(f, u->dropin_paths)
-                (void) config_parse(u->id, *f, NULL,
-                                    UNIT_VTABLE(u)->sections,
-                                    config_item_perf_lookup, load_fragment_gperf_lookup,
-                                    0, u);
+        STRV_FOREACH(f, u->dropin_paths) {
+                _cleanup_fclose_ FILE *file = NULL;
+                ConfigFile *prepared = NULL;
+                struct stat st;
+
+                /* Use the contents read ahead of time, if they are from the file we open now. Otherwise parse what we
+                 * opened, or leave it to config_parse() to report why we couldn't. */
+                file = fopen(*f, "re");
+                if (file && fstat(fileno(file), &st) >= 0)
+                        prepared = manager_get_prepared_file(u->manager, *f, &st);
+
+                if (prepared)
+                        (void) config_file_parse(u->id, prepared,
+                                                 UNIT_VTABLE(u)->sections,
+                                                 config_item_perf_lookup, load_fragment_gperf_lookup,
+                                                 0, u);
+                else
+                        (void) config_parse(u->id, *f, file,
+                                            UNIT_VTABLE(u)->sections,
+                                            config_item_perf_lookup, load_fragment_gperf_lookup,
+                                            0, u);
+        }
 
         u->dropin_mtime = now(CLOCK_REALTIME);
 
@@ -51,6 +51,7 @@
 #include "ioprio.h"
 #include "journal-util.h"
 #include "load-fragment.h"
+#include "load-prepare.h"
 #include "log.h"
 #include "missing.h"
 #include "mount-util.h"
@@ -1727,7 +1728,7 @@ int config_parse_trigger_unit(
         assert(rvalue);
         assert(data);
 
-        if (!hashmap_isempty(u->dependencies[UNIT_TRIGGERS])) {
+        if (!unit_dependency_set_isempty(u->dependencies[UNIT_TRIGGERS])) {
                 log_syntax(unit, LOG_ERR, filename, line, 0, "Multiple units to trigger specified, ignoring: %s", rvalue);
                 return 0;
         }
@@ -4684,6 +4685,7 @@ static int load_from_path(Unit *u, const char *path) {
         _cleanup_set_free_free_ Set *symlink_names = NULL;
         _cleanup_fclose_ FILE *f = NULL;
         _cleanup_free_ char *filename = NULL;
+        ConfigFile *prepared = NULL;
         char *id = NULL;
         Unit *merged;
         struct stat st;
@@ -4774,11 +4776,20 @@ static int load_from_path(Unit *u, const char *path) {
                 u->load_state = UNIT_LOADED;
                 u->fragment_mtime = timespec_load(&st.st_mtim);
 
+                /* Use the contents read ahead of time, if they are from the file we just opened */
+                prepared = manager_get_prepared_file(u->manager, filename, &st);
+
                 /* Now, parse the file contents */
-                r = config_parse(u->id, filename, f,
-                                 UNIT_VTABLE(u)->sections,
-                                 config_item_perf_lookup, load_fragment_gperf_lookup,
-                                 CONFIG_PARSE_ALLOW_INCLUDE, u);
+                if (prepared)
+                        r = config_file_parse(u->id, prepared,
+                                              UNIT_VTABLE(u)->sections,
+                                              config_item_perf_lookup, load_fragment_gperf_lookup,
+                                              CONFIG_PARSE_ALLOW_INCLUDE, u);
+                else
+                        r = config_parse(u->id, filename, f,
+                                         UNIT_VTABLE(u)->sections,
+                                         config_item_perf_lookup, load_fragment_gperf_lookup,
+                                         CONFIG_PARSE_ALLOW_INCLUDE, u);
                 if (r < 0)
                         return r;
         }
@@ -0,0 +1,262 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "hashmap.h"
+#include "load-dropin.h"
+#include "load-prepare.h"
+#include "log.h"
+#include "path-util.h"
+#include "set.h"
+#include "strv.h"
+#include "thread-pool.h"
+#include "unit-name.h"
+#include "unit.h"
+
+/* When many units are queued for loading, at boot or after a reload, reading and splitting up their unit files is
+ * done on the thread pool first. Only the files we already know exist from the unit path cache are read, and the
+ * parsers are still run on the main thread when the units are loaded, as they modify the units and the manager.
+ * Anything that isn't found prepared here, for example because it is a symlink or appeared only later, is simply
+ * read when it is needed, as before. */
+
+#define PREPARE_FILES_MIN 16U
+#define PREPARE_JOBS_MAX 16U
+
+typedef struct PrepareJob {
+        char **paths;
+        ConfigFile **files;
+        size_t n_paths;
+        size_t offset;
+        size_t stride;
+} PrepareJob;
+
+static void prepare_job_run(void *userdata) {
+        PrepareJob *j = userdata;
+        size_t i;
+
+        /* Called in a worker thread, hence must not log, nor touch anything but the job */
+
+        for (i = j->offset; i < j->n_paths; i += j->stride) {
+                _cleanup_fclose_ FILE *f = NULL;
+
+                f = fopen(j->paths[i], "re");
+                if (!f)
+                        continue;
+
+                (void) config_file_read(j->paths[i], f, 0, j->files + i);
+        }
+}
+
+static char *find_fragment(Manager *m, const char *name) {
+        char **p;
+
+        STRV_FOREACH(p, m->lookup_paths.search_path) {
+                char *fn;
+
+                fn = path_make_absolute(name, *p);
+                if (!fn)
+                        return NULL;
+
+                if (set_contains(m->unit_path_cache, fn))
+                        return fn;
+
+                free(fn);
+        }
+
+        return NULL;
+}
+
+static int add_path(Manager *m, Set *paths, char *fn) {
+
+        /* Takes possession of fn */
+
+        if (hashmap_contains(m->prepared_files, fn)) {
+                free(fn);
+                return 0;
+        }
+
+        return set_consume(paths, fn);
+}
+
+static int unit_collect_files(Unit *u, Set *paths) {
+        _cleanup_strv_free_ char **dropins = NULL;
+        char *fn, **f;
+        int r;
+
+        assert(u);
+        assert(paths);
+
+        fn = find_fragment(u->manager, u->id);
+        if (!fn && u->instance) {
+                _cleanup_free_ char *template = NULL;
+
+                r = unit_name_template(u->id, &template);
+                if (r < 0)
+                        return r;
+
+                fn = find_fragment(u->manager, template);
+        }
+        if (fn) {
+                r = add_path(u->manager, paths, fn);
+                if (r < 0)
+                        return r;
+        }
+
+        if (unit_find_dropin_paths(u, &dropins) <= 0)
+                return 0;
+
+        STRV_FOREACH(f, dropins) {
+                fn = strdup(*f);
+                if (!fn)
+                        return -ENOMEM;
+
+                r = add_path(u->manager, paths, fn);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+int manager_prepare_load_queue(Manager *m) {
+        _cleanup_set_free_free_ Set *paths = NULL;
+        _cleanup_free_ ConfigFile **files = NULL;
+        _cleanup_free_ char **l = NULL;
+        PrepareJob jobs[PREPARE_JOBS_MAX];
+        ThreadJob *handles[PREPARE_JOBS_MAX] = {};
+        size_t n, n_jobs, i;
+        long ncpus;
+        Unit *u;
+        int r;
+
+        assert(m);
+
+        /* Returns the number of files that were read */
+
+        paths = set_new(&string_hash_ops);
+        if (!paths)
+                return -ENOMEM;
+
+        LIST_FOREACH(load_queue, u, m->load_queue) {
+                if (u->load_prepared)
+                        continue;
+
+                u->load_prepared = true;
+
+                if (!m->unit_path_cache || u->transient || u->load_state != UNIT_STUB)
+                        continue;
+
+                r = unit_collect_files(u, paths);
+                if (r < 0)
+                        return r;
+        }
+
+        n = set_size(paths);
+        if (n < PREPARE_FILES_MIN)
+                return 0;
+
+        l = set_get_strv(paths);
+        if (!l)
+                return -ENOMEM;
+
+        files = new0(ConfigFile*, n);
+        if (!files)
+                return -ENOMEM;
+
+        r = hashmap_ensure_allocated(&m->prepared_files, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_jobs = MIN3(n / PREPARE_FILES_MIN, (size_t) MAX(ncpus, 1L), PREPARE_JOBS_MAX);
+
+        for (i = 0; i < n_jobs; i++)
+                jobs[i] = (PrepareJob) {
+                        .paths = l,
+                        .files = files,
+                        .n_paths = n,
+                        .offset = i,
+                        .stride = n_jobs,
+                };
+
+        /* The first job is ours, the others go to the pool, or are run here too if that fails */
+        for (i = 1; i < n_jobs; i++)
+                if (thread_pool_submit(thread_pool_default(), prepare_job_run, jobs + i, handles + i) < 0)
+                        handles[i] = NULL;
+
+        prepare_job_run(jobs);
+
+        for (i = 1; i < n_jobs; i++) {
+                if (handles[i])
+                        (void) thread_job_join(handles[i]);
+                else
+                        prepare_job_run(jobs + i);
+        }
+
+        for (i = 0; i < n; i++) {
+                if (!files[i])
+                        continue;
+
+                r = hashmap_put(m->prepared_files, config_file_filename(files[i]), files[i]);
+                if (r < 0)
+                        config_file_free(files[i]);
+        }
+
+        log_debug("Read %zu unit files in %zu threads.", n, n_jobs);
+
+        return (int) n;
+}
+
+ConfigFile *manager_get_prepared_file(Manager *m, const char *path, const struct stat *st) {
+        ConfigFile *cf;
+        const struct stat *pst;
+
+        assert(m);
+        assert(path);
+        assert(st);
+
+        /* Returns the contents read ahead of time only if they are from the file the caller opened, i.e. it wasn't
+         * replaced or modified in the meantime */
+
+        cf = hashmap_get(m->prepared_files, path);
+        if (!cf)
+                return NULL;
+
+        pst = config_file_stat(cf);
+        if (pst->st_dev != st->st_dev ||
+            pst->st_ino != st->st_ino ||
+            timespec_load(&pst->st_mtim) != timespec_load(&st->st_mtim))
+                return NULL;
+
+        return cf;
+}
+
+void manager_flush_prepared_files(Manager *m) {
+        ConfigFile *cf;
+
+        assert(m);
+
+        while ((cf = hashmap_steal_first(m->prepared_files)))
+                config_file_free(cf);
+
+        m->prepared_files = hashmap_free(m->prepared_files);
+}
@@ -55,6 +55,7 @@
 #include "dirent-util.h"
 #include "env-util.h"
 #include "escape.h"
+#include "event-util.h"
 #include "exec-util.h"
 #include "execute.h"
 #include "exit-status.h"
@@ -64,6 +65,7 @@
 #include "hashmap.h"
 #include "io-util.h"
 #include "label.h"
+#include "load-prepare.h"
 #include "locale-setup.h"
 #include "log.h"
 #include "macro.h"
@@ -76,6 +78,7 @@
 #include "process-util.h"
 #include "ratelimit.h"
 #include "rm-rf.h"
+#include "serialize.h"
 #include "signal-util.h"
 #include "special.h"
 #include "stat-util.h"
@@ -86,6 +89,7 @@
 #include "time-util.h"
 #include "transaction.h"
 #include "umask-util.h"
+#include "unit-metrics.h"
 #include "unit-name.h"
 #include "user-util.h"
 #include "util.h"
@@ -100,6 +104,9 @@
 #define JOBS_IN_PROGRESS_PERIOD_USEC (USEC_PER_SEC / 3)
 #define JOBS_IN_PROGRESS_PERIOD_DIVISOR 3
 
+/* The maximum number of units and jobs to generate change signals for per event loop iteration */
+#define MANAGER_BUS_MESSAGE_BUDGET 10000U
+
 static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_cgroups_agent_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_signal_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
@@ -110,6 +117,7 @@ static int manager_dispatch_jobs_in_progress(sd_event_source *source, usec_t use
 static int manager_dispatch_run_queue(sd_event_source *source, void *userdata);
 static int manager_run_environment_generators(Manager *m);
 static int manager_run_generators(Manager *m);
+static int manager_refresh_generators(Manager *m);
 
 static void manager_watch_jobs_in_progress(Manager *m) {
         usec_t next;
@@ -622,6 +630,7 @@ int manager_new(UnitFileScope scope, unsigned test_run_flags, Manager **_m) {
         m->default_timeout_start_usec = DEFAULT_TIMEOUT_USEC;
         m->default_timeout_stop_usec = DEFAULT_TIMEOUT_USEC;
         m->default_restart_usec = DEFAULT_RESTART_USEC;
+        m->cgroup_realize_iteration = 1; /* Units start out with 0, i.e. never queued */
 
 #if ENABLE_EFI
         if (MANAGER_IS_SYSTEM(m) && detect_container() <= 0)
@@ -667,7 +676,7 @@ int manager_new(UnitFileScope scope, unsigned test_run_flags, Manager **_m) {
         if (r < 0)
                 goto fail;
 
-        r = hashmap_ensure_allocated(&m->units, &string_hash_ops);
+        r = flat_hashmap_ensure_allocated(&m->units, &string_hash_ops);
         if (r < 0)
                 goto fail;
 
@@ -687,6 +696,10 @@ int manager_new(UnitFileScope scope, unsigned test_run_flags, Manager **_m) {
         if (r < 0)
                 goto fail;
 
+        /* Collecting per event source dispatch statistics is cheap, and they are very useful to find out what we
+         * are busy with. They are included in the state dump. */
+        (void) event_set_profile(m->event, true);
+
         r = sd_event_add_defer(m->event, &m->run_queue_event_source, manager_dispatch_run_queue, m);
         if (r < 0)
                 goto fail;
@@ -980,12 +993,11 @@ enum {
 static void unit_gc_mark_good(Unit *u, unsigned gc_marker) {
         Unit *other;
         Iterator i;
-        void *v;
 
         u->gc_marker = gc_marker + GC_OFFSET_GOOD;
 
         /* Recursively mark referenced units as GOOD as well */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REFERENCES], i)
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_REFERENCES], i)
                 if (other->gc_marker == gc_marker + GC_OFFSET_UNSURE)
                         unit_gc_mark_good(other, gc_marker);
 }
@@ -994,7 +1006,6 @@ static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
         Unit *other;
         bool is_bad;
         Iterator i;
-        void *v;
 
         assert(u);
 
@@ -1012,7 +1023,7 @@ static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
 
         is_bad = true;
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REFERENCED_BY], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_REFERENCED_BY], i) {
                 unit_gc_sweep(other, gc_marker);
 
                 if (other->gc_marker == gc_marker + GC_OFFSET_GOOD)
@@ -1107,7 +1118,7 @@ static void manager_clear_jobs_and_units(Manager *m) {
 
         assert(m);
 
-        while ((u = hashmap_first(m->units)))
+        while ((u = flat_hashmap_first(m->units)))
                 unit_free(u);
 
         manager_dispatch_cleanup_queue(m);
@@ -1121,7 +1132,7 @@ static void manager_clear_jobs_and_units(Manager *m) {
         assert(!m->gc_job_queue);
 
         assert(hashmap_isempty(m->jobs));
-        assert(hashmap_isempty(m->units));
+        assert(flat_hashmap_isempty(m->units));
 
         m->n_on_console = 0;
         m->n_running_jobs = 0;
@@ -1151,7 +1162,7 @@ Manager* manager_free(Manager *m) {
         dynamic_user_vacuum(m, false);
         hashmap_free(m->dynamic_users);
 
-        hashmap_free(m->units);
+        flat_hashmap_free(m->units);
         hashmap_free(m->units_by_invocation_id);
         hashmap_free(m->jobs);
         hashmap_free(m->watch_pids1);
@@ -1167,6 +1178,7 @@ Manager* manager_free(Manager *m) {
         sd_event_source_unref(m->time_change_event_source);
         sd_event_source_unref(m->jobs_in_progress_event_source);
         sd_event_source_unref(m->run_queue_event_source);
+        sd_event_source_unref(m->metrics_event_source);
         sd_event_source_unref(m->user_lookup_event_source);
 
         safe_close(m->signal_fd);
@@ -1189,6 +1201,9 @@ Manager* manager_free(Manager *m) {
 
         hashmap_free(m->cgroup_unit);
         set_free_free(m->unit_path_cache);
+        manager_flush_prepared_files(m);
+        exec_timing_free_many(m->generator_timings, m->n_generator_timings);
+        trace_done(&m->trace);
 
         free(m->switch_root);
         free(m->switch_root_init);
@@ -1209,10 +1224,13 @@ Manager* manager_free(Manager *m) {
 }
 
 void manager_enumerate(Manager *m) {
+        usec_t ts;
         UnitType c;
 
         assert(m);
 
+        ts = now(CLOCK_MONOTONIC);
+
         /* Let's ask every type to load all units from disk/kernel
          * that it might know */
         for (c = 0; c < _UNIT_TYPE_MAX; c++) {
@@ -1228,18 +1246,23 @@ void manager_enumerate(Manager *m) {
         }
 
         manager_dispatch_load_queue(m);
+
+        trace_span_pinned(&m->trace, "enumerate", NULL, ts);
 }
 
 static void manager_coldplug(Manager *m) {
         Iterator i;
+        usec_t ts;
         Unit *u;
         char *k;
         int r;
 
         assert(m);
 
+        ts = now(CLOCK_MONOTONIC);
+
         /* Then, let's set up their initial state. */
-        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+        FLAT_HASHMAP_FOREACH_KEY(u, k, m->units, i) {
 
                 /* ignore aliases */
                 if (u->id != k)
@@ -1249,56 +1272,37 @@ static void manager_coldplug(Manager *m) {
                 if (r < 0)
                         log_warning_errno(r, "We couldn't coldplug %s, proceeding anyway: %m", u->id);
         }
+
+        trace_span_pinned(&m->trace, "coldplug", NULL, ts);
 }
 
 static void manager_build_unit_path_cache(Manager *m) {
-        char **i;
         int r;
 
         assert(m);
 
-        set_free_free(m->unit_path_cache);
-
-        m->unit_path_cache = set_new(&string_hash_ops);
-        if (!m->unit_path_cache) {
-                r = -ENOMEM;
-                goto fail;
-        }
-
-        /* This simply builds a list of files we know exist, so that
-         * we don't always have to go to disk */
-
-        STRV_FOREACH(i, m->lookup_paths.search_path) {
-                _cleanup_closedir_ DIR *d = NULL;
-                struct dirent *de;
+        m->unit_path_cache = set_free_free(m->unit_path_cache);
 
-                d = opendir(*i);
-                if (!d) {
-                        if (errno != ENOENT)
-                                log_warning_errno(errno, "Failed to open directory %s, ignoring: %m", *i);
-                        continue;
-                }
+        /* Everything in the unit directories that is older than this has been seen by the units loaded after
+         * this point, see manager_reload_incremental() */
+        m->unit_path_cache_timestamp = now(CLOCK_REALTIME);
 
-                FOREACH_DIRENT(de, d, r = -errno; goto fail) {
-                        char *p;
+        /* This simply builds a list of files we know exist, so that we don't always have to go to disk. The
+         * listings come from the unit file index, which only reads the directories that changed since it was
+         * last updated, and shares them with systemctl. */
 
-                        p = strjoin(streq(*i, "/") ? "" : *i, "/", de->d_name);
-                        if (!p) {
-                                r = -ENOMEM;
-                                goto fail;
-                        }
+        r = lookup_paths_load_index(&m->lookup_paths);
+        if (r < 0)
+                goto fail;
 
-                        r = set_consume(m->unit_path_cache, p);
-                        if (r < 0)
-                                goto fail;
-                }
-        }
+        r = unit_file_index_to_set(m->lookup_paths.index, &m->unit_path_cache);
+        if (r < 0)
+                goto fail;
 
         return;
 
 fail:
         log_warning_errno(r, "Failed to build unit path cache, proceeding without: %m");
-        m->unit_path_cache = set_free_free(m->unit_path_cache);
 }
 
 static void manager_distribute_fds(Manager *m, FDSet *fds) {
@@ -1307,7 +1311,7 @@ static void manager_distribute_fds(Manager *m, FDSet *fds) {
 
         assert(m);
 
-        HASHMAP_FOREACH(u, m->units, i) {
+        FLAT_HASHMAP_FOREACH(u, m->units, i) {
 
                 if (fdset_size(fds) <= 0)
                         break;
@@ -1422,6 +1426,10 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
         manager_vacuum_uid_refs(m);
         manager_vacuum_gid_refs(m);
 
+        r = manager_setup_metrics(m);
+        if (r < 0)
+                log_warning_errno(r, "Failed to set up metrics timer, ignoring: %m");
+
         if (serialization) {
                 assert(m->n_reloading > 0);
                 m->n_reloading--;
@@ -1438,6 +1446,7 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
 int manager_add_job(Manager *m, JobType type, Unit *unit, JobMode mode, sd_bus_error *e, Job **_ret) {
         int r;
         Transaction *tr;
+        usec_t ts;
 
         assert(m);
         assert(type < _JOB_TYPE_MAX);
@@ -1458,6 +1467,8 @@ int manager_add_job(Manager *m, JobType type, Unit *unit, JobMode mode, sd_bus_e
         if (!tr)
                 return -ENOMEM;
 
+        ts = now(CLOCK_MONOTONIC);
+
         r = transaction_add_job_and_dependencies(tr, type, unit, NULL, true, false,
                                                  IN_SET(mode, JOB_IGNORE_DEPENDENCIES, JOB_IGNORE_REQUIREMENTS),
                                                  mode == JOB_IGNORE_DEPENDENCIES, e);
@@ -1470,7 +1481,11 @@ int manager_add_job(Manager *m, JobType type, Unit *unit, JobMode mode, sd_bus_e
                         goto tr_abort;
         }
 
+        trace_span(&m->trace, "transaction-build", unit->id, ts);
+        ts = now(CLOCK_MONOTONIC);
+
         r = transaction_activate(tr, m, mode, e);
+        trace_span(&m->trace, "transaction-activate", unit->id, ts);
         if (r < 0)
                 goto tr_abort;
 
@@ -1567,12 +1582,14 @@ Unit *manager_get_unit(Manager *m, const char *name) {
         assert(m);
         assert(name);
 
-        return hashmap_get(m->units, name);
+        return flat_hashmap_get(m->units, name);
 }
 
 unsigned manager_dispatch_load_queue(Manager *m) {
         Unit *u;
         unsigned n = 0;
+        usec_t ts;
+        int r;
 
         assert(m);
 
@@ -1588,10 +1605,25 @@ unsigned manager_dispatch_load_queue(Manager *m) {
         while ((u = m->load_queue)) {
                 assert(u->in_load_queue);
 
+                /* Read the files of this unit and everything else queued with it in one go. Units queued while
+                 * loading these will be read in the next batch. */
+                if (!u->load_prepared) {
+                        ts = now(CLOCK_MONOTONIC);
+                        r = manager_prepare_load_queue(m);
+                        if (r < 0)
+                                log_debug_errno(r, "Failed to read unit files ahead of loading, ignoring: %m");
+                        trace_span(&m->trace, "load-prepare", NULL, ts);
+                }
+
+                /* The unit might be merged into another one, but is only freed later, hence u->id stays valid */
+                ts = now(CLOCK_MONOTONIC);
                 unit_load(u);
+                trace_span(&m->trace, "load", u->id, ts);
                 n++;
         }
 
+        manager_flush_prepared_files(m);
+
         m->dispatching_load_queue = false;
         return n;
 }
@@ -1707,7 +1739,7 @@ void manager_dump_units(Manager *s, FILE *f, const char *prefix) {
         assert(s);
         assert(f);
 
-        HASHMAP_FOREACH_KEY(u, t, s->units, i)
+        FLAT_HASHMAP_FOREACH_KEY(u, t, s->units, i)
                 if (u->id == t)
                         unit_dump(u, f, prefix);
 }
@@ -1728,6 +1760,8 @@ void manager_dump(Manager *m, FILE *f, const char *prefix) {
                                 format_timestamp(buf, sizeof(buf), m->timestamps[q].realtime));
         }
 
+        event_dump_profile(m->event, f, prefix);
+
         manager_dump_units(m, f, prefix);
         manager_dump_jobs(m, f, prefix);
 }
@@ -1795,41 +1829,62 @@ static int manager_dispatch_run_queue(sd_event_source *source, void *userdata) {
 }
 
 static unsigned manager_dispatch_dbus_queue(Manager *m) {
+        unsigned n = 0, budget = MANAGER_BUS_MESSAGE_BUDGET;
         Job *j;
         Unit *u;
-        unsigned n = 0;
 
         assert(m);
 
+        m->dbus_queue_budget_spent = false;
+
         if (m->dispatching_dbus_queue)
                 return 0;
 
+        /* Each unit and job is queued only once, no matter how often it changed, so that we send one signal with
+         * its latest state. On connections whose clients don't read our messages fast enough, the signals are held
+         * back further, see bus_defer_change_signal(). Send those first that can go out now. */
+
         m->dispatching_dbus_queue = true;
 
-        while ((u = m->dbus_unit_queue)) {
+        n = bus_dispatch_deferred_signals(m, budget);
+        budget -= n;
+
+        while (budget > 0 && (u = m->dbus_unit_queue)) {
                 assert(u->in_dbus_queue);
 
                 bus_unit_send_change_signal(u);
-                n++;
+                n++, budget--;
         }
 
-        while ((j = m->dbus_job_queue)) {
+        while (budget > 0 && (j = m->dbus_job_queue)) {
                 assert(j->in_dbus_queue);
 
                 bus_job_send_change_signal(j);
-                n++;
+                n++, budget--;
         }
 
         m->dispatching_dbus_queue = false;
 
+        /* The reload completion and the method reply are never held back, nor counted against the budget */
+
         if (m->send_reloading_done) {
                 m->send_reloading_done = false;
 
                 bus_manager_send_reloading(m, false);
+                n++;
         }
 
-        if (m->queued_message)
+        if (m->queued_message) {
                 bus_send_queued_message(m);
+                n++;
+        }
+
+        /* Don't spend too much time in one go generating signals either. If the budget is spent, return to the
+         * event loop to process what is pending there, and come back right after, see manager_loop(). */
+        if (budget <= 0) {
+                m->dbus_queue_budget_spent = true;
+                return 0;
+        }
 
         return n;
 }
@@ -2340,7 +2395,7 @@ static int manager_dispatch_time_change_fd(sd_event_source *source, int fd, uint
 
         manager_setup_time_change(m);
 
-        HASHMAP_FOREACH(u, m->units, i)
+        FLAT_HASHMAP_FOREACH(u, m->units, i)
                 if (UNIT_VTABLE(u)->time_change)
                         UNIT_VTABLE(u)->time_change(u);
 
@@ -2435,6 +2490,10 @@ int manager_loop(Manager *m) {
                 } else
                         wait_usec = USEC_INFINITY;
 
+                /* There are more change signals to send, only look for pending events */
+                if (m->dbus_queue_budget_spent)
+                        wait_usec = 0;
+
                 r = sd_event_run(m->event, wait_usec);
                 if (r < 0)
                         return log_error_errno(r, "Failed to run event loop: %m");
@@ -2697,7 +2756,7 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
 
         fputc_unlocked('\n', f);
 
-        HASHMAP_FOREACH_KEY(u, t, m->units, i) {
+        FLAT_HASHMAP_FOREACH_KEY(u, t, m->units, i) {
                 if (u->id != t)
                         continue;
 
@@ -2726,6 +2785,7 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
 }
 
 int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
+        _cleanup_deserializer_free_ Deserializer *d = NULL;
         int r = 0;
 
         assert(m);
@@ -2735,26 +2795,21 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
 
         m->n_reloading++;
 
-        for (;;) {
-                char line[LINE_MAX];
-                const char *val, *l;
+        r = deserializer_new(f, &d);
+        if (r < 0)
+                goto finish;
 
-                if (!fgets(line, sizeof(line), f)) {
-                        if (feof(f))
-                                r = 0;
-                        else
-                                r = -errno;
+        for (;;) {
+                const char *l, *val;
 
+                r = deserializer_read(d, &l, &val);
+                if (r <= 0)
                         goto finish;
-                }
-
-                char_array_0(line);
-                l = strstrip(line);
 
                 if (l[0] == 0)
                         break;
 
-                if ((val = startswith(l, "current-job-id="))) {
+                if (streq(l, "current-job-id")) {
                         uint32_t id;
 
                         if (safe_atou32(val, &id) < 0)
@@ -2762,7 +2817,7 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                         else
                                 m->current_job_id = MAX(m->current_job_id, id);
 
-                } else if ((val = startswith(l, "n-installed-jobs="))) {
+                } else if (streq(l, "n-installed-jobs")) {
                         uint32_t n;
 
                         if (safe_atou32(val, &n) < 0)
@@ -2770,7 +2825,7 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                         else
                                 m->n_installed_jobs += n;
 
-                } else if ((val = startswith(l, "n-failed-jobs="))) {
+                } else if (streq(l, "n-failed-jobs")) {
                         uint32_t n;
 
                         if (safe_atou32(val, &n) < 0)
@@ -2778,7 +2833,7 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                         else
                                 m->n_failed_jobs += n;
 
-                } else if ((val = startswith(l, "taint-usr="))) {
+                } else if (streq(l, "taint-usr")) {
                         int b;
 
                         b = parse_boolean(val);
@@ -2787,7 +2842,7 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                         else
                                 m->taint_usr = m->taint_usr || b;
 
-                } else if ((val = startswith(l, "ready-sent="))) {
+                } else if (streq(l, "ready-sent")) {
                         int b;
 
                         b = parse_boolean(val);
@@ -2796,14 +2851,14 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                         else
                                 m->ready_sent = m->ready_sent || b;
 
-                } else if (startswith(l, "env=")) {
-                        r = deserialize_environment(&m->environment, l);
+                } else if (streq(l, "env")) {
+                        r = deserialize_environment(&m->environment, strjoina("env=", val));
                         if (r == -ENOMEM)
                                 goto finish;
                         if (r < 0)
-                                log_notice_errno(r, "Failed to parse environment entry: \"%s\": %m", l);
+                                log_notice_errno(r, "Failed to parse environment entry: \"%s\": %m", val);
 
-                } else if ((val = startswith(l, "notify-fd="))) {
+                } else if (streq(l, "notify-fd")) {
                         int fd;
 
                         if (safe_atoi(val, &fd) < 0 || fd < 0 || !fdset_contains(fds, fd))
@@ -2814,7 +2869,7 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                                 m->notify_fd = fdset_remove(fds, fd);
                         }
 
-                } else if ((val = startswith(l, "notify-socket="))) {
+                } else if (streq(l, "notify-socket")) {
                         char *n;
 
                         n = strdup(val);
@@ -2826,7 +2881,7 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                         free(m->notify_socket);
                         m->notify_socket = n;
 
-                } else if ((val = startswith(l, "cgroups-agent-fd="))) {
+                } else if (streq(l, "cgroups-agent-fd")) {
                         int fd;
 
                         if (safe_atoi(val, &fd) < 0 || fd < 0 || !fdset_contains(fds, fd))
@@ -2837,7 +2892,7 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                                 m->cgroups_agent_fd = fdset_remove(fds, fd);
                         }
 
-                } else if ((val = startswith(l, "user-lookup="))) {
+                } else if (streq(l, "user-lookup")) {
                         int fd0, fd1;
 
                         if (sscanf(val, "%i %i", &fd0, &fd1) != 2 || fd0 < 0 || fd1 < 0 || fd0 == fd1 || !fdset_contains(fds, fd0) || !fdset_contains(fds, fd1))
@@ -2849,13 +2904,13 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                                 m->user_lookup_fds[1] = fdset_remove(fds, fd1);
                         }
 
-                } else if ((val = startswith(l, "dynamic-user=")))
+                } else if (streq(l, "dynamic-user"))
                         dynamic_user_deserialize_one(m, val, fds);
-                else if ((val = startswith(l, "destroy-ipc-uid=")))
+                else if (streq(l, "destroy-ipc-uid"))
                         manager_deserialize_uid_refs_one(m, val);
-                else if ((val = startswith(l, "destroy-ipc-gid=")))
+                else if (streq(l, "destroy-ipc-gid"))
                         manager_deserialize_gid_refs_one(m, val);
-                else if ((val = startswith(l, "subscribed="))) {
+                else if (streq(l, "subscribed")) {
 
                         if (strv_extend(&m->deserialized_subscribed, val) < 0)
                                 log_oom();
@@ -2863,50 +2918,46 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                         ManagerTimestamp q;
 
                         for (q = 0; q < _MANAGER_TIMESTAMP_MAX; q++) {
-                                val = startswith(l, manager_timestamp_to_string(q));
-                                if (!val)
-                                        continue;
+                                const char *t;
 
-                                val = startswith(val, "-timestamp=");
-                                if (val)
+                                t = startswith(l, manager_timestamp_to_string(q));
+                                if (t && streq(t, "-timestamp"))
                                         break;
                         }
 
                         if (q < _MANAGER_TIMESTAMP_MAX) /* found it */
                                 dual_timestamp_deserialize(val, m->timestamps + q);
-                        else if (!startswith(l, "kdbus-fd=")) /* ignore kdbus */
+                        else if (!streq(l, "kdbus-fd")) /* ignore kdbus */
                                 log_notice("Unknown serialization item '%s'", l);
                 }
         }
 
         for (;;) {
+                _cleanup_free_ char *unit_name = NULL;
+                const char *l, *val;
                 Unit *u;
-                char name[UNIT_NAME_MAX+2];
-                const char* unit_name;
 
                 /* Start marker */
-                if (!fgets(name, sizeof(name), f)) {
-                        if (feof(f))
-                                r = 0;
-                        else
-                                r = -errno;
+                r = deserializer_read(d, &l, &val);
+                if (r <= 0)
+                        goto finish;
 
+                unit_name = strdup(l);
+                if (!unit_name) {
+                        r = -ENOMEM;
                         goto finish;
                 }
 
-                char_array_0(name);
-                unit_name = strstrip(name);
-
                 r = manager_load_unit(m, unit_name, NULL, NULL, &u);
                 if (r < 0) {
                         log_notice_errno(r, "Failed to load unit \"%s\", skipping deserialization: %m", unit_name);
                         if (r == -ENOMEM)
                                 goto finish;
-                        unit_deserialize_skip(f);
+                        unit_deserialize_skip(d);
                         continue;
                 }
 
-                r = unit_deserialize(u, f, fds);
+                r = unit_deserialize(u, d, fds);
                 if (r < 0) {
                         log_notice_errno(r, "Failed to deserialize unit \"%s\": %m", unit_name);
                         if (r == -ENOMEM)
@@ -2925,13 +2976,24 @@ finish:
 }
 
 int manager_reload(Manager *m) {
+        char timespan[FORMAT_TIMESPAN_MAX];
         int r, q;
         _cleanup_fclose_ FILE *f = NULL;
         _cleanup_fdset_free_ FDSet *fds = NULL;
+        _cleanup_close_ int fd = -1;
+        usec_t begin;
 
         assert(m);
 
-        r = manager_open_serialization(m, &f);
+        begin = now(CLOCK_MONOTONIC);
+
+        /* Unlike when reexecuting, the serialized state never leaves this process, hence we can use the more
+         * compact binary encoding, without caring for compatibility with other versions. */
+        fd = open_serialization_fd("systemd-state");
+        if (fd < 0)
+                return fd;
+
+        r = serialize_open_binary(fd, &f);
         if (r < 0)
                 return r;
 
@@ -2950,11 +3012,26 @@ int manager_reload(Manager *m) {
                 return r;
         }
 
-        if (fseeko(f, 0, SEEK_SET) < 0) {
+        /* Closing the stream flushes the encoder, and is where encoding errors are reported */
+        r = fclose(f);
+        f = NULL;
+        if (r != 0) {
                 m->n_reloading--;
                 return -errno;
         }
 
+        if (lseek(fd, 0, SEEK_SET) < 0) {
+                m->n_reloading--;
+                return -errno;
+        }
+
+        f = fdopen(fd, "re");
+        if (!f) {
+                m->n_reloading--;
+                return -errno;
+        }
+        fd = -1;
+
         /* From here on there is no way back. */
         manager_clear_jobs_and_units(m);
         lookup_paths_flush_generator(&m->lookup_paths);
@@ -3021,6 +3098,387 @@ int manager_reload(Manager *m) {
         if (m->api_bus)
                 manager_sync_bus_names(m, m->api_bus);
 
+        /* MetricsIntervalSec= might have changed */
+        q = manager_setup_metrics(m);
+        if (q < 0)
+                log_warning_errno(q, "Failed to set up metrics timer, ignoring: %m");
+
+        assert(m->n_reloading > 0);
+        m->n_reloading--;
+
+        m->send_reloading_done = true;
+
+        log_debug("Reloading of %u unit names took %s.",
+                  flat_hashmap_size(m->units),
+                  format_timespan(timespan, sizeof(timespan), now(CLOCK_MONOTONIC) - begin, USEC_PER_MSEC));
+
+        return r;
+}
+
+static int changed_names_add(Set *names, const char *path) {
+        char *n, *e;
+
+        n = strdup(basename(path));
+        if (!n)
+                return -ENOMEM;
+
+        /* Drop-in and .wants/.requires directories refer to the unit they are named after */
+        e = endswith(n, ".d") ?: endswith(n, ".wants") ?: endswith(n, ".requires");
+        if (e)
+                *e = 0;
+
+        return set_consume(names, n);
+}
+
+/* Directories modified less than this before the unit path cache was built are considered changed, as their mtime
+ * is taken from a coarse clock, and has a limited granularity on some file systems */
+#define RACY_USEC USEC_PER_SEC
+
+static int manager_find_changed_unit_files(Manager *m, Set *old_cache, usec_t since, Set **ret) {
+        _cleanup_set_free_free_ Set *names = NULL;
+        Iterator i;
+        char *p;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        /* Collects the names of all units that have unit files, drop-ins or .wants/.requires symlinks added or
+         * removed. We only compare the top level of the unit directories, as drop-in and .wants/.requires
+         * directories are not part of the unit path cache. Changes in those show in their mtime however. Changes
+         * to the contents of existing files are detected by unit_need_daemon_reload(). */
+
+        names = set_new(&string_hash_ops);
+        if (!names)
+                return -ENOMEM;
+
+        SET_FOREACH(p, m->unit_path_cache, i) {
+                struct stat st;
+
+                if (set_contains(old_cache, p)) {
+                        if (!endswith(p, ".d") && !endswith(p, ".wants") && !endswith(p, ".requires"))
+                                continue;
+
+                        if (stat(p, &st) < 0 || !S_ISDIR(st.st_mode) || timespec_load(&st.st_mtim) + RACY_USEC <= since)
+                                continue;
+                }
+
+                r = changed_names_add(names, p);
+                if (r < 0)
+                        return r;
+        }
+
+        SET_FOREACH(p, old_cache, i) {
+                if (set_contains(m->unit_path_cache, p))
+                        continue;
+
+                r = changed_names_add(names, p);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = names;
+        names = NULL;
+
+        return 0;
+}
+
+static bool lookup_paths_is_generated(const LookupPaths *p, const char *path) {
+        assert(p);
+        assert(path);
+
+        return path_equal_ptr(path, p->generator) ||
+                path_equal_ptr(path, p->generator_early) ||
+                path_equal_ptr(path, p->generator_late) ||
+                path_equal_ptr(path, p->transient);
+}
+
+static bool manager_search_path_changed(Manager *m, const LookupPaths *lp) {
+        char **a, **b;
+
+        assert(m);
+        assert(lp);
+
+        /* In test mode, the generator and transient directories are temporary directories, which differ each time
+         * the lookup paths are initialized, and the new ones don't exist, hence skip them on both sides */
+
+        if (!m->test_run_flags)
+                return !strv_equal(lp->search_path, m->lookup_paths.search_path);
+
+        a = m->lookup_paths.search_path;
+        b = lp->search_path;
+
+        for (;;) {
+                bool a_done, b_done;
+
+                while (a && *a && lookup_paths_is_generated(&m->lookup_paths, *a))
+                        a++;
+                while (b && *b && lookup_paths_is_generated(lp, *b))
+                        b++;
+
+                a_done = !a || !*a;
+                b_done = !b || !*b;
+                if (a_done || b_done)
+                        return a_done != b_done;
+
+                if (!path_equal(*a, *b))
+                        return true;
+
+                a++;
+                b++;
+        }
+}
+
+static bool unit_files_changed(Unit *u, Set *changed_names) {
+        Iterator i;
+        char *n;
+
+        assert(u);
+
+        if (!set_isempty(changed_names))
+                SET_FOREACH(n, u->names, i) {
+                        _cleanup_free_ char *template = NULL;
+
+                        if (set_contains(changed_names, n))
+                                return true;
+
+                        if (unit_name_template(n, &template) >= 0 && set_contains(changed_names, template))
+                                return true;
+                }
+
+        return unit_need_daemon_reload(u);
+}
+
+static bool manager_unit_file_is_alias(Manager *m, const char *name) {
+        char **dir;
+
+        assert(m);
+        assert(name);
+
+        /* Checks whether the first unit file found for the name is a symlink to a unit file of a different name,
+         * i.e. whether loading the name would merge the unit into another one */
+
+        STRV_FOREACH(dir, m->lookup_paths.search_path) {
+                _cleanup_free_ char *buf = NULL, *template = NULL;
+                const char *p, *target;
+                int r;
+
+                p = strjoina(*dir, "/", name);
+                if (!set_contains(m->unit_path_cache, p))
+                        continue;
+
+                /* The index knows the symlink targets already */
+                r = unit_file_index_lookup(m->lookup_paths.index, p, &target);
+                if (r == -ENODATA) {
+                        if (readlink_malloc(p, &buf) < 0)
+                                return false;
+
+                        target = buf;
+                } else if (r < 0 || !target)
+                        return false;
+
+                /* Masked */
+                if (null_or_empty_path(p) > 0)
+                        return false;
+
+                if (streq(basename(target), name))
+                        return false;
+
+                if (unit_name_template(name, &template) >= 0 && streq(basename(target), template))
+                        return false;
+
+                return true;
+        }
+
+        return false;
+}
+
+static bool manager_unit_may_reload_in_place(Manager *m, Unit *u) {
+        _cleanup_free_ char *template = NULL;
+
+        if (!unit_may_unload(u))
+                return false;
+
+        if (manager_unit_file_is_alias(m, u->id))
+                return false;
+
+        if (unit_name_template(u->id, &template) >= 0 && manager_unit_file_is_alias(m, template))
+                return false;
+
+        return true;
+}
+
+int manager_reload_incremental(Manager *m) {
+        _cleanup_lookup_paths_free_ LookupPaths lp = {};
+        _cleanup_set_free_free_ Set *old_cache = NULL, *changed_names = NULL;
+        _cleanup_deserializer_free_ Deserializer *d = NULL;
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_close_ int fd = -1;
+        _cleanup_free_ Unit **units = NULL;
+        size_t n_units = 0, n_allocated = 0, k;
+        char timespan[FORMAT_TIMESPAN_MAX];
+        usec_t begin, since;
+        Iterator i;
+        Unit *u;
+        char *id;
+        int r;
+
+        assert(m);
+
+        /* Reloads only the units whose unit files, drop-ins, .wants/.requires symlinks or generated units changed
+         * since they were loaded, leaving all other units alone. Each changed unit is serialized, unloaded, loaded
+         * again in place and deserialized. Returns the number of reloaded units, or -EOPNOTSUPP if the changes
+         * cannot be applied this way, in which case a full reload is required. Note that unlike a full reload this
+         * does not touch the manager's own configuration. */
+
+        if (!m->unit_path_cache)
+                return -EOPNOTSUPP;
+
+        begin = now(CLOCK_MONOTONIC);
+
+        r = manager_run_environment_generators(m);
+        if (r < 0)
+                log_warning_errno(r, "Failed to run environment generators, ignoring: %m");
+
+        r = manager_refresh_generators(m);
+        if (r < 0)
+                return -EOPNOTSUPP;
+
+        /* Directories that appeared in or disappeared from the search path need a full reload */
+        r = lookup_paths_init(&lp, m->unit_file_scope,
+                              m->test_run_flags ? LOOKUP_PATHS_TEMPORARY_GENERATED : 0,
+                              NULL);
+        if (r < 0)
+                return r;
+
+        /* We only need the paths, not the (still empty) temporary directory */
+        if (lp.temporary_dir)
+                (void) rmdir(lp.temporary_dir);
+
+        (void) lookup_paths_reduce(&lp);
+
+        if (manager_search_path_changed(m, &lp)) {
+                log_debug("Unit search path changed, full reload required.");
+                return -EOPNOTSUPP;
+        }
+
+        since = m->unit_path_cache_timestamp;
+        old_cache = m->unit_path_cache;
+        m->unit_path_cache = NULL;
+
+        manager_build_unit_path_cache(m);
+        if (!m->unit_path_cache)
+                return -EOPNOTSUPP;
+
+        r = manager_find_changed_unit_files(m, old_cache, since, &changed_names);
+        if (r < 0)
+                return r;
+
+        FLAT_HASHMAP_FOREACH_KEY(u, id, m->units, i) {
+
+                /* ignore aliases */
+                if (u->id != id)
+                        continue;
+
+                if (!unit_files_changed(u, changed_names))
+                        continue;
+
+                if (!manager_unit_may_reload_in_place(m, u)) {
+                        log_unit_debug(u, "Unit files of %s changed, but it cannot be reloaded in place, full reload required.", u->id);
+                        return -EOPNOTSUPP;
+                }
+
+                if (!GREEDY_REALLOC(units, n_allocated, n_units + 1))
+                        return -ENOMEM;
+
+                units[n_units++] = u;
+        }
+
+        if (n_units == 0) {
+                log_debug("No unit files changed, took %s.",
+                          format_timespan(timespan, sizeof(timespan), now(CLOCK_MONOTONIC) - begin, USEC_PER_MSEC));
+                return 0;
+        }
+
+        fds = fdset_new();
+        if (!fds)
+                return -ENOMEM;
+
+        fd = open_serialization_fd("systemd-state");
+        if (fd < 0)
+                return fd;
+
+        r = serialize_open_binary(fd, &f);
+        if (r < 0)
+                return r;
+
+        m->n_reloading++;
+        bus_manager_send_reloading(m, true);
+
+        for (k = 0; k < n_units; k++) {
+                r = unit_serialize(units[k], f, fds, false);
+                if (r < 0)
+                        goto finish;
+        }
+
+        r = fclose(f);
+        f = NULL;
+        if (r != 0) {
+                r = -errno;
+                goto finish;
+        }
+
+        if (lseek(fd, 0, SEEK_SET) < 0) {
+                r = -errno;
+                goto finish;
+        }
+
+        f = fdopen(fd, "re");
+        if (!f) {
+                r = -errno;
+                goto finish;
+        }
+        fd = -1;
+
+        r = deserializer_new(f, &d);
+        if (r < 0)
+                goto finish;
+
+        /* From here on there is no way back. */
+        for (k = 0; k < n_units; k++) {
+                log_unit_debug(units[k], "Unit files of %s changed, reloading.", units[k]->id);
+                unit_unload(units[k]);
+        }
+
+        manager_dispatch_load_queue(m);
+
+        for (k = 0; k < n_units; k++) {
+                r = unit_deserialize(units[k], d, fds);
+                if (r < 0) {
+                        log_unit_notice_errno(units[k], r, "Failed to deserialize unit \"%s\": %m", units[k]->id);
+                        if (r == -ENOMEM)
+                                goto finish;
+                }
+        }
+
+        for (k = 0; k < n_units; k++) {
+                r = unit_coldplug(units[k]);
+                if (r < 0)
+                        log_unit_warning_errno(units[k], r, "We couldn't coldplug %s, proceeding anyway: %m", units[k]->id);
+        }
+
+        /* Release any dynamic users and UIDs/GIDs no longer referenced */
+        dynamic_user_vacuum(m, true);
+        manager_vacuum_uid_refs(m);
+        manager_vacuum_gid_refs(m);
+
+        r = (int) n_units;
+
+        log_debug("Reloading of %zu changed units took %s.",
+                  n_units, format_timespan(timespan, sizeof(timespan), now(CLOCK_MONOTONIC) - begin, USEC_PER_MSEC));
+
+finish:
         assert(m->n_reloading > 0);
         m->n_reloading--;
 
@@ -3035,7 +3493,7 @@ void manager_reset_failed(Manager *m) {
 
         assert(m);
 
-        HASHMAP_FOREACH(u, m->units, i)
+        FLAT_HASHMAP_FOREACH(u, m->units, i)
                 unit_reset_failed(u);
 }
 
@@ -3228,12 +3686,47 @@ static int manager_run_environment_generators(Manager *m) {
         if (!generator_path_any(paths))
                 return 0;
 
-        return execute_directories(paths, DEFAULT_TIMEOUT_USEC, gather_environment, args, NULL);
+        return execute_directories(paths, DEFAULT_TIMEOUT_USEC, gather_environment, args, NULL, NULL, NULL);
+}
+
+static void manager_execute_generators(Manager *m, char **paths, const char *generator, const char *generator_early, const char *generator_late) {
+        ExecTiming *timings = NULL;
+        size_t n_timings = 0, i;
+        const char *argv[5];
+        usec_t ts;
+
+        assert(m);
+
+        argv[0] = NULL; /* Leave this empty, execute_directory() will fill something in */
+        argv[1] = generator;
+        argv[2] = generator_early;
+        argv[3] = generator_late;
+        argv[4] = NULL;
+
+        ts = now(CLOCK_MONOTONIC);
+
+        RUN_WITH_UMASK(0022)
+                (void) execute_directories((const char* const*) paths, DEFAULT_TIMEOUT_USEC,
+                                           NULL, NULL, (char**) argv, &timings, &n_timings);
+
+        trace_span_pinned(&m->trace, "generators", NULL, ts);
+
+        for (i = 0; i < n_timings; i++) {
+                char buf[FORMAT_TIMESPAN_MAX];
+
+                log_debug("Generator %s finished in %s.",
+                          timings[i].path, format_timespan(buf, sizeof(buf), timings[i].duration, USEC_PER_MSEC));
+
+                trace_add_pinned(&m->trace, TRACE_GENERATOR, "generator", timings[i].path, timings[i].start, timings[i].duration);
+        }
+
+        exec_timing_free_many(m->generator_timings, m->n_generator_timings);
+        m->generator_timings = timings;
+        m->n_generator_timings = n_timings;
 }
 
 static int manager_run_generators(Manager *m) {
         _cleanup_strv_free_ char **paths = NULL;
-        const char *argv[5];
         int r;
 
         assert(m);
@@ -3252,18 +3745,241 @@ static int manager_run_generators(Manager *m) {
         if (r < 0)
                 goto finish;
 
-        argv[0] = NULL; /* Leave this empty, execute_directory() will fill something in */
-        argv[1] = m->lookup_paths.generator;
-        argv[2] = m->lookup_paths.generator_early;
-        argv[3] = m->lookup_paths.generator_late;
-        argv[4] = NULL;
+        manager_execute_generators(m, paths,
+                                   m->lookup_paths.generator,
+                                   m->lookup_paths.generator_early,
+                                   m->lookup_paths.generator_late);
 
-        RUN_WITH_UMASK(0022)
-                execute_directories((const char* const*) paths, DEFAULT_TIMEOUT_USEC,
-                                    NULL, NULL, (char**) argv);
+finish:
+        lookup_paths_trim_generator(&m->lookup_paths);
+        return r;
+}
+
+static int read_full_file_at(int dir_fd, const char *name, char **ret, size_t *ret_size) {
+        _cleanup_fclose_ FILE *f = NULL;
+        int fd;
+
+        fd = openat(dir_fd, name, O_RDONLY|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW);
+        if (fd < 0)
+                return -errno;
+
+        f = fdopen(fd, "re");
+        if (!f) {
+                safe_close(fd);
+                return -errno;
+        }
+
+        return read_full_stream(f, ret, ret_size);
+}
+
+static bool generated_file_same(int from_fd, int to_fd, const char *name, const struct stat *a, const struct stat *b) {
+        _cleanup_free_ char *x = NULL, *y = NULL;
+        size_t n, k;
+
+        if (a->st_mode != b->st_mode)
+                return false;
+
+        if (S_ISLNK(a->st_mode)) {
+                if (readlinkat_malloc(from_fd, name, &x) < 0 ||
+                    readlinkat_malloc(to_fd, name, &y) < 0)
+                        return false;
+
+                return streq(x, y);
+        }
+
+        if (!S_ISREG(a->st_mode) || a->st_size != b->st_size)
+                return false;
+
+        if (read_full_file_at(from_fd, name, &x, &n) < 0 ||
+            read_full_file_at(to_fd, name, &y, &k) < 0)
+                return false;
+
+        return n == k && memcmp(x, y, n) == 0;
+}
+
+static int generated_entry_remove(int dir_fd, const char *name, const struct stat *st) {
+        int fd;
+
+        if (!S_ISDIR(st->st_mode))
+                return unlinkat(dir_fd, name, 0) < 0 ? -errno : 0;
+
+        fd = openat(dir_fd, name, O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW);
+        if (fd < 0)
+                return -errno;
+
+        (void) rm_rf_children(fd, REMOVE_PHYSICAL, NULL);
+
+        return unlinkat(dir_fd, name, AT_REMOVEDIR) < 0 ? -errno : 0;
+}
+
+static int generated_dir_sync(int from_fd, int to_fd) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        int r;
+
+        /* Makes the tree below to_fd identical to the one below from_fd, moving over only the entries that
+         * differ. Unchanged generated files and directories hence keep their mtimes. */
+
+        d = xopendirat(to_fd, ".", O_NOFOLLOW);
+        if (!d)
+                return -errno;
+
+        FOREACH_DIRENT_ALL(de, d, return -errno) {
+                struct stat st;
+
+                if (dot_or_dot_dot(de->d_name))
+                        continue;
+
+                if (fstatat(from_fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) >= 0)
+                        continue;
+                if (errno != ENOENT)
+                        return -errno;
+
+                if (fstatat(to_fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+                        return -errno;
+
+                r = generated_entry_remove(to_fd, de->d_name, &st);
+                if (r < 0)
+                        return r;
+        }
+
+        d = safe_closedir(d);
+
+        d = xopendirat(from_fd, ".", O_NOFOLLOW);
+        if (!d)
+                return -errno;
+
+        FOREACH_DIRENT_ALL(de, d, return -errno) {
+                struct stat a, b;
+
+                if (dot_or_dot_dot(de->d_name))
+                        continue;
+
+                if (fstatat(from_fd, de->d_name, &a, AT_SYMLINK_NOFOLLOW) < 0)
+                        return -errno;
+
+                if (fstatat(to_fd, de->d_name, &b, AT_SYMLINK_NOFOLLOW) >= 0) {
+
+                        if (S_ISDIR(a.st_mode) && S_ISDIR(b.st_mode)) {
+                                _cleanup_close_ int x = -1, y = -1;
+
+                                x = openat(from_fd, de->d_name, O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW);
+                                if (x < 0)
+                                        return -errno;
+
+                                y = openat(to_fd, de->d_name, O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW);
+                                if (y < 0)
+                                        return -errno;
+
+                                r = generated_dir_sync(x, y);
+                                if (r < 0)
+                                        return r;
+
+                                continue;
+                        }
+
+                        if (generated_file_same(from_fd, to_fd, de->d_name, &a, &b))
+                                continue;
+
+                        /* Directories cannot be replaced atomically by something else or vice versa */
+                        if (S_ISDIR(a.st_mode) || S_ISDIR(b.st_mode)) {
+                                r = generated_entry_remove(to_fd, de->d_name, &b);
+                                if (r < 0)
+                                        return r;
+                        }
+
+                } else if (errno != ENOENT)
+                        return -errno;
+
+                if (renameat(from_fd, de->d_name, to_fd, de->d_name) < 0)
+                        return -errno;
+        }
+
+        return 0;
+}
+
+static int manager_refresh_generators(Manager *m) {
+        _cleanup_strv_free_ char **paths = NULL;
+        _cleanup_free_ char *t = NULL;
+        _cleanup_close_ int fd = -1;
+        const char *targets[3], *subdirs[3] = { "normal", "early", "late" };
+        unsigned k;
+        int r;
+
+        assert(m);
+
+        /* Reruns the generators like manager_run_generators(), but lets them write to a scratch directory first,
+         * and then only updates the generated files that actually changed. */
+
+        if (m->test_run_flags && !(m->test_run_flags & MANAGER_TEST_RUN_GENERATORS))
+                return 0;
+
+        targets[0] = m->lookup_paths.generator;
+        targets[1] = m->lookup_paths.generator_early;
+        targets[2] = m->lookup_paths.generator_late;
+        if (!targets[0] || !targets[1] || !targets[2])
+                return 0;
+
+        paths = generator_binary_paths(m->unit_file_scope);
+        if (!paths)
+                return log_oom();
+
+        r = tempfn_xxxxxx(targets[0], NULL, &t);
+        if (r < 0)
+                return r;
+
+        if (!mkdtemp(t))
+                return -errno;
+
+        fd = open(t, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (fd < 0) {
+                r = -errno;
+                goto finish;
+        }
+
+        for (k = 0; k < ELEMENTSOF(subdirs); k++)
+                if (mkdirat(fd, subdirs[k], 0755) < 0) {
+                        r = -errno;
+                        goto finish;
+                }
+
+        if (generator_path_any((const char* const*) paths))
+                manager_execute_generators(m, paths,
+                                           strjoina(t, "/", subdirs[0]),
+                                           strjoina(t, "/", subdirs[1]),
+                                           strjoina(t, "/", subdirs[2]));
+
+        r = lookup_paths_mkdir_generator(&m->lookup_paths);
+        if (r < 0)
+                goto finish;
+
+        for (k = 0; k < ELEMENTSOF(subdirs); k++) {
+                _cleanup_close_ int from = -1, to = -1;
+
+                from = openat(fd, subdirs[k], O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+                if (from < 0) {
+                        r = -errno;
+                        goto finish;
+                }
+
+                to = open(targets[k], O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+                if (to < 0) {
+                        r = -errno;
+                        goto finish;
+                }
+
+                r = generated_dir_sync(from, to);
+                if (r < 0) {
+                        log_warning_errno(r, "Failed to update generated units in %s: %m", targets[k]);
+                        goto finish;
+                }
+        }
+
+        r = 0;
 
 finish:
         lookup_paths_trim_generator(&m->lookup_paths);
+        (void) rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL);
         return r;
 }
 
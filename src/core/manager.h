@@ -28,11 +28,15 @@
 #include "sd-event.h"
 
 #include "cgroup-util.h"
+#include "exec-util.h"
 #include "fdset.h"
+#include "flat-hashmap.h"
 #include "hashmap.h"
 #include "ip-address-access.h"
 #include "list.h"
+#include "mount-table.h"
 #include "ratelimit.h"
+#include "trace.h"
 
 /* Enforce upper limit how many names we allow */
 #define MANAGER_MAX_NAMES 131072 /* 128K */
@@ -109,7 +113,7 @@ struct Manager {
          * not, and the list of jobs may neither. */
 
         /* Active jobs and units */
-        Hashmap *units;  /* name string => Unit object n:1 */
+        FlatHashmap *units;  /* name string => Unit object n:1 */
         Hashmap *units_by_invocation_id;
         Hashmap *jobs;   /* job id => Job object 1:1 */
 
@@ -183,6 +187,10 @@ struct Manager {
         UnitFileScope unit_file_scope;
         LookupPaths lookup_paths;
         Set *unit_path_cache;
+        usec_t unit_path_cache_timestamp;
+
+        /* Unit files read ahead of loading the units in the load queue, path → ConfigFile */
+        Hashmap *prepared_files;
 
         char **environment;
 
@@ -191,6 +199,10 @@ struct Manager {
 
         dual_timestamp timestamps[_MANAGER_TIMESTAMP_MAX];
 
+        /* How long each generator took when they were last run */
+        ExecTiming *generator_timings;
+        size_t n_generator_timings;
+
         struct udev* udev;
 
         /* Data specific to the device subsystem */
@@ -201,6 +213,10 @@ struct Manager {
         /* Data specific to the mount subsystem */
         struct libmnt_monitor *mount_monitor;
         sd_event_source *mount_event_source;
+        MountTable *mount_table;
+        sd_event_source *mount_rescan_event_source;
+        usec_t mount_rescan_timestamp;
+        bool mount_rescan_all;
 
         /* Data specific to the swap filesystem */
         FILE *proc_swaps;
@@ -226,6 +242,9 @@ struct Manager {
 
         Hashmap *watch_bus;  /* D-Bus names => Unit object n:1 */
 
+        /* Change signals held back on connections whose clients don't keep up: sd_bus => BusDeferredSignals */
+        Hashmap *deferred_signals;
+
         bool send_reloading_done;
 
         uint32_t current_job_id;
@@ -239,6 +258,13 @@ struct Manager {
         CGroupMask cgroup_supported;
         char *cgroup_root;
 
+        /* Bumped on each dispatch of the realize queue, see unit_add_siblings_to_cgroup_realize_queue() */
+        unsigned cgroup_realize_iteration;
+
+        /* Counters of cgroup attribute writes, and of those skipped since the value was written before already */
+        uint64_t n_cgroup_attribute_writes;
+        uint64_t n_cgroup_attribute_writes_skipped;
+
         /* Notifications from cgroups, when the unified hierarchy is used is done via inotify. */
         int cgroup_inotify_fd;
         sd_event_source *cgroup_inotify_event_source;
@@ -258,6 +284,7 @@ struct Manager {
 
         bool dispatching_load_queue:1;
         bool dispatching_dbus_queue:1;
+        bool dbus_queue_budget_spent:1;
 
         bool taint_usr:1;
 
@@ -291,6 +318,13 @@ struct Manager {
         uint64_t default_tasks_max;
         usec_t default_timer_accuracy_usec;
 
+        /* How often to write the metrics table, if at all */
+        usec_t metrics_interval_usec;
+        sd_event_source *metrics_event_source;
+
+        /* The last spans of time spent in the various phases, for "systemd-analyze trace" */
+        Trace trace;
+
         struct rlimit *rlimit[_RLIMIT_MAX];
 
         /* non-zero if we are reloading or reexecuting, */
@@ -394,6 +428,7 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root);
 int manager_deserialize(Manager *m, FILE *f, FDSet *fds);
 
 int manager_reload(Manager *m);
+int manager_reload_incremental(Manager *m);
 
 void manager_reset_failed(Manager *m);
 
@@ -0,0 +1,306 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+
+#include "alloc-util.h"
+#include "mount-table.h"
+#include "string-util.h"
+
+static MountEntry *mount_entry_free(MountEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->what);
+        free(e->where);
+        free(e->options);
+        free(e->fstype);
+
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(MountEntry*, mount_entry_free);
+
+MountTable *mount_table_new(void) {
+        return new0(MountTable, 1);
+}
+
+static void mount_table_flush_changes(MountTable *t) {
+        size_t i;
+
+        assert(t);
+
+        for (i = 0; i < t->n_removed; i++)
+                mount_entry_free(t->removed[i]);
+
+        t->n_removed = 0;
+        t->n_added = 0;
+}
+
+void mount_table_clear(MountTable *t) {
+        MountEntry *e;
+        char *k;
+
+        if (!t)
+                return;
+
+        mount_table_flush_changes(t);
+
+        hashmap_clear(t->by_where);
+
+        while ((k = hashmap_steal_first_key(t->what_count)))
+                free(k);
+
+        while ((e = hashmap_steal_first(t->by_id)))
+                mount_entry_free(e);
+}
+
+MountTable *mount_table_free(MountTable *t) {
+        if (!t)
+                return NULL;
+
+        mount_table_clear(t);
+
+        hashmap_free(t->by_id);
+        hashmap_free(t->by_where);
+        hashmap_free(t->what_count);
+
+        free(t->added);
+        free(t->removed);
+
+        return mfree(t);
+}
+
+static int mount_table_ref_what(MountTable *t, const char *what) {
+        _cleanup_free_ char *k = NULL;
+        unsigned n;
+        int r;
+
+        n = PTR_TO_UINT(hashmap_get(t->what_count, what));
+        if (n > 0)
+                return hashmap_update(t->what_count, what, UINT_TO_PTR(n + 1));
+
+        k = strdup(what);
+        if (!k)
+                return -ENOMEM;
+
+        r = hashmap_put(t->what_count, k, UINT_TO_PTR(1));
+        if (r < 0)
+                return r;
+
+        k = NULL;
+        return 0;
+}
+
+static void mount_table_unref_what(MountTable *t, const char *what) {
+        unsigned n;
+        char *k;
+
+        n = PTR_TO_UINT(hashmap_get2(t->what_count, what, (void**) &k));
+        if (n > 1) {
+                (void) hashmap_update(t->what_count, what, UINT_TO_PTR(n - 1));
+                return;
+        }
+
+        if (n == 1) {
+                hashmap_remove(t->what_count, what);
+                free(k);
+        }
+}
+
+static void mount_table_unlink(MountTable *t, MountEntry *e) {
+        MountEntry *head;
+        bool was_head;
+
+        assert(t);
+        assert(e);
+
+        hashmap_remove(t->by_id, &e->id);
+
+        head = hashmap_get(t->by_where, e->where);
+        was_head = head == e;
+
+        LIST_REMOVE(same_where, head, e);
+
+        /* The key of the by_where entry is the head's string, hence update it if the head changes */
+        if (!head)
+                hashmap_remove(t->by_where, e->where);
+        else if (was_head)
+                (void) hashmap_remove_and_replace(t->by_where, e->where, head->where, head);
+
+        mount_table_unref_what(t, e->what);
+}
+
+void mount_table_begin(MountTable *t) {
+        assert(t);
+
+        mount_table_flush_changes(t);
+
+        t->generation++;
+        t->n_seen = 0;
+}
+
+int mount_table_add(
+                MountTable *t,
+                uint64_t id,
+                const char *what,
+                const char *where,
+                const char *options,
+                const char *fstype) {
+
+        _cleanup_(mount_entry_freep) MountEntry *n = NULL;
+        MountEntry *e, *head;
+        int r;
+
+        assert(t);
+        assert(what);
+        assert(where);
+        assert(options);
+        assert(fstype);
+
+        /* Returns 0 if the entry is unchanged since the last scan, 1 if it is new or changed. On failure the table
+         * is in an inconsistent state, and needs to be flushed with mount_table_clear(). */
+
+        e = hashmap_get(t->by_id, &id);
+        if (e &&
+            streq(e->where, where) &&
+            streq(e->what, what) &&
+            streq(e->options, options) &&
+            streq(e->fstype, fstype)) {
+
+                if (e->generation != t->generation)
+                        t->n_seen++;
+
+                e->generation = t->generation;
+                e->position = t->n_seen;
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(&t->by_id, &uint64_hash_ops);
+        if (r < 0)
+                return r;
+        r = hashmap_ensure_allocated(&t->by_where, &string_hash_ops);
+        if (r < 0)
+                return r;
+        r = hashmap_ensure_allocated(&t->what_count, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        if (!GREEDY_REALLOC(t->added, t->n_allocated_added, t->n_added + 1))
+                return -ENOMEM;
+
+        n = new0(MountEntry, 1);
+        if (!n)
+                return -ENOMEM;
+
+        n->id = id;
+        n->what = strdup(what);
+        n->where = strdup(where);
+        n->options = strdup(options);
+        n->fstype = strdup(fstype);
+        if (!n->what || !n->where || !n->options || !n->fstype)
+                return -ENOMEM;
+
+        if (e) {
+                /* The mount was changed, or the ID was reused: replace the old entry */
+                if (!GREEDY_REALLOC(t->removed, t->n_allocated_removed, t->n_removed + 1))
+                        return -ENOMEM;
+
+                if (e->generation == t->generation)
+                        t->n_seen--;
+
+                mount_table_unlink(t, e);
+                t->removed[t->n_removed++] = e;
+        }
+
+        r = hashmap_put(t->by_id, &n->id, n);
+        if (r < 0)
+                return r;
+
+        e = n;
+        n = NULL;
+
+        t->n_seen++;
+        e->generation = t->generation;
+        e->position = t->n_seen;
+        LIST_INIT(same_where, e);
+
+        /* Keep the head of the list stable, so that the by_where key doesn't need to change */
+        head = hashmap_get(t->by_where, e->where);
+        if (head)
+                LIST_INSERT_AFTER(same_where, head, head, e);
+        else {
+                r = hashmap_put(t->by_where, e->where, e);
+                if (r < 0)
+                        return r;
+        }
+
+        r = mount_table_ref_what(t, e->what);
+        if (r < 0)
+                return r;
+
+        t->added[t->n_added++] = e;
+        return 1;
+}
+
+int mount_table_end(MountTable *t) {
+        MountEntry *e;
+        Iterator i;
+
+        assert(t);
+
+        /* Drop everything that wasn't seen since mount_table_begin(). If every entry was seen again, there's
+         * nothing to do, which is the common case when only a few entries were added. */
+        if (t->n_seen >= hashmap_size(t->by_id))
+                return 0;
+
+        HASHMAP_FOREACH(e, t->by_id, i) {
+                if (e->generation == t->generation)
+                        continue;
+
+                if (!GREEDY_REALLOC(t->removed, t->n_allocated_removed, t->n_removed + 1))
+                        return -ENOMEM;
+
+                mount_table_unlink(t, e);
+                t->removed[t->n_removed++] = e;
+        }
+
+        return 0;
+}
+
+MountEntry *mount_table_find_where(MountTable *t, const char *where) {
+        MountEntry *e, *top = NULL;
+
+        assert(where);
+
+        if (!t)
+                return NULL;
+
+        /* Returns the entry listed last for the mount point, i.e. the one that is visible */
+        LIST_FOREACH(same_where, e, (MountEntry*) hashmap_get(t->by_where, where))
+                if (!top || e->position > top->position)
+                        top = e;
+
+        return top;
+}
+
+bool mount_table_has_what(MountTable *t, const char *what) {
+        assert(what);
+
+        return t && hashmap_contains(t->what_count, what);
+}
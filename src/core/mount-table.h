@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include "hashmap.h"
+#include "list.h"
+#include "macro.h"
+
+/*
+ * A snapshot of /proc/self/mountinfo, indexed by mount ID, used to figure out which entries changed since the
+ * previous scan, so that only the mount units they affect need to be looked at.
+ *
+ * A scan is started with mount_table_begin(), then every entry currently in the table is passed to
+ * mount_table_add(), in file order, and mount_table_end() drops all entries which weren't seen again. Afterwards
+ * the "added" and "removed" arrays list what changed. An entry whose fields changed (e.g. on a remount, or when
+ * a mount ID got reused) is listed in both: the old version in "removed", the new one in "added".
+ *
+ * All strings are stored the way they appear in the table, i.e. still escaped.
+ */
+
+typedef struct MountEntry MountEntry;
+typedef struct MountTable MountTable;
+
+struct MountEntry {
+        uint64_t id;
+
+        char *what;
+        char *where;
+        char *options;
+        char *fstype;
+
+        /* The position in the table and the scan this entry was last seen in */
+        unsigned position;
+        unsigned generation;
+
+        /* All entries mounted on the same directory, i.e. over-mounts */
+        LIST_FIELDS(MountEntry, same_where);
+};
+
+struct MountTable {
+        Hashmap *by_id;         /* uint64_t id → MountEntry */
+        Hashmap *by_where;      /* where → MountEntry list */
+        Hashmap *what_count;    /* what → number of entries using it */
+
+        unsigned generation;
+        unsigned n_seen;
+
+        /* The result of the last scan. The added entries are owned by the table, the removed ones by the arrays. */
+        MountEntry **added;
+        size_t n_added, n_allocated_added;
+        MountEntry **removed;
+        size_t n_removed, n_allocated_removed;
+};
+
+MountTable *mount_table_new(void);
+MountTable *mount_table_free(MountTable *t);
+void mount_table_clear(MountTable *t);
+
+void mount_table_begin(MountTable *t);
+int mount_table_add(MountTable *t, uint64_t id, const char *what, const char *where, const char *options, const char *fstype);
+int mount_table_end(MountTable *t);
+
+MountEntry *mount_table_find_where(MountTable *t, const char *where);
+bool mount_table_has_what(MountTable *t, const char *what);
+
+static inline unsigned mount_table_size(MountTable *t) {
+        return t ? hashmap_size(t->by_id) : 0;
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(MountTable*, mount_table_free);
+#define _cleanup_mount_table_free_ _cleanup_(mount_table_freep)
@@ -49,6 +49,9 @@
 
 #define RETRY_UMOUNT_MAX 32
 
+/* After a rescan of the mount table, further rescans are delayed for this long, see mount_schedule_rescan() */
+#define MOUNT_RESCAN_INTERVAL_USEC (50*USEC_PER_MSEC)
+
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct libmnt_table*, mnt_free_table);
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct libmnt_iter*, mnt_free_iter);
 
@@ -68,6 +71,7 @@ static const UnitActiveState state_translation_table[_MOUNT_STATE_MAX] = {
 
 static int mount_dispatch_timer(sd_event_source *source, usec_t usec, void *userdata);
 static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata);
+static void mount_flush_rescan(Manager *m);
 
 static bool MOUNT_STATE_WITH_PROCESS(MountState state) {
         return IN_SET(state,
@@ -1248,6 +1252,10 @@ static void mount_sigchld_event(Unit *u, pid_t pid, int code, int status) {
         if (pid != m->control_pid)
                 return;
 
+        /* The state changes below rely on seeing mount table changes before the SIGCHLD of the mount command (see
+         * below), hence catch up with a rescan that mount_schedule_rescan() delayed. */
+        mount_flush_rescan(u->manager);
+
         m->control_pid = 0;
 
         if (is_clean_exit(code, status, EXIT_CLEAN_COMMAND, NULL))
@@ -1589,13 +1597,58 @@ fail:
         return r;
 }
 
-static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
+static int mount_setup_where(Manager *m, const char *where, bool set_flags, Set *units) {
+        _cleanup_free_ char *p = NULL, *d = NULL, *e = NULL;
+        MountEntry *top;
+        Unit *u;
+        int r = 0;
+
+        assert(m);
+        assert(where);
+
+        /* Sets up the mount unit for a mount point from the entry that is visible there, and adds the unit to
+         * 'units', so that its state is updated later on. If nothing is mounted there anymore, the unit is only
+         * added to 'units'. */
+
+        if (cunescape(where, UNESCAPE_RELAX, &p) < 0)
+                return log_oom();
+
+        top = mount_table_find_where(m->mount_table, where);
+        if (top) {
+                if (cunescape(top->what, UNESCAPE_RELAX, &d) < 0)
+                        return log_oom();
+
+                r = mount_setup_unit(m, d, p, top->options, top->fstype, set_flags);
+        }
+
+        if (!units || !is_path(p))
+                return r;
+
+        if (unit_name_from_path(p, ".mount", &e) < 0)
+                return r;
+
+        u = manager_get_unit(m, e);
+        if (u && set_put(units, u) < 0)
+                return log_oom();
+
+        return r;
+}
+
+static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags, Set *units) {
         _cleanup_(mnt_free_tablep) struct libmnt_table *t = NULL;
         _cleanup_(mnt_free_iterp) struct libmnt_iter *i = NULL;
+        _cleanup_set_free_ Set *wheres = NULL;
+        const char *where;
+        MountEntry *e;
+        Iterator j;
+        size_t k;
         int r = 0;
 
         assert(m);
 
+        /* Parses /proc/self/mountinfo and sets up the mount units for the mount points that changed since the last
+         * call, or for all of them if m->mount_rescan_all is set. The units are added to 'units'. */
+
         t = mnt_new_table();
         if (!t)
                 return log_oom();
@@ -1608,18 +1661,25 @@ static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
         if (r < 0)
                 return log_error_errno(r, "Failed to parse /proc/self/mountinfo: %m");
 
-        r = 0;
+        if (!m->mount_table) {
+                m->mount_table = mount_table_new();
+                if (!m->mount_table)
+                        return log_oom();
+        }
+
+        mount_table_begin(m->mount_table);
+
         for (;;) {
                 const char *device, *path, *options, *fstype;
-                _cleanup_free_ char *d = NULL, *p = NULL;
                 struct libmnt_fs *fs;
-                int k;
 
-                k = mnt_table_next_fs(t, i, &fs);
-                if (k == 1)
+                r = mnt_table_next_fs(t, i, &fs);
+                if (r == 1)
                         break;
-                if (k < 0)
-                        return log_error_errno(k, "Failed to get next entry from /proc/self/mountinfo: %m");
+                if (r < 0) {
+                        log_error_errno(r, "Failed to get next entry from /proc/self/mountinfo: %m");
+                        goto fail;
+                }
 
                 device = mnt_fs_get_source(fs);
                 path = mnt_fs_get_target(fs);
@@ -1629,19 +1689,80 @@ static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
                 if (!device || !path)
                         continue;
 
-                if (cunescape(device, UNESCAPE_RELAX, &d) < 0)
-                        return log_oom();
+                /* Only the entries which differ from the last scan are unescaped and looked at further */
+                r = mount_table_add(m->mount_table, mnt_fs_get_id(fs), device, path, options, fstype);
+                if (r < 0) {
+                        log_oom();
+                        goto fail;
+                }
+        }
 
-                if (cunescape(path, UNESCAPE_RELAX, &p) < 0)
-                        return log_oom();
+        r = mount_table_end(m->mount_table);
+        if (r < 0) {
+                log_oom();
+                goto fail;
+        }
+
+        wheres = set_new(&string_hash_ops);
+        if (!wheres) {
+                r = log_oom();
+                goto fail;
+        }
+
+        if (m->mount_rescan_all)
+                HASHMAP_FOREACH_KEY(e, where, m->mount_table->by_where, j) {
+                        if (set_put(wheres, where) < 0) {
+                                r = log_oom();
+                                goto fail;
+                        }
+                }
+
+        for (k = 0; k < m->mount_table->n_removed; k++)
+                if (set_put(wheres, m->mount_table->removed[k]->where) < 0) {
+                        r = log_oom();
+                        goto fail;
+                }
+
+        for (k = 0; k < m->mount_table->n_added; k++) {
+                _cleanup_free_ char *d = NULL;
+
+                e = m->mount_table->added[k];
+
+                if (set_put(wheres, e->where) < 0) {
+                        r = log_oom();
+                        goto fail;
+                }
+
+                if (cunescape(e->what, UNESCAPE_RELAX, &d) < 0) {
+                        r = log_oom();
+                        goto fail;
+                }
 
                 (void) device_found_node(m, d, true, DEVICE_FOUND_MOUNT, set_flags);
+        }
+
+        log_debug("Mount table rescan: %u entries, %zu added, %zu removed, %u mount points to update.",
+                  mount_table_size(m->mount_table), m->mount_table->n_added, m->mount_table->n_removed, set_size(wheres));
+
+        r = 0;
+        SET_FOREACH(where, wheres, j) {
+                int q;
 
-                k = mount_setup_unit(m, d, p, options, fstype, set_flags);
-                if (r == 0 && k < 0)
-                        r = k;
+                q = mount_setup_where(m, where, set_flags, units);
+                if (r == 0 && q < 0)
+                        r = q;
         }
 
+        /* If a unit couldn't be set up the changes are lost, hence go through everything on the next rescan */
+        if (r < 0)
+                m->mount_rescan_all = true;
+
+        return r;
+
+fail:
+        /* The table is in an unknown state now, start from scratch */
+        mount_table_clear(m->mount_table);
+        m->mount_rescan_all = true;
         return r;
 }
 
@@ -1649,6 +1770,8 @@ static void mount_shutdown(Manager *m) {
         assert(m);
 
         m->mount_event_source = sd_event_source_unref(m->mount_event_source);
+        m->mount_rescan_event_source = sd_event_source_unref(m->mount_rescan_event_source);
+        m->mount_table = mount_table_free(m->mount_table);
 
         mnt_unref_monitor(m->mount_monitor);
         m->mount_monitor = NULL;
@@ -1757,7 +1880,12 @@ static void mount_enumerate(Manager *m) {
                 (void) sd_event_source_set_description(m->mount_event_source, "mount-monitor-dispatch");
         }
 
-        r = mount_load_proc_self_mountinfo(m, false);
+        /* The units are created from scratch, hence forget what we know about the mount table, so that they are set
+         * up for all entries. Then reconcile all units with the table on the first rescan. */
+        mount_table_clear(m->mount_table);
+        m->mount_rescan_all = true;
+
+        r = mount_load_proc_self_mountinfo(m, false, NULL);
         if (r < 0)
                 goto fail;
 
@@ -1767,41 +1895,83 @@ fail:
         mount_shutdown(m);
 }
 
-static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
-        _cleanup_set_free_ Set *around = NULL, *gone = NULL;
-        Manager *m = userdata;
-        const char *what;
+static void mount_follow_proc_self_mountinfo(Mount *mount) {
+        assert(mount);
+
+        if (!mount_is_mounted(mount)) {
+
+                /* A mount point is not around right now. It
+                 * might be gone, or might never have
+                 * existed. */
+
+                mount->from_proc_self_mountinfo = false;
+
+                switch (mount->state) {
+
+                case MOUNT_MOUNTED:
+                        /* This has just been unmounted by
+                         * somebody else, follow the state
+                         * change. */
+                        mount->result = MOUNT_SUCCESS; /* make sure we forget any earlier umount failures */
+                        mount_enter_dead(mount, MOUNT_SUCCESS);
+                        break;
+
+                default:
+                        break;
+                }
+
+        } else if (mount->just_mounted || mount->just_changed) {
+
+                /* A mount point was added or changed */
+
+                switch (mount->state) {
+
+                case MOUNT_DEAD:
+                case MOUNT_FAILED:
+
+                        /* This has just been mounted by somebody else, follow the state change, but let's
+                         * generate a new invocation ID for this implicitly and automatically. */
+                        (void) unit_acquire_invocation_id(UNIT(mount));
+                        mount_enter_mounted(mount, MOUNT_SUCCESS);
+                        break;
+
+                case MOUNT_MOUNTING:
+                        mount_set_state(mount, MOUNT_MOUNTING_DONE);
+                        break;
+
+                default:
+                        /* Nothing really changed, but let's
+                         * issue an notification call
+                         * nonetheless, in case somebody is
+                         * waiting for this. (e.g. file system
+                         * ro/rw remounts.) */
+                        mount_set_state(mount, mount->state);
+                        break;
+                }
+        }
+
+        /* Reset the flags for later calls */
+        mount->is_mounted = mount->just_mounted = mount->just_changed = false;
+}
+
+static int mount_rescan(Manager *m) {
+        _cleanup_set_free_ Set *units = NULL;
         Iterator i;
+        size_t k;
         Unit *u;
         int r;
 
         assert(m);
-        assert(revents & EPOLLIN);
 
-        if (fd == mnt_monitor_get_fd(m->mount_monitor)) {
-                bool rescan = false;
+        m->mount_rescan_timestamp = now(CLOCK_MONOTONIC);
+        if (m->mount_rescan_event_source)
+                (void) sd_event_source_set_enabled(m->mount_rescan_event_source, SD_EVENT_OFF);
 
-                /* Drain all events and verify that the event is valid.
-                 *
-                 * Note that libmount also monitors /run/mount mkdir if the
-                 * directory does not exist yet. The mkdir may generate event
-                 * which is irrelevant for us.
-                 *
-                 * error: r < 0; valid: r == 0, false positive: rc == 1 */
-                do {
-                        r = mnt_monitor_next_change(m->mount_monitor, NULL, NULL);
-                        if (r == 0)
-                                rescan = true;
-                        else if (r < 0)
-                                return log_error_errno(r, "Failed to drain libmount events");
-                } while (r == 0);
-
-                log_debug("libmount event [rescan: %s]", yes_no(rescan));
-                if (!rescan)
-                        return 0;
-        }
+        units = set_new(NULL);
+        if (!units)
+                return log_oom();
 
-        r = mount_load_proc_self_mountinfo(m, true);
+        r = mount_load_proc_self_mountinfo(m, true, units);
         if (r < 0) {
                 /* Reset flags, just in case, for later calls */
                 LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
@@ -1815,92 +1985,139 @@ static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
 
         manager_dispatch_load_queue(m);
 
-        LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
-                Mount *mount = MOUNT(u);
+        /* Usually only the units of the mount points that changed need to be looked at. After enumeration and
+         * after errors all of them are, so that units whose mount went away in the meantime are caught too. */
+        if (m->mount_rescan_all) {
+                LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT])
+                        mount_follow_proc_self_mountinfo(MOUNT(u));
 
-                if (!mount_is_mounted(mount)) {
+                m->mount_rescan_all = false;
+        } else
+                SET_FOREACH(u, units, i)
+                        mount_follow_proc_self_mountinfo(MOUNT(u));
 
-                        /* A mount point is not around right now. It
-                         * might be gone, or might never have
-                         * existed. */
+        for (k = 0; k < m->mount_table->n_removed; k++) {
+                _cleanup_free_ char *d = NULL;
+                MountEntry *e = m->mount_table->removed[k];
 
-                        if (mount->from_proc_self_mountinfo &&
-                            mount->parameters_proc_self_mountinfo.what) {
+                if (mount_table_has_what(m->mount_table, e->what))
+                        continue;
 
-                                /* Remember that this device might just have disappeared */
-                                if (set_ensure_allocated(&gone, &string_hash_ops) < 0 ||
-                                    set_put(gone, mount->parameters_proc_self_mountinfo.what) < 0)
-                                        log_oom(); /* we don't care too much about OOM here... */
-                        }
+                if (cunescape(e->what, UNESCAPE_RELAX, &d) < 0) {
+                        log_oom(); /* we don't care too much about OOM here... */
+                        continue;
+                }
 
-                        mount->from_proc_self_mountinfo = false;
+                /* Let the device units know that the device is no longer mounted */
+                (void) device_found_node(m, d, false, DEVICE_FOUND_MOUNT, true);
+        }
 
-                        switch (mount->state) {
+        return 0;
+}
 
-                        case MOUNT_MOUNTED:
-                                /* This has just been unmounted by
-                                 * somebody else, follow the state
-                                 * change. */
-                                mount->result = MOUNT_SUCCESS; /* make sure we forget any earlier umount failures */
-                                mount_enter_dead(mount, MOUNT_SUCCESS);
-                                break;
+static int mount_dispatch_rescan(sd_event_source *source, usec_t usec, void *userdata) {
+        Manager *m = userdata;
 
-                        default:
-                                break;
-                        }
+        assert(m);
 
-                } else if (mount->just_mounted || mount->just_changed) {
+        return mount_rescan(m);
+}
 
-                        /* A mount point was added or changed */
+static bool mount_rescan_pending(Manager *m) {
+        int enabled;
 
-                        switch (mount->state) {
+        assert(m);
 
-                        case MOUNT_DEAD:
-                        case MOUNT_FAILED:
+        return m->mount_rescan_event_source &&
+                sd_event_source_get_enabled(m->mount_rescan_event_source, &enabled) >= 0 &&
+                enabled != SD_EVENT_OFF;
+}
 
-                                /* This has just been mounted by somebody else, follow the state change, but let's
-                                 * generate a new invocation ID for this implicitly and automatically. */
-                                (void) unit_acquire_invocation_id(UNIT(mount));
-                                mount_enter_mounted(mount, MOUNT_SUCCESS);
-                                break;
+static void mount_flush_rescan(Manager *m) {
+        assert(m);
 
-                        case MOUNT_MOUNTING:
-                                mount_set_state(mount, MOUNT_MOUNTING_DONE);
-                                break;
+        if (mount_rescan_pending(m))
+                (void) mount_rescan(m);
+}
 
-                        default:
-                                /* Nothing really changed, but let's
-                                 * issue an notification call
-                                 * nonetheless, in case somebody is
-                                 * waiting for this. (e.g. file system
-                                 * ro/rw remounts.) */
-                                mount_set_state(mount, mount->state);
-                                break;
-                        }
-                }
+static int mount_schedule_rescan(Manager *m) {
+        usec_t next;
+        int r;
 
-                if (mount_is_mounted(mount) &&
-                    mount->from_proc_self_mountinfo &&
-                    mount->parameters_proc_self_mountinfo.what) {
+        assert(m);
 
-                        if (set_ensure_allocated(&around, &string_hash_ops) < 0 ||
-                            set_put(around, mount->parameters_proc_self_mountinfo.what) < 0)
-                                log_oom();
-                }
+        /* Setting up many mounts at once results in a burst of events, and rescanning the table for each of them
+         * is a waste. Hence rescan right away only if the last rescan was a while ago, and delay it otherwise, so
+         * that all events coming in in the meantime are dealt with by a single rescan. */
 
-                /* Reset the flags for later calls */
-                mount->is_mounted = mount->just_mounted = mount->just_changed = false;
-        }
+        if (mount_rescan_pending(m))
+                return 0;
 
-        SET_FOREACH(what, gone, i) {
-                if (set_contains(around, what))
-                        continue;
+        next = usec_add(m->mount_rescan_timestamp, MOUNT_RESCAN_INTERVAL_USEC);
+        if (now(CLOCK_MONOTONIC) >= next)
+                return mount_rescan(m);
 
-                /* Let the device units know that the device is no longer mounted */
-                (void) device_found_node(m, what, false, DEVICE_FOUND_MOUNT, true);
+        if (m->mount_rescan_event_source) {
+                r = sd_event_source_set_time(m->mount_rescan_event_source, next);
+                if (r < 0)
+                        goto fail;
+
+                r = sd_event_source_set_enabled(m->mount_rescan_event_source, SD_EVENT_ONESHOT);
+                if (r < 0)
+                        goto fail;
+
+                return 0;
         }
 
+        r = sd_event_add_time(m->event, &m->mount_rescan_event_source, CLOCK_MONOTONIC, next, USEC_PER_MSEC, mount_dispatch_rescan, m);
+        if (r < 0)
+                goto fail;
+
+        /* Same priority as the mount monitor */
+        r = sd_event_source_set_priority(m->mount_rescan_event_source, -10);
+        if (r < 0)
+                goto fail;
+
+        (void) sd_event_source_set_description(m->mount_rescan_event_source, "mount-rescan");
+
         return 0;
+
+fail:
+        log_warning_errno(r, "Failed to delay mount table rescan, rescanning right away: %m");
+        return mount_rescan(m);
+}
+
+static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        int r;
+
+        assert(m);
+        assert(revents & EPOLLIN);
+
+        if (fd == mnt_monitor_get_fd(m->mount_monitor)) {
+                bool rescan = false;
+
+                /* Drain all events and verify that the event is valid.
+                 *
+                 * Note that libmount also monitors /run/mount mkdir if the
+                 * directory does not exist yet. The mkdir may generate event
+                 * which is irrelevant for us.
+                 *
+                 * error: r < 0; valid: r == 0, false positive: rc == 1 */
+                do {
+                        r = mnt_monitor_next_change(m->mount_monitor, NULL, NULL);
+                        if (r == 0)
+                                rescan = true;
+                        else if (r < 0)
+                                return log_error_errno(r, "Failed to drain libmount events");
+                } while (r == 0);
+
+                log_debug("libmount event [rescan: %s]", yes_no(rescan));
+                if (!rescan)
+                        return 0;
+        }
+
+        return mount_schedule_rescan(m);
 }
 
 static void mount_reset_failed(Unit *u) {
@@ -61,6 +61,9 @@
 #include "unit.h"
 #include "user-util.h"
 
+/* The maximum size of the pool of workers of an Accept=yes socket. Each one is a unit loaded along with the socket. */
+#define SOCKET_WORKERS_MAX 1024U
+
 struct SocketPeer {
         unsigned n_ref;
 
@@ -254,6 +257,39 @@ int socket_instantiate_service(Socket *s) {
         return unit_add_two_dependencies(UNIT(s), UNIT_BEFORE, UNIT_TRIGGERS, u, false, UNIT_DEPENDENCY_IMPLICIT);
 }
 
+static int socket_add_workers(Socket *s) {
+        _cleanup_free_ char *prefix = NULL;
+        unsigned k;
+        int r;
+
+        assert(s);
+
+        /* For Accept=yes sockets with Workers= set, the instances of the template service making up the pool are
+         * known in advance, just like the service of Accept=no sockets, hence hook them up at load time already. */
+
+        r = unit_name_to_prefix(UNIT(s)->id, &prefix);
+        if (r < 0)
+                return r;
+
+        for (k = 0; k < s->n_workers; k++) {
+                _cleanup_free_ char *name = NULL;
+                Unit *u;
+
+                if (asprintf(&name, "%s@worker%u.service", prefix, k) < 0)
+                        return -ENOMEM;
+
+                r = manager_load_unit(UNIT(s)->manager, name, NULL, NULL, &u);
+                if (r < 0)
+                        return r;
+
+                r = unit_add_two_dependencies(UNIT(s), UNIT_BEFORE, UNIT_TRIGGERS, u, true, UNIT_DEPENDENCY_IMPLICIT);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
 static bool have_non_accept_socket(Socket *s) {
         SocketPort *p;
 
@@ -355,13 +391,14 @@ static int socket_add_extras(Socket *s) {
          * off the queues, which it might not necessarily do. Moreover, while Accept=no services are supposed to
          * process whatever is queued in one go, and thus should normally never have to be started frequently. This is
          * different for Accept=yes where each connection is processed by a new service instance, and thus frequent
-         * service starts are typical. */
+         * service starts are typical. With Workers= the pool of instances takes the traffic off the queues, and is
+         * only started once, hence it is treated like Accept=no. */
 
         if (s->trigger_limit.interval == USEC_INFINITY)
                 s->trigger_limit.interval = 2 * USEC_PER_SEC;
 
         if (s->trigger_limit.burst == (unsigned) -1) {
-                if (s->accept)
+                if (s->accept && s->n_workers == 0)
                         s->trigger_limit.burst = 200;
                 else
                         s->trigger_limit.burst = 20;
@@ -384,6 +421,13 @@ static int socket_add_extras(Socket *s) {
                         return r;
         }
 
+        /* An oversized pool is refused by socket_verify(), don't load all its units first */
+        if (s->accept && s->n_workers > 0 && s->n_workers <= SOCKET_WORKERS_MAX) {
+                r = socket_add_workers(s);
+                if (r < 0)
+                        return r;
+        }
+
         r = socket_add_mount_dependencies(s);
         if (r < 0)
                 return r;
@@ -461,6 +505,16 @@ static int socket_verify(Socket *s) {
                 return -EINVAL;
         }
 
+        if (!s->accept && s->n_workers > 0) {
+                log_unit_error(UNIT(s), "Workers= setting requires Accept=yes. Refusing.");
+                return -EINVAL;
+        }
+
+        if (s->n_workers > SOCKET_WORKERS_MAX) {
+                log_unit_error(UNIT(s), "Workers= setting too large, at most %u are supported. Refusing.", SOCKET_WORKERS_MAX);
+                return -EINVAL;
+        }
+
         if (s->accept && s->max_connections <= 0) {
                 log_unit_error(UNIT(s), "MaxConnection= setting too small. Refusing.");
                 return -EINVAL;
@@ -715,10 +769,12 @@ static void socket_dump(Unit *u, FILE *f, const char *prefix) {
                 fprintf(f,
                         "%sAccepted: %u\n"
                         "%sNConnections: %u\n"
-                        "%sMaxConnections: %u\n",
+                        "%sMaxConnections: %u\n"
+                        "%sWorkers: %u\n",
                         prefix, s->n_accepted,
                         prefix, s->n_connections,
-                        prefix, s->max_connections);
+                        prefix, s->max_connections,
+                        prefix, s->n_workers);
 
         if (s->priority >= 0)
                 fprintf(f,
@@ -2225,6 +2281,41 @@ static void flush_ports(Socket *s) {
         }
 }
 
+static int socket_start_workers(Socket *s, sd_bus_error *error) {
+        Unit *other;
+        Iterator i;
+        int r;
+
+        assert(s);
+
+        /* Starts all workers of the pool that aren't running or about to, which get the listening sockets passed,
+         * like the service of an Accept=no socket. */
+
+        UNIT_DEPENDENCY_SET_FOREACH(other, UNIT(s)->dependencies[UNIT_TRIGGERS], i) {
+                if (other->type != UNIT_SERVICE || unit_active_or_pending(other))
+                        continue;
+
+                r = manager_add_job(UNIT(s)->manager, JOB_START, other, JOB_REPLACE, error, NULL);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static bool socket_has_active_workers(Socket *s) {
+        Unit *other;
+        Iterator i;
+
+        assert(s);
+
+        UNIT_DEPENDENCY_SET_FOREACH(other, UNIT(s)->dependencies[UNIT_TRIGGERS], i)
+                if (other->type == UNIT_SERVICE && unit_active_or_pending(other))
+                        return true;
+
+        return false;
+}
+
 static void socket_enter_running(Socket *s, int cfd) {
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         int r;
@@ -2254,15 +2345,21 @@ static void socket_enter_running(Socket *s, int cfd) {
                 return;
         }
 
-        if (cfd < 0) {
+        if (cfd < 0 && s->accept) {
+                /* Accept=yes with Workers= set: (re)start the pool, the workers accept connections themselves */
+                r = socket_start_workers(s, &error);
+                if (r < 0)
+                        goto fail;
+
+                socket_set_state(s, SOCKET_RUNNING);
+        } else if (cfd < 0) {
                 bool pending = false;
                 Unit *other;
                 Iterator i;
-                void *v;
 
                 /* If there's already a start pending don't bother to
                  * do anything */
-                HASHMAP_FOREACH_KEY(v, other, UNIT(s)->dependencies[UNIT_TRIGGERS], i)
+                UNIT_DEPENDENCY_SET_FOREACH(other, UNIT(s)->dependencies[UNIT_TRIGGERS], i)
                         if (unit_active_or_pending(other)) {
                                 pending = true;
                                 break;
@@ -2371,7 +2468,7 @@ static void socket_enter_running(Socket *s, int cfd) {
 
 fail:
         log_unit_warning(UNIT(s), "Failed to queue service startup job (Maybe the service file is missing or not a %s unit?): %s",
-                         cfd >= 0 ? "template" : "non-template",
+                         s->accept ? "template" : "non-template",
                          bus_error_message(&error, r));
 
         socket_enter_stop_pre(s, SOCKET_FAILURE_RESOURCES);
@@ -2901,6 +2998,7 @@ static int socket_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
         }
 
         if (p->socket->accept &&
+            p->socket->n_workers == 0 &&
             p->type == SOCKET_SOCKET &&
             socket_address_can_accept(&p->address)) {
 
@@ -3159,8 +3257,8 @@ static void socket_trigger_notify(Unit *u, Unit *other) {
         if (!IN_SET(s->state, SOCKET_RUNNING, SOCKET_LISTENING))
                 return;
 
-        /* We don't care for the service state if we are in Accept=yes mode */
-        if (s->accept)
+        /* We don't care for the service state if we are in Accept=yes mode, unless we manage a pool of workers */
+        if (s->accept && s->n_workers == 0)
                 return;
 
         /* Propagate start limit hit state */
@@ -3176,8 +3274,15 @@ static void socket_trigger_notify(Unit *u, Unit *other) {
         if (IN_SET(SERVICE(other)->state,
                    SERVICE_DEAD, SERVICE_FAILED,
                    SERVICE_FINAL_SIGTERM, SERVICE_FINAL_SIGKILL,
-                   SERVICE_AUTO_RESTART))
-               socket_enter_listening(s);
+                   SERVICE_AUTO_RESTART)) {
+
+                /* Replace a worker that went away, as long as the others are still around. Once the whole pool is
+                 * gone, we wait for traffic again, and start it anew then. */
+                if (s->accept && s->state == SOCKET_RUNNING && socket_has_active_workers(s))
+                        socket_enter_running(s, -1);
+                else
+                        socket_enter_listening(s);
+        }
 
         if (SERVICE(other)->state == SERVICE_RUNNING)
                 socket_set_state(s, SOCKET_RUNNING);
@@ -88,6 +88,10 @@ struct Socket {
         unsigned max_connections;
         unsigned max_connections_per_source;
 
+        /* For Accept=yes sockets, the number of template instances that get the listening sockets passed and
+         * accept connections themselves, instead of one instance being spawned per connection */
+        unsigned n_workers;
+
         unsigned backlog;
         unsigned keep_alive_cnt;
         usec_t timeout_usec;
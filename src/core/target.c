@@ -71,9 +71,8 @@ static int target_add_default_dependencies(Target *t) {
         for (k = 0; k < ELEMENTSOF(deps); k++) {
                 Unit *other;
                 Iterator i;
-                void *v;
 
-                HASHMAP_FOREACH_KEY(v, other, UNIT(t)->dependencies[deps[k]], i) {
+                UNIT_DEPENDENCY_SET_FOREACH(other, UNIT(t)->dependencies[deps[k]], i) {
                         r = unit_add_default_target_dependency(other, UNIT(t));
                         if (r < 0)
                                 return r;
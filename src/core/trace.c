@@ -0,0 +1,173 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "alloc-util.h"
+#include "string-table.h"
+#include "trace.h"
+
+static const char *trace_ref_object(Trace *t, const char *object) {
+        void *v, *k = NULL;
+        char *copy;
+
+        assert(t);
+
+        if (!object)
+                return NULL;
+
+        v = hashmap_get2(t->objects, object, &k);
+        if (v) {
+                (void) hashmap_update(t->objects, k, UINT_TO_PTR(PTR_TO_UINT(v) + 1));
+                return k;
+        }
+
+        if (hashmap_ensure_allocated(&t->objects, &string_hash_ops) < 0)
+                return NULL;
+
+        copy = strdup(object);
+        if (!copy)
+                return NULL;
+
+        if (hashmap_put(t->objects, copy, UINT_TO_PTR(1)) < 0) {
+                free(copy);
+                return NULL;
+        }
+
+        return copy;
+}
+
+static void trace_unref_object(Trace *t, const char *object) {
+        unsigned n;
+
+        assert(t);
+
+        if (!object)
+                return;
+
+        n = PTR_TO_UINT(hashmap_get(t->objects, object));
+        assert(n > 0);
+
+        if (n > 1) {
+                (void) hashmap_update(t->objects, object, UINT_TO_PTR(n - 1));
+                return;
+        }
+
+        (void) hashmap_remove(t->objects, object);
+        free((char*) object);
+}
+
+void trace_add(Trace *t, TraceCategory category, const char *name, const char *object, usec_t begin, usec_t duration) {
+        TraceEvent *e;
+
+        assert(t);
+        assert(category >= 0 && category < _TRACE_CATEGORY_MAX);
+        assert(name);
+
+        /* Tracing is best effort, hence if we cannot allocate the ring, we simply don't record anything */
+        if (!t->events) {
+                t->events = new(TraceEvent, TRACE_EVENTS_MAX);
+                if (!t->events)
+                        return;
+        }
+
+        e = t->events + t->n_events % TRACE_EVENTS_MAX;
+
+        /* Take the new reference first, the old event might refer to the same object */
+        object = trace_ref_object(t, object);
+        if (t->n_events >= TRACE_EVENTS_MAX)
+                trace_unref_object(t, e->object);
+
+        *e = (TraceEvent) {
+                .category = category,
+                .name = name,
+                .object = object,
+                .begin = begin,
+                .duration = duration,
+        };
+
+        t->n_events++;
+}
+
+void trace_add_pinned(Trace *t, TraceCategory category, const char *name, const char *object, usec_t begin, usec_t duration) {
+        assert(t);
+        assert(category >= 0 && category < _TRACE_CATEGORY_MAX);
+        assert(name);
+
+        if (t->n_pinned >= TRACE_PINNED_MAX ||
+            !GREEDY_REALLOC(t->pinned, t->n_pinned_allocated, t->n_pinned + 1)) {
+                trace_add(t, category, name, object, begin, duration);
+                return;
+        }
+
+        t->pinned[t->n_pinned++] = (TraceEvent) {
+                .category = category,
+                .name = name,
+                .object = trace_ref_object(t, object),
+                .begin = begin,
+                .duration = duration,
+        };
+}
+
+void trace_done(Trace *t) {
+        char *object;
+
+        assert(t);
+
+        while ((object = hashmap_steal_first_key(t->objects)))
+                free(object);
+
+        t->objects = hashmap_free(t->objects);
+        t->events = mfree(t->events);
+        t->n_events = 0;
+        t->pinned = mfree(t->pinned);
+        t->n_pinned = t->n_pinned_allocated = 0;
+}
+
+size_t trace_size(const Trace *t) {
+        assert(t);
+
+        return t->n_pinned + (size_t) MIN(t->n_events, (uint64_t) TRACE_EVENTS_MAX);
+}
+
+const TraceEvent *trace_get(const Trace *t, size_t i) {
+        uint64_t first;
+
+        assert(t);
+
+        /* Returns the pinned events first, and then the ones in the ring, each in the order they were added, i.e.
+         * the oldest one first */
+
+        if (i >= trace_size(t))
+                return NULL;
+
+        if (i < t->n_pinned)
+                return t->pinned + i;
+
+        i -= t->n_pinned;
+
+        first = t->n_events > TRACE_EVENTS_MAX ? t->n_events - TRACE_EVENTS_MAX : 0;
+
+        return t->events + (first + i) % TRACE_EVENTS_MAX;
+}
+
+static const char* const trace_category_table[_TRACE_CATEGORY_MAX] = {
+        [TRACE_MANAGER] = "manager",
+        [TRACE_JOB] = "job",
+        [TRACE_GENERATOR] = "generator",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(trace_category, TraceCategory);
@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include "hashmap.h"
+#include "macro.h"
+#include "time-util.h"
+
+/* The trace is a ring buffer of the last TRACE_EVENTS_MAX spans of time the manager spent in its various phases, for
+ * "systemd-analyze trace". Recording an event is cheap: the names are static strings, and the objects (unit names,
+ * generators) are stored only once, for as long as an event in the ring refers to them.
+ *
+ * The one-off phases of startup and reloading (generators, enumeration, coldplug) are pinned: they are kept in a
+ * separate buffer that the per-unit events never overwrite, so that they are still around after a busy boot. Only
+ * the first TRACE_PINNED_MAX of them are kept there, later ones go into the ring too. */
+
+#define TRACE_EVENTS_MAX 8192U
+#define TRACE_PINNED_MAX 1024U
+
+typedef enum TraceCategory {
+        TRACE_MANAGER,          /* Work done by the manager itself, properly nested */
+        TRACE_JOB,              /* Time a job spent waiting in the queue, and running */
+        TRACE_GENERATOR,        /* Generator processes, run in parallel */
+        _TRACE_CATEGORY_MAX,
+        _TRACE_CATEGORY_INVALID = -1,
+} TraceCategory;
+
+typedef struct TraceEvent {
+        TraceCategory category;
+        const char *name;
+        const char *object;
+        usec_t begin;           /* CLOCK_MONOTONIC */
+        usec_t duration;
+} TraceEvent;
+
+typedef struct Trace {
+        TraceEvent *events;
+        uint64_t n_events;      /* How many events were added in total */
+        TraceEvent *pinned;
+        size_t n_pinned, n_pinned_allocated;
+        Hashmap *objects;       /* object → number of events referring to it */
+} Trace;
+
+void trace_add(Trace *t, TraceCategory category, const char *name, const char *object, usec_t begin, usec_t duration);
+void trace_add_pinned(Trace *t, TraceCategory category, const char *name, const char *object, usec_t begin, usec_t duration);
+void trace_done(Trace *t);
+
+size_t trace_size(const Trace *t);
+const TraceEvent *trace_get(const Trace *t, size_t i);
+
+/* Records work of the manager that started at 'begin' and ends now */
+#define trace_span(t, name, object, begin)                              \
+        ({                                                              \
+                usec_t _begin = (begin);                                \
+                trace_add((t), TRACE_MANAGER, (name), (object), _begin, now(CLOCK_MONOTONIC) - _begin); \
+        })
+
+#define trace_span_pinned(t, name, object, begin)                       \
+        ({                                                              \
+                usec_t _begin = (begin);                                \
+                trace_add_pinned((t), TRACE_MANAGER, (name), (object), _begin, now(CLOCK_MONOTONIC) - _begin); \
+        })
+
+const char *trace_category_to_string(TraceCategory c) _const_;
+TraceCategory trace_category_from_string(const char *s) _pure_;
@@ -306,8 +306,8 @@ static void transaction_drop_redundant(Transaction *tr) {
 
         assert(tr);
 
-rescan:
         HASHMAP_FOREACH(j, tr->jobs, i) {
+                Unit *u = j->unit;
                 Job *k;
 
                 LIST_FOREACH(transaction, k, j) {
@@ -318,9 +318,13 @@ rescan:
                                 goto next_unit;
                 }
 
+                /* Dropping these jobs only removes the current entry, which is safe while iterating, and
+                 * doesn't make the jobs of any other unit more or less redundant. Hence there's no need to
+                 * start over, which made this quadratic for transactions with many redundant jobs. */
+
                 /* log_debug("Found redundant job %s/%s, dropping.", j->unit->id, job_type_to_string(j->type)); */
-                transaction_delete_job(tr, j, false);
-                goto rescan;
+                while ((k = hashmap_get(tr->jobs, u)))
+                        transaction_delete_job(tr, k, false);
         next_unit:;
         }
 }
@@ -358,103 +362,132 @@ static char* merge_unit_ids(const char* unit_log_field, char **pairs) {
         return ans;
 }
 
-static int transaction_verify_order_one(Transaction *tr, Job *j, Job *from, unsigned generation, sd_bus_error *e) {
-        Iterator i;
-        Unit *u;
-        void *v;
-        int r;
+static int transaction_break_order_cycle(Transaction *tr, Job *j, Job *from, unsigned generation, sd_bus_error *e) {
+        Job *k, *delete = NULL;
+        _cleanup_free_ char **array = NULL, *unit_ids = NULL;
+        char **unit_id, **job_type;
 
         assert(tr);
         assert(j);
-        assert(!j->transaction_prev);
+        assert(from);
 
-        /* Does a recursive sweep through the ordering graph, looking
-         * for a cycle. If we find a cycle we try to break it. */
+        /* So, we reached j again from 'from', and j is still on our path. We have
+         * a cycle. Let's try to break it. We go backwards in our path and
+         * try to find a suitable job to remove. We use the marker to find
+         * our way back, since smart how we are we stored our way back in
+         * there. */
 
-        /* Have we seen this before? */
-        if (j->generation == generation) {
-                Job *k, *delete = NULL;
-                _cleanup_free_ char **array = NULL, *unit_ids = NULL;
-                char **unit_id, **job_type;
+        for (k = from; k; k = ((k->generation == generation && k->marker != k) ? k->marker : NULL)) {
 
-                /* If the marker is NULL we have been here already and
-                 * decided the job was loop-free from here. Hence
-                 * shortcut things and return right-away. */
-                if (!j->marker)
-                        return 0;
+                /* For logging below */
+                if (strv_push_pair(&array, k->unit->id, (char*) job_type_to_string(k->type)) < 0)
+                        log_oom();
 
-                /* So, the marker is not NULL and we already have been here. We have
-                 * a cycle. Let's try to break it. We go backwards in our path and
-                 * try to find a suitable job to remove. We use the marker to find
-                 * our way back, since smart how we are we stored our way back in
-                 * there. */
+                if (!delete && hashmap_get(tr->jobs, k->unit) && !unit_matters_to_anchor(k->unit, k))
+                        /* Ok, we can drop this one, so let's do so. */
+                        delete = k;
 
-                for (k = from; k; k = ((k->generation == generation && k->marker != k) ? k->marker : NULL)) {
-
-                        /* For logging below */
-                        if (strv_push_pair(&array, k->unit->id, (char*) job_type_to_string(k->type)) < 0)
-                                log_oom();
-
-                        if (!delete && hashmap_get(tr->jobs, k->unit) && !unit_matters_to_anchor(k->unit, k))
-                                /* Ok, we can drop this one, so let's do so. */
-                                delete = k;
-
-                        /* Check if this in fact was the beginning of the cycle */
-                        if (k == j)
-                                break;
-                }
+                /* Check if this in fact was the beginning of the cycle */
+                if (k == j)
+                        break;
+        }
 
-                unit_ids = merge_unit_ids(j->manager->unit_log_field, array); /* ignore error */
-
-                STRV_FOREACH_PAIR(unit_id, job_type, array)
-                        /* logging for j not k here to provide a consistent narrative */
-                        log_struct(LOG_WARNING,
-                                   "MESSAGE=%s: Found %s on %s/%s",
-                                   j->unit->id,
-                                   unit_id == array ? "ordering cycle" : "dependency",
-                                   *unit_id, *job_type,
-                                   unit_ids, NULL);
-
-                if (delete) {
-                        const char *status;
-                        /* logging for j not k here to provide a consistent narrative */
-                        log_struct(LOG_ERR,
-                                   "MESSAGE=%s: Job %s/%s deleted to break ordering cycle starting with %s/%s",
-                                   j->unit->id, delete->unit->id, job_type_to_string(delete->type),
-                                   j->unit->id, job_type_to_string(j->type),
-                                   unit_ids, NULL);
-
-                        if (log_get_show_color())
-                                status = ANSI_HIGHLIGHT_RED " SKIP " ANSI_NORMAL;
-                        else
-                                status = " SKIP ";
+        unit_ids = merge_unit_ids(j->manager->unit_log_field, array); /* ignore error */
 
-                        unit_status_printf(delete->unit, status,
-                                           "Ordering cycle found, skipping %s");
-                        transaction_delete_unit(tr, delete->unit);
-                        return -EAGAIN;
-                }
+        STRV_FOREACH_PAIR(unit_id, job_type, array)
+                /* logging for j not k here to provide a consistent narrative */
+                log_struct(LOG_WARNING,
+                           "MESSAGE=%s: Found %s on %s/%s",
+                           j->unit->id,
+                           unit_id == array ? "ordering cycle" : "dependency",
+                           *unit_id, *job_type,
+                           unit_ids, NULL);
 
+        if (delete) {
+                const char *status;
+                /* logging for j not k here to provide a consistent narrative */
                 log_struct(LOG_ERR,
-                           "MESSAGE=%s: Unable to break cycle starting with %s/%s",
-                           j->unit->id, j->unit->id, job_type_to_string(j->type),
+                           "MESSAGE=%s: Job %s/%s deleted to break ordering cycle starting with %s/%s",
+                           j->unit->id, delete->unit->id, job_type_to_string(delete->type),
+                           j->unit->id, job_type_to_string(j->type),
                            unit_ids, NULL);
 
-                return sd_bus_error_setf(e, BUS_ERROR_TRANSACTION_ORDER_IS_CYCLIC,
-                                         "Transaction order is cyclic. See system logs for details.");
+                if (log_get_show_color())
+                        status = ANSI_HIGHLIGHT_RED " SKIP " ANSI_NORMAL;
+                else
+                        status = " SKIP ";
+
+                unit_status_printf(delete->unit, status,
+                                   "Ordering cycle found, skipping %s");
+                transaction_delete_unit(tr, delete->unit);
+                return -EAGAIN;
         }
 
+        log_struct(LOG_ERR,
+                   "MESSAGE=%s: Unable to break cycle starting with %s/%s",
+                   j->unit->id, j->unit->id, job_type_to_string(j->type),
+                   unit_ids, NULL);
+
+        return sd_bus_error_setf(e, BUS_ERROR_TRANSACTION_ORDER_IS_CYCLIC,
+                                 "Transaction order is cyclic. See system logs for details.");
+}
+
+typedef struct VerifyOrderFrame {
+        Job *job;
+        Iterator i;
+} VerifyOrderFrame;
+
+static int transaction_verify_order_one(
+                Transaction *tr,
+                Job *j,
+                unsigned generation,
+                VerifyOrderFrame **stack,
+                size_t *n_allocated,
+                sd_bus_error *e) {
+
+        size_t n = 0;
+
+        assert(tr);
+        assert(j);
+        assert(stack);
+        assert(n_allocated);
+        assert(!j->transaction_prev);
+
+        /* Does a depth-first sweep through the ordering graph, looking
+         * for a cycle. If we find a cycle we try to break it. Ordering
+         * chains can be thousands of units long, hence we keep our own
+         * stack instead of recursing, and reuse it between calls. */
+
+        /* If we have been here already, we decided the job was
+         * loop-free from here. Hence shortcut things and return
+         * right-away. */
+        if (j->generation == generation)
+                return 0;
+
         /* Make the marker point to where we come from, so that we can
          * find our way backwards if we want to break a cycle. We use
          * a special marker for the beginning: we point to
          * ourselves. */
-        j->marker = from ? from : j;
+        j->marker = j;
         j->generation = generation;
 
-        /* We assume that the dependencies are bidirectional, and
-         * hence can ignore UNIT_AFTER */
-        HASHMAP_FOREACH_KEY(v, u, j->unit->dependencies[UNIT_BEFORE], i) {
-                Job *o;
+        if (!GREEDY_REALLOC(*stack, *n_allocated, 1))
+                return -ENOMEM;
+        (*stack)[n++] = (VerifyOrderFrame) { .job = j, .i = ITERATOR_FIRST };
+
+        while (n > 0) {
+                Job *from = (*stack)[n-1].job, *o;
+                Unit *u;
+
+                /* We assume that the dependencies are bidirectional, and
+                 * hence can ignore UNIT_AFTER */
+                if (!unit_dependency_set_iterate(from->unit->dependencies[UNIT_BEFORE], &(*stack)[n-1].i, NULL, &u)) {
+                        /* Ok, let's backtrack, and remember that this entry is not on
+                         * our path anymore. */
+                        from->marker = NULL;
+                        n--;
+                        continue;
+                }
 
                 /* Is there a job for this unit? */
                 o = hashmap_get(tr->jobs, u);
@@ -467,19 +500,30 @@ static int transaction_verify_order_one(Transaction *tr, Job *j, Job *from, unsi
                                 continue;
                 }
 
-                r = transaction_verify_order_one(tr, o, j, generation, e);
-                if (r < 0)
-                        return r;
-        }
+                assert(!o->transaction_prev);
 
-        /* Ok, let's backtrack, and remember that this entry is not on
-         * our path anymore. */
-        j->marker = NULL;
+                if (o->generation == generation) {
+                        /* A NULL marker means we checked this one completely already */
+                        if (!o->marker)
+                                continue;
+
+                        return transaction_break_order_cycle(tr, o, from, generation, e);
+                }
+
+                o->marker = from;
+                o->generation = generation;
+
+                if (!GREEDY_REALLOC(*stack, *n_allocated, n + 1))
+                        return -ENOMEM;
+                (*stack)[n++] = (VerifyOrderFrame) { .job = o, .i = ITERATOR_FIRST };
+        }
 
         return 0;
 }
 
 static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bus_error *e) {
+        _cleanup_free_ VerifyOrderFrame *stack = NULL;
+        size_t n_allocated = 0;
         Job *j;
         int r;
         Iterator i;
@@ -494,7 +538,7 @@ static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bu
         g = (*generation)++;
 
         HASHMAP_FOREACH(j, tr->jobs, i) {
-                r = transaction_verify_order_one(tr, j, NULL, g, e);
+                r = transaction_verify_order_one(tr, j, g, &stack, &n_allocated, e);
                 if (r < 0)
                         return r;
         }
@@ -504,26 +548,33 @@ static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bu
 
 static void transaction_collect_garbage(Transaction *tr) {
         Iterator i;
+        bool again;
         Job *j;
 
         assert(tr);
 
         /* Drop jobs that are not required by any other job */
 
-rescan:
-        HASHMAP_FOREACH(j, tr->jobs, i) {
-                if (tr->anchor_job == j || j->object_list) {
-                        /* log_debug("Keeping job %s/%s because of %s/%s", */
-                        /*           j->unit->id, job_type_to_string(j->type), */
-                        /*           j->object_list->subject ? j->object_list->subject->unit->id : "root", */
-                        /*           j->object_list->subject ? job_type_to_string(j->object_list->subject->type) : "root"); */
-                        continue;
-                }
+        /* A job without any job depending on it takes no other job with it when deleted, hence this only
+         * removes the current entry, which is safe while iterating. It may leave the jobs it pulled in
+         * unreferenced though, hence repeat until nothing changes. */
+        do {
+                again = false;
+
+                HASHMAP_FOREACH(j, tr->jobs, i) {
+                        if (tr->anchor_job == j || j->object_list) {
+                                /* log_debug("Keeping job %s/%s because of %s/%s", */
+                                /*           j->unit->id, job_type_to_string(j->type), */
+                                /*           j->object_list->subject ? j->object_list->subject->unit->id : "root", */
+                                /*           j->object_list->subject ? job_type_to_string(j->object_list->subject->type) : "root"); */
+                                continue;
+                        }
 
-                /* log_debug("Garbage collecting job %s/%s", j->unit->id, job_type_to_string(j->type)); */
-                transaction_delete_job(tr, j, true);
-                goto rescan;
-        }
+                        /* log_debug("Garbage collecting job %s/%s", j->unit->id, job_type_to_string(j->type)); */
+                        transaction_delete_job(tr, j, true);
+                        again = true;
+                }
+        } while (again);
 }
 
 static int transaction_is_destructive(Transaction *tr, JobMode mode, sd_bus_error *e) {
@@ -863,13 +914,12 @@ void transaction_add_propagate_reload_jobs(Transaction *tr, Unit *unit, Job *by,
         Iterator i;
         JobType nt;
         Unit *dep;
-        void *v;
         int r;
 
         assert(tr);
         assert(unit);
 
-        HASHMAP_FOREACH_KEY(v, dep, unit->dependencies[UNIT_PROPAGATES_RELOAD_TO], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(dep, unit->dependencies[UNIT_PROPAGATES_RELOAD_TO], i) {
                 nt = job_type_collapse(JOB_TRY_RELOAD, dep);
                 if (nt == JOB_NOP)
                         continue;
@@ -899,7 +949,6 @@ int transaction_add_job_and_dependencies(
         Iterator i;
         Unit *dep;
         Job *ret;
-        void *v;
         int r;
 
         assert(tr);
@@ -973,7 +1022,7 @@ int transaction_add_job_and_dependencies(
 
                 /* Finally, recursively add in all dependencies. */
                 if (IN_SET(type, JOB_START, JOB_RESTART)) {
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_REQUIRES], i) {
+                        UNIT_DEPENDENCY_SET_FOREACH(dep, ret->unit->dependencies[UNIT_REQUIRES], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, true, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -983,7 +1032,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_BINDS_TO], i) {
+                        UNIT_DEPENDENCY_SET_FOREACH(dep, ret->unit->dependencies[UNIT_BINDS_TO], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, true, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -993,7 +1042,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_WANTS], i) {
+                        UNIT_DEPENDENCY_SET_FOREACH(dep, ret->unit->dependencies[UNIT_WANTS], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, false, false, false, ignore_order, e);
                                 if (r < 0) {
                                         /* unit masked, job type not applicable and unit not found are not considered as errors. */
@@ -1005,7 +1054,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_REQUISITE], i) {
+                        UNIT_DEPENDENCY_SET_FOREACH(dep, ret->unit->dependencies[UNIT_REQUISITE], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_VERIFY_ACTIVE, dep, ret, true, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -1015,7 +1064,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_CONFLICTS], i) {
+                        UNIT_DEPENDENCY_SET_FOREACH(dep, ret->unit->dependencies[UNIT_CONFLICTS], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_STOP, dep, ret, true, true, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -1025,7 +1074,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_CONFLICTED_BY], i) {
+                        UNIT_DEPENDENCY_SET_FOREACH(dep, ret->unit->dependencies[UNIT_CONFLICTED_BY], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_STOP, dep, ret, false, false, false, ignore_order, e);
                                 if (r < 0) {
                                         log_unit_warning(dep,
@@ -1054,7 +1103,7 @@ int transaction_add_job_and_dependencies(
                         ptype = type == JOB_RESTART ? JOB_TRY_RESTART : type;
 
                         for (j = 0; j < ELEMENTSOF(propagate_deps); j++)
-                                HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[propagate_deps[j]], i) {
+                                UNIT_DEPENDENCY_SET_FOREACH(dep, ret->unit->dependencies[propagate_deps[j]], i) {
                                         JobType nt;
 
                                         nt = job_type_collapse(ptype, dep);
@@ -1092,7 +1141,7 @@ int transaction_add_isolate_jobs(Transaction *tr, Manager *m) {
         assert(tr);
         assert(m);
 
-        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+        FLAT_HASHMAP_FOREACH_KEY(u, k, m->units, i) {
 
                 /* ignore aliases */
                 if (u->id != k)
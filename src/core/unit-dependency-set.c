@@ -0,0 +1,397 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "alloc-util.h"
+#include "unit-dependency-set.h"
+#include "util.h"
+
+/* Sets with up to this many allocated entries are searched linearly, larger ones get a hash index */
+#define INDEX_MIN_ENTRIES 16U
+
+#define IDX_NIL UINT_MAX
+
+typedef struct UnitDependencyEntry {
+        Unit *unit;
+        void *data;
+} UnitDependencyEntry;
+
+struct UnitDependencySet {
+        uint32_t n_entries;
+        uint32_t n_allocated;
+
+        UnitDependencyEntry entries[];
+
+        /* If n_allocated is larger than INDEX_MIN_ENTRIES, it is a power of two, and the entries are followed by
+         * an open addressing hash table with linear probing and 2 * n_allocated slots, mapping units to their
+         * position in entries[]. Slots store the position plus one, so that zero marks a free slot. As the table
+         * is sized for n_allocated, it never needs to grow on its own. */
+};
+
+static uint32_t *index_get(const UnitDependencySet *s) {
+        if (s->n_allocated <= INDEX_MIN_ENTRIES)
+                return NULL;
+
+        return (uint32_t*) (s->entries + s->n_allocated);
+}
+
+static unsigned index_bits(const UnitDependencySet *s) {
+        return log2u(s->n_allocated) + 1;
+}
+
+static unsigned index_hash(const UnitDependencySet *s, const Unit *u) {
+        /* Fibonacci hashing of the pointer value. Unit objects are allocated by us, so there's no need for a
+         * keyed hash function here. */
+        return (unsigned) (((uint64_t) (uintptr_t) u * UINT64_C(0x9e3779b97f4a7c15)) >> (64 - index_bits(s)));
+}
+
+static unsigned index_mask(const UnitDependencySet *s) {
+        return 2 * s->n_allocated - 1;
+}
+
+static void index_insert(UnitDependencySet *s, unsigned idx) {
+        uint32_t *index = index_get(s);
+        unsigned slot;
+
+        assert(index);
+
+        for (slot = index_hash(s, s->entries[idx].unit); index[slot] != 0; slot = (slot + 1) & index_mask(s))
+                ;
+
+        index[slot] = idx + 1;
+}
+
+static void index_delete(UnitDependencySet *s, unsigned slot) {
+        uint32_t *index = index_get(s);
+        unsigned j = slot;
+
+        assert(index);
+
+        /* Backward shift deletion: move later entries of the same probe sequence into the hole, so that no
+         * tombstones are needed. */
+
+        index[slot] = 0;
+
+        for (;;) {
+                unsigned home;
+
+                j = (j + 1) & index_mask(s);
+                if (index[j] == 0)
+                        return;
+
+                home = index_hash(s, s->entries[index[j] - 1].unit);
+
+                /* Leave the entry where it is if its home slot lies cyclically in (slot, j] */
+                if (slot <= j ? (home > slot && home <= j) : (home > slot || home <= j))
+                        continue;
+
+                index[slot] = index[j];
+                index[j] = 0;
+                slot = j;
+        }
+}
+
+static unsigned find(const UnitDependencySet *s, const Unit *u, unsigned *ret_slot) {
+        uint32_t *index;
+        unsigned idx;
+
+        if (!s)
+                return IDX_NIL;
+
+        index = index_get(s);
+        if (index) {
+                unsigned slot;
+
+                for (slot = index_hash(s, u); index[slot] != 0; slot = (slot + 1) & index_mask(s))
+                        if (s->entries[index[slot] - 1].unit == u) {
+                                if (ret_slot)
+                                        *ret_slot = slot;
+                                return index[slot] - 1;
+                        }
+
+                return IDX_NIL;
+        }
+
+        for (idx = 0; idx < s->n_entries; idx++)
+                if (s->entries[idx].unit == u) {
+                        if (ret_slot)
+                                *ret_slot = IDX_NIL;
+                        return idx;
+                }
+
+        return IDX_NIL;
+}
+
+static int resize(UnitDependencySet **s, unsigned n_allocated) {
+        UnitDependencySet *n;
+        size_t size;
+        unsigned i;
+
+        assert(s);
+        assert(n_allocated > 0);
+        assert(n_allocated >= (*s ? (*s)->n_entries : 0));
+
+        if (n_allocated > INDEX_MIN_ENTRIES) {
+                if (n_allocated > UINT32_MAX / 4)
+                        return -ENOMEM;
+
+                n_allocated = 1U << log2u_round_up(n_allocated);
+                size = n_allocated * (sizeof(UnitDependencyEntry) + 2 * sizeof(uint32_t));
+        } else
+                size = n_allocated * sizeof(UnitDependencyEntry);
+
+        n = realloc(*s, offsetof(UnitDependencySet, entries) + size);
+        if (!n)
+                return -ENOMEM;
+
+        if (!*s)
+                n->n_entries = 0;
+        n->n_allocated = n_allocated;
+
+        if (index_get(n)) {
+                memzero(index_get(n), 2 * n_allocated * sizeof(uint32_t));
+
+                for (i = 0; i < n->n_entries; i++)
+                        index_insert(n, i);
+        }
+
+        *s = n;
+        return 0;
+}
+
+UnitDependencySet *unit_dependency_set_free(UnitDependencySet *s) {
+        return mfree(s);
+}
+
+int unit_dependency_set_put(UnitDependencySet **s, Unit *u, void *data) {
+        unsigned idx;
+        int r;
+
+        assert(s);
+        assert(u);
+
+        idx = find(*s, u, NULL);
+        if (idx != IDX_NIL)
+                return (*s)->entries[idx].data == data ? 0 : -EEXIST;
+
+        if (!*s || (*s)->n_entries >= (*s)->n_allocated) {
+                r = resize(s, *s ? (*s)->n_allocated * 2 : 1);
+                if (r < 0)
+                        return r;
+        }
+
+        idx = (*s)->n_entries++;
+        (*s)->entries[idx] = (UnitDependencyEntry) {
+                .unit = u,
+                .data = data,
+        };
+
+        if (index_get(*s))
+                index_insert(*s, idx);
+
+        return 1;
+}
+
+int unit_dependency_set_update(UnitDependencySet *s, Unit *u, void *data) {
+        unsigned idx;
+
+        idx = find(s, u, NULL);
+        if (idx == IDX_NIL)
+                return -ENOENT;
+
+        s->entries[idx].data = data;
+        return 0;
+}
+
+static void remove_entry(UnitDependencySet *s, unsigned idx, unsigned slot) {
+        unsigned last;
+
+        assert(s);
+        assert(idx < s->n_entries);
+
+        if (index_get(s))
+                index_delete(s, slot);
+
+        /* Fill the hole with the last entry. Iteration goes backwards, hence that entry has already been visited
+         * if we are removing the current entry while iterating. */
+        last = s->n_entries - 1;
+        if (idx != last) {
+                s->entries[idx] = s->entries[last];
+
+                if (index_get(s)) {
+                        assert_se(find(s, s->entries[idx].unit, &slot) == last);
+                        index_get(s)[slot] = idx + 1;
+                }
+        }
+
+        s->n_entries--;
+}
+
+void *unit_dependency_set_remove(UnitDependencySet *s, Unit *u) {
+        unsigned idx, slot;
+        void *data;
+
+        idx = find(s, u, &slot);
+        if (idx == IDX_NIL)
+                return NULL;
+
+        data = s->entries[idx].data;
+        remove_entry(s, idx, slot);
+
+        return data;
+}
+
+int unit_dependency_set_remove_and_replace(UnitDependencySet *s, Unit *old_unit, Unit *new_unit, void *data) {
+        unsigned idx, slot;
+
+        idx = find(s, old_unit, &slot);
+        if (idx == IDX_NIL)
+                return -ENOENT;
+
+        if (old_unit != new_unit) {
+                unsigned other_idx, other_slot;
+
+                /* Drop any existing entry for the new unit first, it is overwritten */
+                other_idx = find(s, new_unit, &other_slot);
+                if (other_idx != IDX_NIL) {
+                        remove_entry(s, other_idx, other_slot);
+                        idx = find(s, old_unit, &slot);
+                }
+
+                if (index_get(s))
+                        index_delete(s, slot);
+
+                s->entries[idx].unit = new_unit;
+
+                if (index_get(s))
+                        index_insert(s, idx);
+        }
+
+        s->entries[idx].data = data;
+        return 0;
+}
+
+void *unit_dependency_set_get(UnitDependencySet *s, Unit *u) {
+        unsigned idx;
+
+        idx = find(s, u, NULL);
+        if (idx == IDX_NIL)
+                return NULL;
+
+        return s->entries[idx].data;
+}
+
+bool unit_dependency_set_contains(UnitDependencySet *s, Unit *u) {
+        return find(s, u, NULL) != IDX_NIL;
+}
+
+int unit_dependency_set_reserve(UnitDependencySet **s, unsigned entries_add) {
+        unsigned n_entries;
+
+        assert(s);
+
+        n_entries = unit_dependency_set_size(*s);
+        if (entries_add > UINT_MAX - n_entries)
+                return -ENOMEM;
+
+        if (n_entries + entries_add <= (*s ? (*s)->n_allocated : 0))
+                return 0;
+
+        return resize(s, n_entries + entries_add);
+}
+
+int unit_dependency_set_move(UnitDependencySet **s, UnitDependencySet **other) {
+        unsigned idx;
+        int r;
+
+        assert(s);
+        assert(other);
+
+        /* Moves all entries of 'other' that are not in 's' yet. Entries already in 's' are left in 'other'. This
+         * cannot fail if sufficient space has been reserved in 's' before. */
+
+        if (!*other)
+                return 0;
+
+        if (!*s) {
+                *s = *other;
+                *other = NULL;
+                return 0;
+        }
+
+        r = unit_dependency_set_reserve(s, (*other)->n_entries);
+        if (r < 0)
+                return r;
+
+        for (idx = (*other)->n_entries; idx > 0; idx--) {
+                UnitDependencyEntry *e = (*other)->entries + idx - 1;
+
+                if (unit_dependency_set_contains(*s, e->unit))
+                        continue;
+
+                assert_se(unit_dependency_set_put(s, e->unit, e->data) > 0);
+                assert_se(unit_dependency_set_remove(*other, e->unit));
+        }
+
+        return 0;
+}
+
+unsigned unit_dependency_set_size(UnitDependencySet *s) {
+        return s ? s->n_entries : 0;
+}
+
+size_t unit_dependency_set_memory(UnitDependencySet *s) {
+        if (!s)
+                return 0;
+
+        return offsetof(UnitDependencySet, entries) + s->n_allocated * sizeof(UnitDependencyEntry) +
+                (index_get(s) ? 2 * s->n_allocated * sizeof(uint32_t) : 0);
+}
+
+Unit *unit_dependency_set_first(UnitDependencySet *s) {
+        if (!s || s->n_entries == 0)
+                return NULL;
+
+        return s->entries[0].unit;
+}
+
+bool unit_dependency_set_iterate(UnitDependencySet *s, Iterator *i, void **data, Unit **u) {
+        assert(i);
+
+        if (!s)
+                return false;
+
+        /* We iterate backwards, so that removing the current entry only moves an entry we already visited */
+        if (i->idx > s->n_entries)
+                i->idx = s->n_entries;
+
+        if (i->idx == 0)
+                return false;
+
+        i->idx--;
+
+        if (data)
+                *data = s->entries[i->idx].data;
+        if (u)
+                *u = s->entries[i->idx].unit;
+
+        return true;
+}
@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+
+#include "hashmap.h"
+#include "macro.h"
+
+/*
+ * The set of units a unit has a dependency of a specific type on, together with the UnitDependencyInfo of each
+ * dependency, stored as pointer sized value. Every unit has one of these per dependency type, and there are a lot
+ * of units, hence this is optimized for size: the entries are kept in a single array allocated together with the
+ * set header, without any per-entry overhead. Most sets are small, and are searched linearly. Only sets that grow
+ * beyond a couple of entries (for example the reverse dependencies of shutdown.target or sysinit.target) get an
+ * additional compact hash index of the array positions, so that lookups stay O(1) for them too.
+ *
+ * The API follows the one of Hashmap, including the semantics of the return values. A NULL set is treated as
+ * an empty one for all read operations. Entries are iterated in reverse insertion order, and it is safe to
+ * remove the current entry while iterating.
+ */
+
+typedef struct Unit Unit;
+typedef struct UnitDependencySet UnitDependencySet;
+
+UnitDependencySet *unit_dependency_set_free(UnitDependencySet *s);
+
+int unit_dependency_set_put(UnitDependencySet **s, Unit *u, void *data);
+int unit_dependency_set_update(UnitDependencySet *s, Unit *u, void *data);
+int unit_dependency_set_remove_and_replace(UnitDependencySet *s, Unit *old_unit, Unit *new_unit, void *data);
+
+void *unit_dependency_set_get(UnitDependencySet *s, Unit *u);
+bool unit_dependency_set_contains(UnitDependencySet *s, Unit *u);
+void *unit_dependency_set_remove(UnitDependencySet *s, Unit *u);
+
+int unit_dependency_set_reserve(UnitDependencySet **s, unsigned entries_add);
+int unit_dependency_set_move(UnitDependencySet **s, UnitDependencySet **other);
+
+unsigned unit_dependency_set_size(UnitDependencySet *s) _pure_;
+static inline bool unit_dependency_set_isempty(UnitDependencySet *s) {
+        return unit_dependency_set_size(s) == 0;
+}
+size_t unit_dependency_set_memory(UnitDependencySet *s) _pure_;
+
+Unit *unit_dependency_set_first(UnitDependencySet *s) _pure_;
+
+bool unit_dependency_set_iterate(UnitDependencySet *s, Iterator *i, void **data, Unit **u);
+
+#define UNIT_DEPENDENCY_SET_FOREACH(u, s, i) \
+        for ((i) = ITERATOR_FIRST; unit_dependency_set_iterate((s), &(i), NULL, &(u)); )
+
+#define UNIT_DEPENDENCY_SET_FOREACH_DATA(e, u, s, i) \
+        for ((i) = ITERATOR_FIRST; unit_dependency_set_iterate((s), &(i), (void**) &(e), &(u)); )
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(UnitDependencySet*, unit_dependency_set_free);
+#define _cleanup_unit_dependency_set_free_ _cleanup_(unit_dependency_set_freep)
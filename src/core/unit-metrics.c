@@ -0,0 +1,296 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "cgroup.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "hashmap.h"
+#include "log.h"
+#include "mkdir.h"
+#include "service.h"
+#include "string-util.h"
+#include "unit-metrics.h"
+#include "unit.h"
+
+typedef struct MetricsStrings {
+        char *data;
+        size_t size;
+        size_t allocated;
+        Hashmap *sub_states;
+} MetricsStrings;
+
+static void metrics_strings_done(MetricsStrings *s) {
+        assert(s);
+
+        s->data = mfree(s->data);
+        s->sub_states = hashmap_free(s->sub_states);
+}
+
+static int metrics_strings_add(MetricsStrings *s, uint64_t base, const char *p, le64_t *ret) {
+        size_t l;
+
+        assert(s);
+        assert(p);
+        assert(ret);
+
+        l = strlen(p) + 1;
+
+        if (!GREEDY_REALLOC(s->data, s->allocated, s->size + l))
+                return -ENOMEM;
+
+        memcpy(s->data + s->size, p, l);
+        *ret = htole64(base + s->size);
+        s->size += l;
+
+        return 0;
+}
+
+static int metrics_strings_add_sub_state(MetricsStrings *s, uint64_t base, const char *p, le64_t *ret) {
+        void *v;
+        int r;
+
+        assert(s);
+        assert(p);
+        assert(ret);
+
+        /* There are only a few distinct sub states, and they are static strings, hence store each of them only once,
+         * keyed by pointer */
+
+        v = hashmap_get(s->sub_states, p);
+        if (v) {
+                *ret = htole64(base + PTR_TO_SIZE(v) - 1);
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(&s->sub_states, NULL);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(s->sub_states, p, SIZE_TO_PTR(s->size + 1));
+        if (r < 0)
+                return r;
+
+        return metrics_strings_add(s, base, p, ret);
+}
+
+static int unit_compare(const void *a, const void *b) {
+        return strcmp((*(Unit**) a)->id, (*(Unit**) b)->id);
+}
+
+static le64_t metric_value(int r, uint64_t v) {
+        return htole64(r >= 0 ? v : UINT64_MAX);
+}
+
+static void unit_fill_metrics(Unit *u, UnitMetricsEntry *e) {
+        le64_t ip[_CGROUP_IP_ACCOUNTING_METRIC_MAX];
+        CGroupIPAccountingMetric metric;
+        uint64_t v;
+        int r;
+
+        assert(u);
+        assert(e);
+
+        e->load_state = u->load_state;
+        e->active_state = unit_active_state(u);
+        e->n_restarts = htole32(u->type == UNIT_SERVICE ? SERVICE(u)->n_restarts : 0);
+        e->state_change_timestamp = htole64(u->state_change_timestamp.realtime);
+
+        r = unit_get_cpu_usage(u, &v);
+        e->cpu_usage_nsec = metric_value(r, v);
+
+        r = unit_get_memory_current(u, &v);
+        e->memory_current = metric_value(r, v);
+
+        r = unit_get_tasks_current(u, &v);
+        e->tasks_current = metric_value(r, v);
+
+        /* The entry is packed, hence don't take the addresses of its fields, but assign them one by one */
+        for (metric = 0; metric < _CGROUP_IP_ACCOUNTING_METRIC_MAX; metric++) {
+                r = unit_get_ip_accounting(u, metric, &v);
+                ip[metric] = metric_value(r, v);
+        }
+
+        e->ip_ingress_bytes = ip[CGROUP_IP_INGRESS_BYTES];
+        e->ip_ingress_packets = ip[CGROUP_IP_INGRESS_PACKETS];
+        e->ip_egress_bytes = ip[CGROUP_IP_EGRESS_BYTES];
+        e->ip_egress_packets = ip[CGROUP_IP_EGRESS_PACKETS];
+}
+
+int manager_write_metrics(Manager *m, const char *path) {
+        _cleanup_(metrics_strings_done) MetricsStrings strings = {};
+        _cleanup_free_ UnitMetricsEntry *entries = NULL;
+        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ Unit **units = NULL;
+        UnitMetricsHeader header = {};
+        uint64_t strings_offset;
+        size_t n = 0, k;
+        const char *id;
+        Iterator i;
+        Unit *u;
+        int r;
+
+        assert(m);
+
+        if (!path)
+                path = strjoina(m->prefix[EXEC_DIRECTORY_RUNTIME], "/systemd/metrics");
+
+        units = new(Unit*, MAX(flat_hashmap_size(m->units), 1U));
+        if (!units)
+                return -ENOMEM;
+
+        FLAT_HASHMAP_FOREACH_KEY(u, id, m->units, i) {
+                /* Skip aliases */
+                if (u->id != id)
+                        continue;
+
+                units[n++] = u;
+        }
+
+        qsort_safe(units, n, sizeof(Unit*), unit_compare);
+
+        entries = new0(UnitMetricsEntry, MAX(n, 1U));
+        if (!entries)
+                return -ENOMEM;
+
+        strings_offset = sizeof(UnitMetricsHeader) + n * sizeof(UnitMetricsEntry);
+
+        for (k = 0; k < n; k++) {
+                le64_t id_offset, sub_state_offset;
+
+                r = metrics_strings_add(&strings, strings_offset, units[k]->id, &id_offset);
+                if (r < 0)
+                        return r;
+
+                r = metrics_strings_add_sub_state(&strings, strings_offset, unit_sub_state_to_string(units[k]),
+                                                  &sub_state_offset);
+                if (r < 0)
+                        return r;
+
+                entries[k].id_offset = id_offset;
+                entries[k].sub_state_offset = sub_state_offset;
+
+                unit_fill_metrics(units[k], entries + k);
+        }
+
+        memcpy(header.signature, UNIT_METRICS_SIGNATURE, sizeof(header.signature));
+        header.version = htole32(UNIT_METRICS_VERSION);
+        header.header_size = htole32(sizeof(UnitMetricsHeader));
+        header.entry_size = htole32(sizeof(UnitMetricsEntry));
+        header.n_entries = htole32(n);
+        header.timestamp_realtime = htole64(now(CLOCK_REALTIME));
+        header.timestamp_monotonic = htole64(now(CLOCK_MONOTONIC));
+        header.entries_offset = htole64(sizeof(UnitMetricsHeader));
+        header.strings_offset = htole64(strings_offset);
+        header.strings_size = htole64(strings.size);
+
+        r = mkdir_parents(path, 0755);
+        if (r < 0)
+                return r;
+
+        r = fopen_temporary(path, &f, &temp_path);
+        if (r < 0)
+                return r;
+
+        /* The table is for unprivileged clients too */
+        (void) fchmod(fileno(f), 0644);
+
+        fwrite(&header, sizeof(header), 1, f);
+        fwrite(entries, sizeof(UnitMetricsEntry), n, f);
+        fwrite(strings.data, 1, strings.size, f);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(temp_path, path) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        return 0;
+
+fail:
+        (void) unlink(temp_path);
+        return r;
+}
+
+static int manager_dispatch_metrics(sd_event_source *source, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+        int r;
+
+        assert(m);
+
+        r = manager_write_metrics(m, NULL);
+        if (r < 0)
+                log_debug_errno(r, "Failed to write metrics table, ignoring: %m");
+
+        r = sd_event_source_set_time(source, now(CLOCK_MONOTONIC) + m->metrics_interval_usec);
+        if (r < 0)
+                return log_error_errno(r, "Failed to reset metrics timer: %m");
+
+        return sd_event_source_set_enabled(source, SD_EVENT_ONESHOT);
+}
+
+int manager_setup_metrics(Manager *m) {
+        usec_t next;
+        int r;
+
+        assert(m);
+
+        /* (Re-)arms the timer for writing the metrics table, or disables it, according to MetricsIntervalSec= */
+
+        if (IN_SET(m->metrics_interval_usec, 0, USEC_INFINITY)) {
+                if (m->metrics_event_source) {
+                        m->metrics_event_source = sd_event_source_unref(m->metrics_event_source);
+                        (void) unlink(strjoina(m->prefix[EXEC_DIRECTORY_RUNTIME], "/systemd/metrics"));
+                }
+
+                return 0;
+        }
+
+        next = now(CLOCK_MONOTONIC) + m->metrics_interval_usec;
+
+        if (m->metrics_event_source) {
+                r = sd_event_source_set_time(m->metrics_event_source, next);
+                if (r < 0)
+                        return r;
+
+                return sd_event_source_set_enabled(m->metrics_event_source, SD_EVENT_ONESHOT);
+        }
+
+        r = sd_event_add_time(m->event, &m->metrics_event_source, CLOCK_MONOTONIC, next,
+                              m->metrics_interval_usec / 10, manager_dispatch_metrics, m);
+        if (r < 0)
+                return r;
+
+        /* Writing the table is never urgent */
+        r = sd_event_source_set_priority(m->metrics_event_source, SD_EVENT_PRIORITY_IDLE);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(m->metrics_event_source, "manager-metrics");
+
+        return 0;
+}
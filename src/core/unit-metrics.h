@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include "macro.h"
+#include "manager.h"
+#include "sparse-endian.h"
+
+/* The metrics table is a snapshot of the state and accounting values of all units, written every
+ * MetricsIntervalSec= to $RUNTIME_DIRECTORY/systemd/metrics, and replaced atomically, so that clients can read it in
+ * one go. It consists of the header, the entries sorted by unit name, and the strings they refer to. Offsets are
+ * relative to the beginning of the file. New fields are only ever appended to the header and the entries, hence
+ * clients should use header_size and entry_size to find them, and check for the fields they know about. Values that
+ * are not available are set to UINT64_MAX. */
+
+#define UNIT_METRICS_SIGNATURE ((const uint8_t[]) { 'S', 'D', 'M', 'E', 'T', 'R', 'I', 'C' })
+#define UNIT_METRICS_VERSION 1
+
+typedef struct UnitMetricsHeader {
+        uint8_t signature[8];
+        le32_t version;
+        le32_t header_size;
+        le32_t entry_size;
+        le32_t n_entries;
+        le64_t timestamp_realtime;
+        le64_t timestamp_monotonic;
+        le64_t entries_offset;
+        le64_t strings_offset;
+        le64_t strings_size;
+} _packed_ UnitMetricsHeader;
+
+typedef struct UnitMetricsEntry {
+        le64_t id_offset;
+        le64_t sub_state_offset;
+        uint8_t load_state;             /* UnitLoadState */
+        uint8_t active_state;           /* UnitActiveState */
+        uint8_t reserved[2];
+        le32_t n_restarts;
+        le64_t state_change_timestamp;  /* CLOCK_REALTIME */
+        le64_t cpu_usage_nsec;
+        le64_t memory_current;
+        le64_t tasks_current;
+        le64_t ip_ingress_bytes;
+        le64_t ip_ingress_packets;
+        le64_t ip_egress_bytes;
+        le64_t ip_egress_packets;
+} _packed_ UnitMetricsEntry;
+
+int manager_write_metrics(Manager *m, const char *path);
+int manager_setup_metrics(Manager *m);
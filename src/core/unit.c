@@ -217,7 +217,7 @@ int unit_add_name(Unit *u, const char *text) {
 
         if (set_contains(u->names, s))
                 return 0;
-        if (hashmap_contains(u->manager->units, s))
+        if (flat_hashmap_contains(u->manager->units, s))
                 return -EEXIST;
 
         if (!unit_name_is_valid(s, UNIT_NAME_PLAIN|UNIT_NAME_INSTANCE))
@@ -246,7 +246,7 @@ int unit_add_name(Unit *u, const char *text) {
         if (!unit_type_may_alias(t) && !set_isempty(u->names))
                 return -EEXIST;
 
-        if (hashmap_size(u->manager->units) >= MANAGER_MAX_NAMES)
+        if (flat_hashmap_size(u->manager->units) >= MANAGER_MAX_NAMES)
                 return -E2BIG;
 
         r = set_put(u->names, s);
@@ -254,7 +254,7 @@ int unit_add_name(Unit *u, const char *text) {
                 return r;
         assert(r > 0);
 
-        r = hashmap_put(u->manager->units, s, u);
+        r = flat_hashmap_put(u->manager->units, s, u);
         if (r < 0) {
                 (void) set_remove(u->names, s);
                 return r;
@@ -409,6 +409,7 @@ void unit_add_to_load_queue(Unit *u) {
 
         LIST_PREPEND(load_queue, u->manager->load_queue, u);
         u->in_load_queue = true;
+        u->load_prepared = false;
 }
 
 void unit_add_to_cleanup_queue(Unit *u) {
@@ -453,25 +454,24 @@ void unit_add_to_dbus_queue(Unit *u) {
         u->in_dbus_queue = true;
 }
 
-static void bidi_set_free(Unit *u, Hashmap *h) {
+static void bidi_set_free(Unit *u, UnitDependencySet *s) {
         Unit *other;
         Iterator i;
-        void *v;
 
         assert(u);
 
-        /* Frees the hashmap and makes sure we are dropped from the inverse pointers */
+        /* Frees the set and makes sure we are dropped from the inverse pointers */
 
-        HASHMAP_FOREACH_KEY(v, other, h, i) {
+        UNIT_DEPENDENCY_SET_FOREACH(other, s, i) {
                 UnitDependency d;
 
                 for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
-                        hashmap_remove(other->dependencies[d], u);
+                        unit_dependency_set_remove(other->dependencies[d], u);
 
                 unit_add_to_gc_queue(other);
         }
 
-        hashmap_free(h);
+        unit_dependency_set_free(s);
 }
 
 static void unit_remove_transient(Unit *u) {
@@ -575,6 +575,7 @@ void unit_free(Unit *u) {
                 unit_remove_transient(u);
 
         bus_unit_send_removed_signal(u);
+        bus_drop_deferred_signals(u->manager, BUS_OBJECT_UNIT, u);
 
         unit_done(u);
 
@@ -586,7 +587,7 @@ void unit_free(Unit *u) {
         unit_free_requires_mounts_for(u);
 
         SET_FOREACH(t, u->names, i)
-                hashmap_remove_value(u->manager->units, t, u);
+                flat_hashmap_remove_value(u->manager->units, t, u);
 
         if (!sd_id128_is_null(u->invocation_id))
                 hashmap_remove_value(u->manager->units_by_invocation_id, &u->invocation_id, u);
@@ -674,6 +675,101 @@ void unit_free(Unit *u) {
         free(u);
 }
 
+bool unit_may_unload(Unit *u) {
+        ExecContext *ec;
+
+        assert(u);
+
+        /* Returns true if unit_unload() may be used on the unit, i.e. if all of its runtime state survives a round
+         * trip through serialization. That's not the case for units whose state is partly derived from the kernel
+         * (mounts, swaps, devices) or which only exist at runtime, nor for units that have additional names, as
+         * those are not dropped when unloading. */
+
+        if (!IN_SET(u->type, UNIT_SERVICE, UNIT_SOCKET, UNIT_TARGET, UNIT_TIMER, UNIT_PATH, UNIT_SLICE))
+                return false;
+
+        if (u->load_state == UNIT_MERGED || set_size(u->names) > 1)
+                return false;
+
+        if (u->transient || u->perpetual)
+                return false;
+
+        if (u->job || u->nop_job)
+                return false;
+
+        /* Dynamic users are reference counted by the units using them, and would be released */
+        ec = unit_get_exec_context(u);
+        if (ec && ec->dynamic_user)
+                return false;
+
+        return true;
+}
+
+void unit_unload(Unit *u) {
+        assert(u);
+        assert(unit_may_unload(u));
+
+        /* Drops everything the unit has loaded from its configuration, and puts it back into the load queue, so that
+         * it is loaded again in place, while all other units remain untouched. Like unit_free(), this also releases
+         * the runtime state of the unit, hence the unit needs to be serialized before, and deserialized after it
+         * has been loaded again, exactly like on a full reload. */
+
+        unit_remove_dependencies(u, UNIT_DEPENDENCY_FILE|UNIT_DEPENDENCY_IMPLICIT|UNIT_DEPENDENCY_DEFAULT|UNIT_DEPENDENCY_PATH);
+        unit_free_requires_mounts_for(u);
+
+        unit_done(u);
+        memzero((uint8_t*) u + sizeof(Unit), UNIT_VTABLE(u)->object_size - sizeof(Unit));
+
+        u->bus_track = sd_bus_track_unref(u->bus_track);
+        u->deserialized_refs = strv_free(u->deserialized_refs);
+        unit_unref_uid_gid(u, false);
+
+        u->description = mfree(u->description);
+        u->documentation = strv_free(u->documentation);
+        u->fragment_path = mfree(u->fragment_path);
+        u->source_path = mfree(u->source_path);
+        u->dropin_paths = strv_free(u->dropin_paths);
+        u->fragment_mtime = u->source_mtime = u->dropin_mtime = 0;
+
+        u->job_timeout = USEC_INFINITY;
+        u->job_running_timeout = USEC_INFINITY;
+        u->job_running_timeout_set = false;
+        u->job_timeout_action = EMERGENCY_ACTION_NONE;
+        u->job_timeout_reboot_arg = mfree(u->job_timeout_reboot_arg);
+
+        u->conditions = condition_free_list(u->conditions);
+        u->asserts = condition_free_list(u->asserts);
+
+        unit_ref_unset(&u->slice);
+
+        RATELIMIT_INIT(u->start_limit, u->manager->default_start_limit_interval, u->manager->default_start_limit_burst);
+        u->start_limit_action = EMERGENCY_ACTION_NONE;
+        u->failure_action = EMERGENCY_ACTION_NONE;
+        u->success_action = EMERGENCY_ACTION_NONE;
+        u->reboot_arg = mfree(u->reboot_arg);
+
+        u->on_failure_job_mode = JOB_REPLACE;
+        u->collect_mode = COLLECT_INACTIVE;
+        u->stop_when_unneeded = false;
+        u->default_dependencies = true;
+        u->refuse_manual_start = false;
+        u->refuse_manual_stop = false;
+        u->allow_isolate = false;
+        u->ignore_on_isolate = false;
+
+        u->unit_file_state = _UNIT_FILE_STATE_INVALID;
+        u->unit_file_preset = -1;
+
+        unit_init(u);
+
+        u->load_error = 0;
+        u->load_state = UNIT_STUB;
+        u->coldplugged = false;
+
+        unit_add_to_load_queue(u);
+        unit_add_to_gc_queue(u);
+}
+
 UnitActiveState unit_active_state(Unit *u) {
         assert(u);
 
@@ -710,23 +806,6 @@ static int set_complete_move(Set **s, Set **other) {
         return 0;
 }
 
-static int hashmap_complete_move(Hashmap **s, Hashmap **other) {
-        assert(s);
-        assert(other);
-
-        if (!*other)
-                return 0;
-
-        if (*s)
-                return hashmap_move(*s, *other);
-        else {
-                *s = *other;
-                *other = NULL;
-        }
-
-        return 0;
-}
-
 static int merge_names(Unit *u, Unit *other) {
         char *t;
         Iterator i;
@@ -744,7 +823,7 @@ static int merge_names(Unit *u, Unit *other) {
         other->id = NULL;
 
         SET_FOREACH(t, u->names, i)
-                assert_se(hashmap_replace(u->manager->units, t, u) == 0);
+                assert_se(flat_hashmap_replace(u->manager->units, t, u) == 0);
 
         return 0;
 }
@@ -759,21 +838,20 @@ static int reserve_dependencies(Unit *u, Unit *other, UnitDependency d) {
         /*
          * If u does not have this dependency set allocated, there is no need
          * to reserve anything. In that case other's set will be transferred
-         * as a whole to u by complete_move().
+         * as a whole to u by unit_dependency_set_move().
          */
         if (!u->dependencies[d])
                 return 0;
 
         /* merge_dependencies() will skip a u-on-u dependency */
-        n_reserve = hashmap_size(other->dependencies[d]) - !!hashmap_get(other->dependencies[d], u);
+        n_reserve = unit_dependency_set_size(other->dependencies[d]) - !!unit_dependency_set_get(other->dependencies[d], u);
 
-        return hashmap_reserve(u->dependencies[d], n_reserve);
+        return unit_dependency_set_reserve(&u->dependencies[d], n_reserve);
 }
 
 static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitDependency d) {
         Iterator i;
         Unit *back;
-        void *v;
         int r;
 
         /* Merges all dependencies of type 'd' of the unit 'other' into the deps of the unit 'u' */
@@ -783,7 +861,7 @@ static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitD
         assert(d < _UNIT_DEPENDENCY_MAX);
 
         /* Fix backwards pointers. Let's iterate through all dependendent units of the other unit. */
-        HASHMAP_FOREACH_KEY(v, back, other->dependencies[d], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(back, other->dependencies[d], i) {
                 UnitDependency k;
 
                 /* Let's now iterate through the dependencies of that dependencies of the other units, looking for
@@ -792,7 +870,7 @@ static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitD
                 for (k = 0; k < _UNIT_DEPENDENCY_MAX; k++) {
                         if (back == u) {
                                 /* Do not add dependencies between u and itself. */
-                                if (hashmap_remove(back->dependencies[k], other))
+                                if (unit_dependency_set_remove(back->dependencies[k], other))
                                         maybe_warn_about_dependency(u, other_id, k);
                         } else {
                                 UnitDependencyInfo di_u, di_other, di_merged;
@@ -801,37 +879,37 @@ static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitD
                                  * "back" and "u" instead. Let's merge the bit masks of the dependency we are moving,
                                  * and any such dependency which might already exist */
 
-                                di_other.data = hashmap_get(back->dependencies[k], other);
+                                di_other.data = unit_dependency_set_get(back->dependencies[k], other);
                                 if (!di_other.data)
                                         continue; /* dependency isn't set, let's try the next one */
 
-                                di_u.data = hashmap_get(back->dependencies[k], u);
+                                di_u.data = unit_dependency_set_get(back->dependencies[k], u);
 
                                 di_merged = (UnitDependencyInfo) {
                                         .origin_mask = di_u.origin_mask | di_other.origin_mask,
                                         .destination_mask = di_u.destination_mask | di_other.destination_mask,
                                 };
 
-                                r = hashmap_remove_and_replace(back->dependencies[k], other, u, di_merged.data);
+                                r = unit_dependency_set_remove_and_replace(back->dependencies[k], other, u, di_merged.data);
                                 if (r < 0)
                                         log_warning_errno(r, "Failed to remove/replace: back=%s other=%s u=%s: %m", back->id, other_id, u->id);
                                 assert(r >= 0);
 
-                                /* assert_se(hashmap_remove_and_replace(back->dependencies[k], other, u, di_merged.data) >= 0); */
+                                /* assert_se(unit_dependency_set_remove_and_replace(back->dependencies[k], other, u, di_merged.data) >= 0); */
                         }
                 }
 
         }
 
         /* Also do not move dependencies on u to itself */
-        back = hashmap_remove(other->dependencies[d], u);
+        back = unit_dependency_set_remove(other->dependencies[d], u);
         if (back)
                 maybe_warn_about_dependency(u, other_id, d);
 
         /* The move cannot fail. The caller must have performed a reservation. */
-        assert_se(hashmap_complete_move(&u->dependencies[d], &other->dependencies[d]) == 0);
+        assert_se(unit_dependency_set_move(&u->dependencies[d], &other->dependencies[d]) == 0);
 
-        other->dependencies[d] = hashmap_free(other->dependencies[d]);
+        other->dependencies[d] = unit_dependency_set_free(other->dependencies[d]);
 }
 
 int unit_merge(Unit *u, Unit *other) {
@@ -1229,7 +1307,7 @@ void unit_dump(Unit *u, FILE *f, const char *prefix) {
                 UnitDependencyInfo di;
                 Unit *other;
 
-                HASHMAP_FOREACH_KEY(di.data, other, u->dependencies[d], i) {
+                UNIT_DEPENDENCY_SET_FOREACH_DATA(di.data, other, u->dependencies[d], i) {
                         bool space = false;
 
                         fprintf(f, "%s\t%s: %s (", prefix, unit_dependency_to_string(d), other->id);
@@ -1355,7 +1433,7 @@ int unit_add_default_target_dependency(Unit *u, Unit *target) {
                 return 0;
 
         /* Don't create loops */
-        if (hashmap_get(target->dependencies[UNIT_BEFORE], u))
+        if (unit_dependency_set_get(target->dependencies[UNIT_BEFORE], u))
                 return 0;
 
         return unit_add_dependency(target, UNIT_AFTER, u, true, UNIT_DEPENDENCY_DEFAULT);
@@ -1378,9 +1456,8 @@ static int unit_add_target_dependencies(Unit *u) {
         for (k = 0; k < ELEMENTSOF(deps); k++) {
                 Unit *target;
                 Iterator i;
-                void *v;
 
-                HASHMAP_FOREACH_KEY(v, target, u->dependencies[deps[k]], i) {
+                UNIT_DEPENDENCY_SET_FOREACH(target, u->dependencies[deps[k]], i) {
                         r = unit_add_default_target_dependency(u, target);
                         if (r < 0)
                                 return r;
@@ -1537,7 +1614,7 @@ int unit_load(Unit *u) {
                 if (r < 0)
                         goto fail;
 
-                if (u->on_failure_job_mode == JOB_ISOLATE && hashmap_size(u->dependencies[UNIT_ON_FAILURE]) > 1) {
+                if (u->on_failure_job_mode == JOB_ISOLATE && unit_dependency_set_size(u->dependencies[UNIT_ON_FAILURE]) > 1) {
                         log_unit_error(u, "More than one OnFailure= dependencies specified but OnFailureJobMode=isolate set. Refusing.");
                         r = -EINVAL;
                         goto fail;
@@ -1752,7 +1829,6 @@ bool unit_shall_confirm_spawn(Unit *u) {
 static bool unit_verify_deps(Unit *u) {
         Unit *other;
         Iterator j;
-        void *v;
 
         assert(u);
 
@@ -1761,9 +1837,9 @@ static bool unit_verify_deps(Unit *u) {
          * processing, but do not have any effect afterwards. We don't check BindsTo= dependencies that are not used in
          * conjunction with After= as for them any such check would make things entirely racy. */
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BINDS_TO], j) {
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_BINDS_TO], j) {
 
-                if (!hashmap_contains(u->dependencies[UNIT_AFTER], other))
+                if (!unit_dependency_set_contains(u->dependencies[UNIT_AFTER], other))
                         continue;
 
                 if (!UNIT_IS_ACTIVE_OR_RELOADING(unit_active_state(other))) {
@@ -1966,7 +2042,7 @@ bool unit_can_reload(Unit *u) {
         if (UNIT_VTABLE(u)->can_reload)
                 return UNIT_VTABLE(u)->can_reload(u);
 
-        if (!hashmap_isempty(u->dependencies[UNIT_PROPAGATES_RELOAD_TO]))
+        if (!unit_dependency_set_isempty(u->dependencies[UNIT_PROPAGATES_RELOAD_TO]))
                 return true;
 
         return UNIT_VTABLE(u)->reload;
@@ -2000,9 +2076,8 @@ static void unit_check_unneeded(Unit *u) {
         for (j = 0; j < ELEMENTSOF(needed_dependencies); j++) {
                 Unit *other;
                 Iterator i;
-                void *v;
 
-                HASHMAP_FOREACH_KEY(v, other, u->dependencies[needed_dependencies[j]], i)
+                UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[needed_dependencies[j]], i)
                         if (unit_active_or_pending(other))
                                 return;
         }
@@ -2028,7 +2103,6 @@ static void unit_check_binds_to(Unit *u) {
         bool stop = false;
         Unit *other;
         Iterator i;
-        void *v;
         int r;
 
         assert(u);
@@ -2039,7 +2113,7 @@ static void unit_check_binds_to(Unit *u) {
         if (unit_active_state(u) != UNIT_ACTIVE)
                 return;
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BINDS_TO], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_BINDS_TO], i) {
                 if (other->job)
                         continue;
 
@@ -2077,31 +2151,30 @@ static void unit_check_binds_to(Unit *u) {
 static void retroactively_start_dependencies(Unit *u) {
         Iterator i;
         Unit *other;
-        void *v;
 
         assert(u);
         assert(UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(u)));
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REQUIRES], i)
-                if (!hashmap_get(u->dependencies[UNIT_AFTER], other) &&
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_REQUIRES], i)
+                if (!unit_dependency_set_get(u->dependencies[UNIT_AFTER], other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_REPLACE, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BINDS_TO], i)
-                if (!hashmap_get(u->dependencies[UNIT_AFTER], other) &&
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_BINDS_TO], i)
+                if (!unit_dependency_set_get(u->dependencies[UNIT_AFTER], other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_REPLACE, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_WANTS], i)
-                if (!hashmap_get(u->dependencies[UNIT_AFTER], other) &&
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_WANTS], i)
+                if (!unit_dependency_set_get(u->dependencies[UNIT_AFTER], other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_FAIL, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_CONFLICTS], i)
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_CONFLICTS], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_CONFLICTED_BY], i)
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_CONFLICTED_BY], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL);
 }
@@ -2109,13 +2182,12 @@ static void retroactively_start_dependencies(Unit *u) {
 static void retroactively_stop_dependencies(Unit *u) {
         Unit *other;
         Iterator i;
-        void *v;
 
         assert(u);
         assert(UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(u)));
 
         /* Pull down units which are bound to us recursively if enabled */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BOUND_BY], i)
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_BOUND_BY], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL);
 }
@@ -2123,22 +2195,21 @@ static void retroactively_stop_dependencies(Unit *u) {
 static void check_unneeded_dependencies(Unit *u) {
         Unit *other;
         Iterator i;
-        void *v;
 
         assert(u);
         assert(UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(u)));
 
         /* Garbage collect services that might not be needed anymore, if enabled */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REQUIRES], i)
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_REQUIRES], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_WANTS], i)
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_WANTS], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REQUISITE], i)
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_REQUISITE], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BINDS_TO], i)
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_BINDS_TO], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
 }
@@ -2146,16 +2217,15 @@ static void check_unneeded_dependencies(Unit *u) {
 void unit_start_on_failure(Unit *u) {
         Unit *other;
         Iterator i;
-        void *v;
 
         assert(u);
 
-        if (hashmap_size(u->dependencies[UNIT_ON_FAILURE]) <= 0)
+        if (unit_dependency_set_size(u->dependencies[UNIT_ON_FAILURE]) <= 0)
                 return;
 
         log_unit_info(u, "Triggering OnFailure= dependencies.");
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_ON_FAILURE], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_ON_FAILURE], i) {
                 int r;
 
                 r = manager_add_job(u->manager, JOB_START, other, u->on_failure_job_mode, NULL, NULL);
@@ -2167,11 +2237,10 @@ void unit_start_on_failure(Unit *u) {
 void unit_trigger_notify(Unit *u) {
         Unit *other;
         Iterator i;
-        void *v;
 
         assert(u);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_TRIGGERED_BY], i)
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_TRIGGERED_BY], i)
                 if (UNIT_VTABLE(other)->trigger_notify)
                         UNIT_VTABLE(other)->trigger_notify(other, u);
 }
@@ -2581,6 +2650,7 @@ void unit_unwatch_all_pids(Unit *u) {
                 unit_unwatch_pid(u, PTR_TO_PID(set_first(u->pids)));
 
         u->pids = set_free(u->pids);
+        u->watch_all_pids_iteration = 0;
 }
 
 void unit_tidy_watch_pids(Unit *u, pid_t except1, pid_t except2) {
@@ -2650,8 +2720,8 @@ static void maybe_warn_about_dependency(Unit *u, const char *other, UnitDependen
                 log_unit_warning(u, "Dependency %s=%s dropped, merged into %s", unit_dependency_to_string(dependency), strna(other), u->id);
 }
 
-static int unit_add_dependency_hashmap(
-                Hashmap **h,
+static int unit_add_dependency_to_set(
+                UnitDependencySet **s,
                 Unit *other,
                 UnitDependencyMask origin_mask,
                 UnitDependencyMask destination_mask) {
@@ -2659,19 +2729,15 @@ static int unit_add_dependency_hashmap(
         UnitDependencyInfo info;
         int r;
 
-        assert(h);
+        assert(s);
         assert(other);
         assert(origin_mask < _UNIT_DEPENDENCY_MASK_FULL);
         assert(destination_mask < _UNIT_DEPENDENCY_MASK_FULL);
         assert(origin_mask > 0 || destination_mask > 0);
 
-        r = hashmap_ensure_allocated(h, NULL);
-        if (r < 0)
-                return r;
-
         assert_cc(sizeof(void*) == sizeof(info));
 
-        info.data = hashmap_get(*h, other);
+        info.data = unit_dependency_set_get(*s, other);
         if (info.data) {
                 /* Entry already exists. Add in our mask. */
 
@@ -2682,14 +2748,14 @@ static int unit_add_dependency_hashmap(
                 info.origin_mask |= origin_mask;
                 info.destination_mask |= destination_mask;
 
-                r = hashmap_update(*h, other, info.data);
+                r = unit_dependency_set_update(*s, other, info.data);
         } else {
                 info = (UnitDependencyInfo) {
                         .origin_mask = origin_mask,
                         .destination_mask = destination_mask,
                 };
 
-                r = hashmap_put(*h, other, info.data);
+                r = unit_dependency_set_put(s, other, info.data);
         }
         if (r < 0)
                 return r;
@@ -2751,22 +2817,22 @@ int unit_add_dependency(
                 return 0;
         }
 
-        r = unit_add_dependency_hashmap(u->dependencies + d, other, mask, 0);
+        r = unit_add_dependency_to_set(u->dependencies + d, other, mask, 0);
         if (r < 0)
                 return r;
 
         if (inverse_table[d] != _UNIT_DEPENDENCY_INVALID && inverse_table[d] != d) {
-                r = unit_add_dependency_hashmap(other->dependencies + inverse_table[d], u, 0, mask);
+                r = unit_add_dependency_to_set(other->dependencies + inverse_table[d], u, 0, mask);
                 if (r < 0)
                         return r;
         }
 
         if (add_reference) {
-                r = unit_add_dependency_hashmap(u->dependencies + UNIT_REFERENCES, other, mask, 0);
+                r = unit_add_dependency_to_set(u->dependencies + UNIT_REFERENCES, other, mask, 0);
                 if (r < 0)
                         return r;
 
-                r = unit_add_dependency_hashmap(other->dependencies + UNIT_REFERENCED_BY, u, 0, mask);
+                r = unit_add_dependency_to_set(other->dependencies + UNIT_REFERENCED_BY, u, 0, mask);
                 if (r < 0)
                         return r;
         }
@@ -3275,13 +3341,13 @@ void unit_serialize_item_format(Unit *u, FILE *f, const char *key, const char *f
         fputc('\n', f);
 }
 
-int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
+int unit_deserialize(Unit *u, Deserializer *d, FDSet *fds) {
         ExecRuntime **rt = NULL;
         size_t offset;
         int r;
 
         assert(u);
-        assert(f);
+        assert(d);
         assert(fds);
 
         offset = UNIT_VTABLE(u)->exec_runtime_offset;
@@ -3289,31 +3355,17 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
                 rt = (ExecRuntime**) ((uint8_t*) u + offset);
 
         for (;;) {
-                char line[LINE_MAX], *l, *v;
                 CGroupIPAccountingMetric m;
-                size_t k;
-
-                if (!fgets(line, sizeof(line), f)) {
-                        if (feof(f))
-                                return 0;
-                        return -errno;
-                }
+                const char *l, *v;
 
-                char_array_0(line);
-                l = strstrip(line);
+                r = deserializer_read(d, &l, &v);
+                if (r <= 0)
+                        return r;
 
                 /* End marker */
                 if (isempty(l))
                         break;
 
-                k = strcspn(l, "=");
-
-                if (l[k] == '=') {
-                        l[k] = 0;
-                        v = l+k+1;
-                } else
-                        v = l+k;
-
                 if (streq(l, "job")) {
                         if (v[0] == '\0') {
                                 /* new-style serialized job */
@@ -3323,7 +3375,7 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
                                 if (!j)
                                         return log_oom();
 
-                                r = job_deserialize(j, f);
+                                r = job_deserialize(j, d);
                                 if (r < 0) {
                                         job_free(j);
                                         return r;
@@ -3580,20 +3632,17 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
         return 0;
 }
 
-void unit_deserialize_skip(FILE *f) {
-        assert(f);
+void unit_deserialize_skip(Deserializer *d) {
+        assert(d);
 
         /* Skip serialized data for this unit. We don't know what it is. */
 
         for (;;) {
-                char line[LINE_MAX], *l;
+                const char *l, *v;
 
-                if (!fgets(line, sizeof line, f))
+                if (deserializer_read(d, &l, &v) <= 0)
                         return;
 
-                char_array_0(line);
-                l = strstrip(line);
-
                 /* End marker */
                 if (isempty(l))
                         return;
@@ -4546,7 +4595,6 @@ int unit_setup_exec_runtime(Unit *u) {
         size_t offset;
         Unit *other;
         Iterator i;
-        void *v;
 
         offset = UNIT_VTABLE(u)->exec_runtime_offset;
         assert(offset > 0);
@@ -4557,7 +4605,7 @@ int unit_setup_exec_runtime(Unit *u) {
                 return 0;
 
         /* Try to get it from somebody else */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_JOINS_NAMESPACE_OF], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(other, u->dependencies[UNIT_JOINS_NAMESPACE_OF], i) {
 
                 *rt = unit_get_exec_runtime(other);
                 if (*rt) {
@@ -4936,11 +4984,11 @@ static void unit_update_dependency_mask(Unit *u, UnitDependency d, Unit *other,
 
         if (di.origin_mask == 0 && di.destination_mask == 0) {
                 /* No bit set anymore, let's drop the whole entry */
-                assert_se(hashmap_remove(u->dependencies[d], other));
+                assert_se(unit_dependency_set_remove(u->dependencies[d], other));
                 log_unit_debug(u, "%s lost dependency %s=%s", u->id, unit_dependency_to_string(d), other->id);
         } else
                 /* Mask was reduced, let's update the entry */
-                assert_se(hashmap_update(u->dependencies[d], other, di.data) == 0);
+                assert_se(unit_dependency_set_update(u->dependencies[d], other, di.data) == 0);
 }
 
 void unit_remove_dependencies(Unit *u, UnitDependencyMask mask) {
@@ -4954,46 +5002,38 @@ void unit_remove_dependencies(Unit *u, UnitDependencyMask mask) {
                 return;
 
         for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++) {
-                bool done;
-
-                do {
-                        UnitDependencyInfo di;
-                        Unit *other;
-                        Iterator i;
-
-                        done = true;
-
-                        HASHMAP_FOREACH_KEY(di.data, other, u->dependencies[d], i) {
-                                UnitDependency q;
-
-                                if ((di.origin_mask & ~mask) == di.origin_mask)
-                                        continue;
-                                di.origin_mask &= ~mask;
-                                unit_update_dependency_mask(u, d, other, di);
+                UnitDependencyInfo di;
+                Unit *other;
+                Iterator i;
 
-                                /* We updated the dependency from our unit to the other unit now. But most dependencies
-                                 * imply a reverse dependency. Hence, let's delete that one too. For that we go through
-                                 * all dependency types on the other unit and delete all those which point to us and
-                                 * have the right mask set. */
+                /* The set permits removing the current entry while iterating, hence no need to start over after
+                 * each change */
+                UNIT_DEPENDENCY_SET_FOREACH_DATA(di.data, other, u->dependencies[d], i) {
+                        UnitDependency q;
 
-                                for (q = 0; q < _UNIT_DEPENDENCY_MAX; q++) {
-                                        UnitDependencyInfo dj;
+                        if ((di.origin_mask & ~mask) == di.origin_mask)
+                                continue;
+                        di.origin_mask &= ~mask;
+                        unit_update_dependency_mask(u, d, other, di);
 
-                                        dj.data = hashmap_get(other->dependencies[q], u);
-                                        if ((dj.destination_mask & ~mask) == dj.destination_mask)
-                                                continue;
-                                        dj.destination_mask &= ~mask;
+                        /* We updated the dependency from our unit to the other unit now. But most dependencies
+                         * imply a reverse dependency. Hence, let's delete that one too. For that we go through
+                         * all dependency types on the other unit and delete all those which point to us and
+                         * have the right mask set. */
 
-                                        unit_update_dependency_mask(other, q, u, dj);
-                                }
+                        for (q = 0; q < _UNIT_DEPENDENCY_MAX; q++) {
+                                UnitDependencyInfo dj;
 
-                                unit_add_to_gc_queue(other);
+                                dj.data = unit_dependency_set_get(other->dependencies[q], u);
+                                if ((dj.destination_mask & ~mask) == dj.destination_mask)
+                                        continue;
+                                dj.destination_mask &= ~mask;
 
-                                done = false;
-                                break;
+                                unit_update_dependency_mask(other, q, u, dj);
                         }
 
-                } while (!done);
+                        unit_add_to_gc_queue(other);
+                }
         }
 }
 
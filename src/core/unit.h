@@ -34,6 +34,8 @@ typedef struct UnitStatusMessageFormats UnitStatusMessageFormats;
 #include "emergency-action.h"
 #include "install.h"
 #include "list.h"
+#include "serialize.h"
+#include "unit-dependency-set.h"
 #include "unit-name.h"
 #include "cgroup.h"
 
@@ -105,7 +107,7 @@ typedef enum UnitDependencyMask {
         _UNIT_DEPENDENCY_MASK_FULL = (1 << 8) - 1,
 } UnitDependencyMask;
 
-/* The Unit's dependencies[] hashmaps use this structure as value. It has the same size as a void pointer, and thus can
+/* The Unit's dependencies[] sets use this structure as value. It has the same size as a void pointer, and thus can
  * be stored directly as hashmap value, without any indirection. Note that this stores two masks, as both the origin
  * and the destination of a dependency might have created it. */
 typedef union UnitDependencyInfo {
@@ -145,9 +147,9 @@ struct Unit {
 
         Set *names;
 
-        /* For each dependency type we maintain a Hashmap whose key is the Unit* object, and the value encodes why the
-         * dependency exists, using the UnitDependencyInfo type */
-        Hashmap *dependencies[_UNIT_DEPENDENCY_MAX];
+        /* For each dependency type we maintain a compact set of the Unit* objects, and for each a value that encodes
+         * why the dependency exists, using the UnitDependencyInfo type */
+        UnitDependencySet *dependencies[_UNIT_DEPENDENCY_MAX];
 
         /* Similar, for RequiresMountsFor= path dependencies. The key is the path, the value the UnitDependencyInfo type */
         Hashmap *requires_mounts_for;
@@ -236,6 +238,9 @@ struct Unit {
          * process SIGCHLD for */
         Set *pids;
 
+        /* The event loop iteration in which unit_watch_all_pids() went through the cgroup last, plus one */
+        uint64_t watch_all_pids_iteration;
+
         /* Used in sigchld event invocation to avoid repeat events being invoked */
         uint64_t sigchldgen;
 
@@ -276,6 +281,13 @@ struct Unit {
         CGroupMask cgroup_members_mask;
         int cgroup_inotify_wd;
 
+        /* The values last written to the cgroup attributes, see unit_set_cgroup_attribute() */
+        Hashmap *cgroup_attribute_cache;
+
+        /* For slices: the realize queue iteration in which the members were queued last, and the members mask then */
+        unsigned cgroup_siblings_queued_iteration;
+        CGroupMask cgroup_siblings_queued_mask;
+
         /* IP BPF Firewalling/accounting */
         int ip_accounting_ingress_map_fd;
         int ip_accounting_egress_map_fd;
@@ -329,6 +341,7 @@ struct Unit {
         bool perpetual;
 
         bool in_load_queue:1;
+        bool load_prepared:1;
         bool in_dbus_queue:1;
         bool in_cleanup_queue:1;
         bool in_gc_queue:1;
@@ -564,7 +577,7 @@ extern const UnitVTable * const unit_vtable[_UNIT_TYPE_MAX];
 #define UNIT_HAS_CGROUP_CONTEXT(u) (UNIT_VTABLE(u)->cgroup_context_offset > 0)
 #define UNIT_HAS_KILL_CONTEXT(u) (UNIT_VTABLE(u)->kill_context_offset > 0)
 
-#define UNIT_TRIGGER(u) ((Unit*) hashmap_first_key((u)->dependencies[UNIT_TRIGGERS]))
+#define UNIT_TRIGGER(u) ((Unit*) unit_dependency_set_first((u)->dependencies[UNIT_TRIGGERS]))
 
 DEFINE_CAST(SERVICE, Service);
 DEFINE_CAST(SOCKET, Socket);
@@ -581,6 +594,9 @@ DEFINE_CAST(SCOPE, Scope);
 Unit *unit_new(Manager *m, size_t size);
 void unit_free(Unit *u);
 
+bool unit_may_unload(Unit *u);
+void unit_unload(Unit *u);
+
 int unit_new_for_name(Manager *m, size_t size, const char *name, Unit **ret);
 int unit_add_name(Unit *u, const char *name);
 
@@ -660,8 +676,8 @@ int unit_load_related_unit(Unit *u, const char *type, Unit **_found);
 bool unit_can_serialize(Unit *u) _pure_;
 
 int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs);
-int unit_deserialize(Unit *u, FILE *f, FDSet *fds);
-void unit_deserialize_skip(FILE *f);
+int unit_deserialize(Unit *u, Deserializer *d, FDSet *fds);
+void unit_deserialize_skip(Deserializer *d);
 
 int unit_serialize_item(Unit *u, FILE *f, const char *key, const char *value);
 int unit_serialize_item_escaped(Unit *u, FILE *f, const char *key, const char *value);
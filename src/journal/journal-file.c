@@ -21,7 +21,6 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/fs.h>
-#include <pthread.h>
 #include <stddef.h>
 #include <sys/mman.h>
 #include <sys/statvfs.h>
@@ -144,12 +143,10 @@ static void journal_file_set_offline_internal(JournalFile *f) {
         }
 }
 
-static void * journal_file_set_offline_thread(void *arg) {
+static void journal_file_set_offline_thread(void *arg) {
         JournalFile *f = arg;
 
         journal_file_set_offline_internal(f);
-
-        return NULL;
 }
 
 static int journal_file_set_offline_thread_join(JournalFile *f) {
@@ -160,9 +157,14 @@ static int journal_file_set_offline_thread_join(JournalFile *f) {
         if (f->offline_state == OFFLINE_JOINED)
                 return 0;
 
-        r = pthread_join(f->offline_thread, NULL);
-        if (r)
-                return -r;
+        /* If the offline was done synchronously, there's no job to join */
+        if (f->offline_job) {
+                r = thread_job_join(f->offline_job);
+                if (r < 0)
+                        return r;
+
+                f->offline_job = NULL;
+        }
 
         f->offline_state = OFFLINE_JOINED;
 
@@ -245,10 +247,20 @@ int journal_file_set_offline(JournalFile *f, bool wait) {
         if (wait) /* Without using a thread if waiting. */
                 journal_file_set_offline_internal(f);
         else {
-                r = pthread_create(&f->offline_thread, NULL, journal_file_set_offline_thread, f);
-                if (r > 0) {
+                ThreadPool *p;
+
+                /* Offlining is dispatched to the shared thread pool, so that rotating many journal files at
+                 * once doesn't result in as many threads. */
+                p = thread_pool_default();
+                if (!p) {
                         f->offline_state = OFFLINE_JOINED;
-                        return -r;
+                        return -ENOMEM;
+                }
+
+                r = thread_pool_submit(p, journal_file_set_offline_thread, f, &f->offline_job);
+                if (r < 0) {
+                        f->offline_state = OFFLINE_JOINED;
+                        return r;
                 }
         }
 
@@ -34,6 +34,7 @@
 #include "mmap-cache.h"
 #include "sd-event.h"
 #include "sparse-endian.h"
+#include "thread-pool.h"
 
 typedef struct JournalMetrics {
         /* For all these: -1 means "pick automatically", and 0 means "no limit enforced" */
@@ -119,7 +120,7 @@ typedef struct JournalFile {
 
         OrderedHashmap *chain_cache;
 
-        pthread_t offline_thread;
+        ThreadJob *offline_job;
         volatile OfflineState offline_state;
 
 #if HAVE_XZ || HAVE_LZ4
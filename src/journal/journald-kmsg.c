@@ -19,7 +19,6 @@
 ***/
 
 #include <fcntl.h>
-#include <sys/epoll.h>
 #include <sys/mman.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -29,6 +28,7 @@
 
 #include "alloc-util.h"
 #include "escape.h"
+#include "event-util.h"
 #include "fd-util.h"
 #include "format-util.h"
 #include "io-util.h"
@@ -40,6 +40,9 @@
 #include "stdio-util.h"
 #include "string-util.h"
 
+/* The kernel-side limit per record is 8K currently */
+#define DEV_KMSG_RECORD_MAX 8192
+
 void server_forward_kmsg(
         Server *s,
         int priority,
@@ -319,7 +322,7 @@ finish:
 }
 
 static int server_read_dev_kmsg(Server *s) {
-        char buffer[8192+1]; /* the kernel-side limit per record is 8K currently */
+        char buffer[DEV_KMSG_RECORD_MAX+1];
         ssize_t l;
 
         assert(s);
@@ -372,20 +375,37 @@ int server_flush_dev_kmsg(Server *s) {
         return 0;
 }
 
-static int dispatch_dev_kmsg(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+static int dispatch_dev_kmsg(sd_event_source *es, int fd, int result, const void *data, void *userdata) {
+        char buffer[DEV_KMSG_RECORD_MAX];
         Server *s = userdata;
 
         assert(es);
         assert(fd == s->dev_kmsg_fd);
         assert(s);
 
-        if (revents & EPOLLERR)
+        /* The read is done by the event loop already, possibly asynchronously, see server_read_dev_kmsg() for the
+         * synchronous version of this */
+
+        if (result == -EPIPE) {
                 log_warning("/dev/kmsg buffer overrun, some messages lost.");
+                return 0;
+        }
 
-        if (!(revents & EPOLLIN))
-                log_error("Got invalid event from epoll for /dev/kmsg: %"PRIx32, revents);
+        if (result == -EINVAL) {
+                s->dev_kmsg_event_source = sd_event_source_unref(s->dev_kmsg_event_source);
+                return 0;
+        }
 
-        return server_read_dev_kmsg(s);
+        if (IN_SET(result, 0, -EAGAIN, -EINTR))
+                return 0;
+
+        if (result < 0)
+                return log_error_errno(result, "Failed to read from kernel: %m");
+
+        /* dev_kmsg_record() splits the record up in place, hence work on a copy */
+        memcpy(buffer, data, result);
+        dev_kmsg_record(s, buffer, result);
+        return 0;
 }
 
 int server_open_dev_kmsg(Server *s) {
@@ -409,16 +429,10 @@ int server_open_dev_kmsg(Server *s) {
         if (!s->read_kmsg)
                 return 0;
 
-        r = sd_event_add_io(s->event, &s->dev_kmsg_event_source, s->dev_kmsg_fd, EPOLLIN, dispatch_dev_kmsg, s);
+        /* Older kernels where /dev/kmsg is not readable fail the read with EINVAL, see above */
+        r = event_add_completion(s->event, &s->dev_kmsg_event_source, s->dev_kmsg_fd, EVENT_COMPLETION_READ,
+                                 DEV_KMSG_RECORD_MAX, 0, dispatch_dev_kmsg, s);
         if (r < 0) {
-
-                /* This will fail with EPERM on older kernels where
-                 * /dev/kmsg is not readable. */
-                if (r == -EPERM) {
-                        r = 0;
-                        goto fail;
-                }
-
                 log_error_errno(r, "Failed to add /dev/kmsg fd to event loop: %m");
                 goto fail;
         }
@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "sd-event.h"
+
+#include "time-util.h"
+
+typedef struct EventSourceProfile {
+        uint64_t n_dispatched;
+        usec_t dispatch_usec;
+        usec_t dispatch_usec_max;
+        usec_t latency_usec;
+        usec_t latency_usec_max;
+} EventSourceProfile;
+
+int event_set_profile(sd_event *e, bool b);
+int event_get_profile(sd_event *e);
+
+int event_source_get_profile(sd_event_source *s, EventSourceProfile *ret);
+
+void event_dump_profile(sd_event *e, FILE *f, const char *prefix);
+
+/* Time event sources are bucketed by default, turning this off sorts them all in the prioqs right away, which is
+ * only useful for comparing the two. Only allowed while there are no time event sources. */
+int event_set_time_buckets(sd_event *e, bool b);
+
+/* Completion sources perform an operation on an fd on behalf of the caller whenever it is possible, and hand the
+ * result to the callback: the number of bytes read or received into the buffer, the accepted fd, or a negative
+ * errno. If the kernel supports it, the operations are submitted to io_uring, so that there is no separate
+ * readiness notification and syscall per operation, otherwise they are done the classic way, after epoll reported
+ * the fd as readable. The buffer belongs to the event source, and is only valid during the callback. As long as
+ * the source is enabled, the operation is submitted again after each callback. */
+typedef enum EventCompletionType {
+        EVENT_COMPLETION_READ,
+        EVENT_COMPLETION_RECV,          /* flags are MSG_xyz */
+        EVENT_COMPLETION_ACCEPT,        /* flags are SOCK_xyz, as for accept4() */
+        _EVENT_COMPLETION_TYPE_MAX,
+        _EVENT_COMPLETION_TYPE_INVALID = -1,
+} EventCompletionType;
+
+typedef int (*event_completion_handler_t)(sd_event_source *s, int fd, int result, const void *buffer, void *userdata);
+
+int event_add_completion(
+                sd_event *e,
+                sd_event_source **ret,
+                int fd,
+                EventCompletionType type,
+                size_t size,
+                int flags,
+                event_completion_handler_t callback,
+                void *userdata);
+
+int event_source_get_completion_uring(sd_event_source *s);
@@ -18,17 +18,26 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <poll.h>
 #include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/timerfd.h>
 #include <sys/wait.h>
+#if HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
 
 #include "sd-daemon.h"
 #include "sd-event.h"
 #include "sd-id128.h"
 
 #include "alloc-util.h"
+#include "env-util.h"
+#include "event-util.h"
 #include "fd-util.h"
 #include "hashmap.h"
+#include "io-util.h"
 #include "list.h"
 #include "macro.h"
 #include "missing.h"
@@ -55,6 +64,7 @@ typedef enum EventSourceType {
         SOURCE_DEFER,
         SOURCE_POST,
         SOURCE_EXIT,
+        SOURCE_COMPLETION,
         SOURCE_WATCHDOG,
         _SOURCE_EVENT_SOURCE_TYPE_MAX,
         _SOURCE_EVENT_SOURCE_TYPE_INVALID = -1
@@ -72,6 +82,7 @@ static const char* const event_source_type_table[_SOURCE_EVENT_SOURCE_TYPE_MAX]
         [SOURCE_DEFER] = "defer",
         [SOURCE_POST] = "post",
         [SOURCE_EXIT] = "exit",
+        [SOURCE_COMPLETION] = "completion",
         [SOURCE_WATCHDOG] = "watchdog",
 };
 
@@ -84,12 +95,58 @@ typedef enum WakeupType {
         WAKEUP_EVENT_SOURCE,
         WAKEUP_CLOCK_DATA,
         WAKEUP_SIGNAL_DATA,
+        WAKEUP_URING_DATA,
         _WAKEUP_TYPE_MAX,
         _WAKEUP_TYPE_INVALID = -1,
 } WakeupType;
 
 #define EVENT_SOURCE_IS_TIME(t) IN_SET((t), SOURCE_TIME_REALTIME, SOURCE_TIME_BOOTTIME, SOURCE_TIME_MONOTONIC, SOURCE_TIME_REALTIME_ALARM, SOURCE_TIME_BOOTTIME_ALARM)
 
+/* Time event sources are queued in two stages: the ones that are due next are kept in a prioq, all others are
+ * kept in unsorted lists, bucketed by their due time in units of 2^TIME_BUCKET_SHIFT µs (i.e. ~1s). Only when a
+ * bucket turns into the earliest one it is moved into the prioq as a whole. This way, (re-)arming a timer for
+ * some time in the future, disabling it or dispatching it, is O(1) in most cases, instead of requiring a
+ * reshuffle of a prioq with all time sources in it. */
+#define TIME_BUCKET_SHIFT 20
+
+struct time_bucket {
+        uint64_t index;
+        unsigned prioq_index;
+
+        LIST_HEAD(struct time_entry, entries);
+};
+
+struct time_entry {
+        usec_t key; /* USEC_INFINITY if not queued */
+
+        struct time_bucket *bucket; /* if queued in a bucket */
+        unsigned prioq_index;       /* if queued in the prioq */
+
+        LIST_FIELDS(struct time_entry, entries);
+};
+
+struct time_queue {
+        Prioq *prioq; /* entries, ordered by key */
+        Prioq *buckets; /* buckets, ordered by index */
+        Hashmap *buckets_by_index;
+        bool unbucketed; /* put all entries directly into the prioq, for comparison */
+};
+
+/* The buffer of a completion source, and the operation that is in flight for it. It is allocated separately from
+ * the event source, because once submitted to io_uring, the kernel might write into it until the operation
+ * completed, even if the event source is gone by then. Such orphaned requests are freed when their completion
+ * arrives. */
+typedef struct CompletionRequest CompletionRequest;
+
+struct CompletionRequest {
+        sd_event_source *source;        /* NULL if orphaned */
+        EventCompletionType type;
+        bool polling;                   /* io_uring only: the operation is linked behind a poll */
+        LIST_FIELDS(CompletionRequest, orphans);
+        size_t size;
+        uint8_t buffer[];
+};
+
 struct sd_event_source {
         WakeupType wakeup;
 
@@ -115,6 +172,10 @@ struct sd_event_source {
 
         LIST_FIELDS(sd_event_source, sources);
 
+        /* Dispatch statistics, only collected if profiling is turned on for the event loop */
+        EventSourceProfile profile;
+        usec_t pending_timestamp;
+
         union {
                 struct {
                         sd_event_io_handler_t callback;
@@ -126,8 +187,8 @@ struct sd_event_source {
                 struct {
                         sd_event_time_handler_t callback;
                         usec_t next, accuracy;
-                        unsigned earliest_index;
-                        unsigned latest_index;
+                        struct time_entry earliest;
+                        struct time_entry latest;
                 } time;
                 struct {
                         sd_event_signal_handler_t callback;
@@ -150,6 +211,18 @@ struct sd_event_source {
                         sd_event_handler_t callback;
                         unsigned prioq_index;
                 } exit;
+                struct {
+                        event_completion_handler_t callback;
+                        int fd;
+                        EventCompletionType type;
+                        int flags;
+                        int result;
+                        CompletionRequest *request;
+                        bool uring:1;           /* submitted to io_uring, otherwise watched with epoll */
+                        bool in_flight:1;       /* io_uring only */
+                        bool registered:1;      /* epoll only */
+                        bool always_ready:1;    /* epoll only: the fd cannot be watched, e.g. a regular file */
+                } completion;
         };
 };
 
@@ -157,15 +230,16 @@ struct clock_data {
         WakeupType wakeup;
         int fd;
 
-        /* For all clocks we maintain two priority queues each, one
+        /* For all clocks we maintain two time queues each, one
          * ordered for the earliest times the events may be
          * dispatched, and one ordered by the latest times they must
          * have been dispatched. The range between the top entries in
-         * the two prioqs is the time window we can freely schedule
-         * wakeups in */
+         * the two queues is the time window we can freely schedule
+         * wakeups in. Disabled and pending sources are not queued. */
 
-        Prioq *earliest;
-        Prioq *latest;
+        struct time_queue earliest;
+        struct time_queue latest;
+        unsigned n_sources;
         usec_t next;
 
         bool needs_rearm:1;
@@ -184,6 +258,41 @@ struct signal_data {
         sd_event_source *current;
 };
 
+#if HAVE_LINUX_IO_URING_H
+/* How many operations may be in flight at the same time. Completion sources beyond that are watched with epoll
+ * instead. Note that each source has at most one operation in flight, but orphaned requests and their cancellations
+ * need room in the completion queue too, hence leave some headroom. */
+#define URING_ENTRIES 256U
+#define URING_SOURCES_MAX (URING_ENTRIES / 2)
+
+/* The poll an operation is linked behind is tagged with the address of the request with the lowest bit set, so that
+ * it can be told apart from the operation, and cancelled on its own */
+#define URING_POLL_TAG 1U
+
+/* How long to wait for cancelled operations to let go of their buffers when the event loop is freed */
+#define URING_DRAIN_TIMEOUT_USEC (1 * USEC_PER_SEC)
+
+struct uring_data {
+        WakeupType wakeup;
+        int fd;
+
+        void *sq_ring, *cq_ring;
+        size_t sq_ring_size, cq_ring_size;
+        struct io_uring_sqe *sqes;
+        size_t sqes_size;
+
+        unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+        unsigned *cq_head, *cq_tail, *cq_mask;
+        struct io_uring_cqe *cqes;
+
+        unsigned n_queued;      /* prepared, but not submitted yet */
+        unsigned n_in_flight;   /* submitted, but not completed yet, including orphans */
+        unsigned n_sources;
+
+        LIST_HEAD(CompletionRequest, orphans);
+};
+#endif
+
 struct sd_event {
         unsigned n_ref;
 
@@ -224,6 +333,8 @@ struct sd_event {
         bool need_process_child:1;
         bool watchdog:1;
         bool profile_delays:1;
+        bool profile_sources:1;
+        bool uring_unavailable:1;
 
         int exit_code;
 
@@ -236,11 +347,21 @@ struct sd_event {
 
         LIST_HEAD(sd_event_source, sources);
 
+        /* The buffer epoll_wait() writes into. It is kept around between iterations so that we don't have to
+         * allocate (or, worse, alloca()) one with an entry per event source on each iteration. */
+        struct epoll_event *event_queue;
+        size_t event_queue_allocated;
+
+        /* Set up on first use by a completion source, if the kernel supports it */
+        struct uring_data *uring;
+
         usec_t last_run, last_log;
         unsigned delays[sizeof(usec_t) * 8];
 };
 
 static void source_disconnect(sd_event_source *s);
+static int source_set_pending(sd_event_source *s, bool b);
+static void event_free_uring(sd_event *e);
 
 static int pending_prioq_compare(const void *a, const void *b) {
         const sd_event_source *x = a, *y = b;
@@ -298,62 +419,177 @@ static int prepare_prioq_compare(const void *a, const void *b) {
         return 0;
 }
 
-static int earliest_time_prioq_compare(const void *a, const void *b) {
-        const sd_event_source *x = a, *y = b;
+static usec_t time_event_source_latest(const sd_event_source *s) {
+        return usec_add(s->time.next, s->time.accuracy);
+}
 
-        assert(EVENT_SOURCE_IS_TIME(x->type));
-        assert(x->type == y->type);
+static int time_entry_compare(const void *a, const void *b) {
+        const struct time_entry *x = a, *y = b;
 
-        /* Enabled ones first */
-        if (x->enabled != SD_EVENT_OFF && y->enabled == SD_EVENT_OFF)
+        if (x->key < y->key)
                 return -1;
-        if (x->enabled == SD_EVENT_OFF && y->enabled != SD_EVENT_OFF)
+        if (x->key > y->key)
                 return 1;
 
-        /* Move the pending ones to the end */
-        if (!x->pending && y->pending)
-                return -1;
-        if (x->pending && !y->pending)
-                return 1;
+        return 0;
+}
+
+static int time_bucket_compare(const void *a, const void *b) {
+        const struct time_bucket *x = a, *y = b;
 
-        /* Order by time */
-        if (x->time.next < y->time.next)
+        if (x->index < y->index)
                 return -1;
-        if (x->time.next > y->time.next)
+        if (x->index > y->index)
                 return 1;
 
         return 0;
 }
 
-static usec_t time_event_source_latest(const sd_event_source *s) {
-        return usec_add(s->time.next, s->time.accuracy);
+static void time_entry_init(struct time_entry *t) {
+        assert(t);
+
+        *t = (struct time_entry) {
+                .key = USEC_INFINITY,
+                .prioq_index = PRIOQ_IDX_NULL,
+        };
 }
 
-static int latest_time_prioq_compare(const void *a, const void *b) {
-        const sd_event_source *x = a, *y = b;
+static int time_queue_reserve(struct time_queue *q, unsigned n) {
+        int r;
 
-        assert(EVENT_SOURCE_IS_TIME(x->type));
-        assert(x->type == y->type);
+        assert(q);
 
-        /* Enabled ones first */
-        if (x->enabled != SD_EVENT_OFF && y->enabled == SD_EVENT_OFF)
-                return -1;
-        if (x->enabled == SD_EVENT_OFF && y->enabled != SD_EVENT_OFF)
-                return 1;
+        r = prioq_ensure_allocated(&q->prioq, time_entry_compare);
+        if (r < 0)
+                return r;
 
-        /* Move the pending ones to the end */
-        if (!x->pending && y->pending)
-                return -1;
-        if (x->pending && !y->pending)
-                return 1;
+        r = prioq_ensure_allocated(&q->buckets, time_bucket_compare);
+        if (r < 0)
+                return r;
 
-        /* Order by time */
-        if (time_event_source_latest(x) < time_event_source_latest(y))
-                return -1;
-        if (time_event_source_latest(x) > time_event_source_latest(y))
-                return 1;
+        r = hashmap_ensure_allocated(&q->buckets_by_index, &uint64_hash_ops);
+        if (r < 0)
+                return r;
 
-        return 0;
+        /* Make sure we can always move all entries into the prioq, so that we never have to fail when
+         * queueing an entry or when moving a bucket into the prioq. */
+        return prioq_reserve(q->prioq, n);
+}
+
+static void time_bucket_free(struct time_queue *q, struct time_bucket *b) {
+        assert(q);
+        assert(b);
+        assert(!b->entries);
+
+        prioq_remove(q->buckets, b, &b->prioq_index);
+        hashmap_remove(q->buckets_by_index, &b->index);
+        free(b);
+}
+
+static void time_queue_done(struct time_queue *q) {
+        assert(q);
+
+        /* All entries have been removed when the event sources were disconnected, and empty buckets are freed
+         * immediately. */
+        assert(prioq_isempty(q->buckets));
+
+        prioq_free(q->prioq);
+        prioq_free(q->buckets);
+        hashmap_free(q->buckets_by_index);
+}
+
+static void time_queue_remove(struct time_queue *q, struct time_entry *t) {
+        assert(q);
+        assert(t);
+
+        if (t->bucket) {
+                struct time_bucket *b = t->bucket;
+
+                LIST_REMOVE(entries, b->entries, t);
+                t->bucket = NULL;
+
+                if (!b->entries)
+                        time_bucket_free(q, b);
+
+        } else if (t->key != USEC_INFINITY)
+                assert_se(prioq_remove(q->prioq, t, &t->prioq_index) > 0);
+
+        t->key = USEC_INFINITY;
+}
+
+static void time_queue_put(struct time_queue *q, struct time_entry *t, usec_t key) {
+        struct time_bucket *b;
+        uint64_t index;
+
+        assert(q);
+        assert(t);
+        assert(t->key == USEC_INFINITY);
+        assert(key != USEC_INFINITY);
+
+        t->key = key;
+        if (q->unbucketed)
+                goto fallback;
+
+        index = key >> TIME_BUCKET_SHIFT;
+
+        b = hashmap_get(q->buckets_by_index, &index);
+        if (!b) {
+                b = new0(struct time_bucket, 1);
+                if (!b)
+                        goto fallback;
+
+                b->index = index;
+                b->prioq_index = PRIOQ_IDX_NULL;
+
+                if (prioq_put(q->buckets, b, &b->prioq_index) < 0) {
+                        free(b);
+                        goto fallback;
+                }
+
+                if (hashmap_put(q->buckets_by_index, &b->index, b) < 0) {
+                        prioq_remove(q->buckets, b, &b->prioq_index);
+                        free(b);
+                        goto fallback;
+                }
+        }
+
+        LIST_PREPEND(entries, b->entries, t);
+        t->bucket = b;
+        return;
+
+fallback:
+        /* If we can't allocate a bucket, put the entry directly into the prioq, for which we reserved enough
+         * memory. This is always correct, just slower. */
+        assert_se(prioq_put(q->prioq, t, &t->prioq_index) >= 0);
+}
+
+static struct time_entry* time_queue_peek(struct time_queue *q) {
+        struct time_bucket *b;
+        struct time_entry *t;
+
+        assert(q);
+
+        for (;;) {
+                t = prioq_peek(q->prioq);
+
+                b = prioq_peek(q->buckets);
+                if (!b)
+                        return t;
+
+                if (t && (t->key >> TIME_BUCKET_SHIFT) < b->index)
+                        return t;
+
+                /* The earliest bucket might contain entries that are due before the top of the prioq, hence move
+                 * them over and try again. */
+                while ((t = b->entries)) {
+                        LIST_REMOVE(entries, b->entries, t);
+                        t->bucket = NULL;
+
+                        assert_se(prioq_put(q->prioq, t, &t->prioq_index) >= 0);
+                }
+
+                time_bucket_free(q, b);
+        }
 }
 
 static int exit_prioq_compare(const void *a, const void *b) {
@@ -380,10 +616,11 @@ static int exit_prioq_compare(const void *a, const void *b) {
 static void free_clock_data(struct clock_data *d) {
         assert(d);
         assert(d->wakeup == WAKEUP_CLOCK_DATA);
+        assert(d->n_sources == 0);
 
         safe_close(d->fd);
-        prioq_free(d->earliest);
-        prioq_free(d->latest);
+        time_queue_done(&d->earliest);
+        time_queue_done(&d->latest);
 }
 
 static void event_free(sd_event *e) {
@@ -402,6 +639,8 @@ static void event_free(sd_event *e) {
         if (e->default_event_ptr)
                 *(e->default_event_ptr) = NULL;
 
+        event_free_uring(e);
+
         safe_close(e->epoll_fd);
         safe_close(e->watchdog_fd);
 
@@ -420,6 +659,8 @@ static void event_free(sd_event *e) {
 
         hashmap_free(e->child_sources);
         set_free(e->post_sources);
+
+        free(e->event_queue);
         free(e);
 }
 
@@ -451,8 +692,9 @@ _public_ int sd_event_new(sd_event** ret) {
         }
 
         if (secure_getenv("SD_EVENT_PROFILE_DELAYS")) {
-                log_debug("Event loop profiling enabled. Logarithmic histogram of event loop iterations in the range 2^0 ... 2^63 us will be logged every 5s.");
+                log_debug("Event loop profiling enabled. Logarithmic histogram of event loop iterations in the range 2^0 ... 2^63 us and event source statistics will be logged every 5s.");
                 e->profile_delays = true;
+                e->profile_sources = true;
         }
 
         *ret = e;
@@ -547,6 +789,537 @@ static int source_io_register(
         return 0;
 }
 
+#if HAVE_LINUX_IO_URING_H
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+        return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+        return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void uring_free(struct uring_data *d) {
+        CompletionRequest *req;
+
+        if (!d)
+                return;
+
+        if (d->sq_ring && d->sq_ring != MAP_FAILED)
+                (void) munmap(d->sq_ring, d->sq_ring_size);
+        if (d->cq_ring && d->cq_ring != MAP_FAILED && d->cq_ring != d->sq_ring)
+                (void) munmap(d->cq_ring, d->cq_ring_size);
+        if (d->sqes && d->sqes != MAP_FAILED)
+                (void) munmap(d->sqes, d->sqes_size);
+
+        safe_close(d->fd);
+
+        /* By now the kernel is done with whatever is still listed here, or it is our copy in a forked off child */
+        while ((req = d->orphans)) {
+                LIST_REMOVE(orphans, d->orphans, req);
+                free(req);
+        }
+
+        free(d);
+}
+
+static bool uring_supports(int fd) {
+        static const uint8_t ops[] = { IORING_OP_READ, IORING_OP_RECV, IORING_OP_ACCEPT, IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL };
+        _cleanup_free_ struct io_uring_probe *probe = NULL;
+        size_t i;
+
+        /* The opcodes we need were all added in 5.6, together with the probing itself */
+
+        probe = malloc0(offsetof(struct io_uring_probe, ops) + 256 * sizeof(struct io_uring_probe_op));
+        if (!probe)
+                return false;
+
+        if (sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+                return false;
+
+        for (i = 0; i < ELEMENTSOF(ops); i++)
+                if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+                        return false;
+
+        return true;
+}
+
+static int uring_setup(sd_event *e) {
+        struct io_uring_params p = {};
+        struct uring_data *d;
+        struct epoll_event ev = {};
+        int r;
+
+        assert(e);
+
+        if (e->uring)
+                return 0;
+        if (e->uring_unavailable)
+                return -EOPNOTSUPP;
+
+        /* Once we found io_uring to be unavailable, don't try again for this event loop */
+        e->uring_unavailable = true;
+
+        r = getenv_bool("SYSTEMD_EVENT_IO_URING");
+        if (r == 0)
+                return -EOPNOTSUPP;
+
+        d = new0(struct uring_data, 1);
+        if (!d)
+                return -ENOMEM;
+
+        d->wakeup = WAKEUP_URING_DATA;
+
+        d->fd = sys_io_uring_setup(URING_ENTRIES, &p);
+        if (d->fd < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        if (!uring_supports(d->fd)) {
+                r = -EOPNOTSUPP;
+                goto fail;
+        }
+
+        d->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        d->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+                d->sq_ring_size = d->cq_ring_size = MAX(d->sq_ring_size, d->cq_ring_size);
+
+        d->sq_ring = mmap(NULL, d->sq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, d->fd, IORING_OFF_SQ_RING);
+        if (d->sq_ring == MAP_FAILED) {
+                r = -errno;
+                goto fail;
+        }
+
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+                d->cq_ring = d->sq_ring;
+        else {
+                d->cq_ring = mmap(NULL, d->cq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, d->fd, IORING_OFF_CQ_RING);
+                if (d->cq_ring == MAP_FAILED) {
+                        r = -errno;
+                        goto fail;
+                }
+        }
+
+        d->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+        d->sqes = mmap(NULL, d->sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, d->fd, IORING_OFF_SQES);
+        if (d->sqes == MAP_FAILED) {
+                r = -errno;
+                goto fail;
+        }
+
+        d->sq_head = (unsigned*) ((uint8_t*) d->sq_ring + p.sq_off.head);
+        d->sq_tail = (unsigned*) ((uint8_t*) d->sq_ring + p.sq_off.tail);
+        d->sq_mask = (unsigned*) ((uint8_t*) d->sq_ring + p.sq_off.ring_mask);
+        d->sq_array = (unsigned*) ((uint8_t*) d->sq_ring + p.sq_off.array);
+        d->cq_head = (unsigned*) ((uint8_t*) d->cq_ring + p.cq_off.head);
+        d->cq_tail = (unsigned*) ((uint8_t*) d->cq_ring + p.cq_off.tail);
+        d->cq_mask = (unsigned*) ((uint8_t*) d->cq_ring + p.cq_off.ring_mask);
+        d->cqes = (struct io_uring_cqe*) ((uint8_t*) d->cq_ring + p.cq_off.cqes);
+
+        /* The ring fd becomes readable when there are completions, hence we can wait for it like for any other fd,
+         * and sd_event_get_fd() continues to work for embedding the loop */
+        ev.events = EPOLLIN;
+        ev.data.ptr = d;
+        if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, d->fd, &ev) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        e->uring = d;
+        e->uring_unavailable = false;
+
+        log_debug("Using io_uring for completion sources of event loop.");
+        return 0;
+
+fail:
+        log_debug_errno(r, "io_uring not available, using epoll for completion sources: %m");
+        uring_free(d);
+        return r;
+}
+
+static int uring_flush(struct uring_data *d) {
+        int r;
+
+        assert(d);
+
+        while (d->n_queued > 0) {
+                r = sys_io_uring_enter(d->fd, d->n_queued, 0, 0);
+                if (r < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return -errno;
+                }
+
+                assert((unsigned) r <= d->n_queued);
+                d->n_queued -= r;
+
+                if (r == 0)
+                        return -EAGAIN;
+        }
+
+        return 0;
+}
+
+static unsigned uring_sq_space(struct uring_data *d) {
+        assert(d);
+
+        return *d->sq_mask + 1 - (*d->sq_tail - __atomic_load_n(d->sq_head, __ATOMIC_ACQUIRE));
+}
+
+static int uring_reserve(struct uring_data *d, unsigned n) {
+        assert(d);
+
+        /* Makes sure there's room for n more entries in the submission queue, so that linked entries are always
+         * submitted together */
+
+        if (uring_sq_space(d) >= n)
+                return 0;
+
+        /* The submission queue is full, hand what we have to the kernel first */
+        (void) uring_flush(d);
+
+        return uring_sq_space(d) >= n ? 0 : -EBUSY;
+}
+
+static struct io_uring_sqe* uring_get_sqe(struct uring_data *d) {
+        struct io_uring_sqe *sqe;
+        unsigned k;
+
+        assert(d);
+
+        if (uring_reserve(d, 1) < 0)
+                return NULL;
+
+        k = *d->sq_tail & *d->sq_mask;
+        sqe = d->sqes + k;
+        memzero(sqe, sizeof(struct io_uring_sqe));
+        d->sq_array[k] = k;
+
+        /* The entry is only visible to the kernel once the tail moved, which uring_queue_sqe() does */
+        return sqe;
+}
+
+static void uring_queue_sqe(struct uring_data *d) {
+        assert(d);
+
+        __atomic_store_n(d->sq_tail, *d->sq_tail + 1, __ATOMIC_RELEASE);
+        d->n_queued++;
+}
+
+static void uring_prep_op(struct io_uring_sqe *sqe, sd_event_source *s) {
+        CompletionRequest *req = s->completion.request;
+
+        sqe->fd = s->completion.fd;
+        sqe->user_data = PTR_TO_UINT64(req);
+
+        switch (s->completion.type) {
+
+        case EVENT_COMPLETION_READ:
+                sqe->opcode = IORING_OP_READ;
+                sqe->addr = PTR_TO_UINT64(req->buffer);
+                sqe->len = req->size;
+                sqe->off = (uint64_t) -1; /* the current file position */
+                break;
+
+        case EVENT_COMPLETION_RECV:
+                sqe->opcode = IORING_OP_RECV;
+                sqe->addr = PTR_TO_UINT64(req->buffer);
+                sqe->len = req->size;
+                sqe->msg_flags = s->completion.flags;
+                break;
+
+        case EVENT_COMPLETION_ACCEPT:
+                sqe->opcode = IORING_OP_ACCEPT;
+                sqe->accept_flags = s->completion.flags;
+                break;
+
+        default:
+                assert_not_reached("Unknown completion type");
+        }
+}
+
+static int completion_submit_uring(sd_event_source *s, bool wait_readable) {
+        struct uring_data *d = s->event->uring;
+        struct io_uring_sqe *sqe;
+
+        assert(d);
+        assert(!s->completion.in_flight);
+
+        if (uring_reserve(d, wait_readable ? 2 : 1) < 0)
+                return -EBUSY;
+
+        if (wait_readable) {
+                /* The fd is non-blocking and nothing was ready. Let the kernel wait for it, and do the operation
+                 * right after, in one submission. The completion of the poll itself is not reported. */
+                sqe = uring_get_sqe(d);
+                if (!sqe)
+                        return -EBUSY;
+
+                sqe->opcode = IORING_OP_POLL_ADD;
+                sqe->fd = s->completion.fd;
+                sqe->poll_events = POLLIN;
+                sqe->flags = IOSQE_IO_LINK;
+                sqe->user_data = PTR_TO_UINT64(s->completion.request) | URING_POLL_TAG;
+                uring_queue_sqe(d);
+                d->n_in_flight++;
+        }
+
+        s->completion.request->polling = wait_readable;
+
+        sqe = uring_get_sqe(d);
+        if (!sqe)
+                return -EBUSY;
+
+        uring_prep_op(sqe, s);
+        uring_queue_sqe(d);
+        d->n_in_flight++;
+
+        s->completion.in_flight = true;
+        return 0;
+}
+
+static void uring_cancel_one(struct uring_data *d, uint64_t user_data) {
+        struct io_uring_sqe *sqe;
+
+        assert(d);
+
+        sqe = uring_get_sqe(d);
+        if (!sqe)
+                return;
+
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = user_data;
+        sqe->user_data = 0;
+        uring_queue_sqe(d);
+        d->n_in_flight++;
+}
+
+static void uring_cancel(struct uring_data *d, CompletionRequest *req) {
+        assert(d);
+        assert(req);
+
+        /* An operation that is linked behind a poll which didn't fire yet cannot be cancelled itself, the kernel
+         * doesn't know it as in flight yet. Cancel the poll then, which fails the operation along with it. Cancel
+         * the operation too, in case the poll fired already. */
+        if (req->polling)
+                uring_cancel_one(d, PTR_TO_UINT64(req) | URING_POLL_TAG);
+
+        uring_cancel_one(d, PTR_TO_UINT64(req));
+}
+
+static void completion_orphan_uring(sd_event_source *s) {
+        struct uring_data *d = s->event->uring;
+        CompletionRequest *req = s->completion.request;
+
+        assert(d);
+        assert(req);
+
+        /* A forked off child must not touch the ring it inherited, it belongs to the parent. The request is just
+         * freed along with the source then. */
+        if (event_pid_changed(s->event))
+                return;
+
+        /* The operation is still in flight, hence hand the request over to the ring, and ask the kernel to cancel
+         * it. It is freed when its completion (successful or not) arrives. */
+
+        req->source = NULL;
+        LIST_PREPEND(orphans, d->orphans, req);
+        s->completion.request = NULL;
+        s->completion.in_flight = false;
+
+        uring_cancel(d, req);
+}
+
+static void uring_free_orphan(struct uring_data *d, CompletionRequest *req, int result) {
+        assert(d);
+        assert(req);
+        assert(!req->source);
+
+        if (req->type == EVENT_COMPLETION_ACCEPT && result >= 0)
+                safe_close(result);
+
+        LIST_REMOVE(orphans, d->orphans, req);
+        free(req);
+}
+
+static void event_free_uring(sd_event *e) {
+        struct uring_data *d = e->uring;
+        CompletionRequest *req;
+        usec_t deadline;
+
+        if (!d)
+                return;
+
+        e->uring = NULL;
+
+        /* The ring is shared with the parent if we were forked off, leave it alone, and just drop our copy */
+        if (event_pid_changed(e)) {
+                uring_free(d);
+                return;
+        }
+
+        /* Wait for the cancellations of the orphaned requests to complete, so that the kernel won't write into
+         * their buffers anymore once we free them. Cancel them again, in case the submission queue was full
+         * when they were orphaned, a cancellation of an operation that is already done is harmless. */
+        LIST_FOREACH(orphans, req, d->orphans)
+                uring_cancel(d, req);
+        (void) uring_flush(d);
+
+        deadline = usec_add(now(CLOCK_MONOTONIC), URING_DRAIN_TIMEOUT_USEC);
+        while (d->orphans && d->n_in_flight > 0) {
+                unsigned head, tail;
+                usec_t n;
+
+                head = *d->cq_head;
+                tail = __atomic_load_n(d->cq_tail, __ATOMIC_ACQUIRE);
+                for (; head != tail; head++) {
+                        struct io_uring_cqe *cqe = d->cqes + (head & *d->cq_mask);
+
+                        d->n_in_flight--;
+
+                        /* Cancellations, and polls */
+                        if (cqe->user_data == 0 || (cqe->user_data & URING_POLL_TAG))
+                                continue;
+
+                        uring_free_orphan(d, UINT64_TO_PTR(cqe->user_data), cqe->res);
+                }
+                __atomic_store_n(d->cq_head, head, __ATOMIC_RELEASE);
+
+                if (!d->orphans)
+                        break;
+
+                n = now(CLOCK_MONOTONIC);
+                if (n >= deadline)
+                        break;
+
+                /* The ring fd is readable while there are completions */
+                if (fd_wait_for_event(d->fd, POLLIN, deadline - n) < 0)
+                        break;
+        }
+
+        if (d->orphans) {
+                /* An operation that cannot be cancelled, e.g. a read from a blocking fd, might still write into its
+                 * buffer at any time, hence don't free it */
+                log_debug("Operations of completion sources still in flight, leaking their buffers.");
+                d->orphans = NULL;
+        }
+
+        uring_free(d);
+}
+#else
+static int uring_setup(sd_event *e) {
+        return -EOPNOTSUPP;
+}
+
+static int completion_submit_uring(sd_event_source *s, bool wait_readable) {
+        return -EOPNOTSUPP;
+}
+
+static void completion_orphan_uring(sd_event_source *s) {
+}
+
+static void event_free_uring(sd_event *e) {
+}
+#endif
+
+static void completion_unregister_epoll(sd_event_source *s) {
+        assert(s);
+        assert(s->type == SOURCE_COMPLETION);
+
+        if (event_pid_changed(s->event))
+                return;
+
+        if (!s->completion.registered)
+                return;
+
+        if (epoll_ctl(s->event->epoll_fd, EPOLL_CTL_DEL, s->completion.fd, NULL) < 0)
+                log_debug_errno(errno, "Failed to remove source %s (type %s) from epoll: %m",
+                                strna(s->description), event_source_type_to_string(s->type));
+
+        s->completion.registered = false;
+}
+
+static int completion_submit(sd_event_source *s) {
+        struct epoll_event ev = {};
+
+        assert(s);
+        assert(s->type == SOURCE_COMPLETION);
+        assert(s->enabled != SD_EVENT_OFF);
+
+        /* Makes sure the operation will be done as soon as possible. Sources whose result wasn't dispatched yet
+         * don't need anything, they are resubmitted after dispatching. */
+
+        if (s->pending)
+                return 0;
+
+        if (s->completion.uring)
+                return s->completion.in_flight ? 0 : completion_submit_uring(s, false);
+
+        /* Without io_uring, watch the fd with epoll, and do the operation when it is readable, in
+         * source_dispatch() */
+        if (s->completion.registered)
+                return 0;
+
+        if (!s->completion.always_ready) {
+                ev.events = EPOLLIN;
+                ev.data.ptr = s;
+                if (epoll_ctl(s->event->epoll_fd, EPOLL_CTL_ADD, s->completion.fd, &ev) >= 0) {
+                        s->completion.registered = true;
+                        return 0;
+                }
+
+                /* epoll refuses regular files and directories. They are always readable as far as poll() is
+                 * concerned, hence do the operation right away. */
+                if (errno != EPERM)
+                        return -errno;
+
+                s->completion.always_ready = true;
+        }
+
+        return source_set_pending(s, true);
+}
+
+static int completion_perform(sd_event_source *s) {
+        CompletionRequest *req;
+        ssize_t n;
+
+        assert(s);
+        assert(s->type == SOURCE_COMPLETION);
+        assert(!s->completion.uring);
+
+        /* The epoll fallback: the fd is readable, hence do the operation now */
+
+        req = s->completion.request;
+
+        switch (s->completion.type) {
+
+        case EVENT_COMPLETION_READ:
+                n = read(s->completion.fd, req->buffer, req->size);
+                break;
+
+        case EVENT_COMPLETION_RECV:
+                n = recv(s->completion.fd, req->buffer, req->size, s->completion.flags);
+                break;
+
+        case EVENT_COMPLETION_ACCEPT:
+                n = accept4(s->completion.fd, NULL, NULL, s->completion.flags);
+                break;
+
+        default:
+                assert_not_reached("Unknown completion type");
+        }
+
+        s->completion.result = n < 0 ? -errno : (int) n;
+        return s->completion.result;
+}
+
 static clockid_t event_source_type_to_clock(EventSourceType t) {
 
         switch (t) {
@@ -620,6 +1393,41 @@ static struct clock_data* event_get_clock_data(sd_event *e, EventSourceType t) {
         }
 }
 
+static void event_source_time_requeue(sd_event_source *s) {
+        struct clock_data *d;
+        usec_t k;
+
+        assert(s);
+        assert(EVENT_SOURCE_IS_TIME(s->type));
+
+        /* Call this whenever the time, accuracy, enabled or pending state of a time event source changed */
+
+        d = event_get_clock_data(s->event, s->type);
+        assert(d);
+
+        if (s->enabled == SD_EVENT_OFF || s->pending)
+                k = USEC_INFINITY;
+        else
+                k = s->time.next;
+
+        if (k != s->time.earliest.key) {
+                time_queue_remove(&d->earliest, &s->time.earliest);
+                if (k != USEC_INFINITY)
+                        time_queue_put(&d->earliest, &s->time.earliest, k);
+        }
+
+        if (k != USEC_INFINITY)
+                k = time_event_source_latest(s);
+
+        if (k != s->time.latest.key) {
+                time_queue_remove(&d->latest, &s->time.latest);
+                if (k != USEC_INFINITY)
+                        time_queue_put(&d->latest, &s->time.latest, k);
+        }
+
+        d->needs_rearm = true;
+}
+
 static int event_make_signal_data(
                 sd_event *e,
                 int sig,
@@ -816,8 +1624,12 @@ static void source_disconnect(sd_event_source *s) {
                 d = event_get_clock_data(s->event, s->type);
                 assert(d);
 
-                prioq_remove(d->earliest, s, &s->time.earliest_index);
-                prioq_remove(d->latest, s, &s->time.latest_index);
+                time_queue_remove(&d->earliest, &s->time.earliest);
+                time_queue_remove(&d->latest, &s->time.latest);
+
+                assert(d->n_sources > 0);
+                d->n_sources--;
+
                 d->needs_rearm = true;
                 break;
         }
@@ -858,6 +1670,26 @@ static void source_disconnect(sd_event_source *s) {
                 prioq_remove(s->event->exit, s, &s->exit.prioq_index);
                 break;
 
+        case SOURCE_COMPLETION:
+                if (s->completion.uring) {
+                        if (s->completion.in_flight)
+                                completion_orphan_uring(s);
+
+#if HAVE_LINUX_IO_URING_H
+                        assert(s->event->uring->n_sources > 0);
+                        s->event->uring->n_sources--;
+#endif
+                } else
+                        completion_unregister_epoll(s);
+
+                /* Don't leak a connection that was accepted but never dispatched */
+                if (s->completion.uring && s->pending &&
+                    s->completion.type == EVENT_COMPLETION_ACCEPT && s->completion.result >= 0)
+                        s->completion.result = safe_close(s->completion.result);
+
+                s->completion.request = mfree(s->completion.request);
+                break;
+
         default:
                 assert_not_reached("Wut? I shouldn't exist.");
         }
@@ -901,6 +1733,10 @@ static int source_set_pending(sd_event_source *s, bool b) {
         if (b) {
                 s->pending_iteration = s->event->iteration;
 
+                /* Take the time now rather than using the timestamp of the last wakeup, as sources may also be
+                 * marked pending while dispatching, long after the wakeup */
+                s->pending_timestamp = s->event->profile_sources ? now(CLOCK_MONOTONIC) : 0;
+
                 r = prioq_put(s->event->pending, s, &s->pending_index);
                 if (r < 0) {
                         s->pending = false;
@@ -909,16 +1745,8 @@ static int source_set_pending(sd_event_source *s, bool b) {
         } else
                 assert_se(prioq_remove(s->event->pending, s, &s->pending_index));
 
-        if (EVENT_SOURCE_IS_TIME(s->type)) {
-                struct clock_data *d;
-
-                d = event_get_clock_data(s->event, s->type);
-                assert(d);
-
-                prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                d->needs_rearm = true;
-        }
+        if (EVENT_SOURCE_IS_TIME(s->type))
+                event_source_time_requeue(s);
 
         if (s->type == SOURCE_SIGNAL && !b) {
                 struct signal_data *d;
@@ -1084,11 +1912,11 @@ _public_ int sd_event_add_time(
         d = event_get_clock_data(e, type);
         assert(d);
 
-        r = prioq_ensure_allocated(&d->earliest, earliest_time_prioq_compare);
+        r = time_queue_reserve(&d->earliest, d->n_sources + 1);
         if (r < 0)
                 return r;
 
-        r = prioq_ensure_allocated(&d->latest, latest_time_prioq_compare);
+        r = time_queue_reserve(&d->latest, d->n_sources + 1);
         if (r < 0)
                 return r;
 
@@ -1105,28 +1933,18 @@ _public_ int sd_event_add_time(
         s->time.next = usec;
         s->time.accuracy = accuracy == 0 ? DEFAULT_ACCURACY_USEC : accuracy;
         s->time.callback = callback;
-        s->time.earliest_index = s->time.latest_index = PRIOQ_IDX_NULL;
+        time_entry_init(&s->time.earliest);
+        time_entry_init(&s->time.latest);
         s->userdata = userdata;
         s->enabled = SD_EVENT_ONESHOT;
 
-        d->needs_rearm = true;
-
-        r = prioq_put(d->earliest, s, &s->time.earliest_index);
-        if (r < 0)
-                goto fail;
-
-        r = prioq_put(d->latest, s, &s->time.latest_index);
-        if (r < 0)
-                goto fail;
+        d->n_sources++;
+        event_source_time_requeue(s);
 
         if (ret)
                 *ret = s;
 
-        return 0;
-
-fail:
-        source_free(s);
-        return r;
+        return 0;
 }
 
 static int signal_exit_callback(sd_event_source *s, const struct signalfd_siginfo *si, void *userdata) {
@@ -1326,6 +2144,83 @@ _public_ int sd_event_add_post(
         return 0;
 }
 
+int event_add_completion(
+                sd_event *e,
+                sd_event_source **ret,
+                int fd,
+                EventCompletionType type,
+                size_t size,
+                int flags,
+                event_completion_handler_t callback,
+                void *userdata) {
+
+        sd_event_source *s;
+        int r;
+
+        assert_return(e, -EINVAL);
+        assert_return(fd >= 0, -EBADF);
+        assert_return(type >= 0 && type < _EVENT_COMPLETION_TYPE_MAX, -EINVAL);
+        assert_return(type == EVENT_COMPLETION_ACCEPT ? size == 0 : size > 0 && size <= INT_MAX, -EINVAL);
+        assert_return(callback, -EINVAL);
+        assert_return(e->state != SD_EVENT_FINISHED, -ESTALE);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        s = source_new(e, !ret, SOURCE_COMPLETION);
+        if (!s)
+                return -ENOMEM;
+
+        s->completion.request = malloc0(offsetof(CompletionRequest, buffer) + size);
+        if (!s->completion.request) {
+                source_free(s);
+                return -ENOMEM;
+        }
+
+        s->completion.request->source = s;
+        s->completion.request->type = type;
+        s->completion.request->size = size;
+
+        s->wakeup = WAKEUP_EVENT_SOURCE;
+        s->completion.fd = fd;
+        s->completion.type = type;
+        s->completion.flags = flags;
+        s->completion.callback = callback;
+        s->userdata = userdata;
+        s->enabled = SD_EVENT_ON;
+
+        /* Use io_uring if the kernel has it, but only for a limited number of sources, so that the rings never
+         * overflow. All others use the epoll fallback. */
+        r = uring_setup(e);
+        if (r == -ENOMEM) {
+                source_free(s);
+                return r;
+        }
+#if HAVE_LINUX_IO_URING_H
+        if (r >= 0 && e->uring->n_sources < URING_SOURCES_MAX) {
+                s->completion.uring = true;
+                e->uring->n_sources++;
+        }
+#endif
+
+        r = completion_submit(s);
+        if (r < 0) {
+                source_free(s);
+                return r;
+        }
+
+        if (ret)
+                *ret = s;
+
+        return 0;
+}
+
+int event_source_get_completion_uring(sd_event_source *s) {
+        assert_return(s, -EINVAL);
+        assert_return(s->type == SOURCE_COMPLETION, -EDOM);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        return s->completion.uring;
+}
+
 _public_ int sd_event_add_exit(
                 sd_event *e,
                 sd_event_source **ret,
@@ -1622,18 +2517,10 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                 case SOURCE_TIME_BOOTTIME:
                 case SOURCE_TIME_MONOTONIC:
                 case SOURCE_TIME_REALTIME_ALARM:
-                case SOURCE_TIME_BOOTTIME_ALARM: {
-                        struct clock_data *d;
-
+                case SOURCE_TIME_BOOTTIME_ALARM:
                         s->enabled = m;
-                        d = event_get_clock_data(s->event, s->type);
-                        assert(d);
-
-                        prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                        d->needs_rearm = true;
+                        event_source_time_requeue(s);
                         break;
-                }
 
                 case SOURCE_SIGNAL:
                         s->enabled = m;
@@ -1660,6 +2547,14 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                         s->enabled = m;
                         break;
 
+                case SOURCE_COMPLETION:
+                        /* An operation in flight is left alone, its result is dispatched once the source is
+                         * enabled again, so that no data is lost */
+                        if (!s->completion.uring)
+                                completion_unregister_epoll(s);
+                        s->enabled = m;
+                        break;
+
                 default:
                         assert_not_reached("Wut? I shouldn't exist.");
                 }
@@ -1679,18 +2574,10 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                 case SOURCE_TIME_BOOTTIME:
                 case SOURCE_TIME_MONOTONIC:
                 case SOURCE_TIME_REALTIME_ALARM:
-                case SOURCE_TIME_BOOTTIME_ALARM: {
-                        struct clock_data *d;
-
+                case SOURCE_TIME_BOOTTIME_ALARM:
                         s->enabled = m;
-                        d = event_get_clock_data(s->event, s->type);
-                        assert(d);
-
-                        prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                        d->needs_rearm = true;
+                        event_source_time_requeue(s);
                         break;
-                }
 
                 case SOURCE_SIGNAL:
 
@@ -1728,10 +2615,31 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                         break;
 
                 case SOURCE_DEFER:
+                        /* Defer sources stay pending while disabled, don't count that time as latency */
+                        if (s->enabled == SD_EVENT_OFF && s->pending_timestamp > 0)
+                                s->pending_timestamp = now(CLOCK_MONOTONIC);
+
+                        s->enabled = m;
+                        break;
+
                 case SOURCE_POST:
                         s->enabled = m;
                         break;
 
+                case SOURCE_COMPLETION: {
+                        int saved = s->enabled;
+
+                        s->enabled = m;
+
+                        r = completion_submit(s);
+                        if (r < 0) {
+                                s->enabled = saved;
+                                return r;
+                        }
+
+                        break;
+                }
+
                 default:
                         assert_not_reached("Wut? I shouldn't exist.");
                 }
@@ -1757,8 +2665,6 @@ _public_ int sd_event_source_get_time(sd_event_source *s, uint64_t *usec) {
 }
 
 _public_ int sd_event_source_set_time(sd_event_source *s, uint64_t usec) {
-        struct clock_data *d;
-
         assert_return(s, -EINVAL);
         assert_return(EVENT_SOURCE_IS_TIME(s->type), -EDOM);
         assert_return(s->event->state != SD_EVENT_FINISHED, -ESTALE);
@@ -1767,13 +2673,7 @@ _public_ int sd_event_source_set_time(sd_event_source *s, uint64_t usec) {
         s->time.next = usec;
 
         source_set_pending(s, false);
-
-        d = event_get_clock_data(s->event, s->type);
-        assert(d);
-
-        prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-        d->needs_rearm = true;
+        event_source_time_requeue(s);
 
         return 0;
 }
@@ -1789,8 +2689,6 @@ _public_ int sd_event_source_get_time_accuracy(sd_event_source *s, uint64_t *use
 }
 
 _public_ int sd_event_source_set_time_accuracy(sd_event_source *s, uint64_t usec) {
-        struct clock_data *d;
-
         assert_return(s, -EINVAL);
         assert_return(usec != (uint64_t) -1, -EINVAL);
         assert_return(EVENT_SOURCE_IS_TIME(s->type), -EDOM);
@@ -1803,12 +2701,7 @@ _public_ int sd_event_source_set_time_accuracy(sd_event_source *s, uint64_t usec
         s->time.accuracy = usec;
 
         source_set_pending(s, false);
-
-        d = event_get_clock_data(s->event, s->type);
-        assert(d);
-
-        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-        d->needs_rearm = true;
+        event_source_time_requeue(s);
 
         return 0;
 }
@@ -1967,7 +2860,7 @@ static int event_arm_timer(
                 struct clock_data *d) {
 
         struct itimerspec its = {};
-        sd_event_source *a, *b;
+        struct time_entry *a, *b;
         usec_t t;
         int r;
 
@@ -1979,8 +2872,8 @@ static int event_arm_timer(
         else
                 d->needs_rearm = false;
 
-        a = prioq_peek(d->earliest);
-        if (!a || a->enabled == SD_EVENT_OFF || a->time.next == USEC_INFINITY) {
+        a = time_queue_peek(&d->earliest);
+        if (!a) {
 
                 if (d->fd < 0)
                         return 0;
@@ -1997,10 +2890,11 @@ static int event_arm_timer(
                 return 0;
         }
 
-        b = prioq_peek(d->latest);
-        assert_se(b && b->enabled != SD_EVENT_OFF);
+        /* The latest time might have overflowed for sources scheduled very far in the future, in which case
+         * they are not queued in the latest queue */
+        b = time_queue_peek(&d->latest);
 
-        t = sleep_between(e, a->time.next, time_event_source_latest(b));
+        t = sleep_between(e, a->key, b ? b->key : USEC_INFINITY);
         if (d->next == t)
                 return 0;
 
@@ -2040,6 +2934,64 @@ static int process_io(sd_event *e, sd_event_source *s, uint32_t revents) {
         return source_set_pending(s, true);
 }
 
+#if HAVE_LINUX_IO_URING_H
+static int process_uring(sd_event *e, struct uring_data *d, uint32_t events) {
+        unsigned head, tail;
+        int r, ret = 0;
+
+        assert(e);
+        assert(d);
+
+        assert_return(events == EPOLLIN, -EIO);
+
+        head = *d->cq_head;
+        tail = __atomic_load_n(d->cq_tail, __ATOMIC_ACQUIRE);
+
+        for (; head != tail; head++) {
+                struct io_uring_cqe *cqe = d->cqes + (head & *d->cq_mask);
+                CompletionRequest *req = UINT64_TO_PTR(cqe->user_data);
+                sd_event_source *s;
+
+                assert(d->n_in_flight > 0);
+                d->n_in_flight--;
+
+                /* Polls we linked to operations, and cancellations */
+                if (!req || (cqe->user_data & URING_POLL_TAG))
+                        continue;
+
+                s = req->source;
+                if (!s) {
+                        uring_free_orphan(d, req, cqe->res);
+                        continue;
+                }
+
+                s->completion.in_flight = false;
+                req->polling = false;
+
+                /* There was nothing to do yet on the non-blocking fd, wait for it. If the source is disabled, it
+                 * is submitted again when it is enabled. */
+                if (cqe->res == -EAGAIN) {
+                        if (s->enabled == SD_EVENT_OFF)
+                                continue;
+
+                        r = completion_submit_uring(s, true);
+                        if (r >= 0)
+                                continue;
+                }
+
+                s->completion.result = cqe->res;
+
+                r = source_set_pending(s, true);
+                if (r < 0)
+                        ret = r;
+        }
+
+        __atomic_store_n(d->cq_head, head, __ATOMIC_RELEASE);
+
+        return ret;
+}
+#endif
+
 static int flush_timer(sd_event *e, int fd, uint32_t events, usec_t *next) {
         uint64_t x;
         ssize_t ss;
@@ -2071,27 +3023,25 @@ static int process_timer(
                 usec_t n,
                 struct clock_data *d) {
 
-        sd_event_source *s;
+        struct time_entry *t;
         int r;
 
         assert(e);
         assert(d);
 
         for (;;) {
-                s = prioq_peek(d->earliest);
-                if (!s ||
-                    s->time.next > n ||
-                    s->enabled == SD_EVENT_OFF ||
-                    s->pending)
+                sd_event_source *s;
+
+                t = time_queue_peek(&d->earliest);
+                if (!t || t->key > n)
                         break;
 
+                s = container_of(t, sd_event_source, time.earliest);
+
+                /* This removes the source from the queues */
                 r = source_set_pending(s, true);
                 if (r < 0)
                         return r;
-
-                prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                d->needs_rearm = true;
         }
 
         return 0;
@@ -2222,13 +3172,44 @@ static int process_signal(sd_event *e, struct signal_data *d, uint32_t events) {
         }
 }
 
+static void source_profile_dispatch(sd_event_source *s, usec_t begin, usec_t end) {
+        usec_t d;
+
+        assert(s);
+
+        d = end > begin ? end - begin : 0;
+
+        s->profile.n_dispatched++;
+        s->profile.dispatch_usec += d;
+        s->profile.dispatch_usec_max = MAX(s->profile.dispatch_usec_max, d);
+
+        /* The time between the source being marked pending and the dispatching. Note that the timestamp is not
+         * set for sources that became pending while profiling was off. */
+        if (s->pending_timestamp > 0 && begin > s->pending_timestamp) {
+                d = begin - s->pending_timestamp;
+
+                s->profile.latency_usec += d;
+                s->profile.latency_usec_max = MAX(s->profile.latency_usec_max, d);
+        }
+
+        /* Defer sources stay pending after dispatching, measure the latency of the next dispatch from now on
+         * rather than from the moment they were added */
+        if (s->type == SOURCE_DEFER && s->pending)
+                s->pending_timestamp = end;
+}
+
 static int source_dispatch(sd_event_source *s) {
         EventSourceType saved_type;
+        usec_t begin = 0;
+        bool profile;
         int r = 0;
 
         assert(s);
         assert(s->pending || s->type == SOURCE_EXIT);
 
+        /* Save this too, the event source might be disconnected from the event loop by the callback */
+        profile = s->event->profile_sources;
+
         /* Save the event source type, here, so that we still know it after the event callback which might invalidate
          * the event. */
         saved_type = s->type;
@@ -2239,6 +3220,12 @@ static int source_dispatch(sd_event_source *s) {
                         return r;
         }
 
+        /* Without io_uring, the fd of a completion source was found readable, now do the operation. If there was
+         * nothing to do after all, the fd is still watched, and there's nothing to dispatch. */
+        if (s->type == SOURCE_COMPLETION && !s->completion.uring &&
+            IN_SET(completion_perform(s), -EAGAIN, -EINTR))
+                return 1;
+
         if (s->type != SOURCE_POST) {
                 sd_event_source *z;
                 Iterator i;
@@ -2262,6 +3249,9 @@ static int source_dispatch(sd_event_source *s) {
                         return r;
         }
 
+        if (profile)
+                begin = now(CLOCK_MONOTONIC);
+
         s->dispatching = true;
 
         switch (s->type) {
@@ -2308,6 +3298,12 @@ static int source_dispatch(sd_event_source *s) {
                 r = s->exit.callback(s, s->userdata);
                 break;
 
+        case SOURCE_COMPLETION:
+                r = s->completion.callback(s, s->completion.fd, s->completion.result,
+                                           s->completion.request->size > 0 ? s->completion.request->buffer : NULL,
+                                           s->userdata);
+                break;
+
         case SOURCE_WATCHDOG:
         case _SOURCE_EVENT_SOURCE_TYPE_MAX:
         case _SOURCE_EVENT_SOURCE_TYPE_INVALID:
@@ -2316,6 +3312,9 @@ static int source_dispatch(sd_event_source *s) {
 
         s->dispatching = false;
 
+        if (profile)
+                source_profile_dispatch(s, begin, now(CLOCK_MONOTONIC));
+
         if (r < 0)
                 log_debug_errno(r, "Event source %s (type %s) returned error, disabling: %m",
                                 strna(s->description), event_source_type_to_string(saved_type));
@@ -2324,6 +3323,15 @@ static int source_dispatch(sd_event_source *s) {
                 source_free(s);
         else if (r < 0)
                 sd_event_source_set_enabled(s, SD_EVENT_OFF);
+        else if (saved_type == SOURCE_COMPLETION && s->type == SOURCE_COMPLETION && s->enabled != SD_EVENT_OFF) {
+                /* Queue the next operation */
+                r = completion_submit(s);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to submit operation for event source %s, disabling: %m",
+                                        strna(s->description));
+                        sd_event_source_set_enabled(s, SD_EVENT_OFF);
+                }
+        }
 
         return 1;
 }
@@ -2464,6 +3472,15 @@ _public_ int sd_event_prepare(sd_event *e) {
         if (r < 0)
                 return r;
 
+#if HAVE_LINUX_IO_URING_H
+        /* Submit all operations that were queued since the last iteration in one go */
+        if (e->uring) {
+                r = uring_flush(e->uring);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to submit operations to io_uring, will retry: %m");
+        }
+#endif
+
         r = event_arm_timer(e, &e->realtime);
         if (r < 0)
                 return r;
@@ -2500,68 +3517,117 @@ pending:
         return r;
 }
 
-_public_ int sd_event_wait(sd_event *e, uint64_t timeout) {
-        struct epoll_event *ev_queue;
-        unsigned ev_queue_max;
-        int r, m, i;
+static int process_epoll(sd_event *e, usec_t timeout) {
+        size_t n_event_queue, m = 0, i;
+        int r, k;
 
-        assert_return(e, -EINVAL);
-        assert_return(!event_pid_changed(e), -ECHILD);
-        assert_return(e->state != SD_EVENT_FINISHED, -ESTALE);
-        assert_return(e->state == SD_EVENT_ARMED, -EBUSY);
+        assert(e);
 
-        if (e->exit_requested) {
-                e->state = SD_EVENT_PENDING;
-                return 1;
-        }
+        n_event_queue = MAX(e->n_sources, 1u);
+        if (!GREEDY_REALLOC(e->event_queue, e->event_queue_allocated, n_event_queue))
+                return -ENOMEM;
 
-        ev_queue_max = MAX(e->n_sources, 1u);
-        ev_queue = newa(struct epoll_event, ev_queue_max);
+        for (;;) {
+                k = epoll_wait(e->epoll_fd, e->event_queue + m, e->event_queue_allocated - m,
+                               timeout == USEC_INFINITY ? -1 : (int) ((timeout + USEC_PER_MSEC - 1) / USEC_PER_MSEC));
+                if (k < 0) {
+                        /* If we were interrupted while draining, just process what we already got */
+                        if (errno == EINTR && m > 0)
+                                break;
 
-        m = epoll_wait(e->epoll_fd, ev_queue, ev_queue_max,
-                       timeout == (uint64_t) -1 ? -1 : (int) ((timeout + USEC_PER_MSEC - 1) / USEC_PER_MSEC));
-        if (m < 0) {
-                if (errno == EINTR) {
-                        e->state = SD_EVENT_PENDING;
-                        return 1;
+                        return -errno;
                 }
 
-                r = -errno;
-                goto finish;
+                m += k;
+
+                /* If the buffer wasn't filled up completely, we got everything that is ready right now. Otherwise,
+                 * there might be more, hence grow the buffer and fetch the rest without waiting, so that we don't
+                 * need another full loop iteration (with all its prepare and timer rearm syscalls) to get to it.
+                 * Note that level-triggered fds might be reported twice this way, which is harmless, as the
+                 * revents are ORed together and the clock and signal fds are drained until EAGAIN. To make sure
+                 * we terminate even if we are flooded, put a limit on how much we grow the buffer. */
+                if (m < e->event_queue_allocated)
+                        break;
+
+                if (e->event_queue_allocated >= n_event_queue * 10)
+                        break;
+
+                /* If we can't grow the buffer, process what we already got, the rest is picked up next time */
+                if (!GREEDY_REALLOC(e->event_queue, e->event_queue_allocated, e->event_queue_allocated + n_event_queue))
+                        break;
+
+                timeout = 0;
         }
 
         triple_timestamp_get(&e->timestamp);
 
         for (i = 0; i < m; i++) {
+                struct epoll_event *ev = e->event_queue + i;
 
-                if (ev_queue[i].data.ptr == INT_TO_PTR(SOURCE_WATCHDOG))
-                        r = flush_timer(e, e->watchdog_fd, ev_queue[i].events, NULL);
+                if (ev->data.ptr == INT_TO_PTR(SOURCE_WATCHDOG))
+                        r = flush_timer(e, e->watchdog_fd, ev->events, NULL);
                 else {
-                        WakeupType *t = ev_queue[i].data.ptr;
+                        WakeupType *t = ev->data.ptr;
 
                         switch (*t) {
 
-                        case WAKEUP_EVENT_SOURCE:
-                                r = process_io(e, ev_queue[i].data.ptr, ev_queue[i].events);
+                        case WAKEUP_EVENT_SOURCE: {
+                                sd_event_source *s = ev->data.ptr;
+
+                                if (s->type == SOURCE_COMPLETION)
+                                        r = source_set_pending(s, true);
+                                else
+                                        r = process_io(e, s, ev->events);
                                 break;
+                        }
 
                         case WAKEUP_CLOCK_DATA: {
-                                struct clock_data *d = ev_queue[i].data.ptr;
-                                r = flush_timer(e, d->fd, ev_queue[i].events, &d->next);
+                                struct clock_data *d = ev->data.ptr;
+                                r = flush_timer(e, d->fd, ev->events, &d->next);
                                 break;
                         }
 
                         case WAKEUP_SIGNAL_DATA:
-                                r = process_signal(e, ev_queue[i].data.ptr, ev_queue[i].events);
+                                r = process_signal(e, ev->data.ptr, ev->events);
+                                break;
+
+#if HAVE_LINUX_IO_URING_H
+                        case WAKEUP_URING_DATA:
+                                r = process_uring(e, ev->data.ptr, ev->events);
                                 break;
+#endif
 
                         default:
                                 assert_not_reached("Invalid wake-up pointer");
                         }
                 }
                 if (r < 0)
-                        goto finish;
+                        return r;
+        }
+
+        return 0;
+}
+
+_public_ int sd_event_wait(sd_event *e, uint64_t timeout) {
+        int r;
+
+        assert_return(e, -EINVAL);
+        assert_return(!event_pid_changed(e), -ECHILD);
+        assert_return(e->state != SD_EVENT_FINISHED, -ESTALE);
+        assert_return(e->state == SD_EVENT_ARMED, -EBUSY);
+
+        if (e->exit_requested) {
+                e->state = SD_EVENT_PENDING;
+                return 1;
+        }
+
+        r = process_epoll(e, timeout);
+        if (r == -EINTR) {
+                e->state = SD_EVENT_PENDING;
+                return 1;
         }
+        if (r < 0)
+                goto finish;
 
         r = process_watchdog(e);
         if (r < 0)
@@ -2647,6 +3713,9 @@ static void event_log_delays(sd_event *e) {
                 e->delays[i] = 0;
         }
         log_debug("Event loop iterations: %.*s", o, b);
+
+        if (log_get_max_level() >= LOG_DEBUG)
+                event_dump_profile(e, NULL, NULL);
 }
 
 _public_ int sd_event_run(sd_event *e, uint64_t timeout) {
@@ -2883,3 +3952,131 @@ _public_ int sd_event_get_iteration(sd_event *e, uint64_t *ret) {
         *ret = e->iteration;
         return 0;
 }
+
+int event_set_profile(sd_event *e, bool b) {
+        assert_return(e, -EINVAL);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        e->profile_sources = b;
+        return 0;
+}
+
+int event_set_time_buckets(sd_event *e, bool b) {
+        static const EventSourceType types[] = {
+                SOURCE_TIME_REALTIME,
+                SOURCE_TIME_BOOTTIME,
+                SOURCE_TIME_MONOTONIC,
+                SOURCE_TIME_REALTIME_ALARM,
+                SOURCE_TIME_BOOTTIME_ALARM,
+        };
+        size_t i;
+
+        assert_return(e, -EINVAL);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        for (i = 0; i < ELEMENTSOF(types); i++)
+                if (event_get_clock_data(e, types[i])->n_sources > 0)
+                        return -EBUSY;
+
+        for (i = 0; i < ELEMENTSOF(types); i++) {
+                struct clock_data *d = event_get_clock_data(e, types[i]);
+
+                d->earliest.unbucketed = d->latest.unbucketed = !b;
+        }
+
+        return 0;
+}
+
+int event_get_profile(sd_event *e) {
+        assert_return(e, -EINVAL);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        return e->profile_sources;
+}
+
+int event_source_get_profile(sd_event_source *s, EventSourceProfile *ret) {
+        assert_return(s, -EINVAL);
+        assert_return(ret, -EINVAL);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        *ret = s->profile;
+        return 0;
+}
+
+static int source_profile_compare(const void *a, const void *b) {
+        sd_event_source *x = *(sd_event_source**) a, *y = *(sd_event_source**) b;
+
+        /* Busiest sources first */
+        if (x->profile.dispatch_usec > y->profile.dispatch_usec)
+                return -1;
+        if (x->profile.dispatch_usec < y->profile.dispatch_usec)
+                return 1;
+
+        if (x->profile.n_dispatched > y->profile.n_dispatched)
+                return -1;
+        if (x->profile.n_dispatched < y->profile.n_dispatched)
+                return 1;
+
+        return 0;
+}
+
+void event_dump_profile(sd_event *e, FILE *f, const char *prefix) {
+        _cleanup_free_ sd_event_source **sources = NULL;
+        sd_event_source *s;
+        unsigned n = 0, i;
+
+        assert(e);
+
+        /* Writes the dispatch statistics of all event sources to f, busiest first. If f is NULL, logs the ten
+         * busiest sources at debug level instead. */
+
+        if (!e->profile_sources)
+                return;
+
+        sources = new(sd_event_source*, e->n_sources);
+        if (!sources) {
+                log_oom();
+                return;
+        }
+
+        LIST_FOREACH(sources, s, e->sources)
+                if (s->profile.n_dispatched > 0)
+                        sources[n++] = s;
+
+        qsort_safe(sources, n, sizeof(sd_event_source*), source_profile_compare);
+
+        if (f) {
+                fprintf(f, "%sEvent Loop Iterations: %" PRIu64 "\n", strempty(prefix), e->iteration);
+
+                if (e->profile_delays) {
+                        fprintf(f, "%sEvent Loop Delays:", strempty(prefix));
+                        for (i = 0; i < ELEMENTSOF(e->delays); i++)
+                                fprintf(f, " %u", e->delays[i]);
+                        fputc('\n', f);
+                }
+        } else
+                n = MIN(n, 10u);
+
+        for (i = 0; i < n; i++) {
+                char total[FORMAT_TIMESPAN_MAX], max[FORMAT_TIMESPAN_MAX], latency[FORMAT_TIMESPAN_MAX], latency_max[FORMAT_TIMESPAN_MAX];
+                const EventSourceProfile *p;
+
+                s = sources[i];
+                p = &s->profile;
+
+                format_timespan(total, sizeof(total), p->dispatch_usec, 1);
+                format_timespan(max, sizeof(max), p->dispatch_usec_max, 1);
+                format_timespan(latency, sizeof(latency), p->latency_usec / p->n_dispatched, 1);
+                format_timespan(latency_max, sizeof(latency_max), p->latency_usec_max, 1);
+
+                if (f)
+                        fprintf(f,
+                                "%sEvent Source %s (%s): dispatched %" PRIu64 " times, total %s, max %s, average latency %s, max latency %s\n",
+                                strempty(prefix), strna(s->description), event_source_type_to_string(s->type),
+                                p->n_dispatched, total, max, latency, latency_max);
+                else
+                        log_debug("Event source %s (%s): dispatched %" PRIu64 " times, total %s, max %s, average latency %s, max latency %s",
+                                  strna(s->description), event_source_type_to_string(s->type),
+                                  p->n_dispatched, total, max, latency, latency_max);
+        }
+}
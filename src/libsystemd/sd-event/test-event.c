@@ -22,12 +22,21 @@
 
 #include "sd-event.h"
 
+#include "alloc-util.h"
+#include "env-util.h"
+#include "event-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "log.h"
 #include "macro.h"
 #include "signal-util.h"
+#include "socket-util.h"
+#include "string-util.h"
+#include "time-util.h"
 #include "util.h"
 
+static bool arg_slow = false;
+
 static int prepare_handler(sd_event_source *s, void *userdata) {
         log_info("preparing %c", PTR_TO_INT(userdata));
         return 1;
@@ -354,14 +363,424 @@ static void test_rtqueue(void) {
         sd_event_unref(e);
 }
 
+static unsigned n_time_fired;
+
+static int time_fired_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        bool *fired = userdata;
+
+        assert_se(!*fired);
+        *fired = true;
+        n_time_fired++;
+
+        return 0;
+}
+
+static void test_time_requeue(void) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        sd_event_source *s[64];
+        bool fired[ELEMENTSOF(s)] = {}, expected[ELEMENTSOF(s)] = {};
+        usec_t n;
+        unsigned i, n_expected = 0;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_now(e, CLOCK_MONOTONIC, &n) > 0);
+
+        /* Start out with everything far in the future, and then move sources back and forth between the
+         * buckets and the prioq, and in and out of the time queues altogether */
+        for (i = 0; i < ELEMENTSOF(s); i++)
+                assert_se(sd_event_add_time(e, &s[i], CLOCK_MONOTONIC, n + USEC_PER_HOUR + i, 0, time_fired_handler, &fired[i]) >= 0);
+
+        for (i = 0; i < ELEMENTSOF(s); i++) {
+                switch (i % 4) {
+
+                case 0:
+                        /* Move into the past, and hence fire */
+                        assert_se(sd_event_source_set_time(s[i], 1 + i) >= 0);
+                        break;
+
+                case 1:
+                        /* Move into the past, but disable again */
+                        assert_se(sd_event_source_set_time(s[i], 1 + i) >= 0);
+                        assert_se(sd_event_source_set_enabled(s[i], SD_EVENT_OFF) >= 0);
+                        break;
+
+                case 2:
+                        /* Move into the past, then postpone, i.e. don't fire */
+                        assert_se(sd_event_source_set_time(s[i], 1 + i) >= 0);
+                        assert_se(sd_event_source_set_time(s[i], n + 2 * USEC_PER_HOUR) >= 0);
+                        break;
+
+                case 3:
+                        /* Disable, move into the past, and enable again, i.e. fire */
+                        assert_se(sd_event_source_set_enabled(s[i], SD_EVENT_OFF) >= 0);
+                        assert_se(sd_event_source_set_time(s[i], 1 + i) >= 0);
+                        assert_se(sd_event_source_set_enabled(s[i], SD_EVENT_ONESHOT) >= 0);
+                        break;
+                }
+
+                expected[i] = IN_SET(i % 4, 0, 3);
+                if (expected[i])
+                        n_expected++;
+        }
+
+        n_time_fired = 0;
+        while (sd_event_run(e, 0) > 0)
+                ;
+
+        assert_se(n_time_fired == n_expected);
+        for (i = 0; i < ELEMENTSOF(s); i++) {
+                assert_se(fired[i] == expected[i]);
+                sd_event_source_unref(s[i]);
+        }
+}
+
+static void time_rearm_benchmark(bool buckets, unsigned n_sources, unsigned n_rounds) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_free_ sd_event_source **s = NULL;
+        const char *what = buckets ? "buckets" : "prioq";
+        char buf[FORMAT_TIMESPAN_MAX];
+        unsigned i, j;
+        usec_t n, ts;
+
+        s = new(sd_event_source*, n_sources);
+        assert_se(s);
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(event_set_time_buckets(e, buckets) >= 0);
+        assert_se(sd_event_now(e, CLOCK_MONOTONIC, &n) > 0);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n_sources; i++)
+                assert_se(sd_event_add_time(e, &s[i], CLOCK_MONOTONIC, n + USEC_PER_HOUR + i * USEC_PER_MSEC, 0, time_fired_handler, NULL) >= 0);
+        log_info("%s: added %u time sources in %s", what, n_sources, format_timespan(buf, sizeof(buf), now(CLOCK_MONOTONIC) - ts, 1));
+
+        /* The queueing can't be changed anymore now */
+        assert_se(event_set_time_buckets(e, !buckets) == -EBUSY);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (j = 1; j <= n_rounds; j++) {
+                for (i = 0; i < n_sources; i++)
+                        assert_se(sd_event_source_set_time(s[i], n + USEC_PER_HOUR + j * USEC_PER_MINUTE + i * USEC_PER_MSEC) >= 0);
+
+                assert_se(sd_event_run(e, 0) == 0);
+        }
+        log_info("%s: re-armed %u time sources %u times in %s", what, n_sources, n_rounds, format_timespan(buf, sizeof(buf), now(CLOCK_MONOTONIC) - ts, 1));
+
+        ts = now(CLOCK_MONOTONIC);
+        for (j = 0; j < n_rounds; j++) {
+                for (i = 0; i < n_sources; i++)
+                        assert_se(sd_event_source_set_enabled(s[i], j % 2 == 0 ? SD_EVENT_OFF : SD_EVENT_ONESHOT) >= 0);
+
+                assert_se(sd_event_run(e, 0) == 0);
+        }
+        log_info("%s: toggled %u time sources %u times in %s", what, n_sources, n_rounds, format_timespan(buf, sizeof(buf), now(CLOCK_MONOTONIC) - ts, 1));
+
+        for (i = 0; i < n_sources; i++)
+                sd_event_source_unref(s[i]);
+}
+
+static void test_time_rearm_benchmark(void) {
+        unsigned n_sources;
+
+        log_info("/* %s */", __func__);
+
+        /* Emulates what PID 1 does to job timeouts and watchdogs: lots of time sources, all of which are
+         * regularly pushed into the future again. Do this with the time sources bucketed, as by default, and with
+         * all of them in the prioqs right away, for comparison. */
+
+        n_sources = arg_slow ? 100000 : 1000;
+
+        time_rearm_benchmark(true, n_sources, 10);
+        time_rearm_benchmark(false, n_sources, 10);
+}
+
+static int profile_handler(sd_event_source *s, void *userdata) {
+        usleep(10 * USEC_PER_MSEC);
+        return 0;
+}
+
+static int profile_late_handler(sd_event_source *s, void *userdata) {
+        return 0;
+}
+
+static int profile_spawn_handler(sd_event_source *s, void *userdata) {
+        sd_event_source **late = userdata;
+
+        usleep(10 * USEC_PER_MSEC);
+
+        /* Becomes pending long after the wakeup of this iteration */
+        assert_se(sd_event_add_defer(sd_event_source_get_event(s), late, profile_late_handler, NULL) >= 0);
+        assert_se(sd_event_source_set_enabled(*late, SD_EVENT_ONESHOT) >= 0);
+        return 0;
+}
+
+static void test_profile(void) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_(sd_event_source_unrefp) sd_event_source *s = NULL, *spawn = NULL, *late = NULL, *busy = NULL;
+        EventSourceProfile p;
+        unsigned i;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_add_defer(e, &s, profile_handler, NULL) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_source_set_description(s, "profile") >= 0);
+
+        /* Nothing is recorded unless profiling is turned on */
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(event_source_get_profile(s, &p) >= 0);
+        assert_se(p.n_dispatched == 0);
+
+        assert_se(event_set_profile(e, true) >= 0);
+        assert_se(event_get_profile(e) > 0);
+
+        for (i = 0; i < 3; i++)
+                assert_se(sd_event_run(e, 0) > 0);
+
+        assert_se(event_source_get_profile(s, &p) >= 0);
+        assert_se(p.n_dispatched == 3);
+        assert_se(p.dispatch_usec >= 30 * USEC_PER_MSEC);
+        assert_se(p.dispatch_usec_max >= 10 * USEC_PER_MSEC);
+        assert_se(p.dispatch_usec_max <= p.dispatch_usec);
+
+        /* The latency is measured from the moment a source is marked pending */
+        assert_se(sd_event_add_defer(e, &spawn, profile_spawn_handler, &late) >= 0);
+        assert_se(sd_event_source_set_enabled(spawn, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(late);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(event_source_get_profile(late, &p) >= 0);
+        assert_se(p.n_dispatched == 1);
+        assert_se(p.latency_usec_max < 10 * USEC_PER_MSEC);
+
+        /* Defer sources stay pending, hence their latency is measured from the end of the previous dispatch, not
+         * from the moment they were added */
+        assert_se(sd_event_add_defer(e, &busy, profile_handler, NULL) >= 0);
+        assert_se(sd_event_source_set_enabled(busy, SD_EVENT_ON) >= 0);
+        for (i = 0; i < 3; i++)
+                assert_se(sd_event_run(e, 0) > 0);
+
+        assert_se(event_source_get_profile(busy, &p) >= 0);
+        assert_se(p.n_dispatched == 3);
+        assert_se(p.latency_usec_max < 10 * USEC_PER_MSEC);
+
+        event_dump_profile(e, stdout, "\t");
+}
+
+struct completion_data {
+        unsigned n_read, n_recv, n_accept;
+        size_t size;
+        char data[32];
+};
+
+static int completion_read_handler(sd_event_source *s, int fd, int result, const void *buffer, void *userdata) {
+        struct completion_data *d = userdata;
+
+        assert_se(result > 0);
+        assert_se((size_t) result < sizeof(d->data));
+
+        memcpy(d->data, buffer, result);
+        d->data[result] = 0;
+        d->n_read++;
+
+        return 0;
+}
+
+static int completion_file_handler(sd_event_source *s, int fd, int result, const void *buffer, void *userdata) {
+        struct completion_data *d = userdata;
+
+        /* A regular file is read until EOF, which is reported as an empty read */
+        assert_se(result >= 0);
+        if (result == 0)
+                return sd_event_source_set_enabled(s, SD_EVENT_OFF);
+
+        assert_se(d->size + result < sizeof(d->data));
+        memcpy(d->data + d->size, buffer, result);
+        d->size += result;
+        d->data[d->size] = 0;
+        d->n_read++;
+
+        return 0;
+}
+
+static int completion_recv_handler(sd_event_source *s, int fd, int result, const void *buffer, void *userdata) {
+        struct completion_data *d = userdata;
+
+        /* Each datagram is received on its own */
+        assert_se(result == 3);
+        assert_se(memcmp(buffer, d->n_recv == 0 ? "foo" : "bar", 3) == 0);
+        d->n_recv++;
+
+        return 0;
+}
+
+static int completion_accept_handler(sd_event_source *s, int fd, int result, const void *buffer, void *userdata) {
+        struct completion_data *d = userdata;
+
+        assert_se(result >= 0);
+        assert_se(!buffer);
+        safe_close(result);
+        d->n_accept++;
+
+        return 0;
+}
+
+static void test_completion(bool uring) {
+        union sockaddr_union sa = {
+                .un.sun_family = AF_UNIX,
+        };
+        /* Closed only after the event loop is freed */
+        _cleanup_close_pair_ int n[2] = { -1, -1 };
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_close_pair_ int p[2] = { -1, -1 }, k[2] = { -1, -1 }, b[2] = { -1, -1 };
+        _cleanup_close_ int listener = -1, c = -1;
+        _cleanup_(sd_event_source_unrefp) sd_event_source *r = NULL, *q = NULL, *a = NULL, *idle = NULL;
+        struct completion_data d = {};
+        socklen_t salen;
+
+        log_info("/* %s(%s) */", __func__, yes_no(uring));
+
+        assert_se(setenv("SYSTEMD_EVENT_IO_URING", one_zero(uring), 1) >= 0);
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(pipe2(p, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, k) >= 0);
+        listener = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0);
+        assert_se(listener >= 0);
+        assert_se(bind(listener, &sa.sa, offsetof(struct sockaddr_un, sun_path)) >= 0);
+        assert_se(listen(listener, 1) >= 0);
+        salen = sizeof(sa);
+        assert_se(getsockname(listener, &sa.sa, &salen) >= 0);
+
+        assert_se(event_add_completion(e, &r, p[0], EVENT_COMPLETION_READ, 16, 0, completion_read_handler, &d) >= 0);
+        assert_se(event_add_completion(e, &q, k[0], EVENT_COMPLETION_RECV, 16, 0, completion_recv_handler, &d) >= 0);
+        assert_se(event_add_completion(e, &a, listener, EVENT_COMPLETION_ACCEPT, 0, SOCK_CLOEXEC, completion_accept_handler, &d) >= 0);
+        log_info("Using io_uring: %s", yes_no(event_source_get_completion_uring(r) > 0));
+        if (!uring)
+                assert_se(event_source_get_completion_uring(r) == 0);
+
+        /* Nothing happened yet */
+        assert_se(sd_event_run(e, 0) == 0);
+
+        assert_se(write(p[1], "hello", 5) == 5);
+        while (d.n_read < 1)
+                assert_se(sd_event_run(e, 5 * USEC_PER_SEC) > 0);
+        assert_se(streq(d.data, "hello"));
+
+        /* The operation is submitted again after the callback */
+        assert_se(write(p[1], "world", 5) == 5);
+        while (d.n_read < 2)
+                assert_se(sd_event_run(e, 5 * USEC_PER_SEC) > 0);
+        assert_se(streq(d.data, "world"));
+
+        /* Nothing is dispatched while the source is disabled, and nothing is lost either */
+        assert_se(sd_event_source_set_enabled(r, SD_EVENT_OFF) >= 0);
+        assert_se(write(p[1], "again", 5) == 5);
+        assert_se(sd_event_run(e, 100 * USEC_PER_MSEC) >= 0);
+        assert_se(d.n_read == 2);
+        assert_se(sd_event_source_set_enabled(r, SD_EVENT_ON) >= 0);
+        while (d.n_read < 3)
+                assert_se(sd_event_run(e, 5 * USEC_PER_SEC) > 0);
+        assert_se(streq(d.data, "again"));
+
+        assert_se(send(k[1], "foo", 3, 0) == 3);
+        assert_se(send(k[1], "bar", 3, 0) == 3);
+        while (d.n_recv < 2)
+                assert_se(sd_event_run(e, 5 * USEC_PER_SEC) > 0);
+
+        c = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+        assert_se(c >= 0);
+        assert_se(connect(c, &sa.sa, salen) >= 0);
+        while (d.n_accept < 1)
+                assert_se(sd_event_run(e, 5 * USEC_PER_SEC) > 0);
+
+        /* Free a source while its operation is in flight, on a blocking fd, the kernel must let go of it */
+        assert_se(pipe2(b, O_CLOEXEC) >= 0);
+        assert_se(event_add_completion(e, &idle, b[0], EVENT_COMPLETION_READ, 16, 0, completion_read_handler, &d) >= 0);
+        assert_se(sd_event_run(e, 0) == 0);
+        idle = sd_event_source_unref(idle);
+        assert_se(sd_event_run(e, 0) >= 0);
+
+        /* Same for a non-blocking operation, which waits behind a poll. Let the loop see the -EAGAIN first, so
+         * that the poll is submitted. */
+        assert_se(socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, n) >= 0);
+        assert_se(event_add_completion(e, &idle, n[0], EVENT_COMPLETION_RECV, 16, MSG_DONTWAIT, completion_recv_handler, &d) >= 0);
+        assert_se(sd_event_run(e, 100 * USEC_PER_MSEC) == 0);
+        assert_se(sd_event_run(e, 0) == 0);
+        idle = sd_event_source_unref(idle);
+        assert_se(sd_event_run(e, 0) >= 0);
+
+        /* And free one whose poll is still in flight together with the event loop itself. The socket stays open
+         * until after that, hence the poll never fires on its own. */
+        assert_se(event_add_completion(e, &idle, n[0], EVENT_COMPLETION_RECV, 16, MSG_DONTWAIT, completion_recv_handler, &d) >= 0);
+        assert_se(sd_event_run(e, 100 * USEC_PER_MSEC) == 0);
+        idle = sd_event_source_unref(idle);
+
+        /* Free a source whose operation completed, but which was not dispatched yet */
+        assert_se(sd_event_source_set_enabled(r, SD_EVENT_OFF) >= 0);
+        assert_se(write(p[1], "unseen", 6) == 6);
+        assert_se(sd_event_run(e, 100 * USEC_PER_MSEC) >= 0);
+        r = sd_event_source_unref(r);
+        assert_se(d.n_read == 3);
+
+        assert_se(unsetenv("SYSTEMD_EVENT_IO_URING") >= 0);
+}
+
+static void test_completion_file(bool uring) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_(sd_event_source_unrefp) sd_event_source *s = NULL;
+        char name[] = "/tmp/test-event-completion.XXXXXX";
+        _cleanup_close_ int fd = -1;
+        struct completion_data d = {};
+        int enabled;
+
+        log_info("/* %s(%s) */", __func__, yes_no(uring));
+
+        assert_se(setenv("SYSTEMD_EVENT_IO_URING", one_zero(uring), 1) >= 0);
+        assert_se(sd_event_new(&e) >= 0);
+
+        /* epoll cannot watch regular files, they are read right away */
+        fd = mkostemp_safe(name);
+        assert_se(fd >= 0);
+        assert_se(unlink(name) >= 0);
+        assert_se(write(fd, "hello world", 11) == 11);
+        assert_se(lseek(fd, 0, SEEK_SET) == 0);
+
+        assert_se(event_add_completion(e, &s, fd, EVENT_COMPLETION_READ, 4, 0, completion_file_handler, &d) >= 0);
+        do {
+                assert_se(sd_event_run(e, 5 * USEC_PER_SEC) > 0);
+                assert_se(sd_event_source_get_enabled(s, &enabled) >= 0);
+        } while (enabled != SD_EVENT_OFF);
+
+        assert_se(d.n_read == 3);
+        assert_se(streq(d.data, "hello world"));
+
+        assert_se(unsetenv("SYSTEMD_EVENT_IO_URING") >= 0);
+}
+
 int main(int argc, char *argv[]) {
+        int r;
 
         log_set_max_level(LOG_DEBUG);
         log_parse_environment();
 
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        arg_slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+
         test_basic();
         test_sd_event_now();
         test_rtqueue();
+        test_time_requeue();
+        test_time_rearm_benchmark();
+        test_profile();
+        test_completion(true);
+        test_completion(false);
+        test_completion_file(true);
+        test_completion_file(false);
 
         return 0;
 }
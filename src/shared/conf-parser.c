@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #include "alloc-util.h"
@@ -81,6 +82,9 @@ int config_item_table_lookup(
         return 0;
 }
 
+/* Longer than the longest "Section.Name" key in the gperf tables */
+#define CONFIG_PERF_KEY_MAX 128
+
 int config_item_perf_lookup(
                 const void *table,
                 const char *section,
@@ -102,14 +106,21 @@ int config_item_perf_lookup(
         if (!section)
                 p = lookup(lvalue, strlen(lvalue));
         else {
-                char *key;
+                char key[CONFIG_PERF_KEY_MAX];
+                size_t a, b;
+
+                /* This is called for every assignment, hence avoid allocating the key. Anything longer than any
+                 * of the keys in the tables can't match anyway. */
+                a = strlen(section);
+                b = strlen(lvalue);
+                if (a + 1 + b >= sizeof(key))
+                        return 0;
 
-                key = strjoin(section, ".", lvalue);
-                if (!key)
-                        return -ENOMEM;
+                memcpy(key, section, a);
+                key[a] = '.';
+                memcpy(key + a + 1, lvalue, b + 1);
 
-                p = lookup(key, strlen(key));
-                free(key);
+                p = lookup(key, a + 1 + b);
         }
 
         if (!p)
@@ -165,36 +176,245 @@ static int next_assignment(
         return 0;
 }
 
-/* Parse a variable assignment line */
-static int parse_line(
-                const char* unit,
-                const char *filename,
-                unsigned line,
-                const char *sections,
-                ConfigItemLookup lookup,
-                const void *table,
-                ConfigParseFlags flags,
-                char **section,
-                unsigned *section_line,
-                bool *section_ignored,
-                char *l,
-                void *userdata) {
+typedef enum ConfigLineType {
+        CONFIG_LINE_SECTION,
+        CONFIG_LINE_BAD_SECTION,
+        CONFIG_LINE_ASSIGNMENT,
+        CONFIG_LINE_BAD_ASSIGNMENT,
+        CONFIG_LINE_INCLUDE,
+} ConfigLineType;
+
+typedef struct ConfigLine {
+        ConfigLineType type;
+        unsigned line;
+        const char *key;   /* the section name, the lvalue, the .include argument, or the bad line */
+        const char *value; /* the rvalue */
+} ConfigLine;
+
+struct ConfigFile {
+        char *filename;
+        struct stat st;
+
+        /* The whole file, split up in place: the lines point into it */
+        char *contents;
+
+        ConfigLine *lines;
+        size_t n_lines, n_allocated;
+
+        /* Set if reading the file failed after the lines above */
+        int error;
+        unsigned error_line;
+        bool error_continuation;
+};
+
+ConfigFile *config_file_free(ConfigFile *cf) {
+        if (!cf)
+                return NULL;
+
+        free(cf->contents);
+        free(cf->lines);
+        free(cf->filename);
+
+        return mfree(cf);
+}
+
+const char *config_file_filename(ConfigFile *cf) {
+        assert(cf);
+
+        return cf->filename;
+}
+
+const struct stat *config_file_stat(ConfigFile *cf) {
+        assert(cf);
+
+        return &cf->st;
+}
 
+/* Split up a line in place */
+static int config_file_add_line(ConfigFile *cf, unsigned line, char *l) {
+        ConfigLine *c;
         char *e;
 
-        assert(filename);
+        assert(cf);
         assert(line > 0);
-        assert(lookup);
         assert(l);
 
         l = strstrip(l);
-        if (!*l)
+        if (!*l || strchr(COMMENTS "\n", *l))
                 return 0;
 
-        if (strchr(COMMENTS "\n", *l))
-                return 0;
+        if (!GREEDY_REALLOC(cf->lines, cf->n_allocated, cf->n_lines + 1))
+                return -ENOMEM;
+
+        c = cf->lines + cf->n_lines++;
+        *c = (ConfigLine) {
+                .line = line,
+                .key = l,
+        };
 
         if (startswith(l, ".include ")) {
+                c->type = CONFIG_LINE_INCLUDE;
+                c->key = strstrip(l+9);
+
+        } else if (*l == '[') {
+                size_t k;
+
+                k = strlen(l);
+                assert(k > 0);
+
+                if (l[k-1] != ']')
+                        c->type = CONFIG_LINE_BAD_SECTION;
+                else {
+                        l[k-1] = 0;
+                        c->type = CONFIG_LINE_SECTION;
+                        c->key = l+1;
+                }
+
+        } else {
+                e = strchr(l, '=');
+                if (!e)
+                        c->type = CONFIG_LINE_BAD_ASSIGNMENT;
+                else {
+                        *e = 0;
+                        c->type = CONFIG_LINE_ASSIGNMENT;
+                        c->key = strstrip(l);
+                        c->value = strstrip(e+1);
+                }
+        }
+
+        return 0;
+}
+
+/* Read the file, and split it up into sections and assignments. This does not log, and doesn't touch any state but
+ * the returned object, and hence may be called from any thread. Failures while reading are recorded in the object,
+ * and reported by config_file_parse(), after the lines read until then are processed, like config_parse() would
+ * do it.
+ *
+ * The file is read in one go, and split up in place, including continuation lines, so that there's no allocation
+ * per line. */
+int config_file_read(const char *filename, FILE *f, ConfigParseFlags flags, ConfigFile **ret) {
+        _cleanup_(config_file_freep) ConfigFile *cf = NULL;
+        char *i, *end, *continuation = NULL, *w = NULL;
+        unsigned line = 0;
+        size_t size;
+        int r;
+
+        assert(filename);
+        assert(f);
+        assert(ret);
+
+        cf = new0(ConfigFile, 1);
+        if (!cf)
+                return -ENOMEM;
+
+        cf->filename = strdup(filename);
+        if (!cf->filename)
+                return -ENOMEM;
+
+        if (fstat(fileno(f), &cf->st) < 0)
+                return -errno;
+
+        /* Only single lines are limited in length, not the file */
+        r = read_full_stream_limit(f, SIZE_MAX, &cf->contents, &size);
+        if (r < 0) {
+                cf->error = r;
+                goto finish;
+        }
+
+        /* Lines are terminated by a newline or NUL byte, like read_line() does it */
+        for (i = cf->contents, end = cf->contents + size; i < end; ) {
+                bool escaped = false;
+                char *l, *p, *e;
+                size_t n;
+
+                l = i;
+                n = strcspn(l, "\n");
+                if (n >= LONG_LINE_MAX) {
+                        cf->error = -ENOBUFS;
+                        break;
+                }
+
+                l[n] = 0;
+                i = l + n + 1;
+
+                if (!(flags & CONFIG_PARSE_REFUSE_BOM)) {
+                        char *q;
+
+                        q = startswith(l, UTF8_BYTE_ORDER_MARK);
+                        if (q) {
+                                n -= q - l;
+                                l = q;
+                                flags |= CONFIG_PARSE_REFUSE_BOM;
+                        }
+                }
+
+                if (continuation) {
+                        if ((size_t) (w - continuation) + n > LONG_LINE_MAX) {
+                                cf->error = -ENOBUFS;
+                                cf->error_continuation = true;
+                                break;
+                        }
+
+                        /* The continuation is always in front of this line, move this line right behind it */
+                        memmove(w, l, n + 1);
+                        w += n;
+
+                        p = continuation;
+                } else {
+                        p = l;
+                        w = l + n;
+                }
+
+                for (e = p; e < w; e++) {
+                        if (escaped)
+                                escaped = false;
+                        else if (*e == '\\')
+                                escaped = true;
+                }
+
+                if (escaped) {
+                        *(w-1) = ' ';
+                        continuation = p;
+                        continue;
+                }
+
+                r = config_file_add_line(cf, ++line, p);
+                if (r < 0) {
+                        cf->error = r;
+                        break;
+                }
+
+                continuation = NULL;
+        }
+
+finish:
+        cf->error_line = line;
+
+        *ret = cf;
+        cf = NULL;
+
+        return 0;
+}
+
+static int config_file_parse_line(
+                const char *unit,
+                ConfigFile *cf,
+                const ConfigLine *c,
+                const char *sections,
+                ConfigItemLookup lookup,
+                const void *table,
+                ConfigParseFlags flags,
+                const char **section,
+                unsigned *section_line,
+                bool *section_ignored,
+                void *userdata) {
+
+        assert(cf);
+        assert(c);
+
+        switch (c->type) {
+
+        case CONFIG_LINE_INCLUDE: {
                 _cleanup_free_ char *fn = NULL;
 
                 /* .includes are a bad idea, we only support them here
@@ -207,82 +427,124 @@ static int parse_line(
                  * Support for them should be eventually removed. */
 
                 if (!(flags & CONFIG_PARSE_ALLOW_INCLUDE)) {
-                        log_syntax(unit, LOG_ERR, filename, line, 0, ".include not allowed here. Ignoring.");
+                        log_syntax(unit, LOG_ERR, cf->filename, c->line, 0, ".include not allowed here. Ignoring.");
                         return 0;
                 }
 
-                fn = file_in_same_dir(filename, strstrip(l+9));
+                fn = file_in_same_dir(cf->filename, c->key);
                 if (!fn)
                         return -ENOMEM;
 
                 return config_parse(unit, fn, NULL, sections, lookup, table, flags, userdata);
         }
 
-        if (*l == '[') {
-                size_t k;
-                char *n;
+        case CONFIG_LINE_BAD_SECTION:
+                log_syntax(unit, LOG_ERR, cf->filename, c->line, 0, "Invalid section header '%s'", c->key);
+                return -EBADMSG;
 
-                k = strlen(l);
-                assert(k > 0);
-
-                if (l[k-1] != ']') {
-                        log_syntax(unit, LOG_ERR, filename, line, 0, "Invalid section header '%s'", l);
-                        return -EBADMSG;
-                }
-
-                n = strndup(l+1, k-2);
-                if (!n)
-                        return -ENOMEM;
+        case CONFIG_LINE_SECTION:
+                if (sections && !nulstr_contains(sections, c->key)) {
 
-                if (sections && !nulstr_contains(sections, n)) {
+                        if (!(flags & CONFIG_PARSE_RELAXED) && !startswith(c->key, "X-"))
+                                log_syntax(unit, LOG_WARNING, cf->filename, c->line, 0, "Unknown section '%s'. Ignoring.", c->key);
 
-                        if (!(flags & CONFIG_PARSE_RELAXED) && !startswith(n, "X-"))
-                                log_syntax(unit, LOG_WARNING, filename, line, 0, "Unknown section '%s'. Ignoring.", n);
-
-                        free(n);
-                        *section = mfree(*section);
+                        *section = NULL;
                         *section_line = 0;
                         *section_ignored = true;
                 } else {
-                        free(*section);
-                        *section = n;
-                        *section_line = line;
+                        *section = c->key;
+                        *section_line = c->line;
                         *section_ignored = false;
                 }
 
                 return 0;
+
+        default:
+                break;
         }
 
         if (sections && !*section) {
 
                 if (!(flags & CONFIG_PARSE_RELAXED) && !*section_ignored)
-                        log_syntax(unit, LOG_WARNING, filename, line, 0, "Assignment outside of section. Ignoring.");
+                        log_syntax(unit, LOG_WARNING, cf->filename, c->line, 0, "Assignment outside of section. Ignoring.");
 
                 return 0;
         }
 
-        e = strchr(l, '=');
-        if (!e) {
-                log_syntax(unit, LOG_WARNING, filename, line, 0, "Missing '='.");
+        if (c->type == CONFIG_LINE_BAD_ASSIGNMENT) {
+                log_syntax(unit, LOG_WARNING, cf->filename, c->line, 0, "Missing '='.");
                 return -EINVAL;
         }
 
-        *e = 0;
-        e++;
-
         return next_assignment(unit,
-                               filename,
-                               line,
+                               cf->filename,
+                               c->line,
                                lookup,
                                table,
                                *section,
                                *section_line,
-                               strstrip(l),
-                               strstrip(e),
+                               c->key,
+                               c->value,
                                flags,
                                userdata);
 }
 
+/* Go through the lines read by config_file_read(), and hand the assignments to the parsers */
+int config_file_parse(
+                const char *unit,
+                ConfigFile *cf,
+                const char *sections,
+                ConfigItemLookup lookup,
+                const void *table,
+                ConfigParseFlags flags,
+                void *userdata) {
+
+        const char *section = NULL;
+        unsigned section_line = 0;
+        bool section_ignored = false;
+        size_t i;
+        int r;
+
+        assert(cf);
+        assert(lookup);
+
+        (void) stat_warn_permissions(cf->filename, &cf->st);
+
+        for (i = 0; i < cf->n_lines; i++) {
+                r = config_file_parse_line(unit,
+                                           cf,
+                                           cf->lines + i,
+                                           sections,
+                                           lookup,
+                                           table,
+                                           flags,
+                                           &section,
+                                           &section_line,
+                                           &section_ignored,
+                                           userdata);
+                if (r < 0) {
+                        if (flags & CONFIG_PARSE_WARN)
+                                log_warning_errno(r, "%s:%u: Failed to parse file: %m", cf->filename, cf->lines[i].line);
+                        return r;
+                }
+        }
+
+        if (cf->error == 0)
+                return 0;
+
+        if (flags & CONFIG_PARSE_WARN) {
+                if (cf->error == -ENOMEM)
+                        log_oom();
+                else if (cf->error == -ENOBUFS)
+                        log_error_errno(cf->error, "%s:%u: %s", cf->filename, cf->error_line,
+                                        cf->error_continuation ? "Continuation line too long" : "Line too long");
+                else
+                        log_error_errno(cf->error, "%s:%u: Error while reading configuration file: %m", cf->filename, cf->error_line);
+        }
+
+        return cf->error;
+}
+
 /* Go through the file and parse each line */
 int config_parse(const char *unit,
                  const char *filename,
@@ -293,10 +555,8 @@ int config_parse(const char *unit,
                  ConfigParseFlags flags,
                  void *userdata) {
 
-        _cleanup_free_ char *section = NULL, *continuation = NULL;
+        _cleanup_(config_file_freep) ConfigFile *cf = NULL;
         _cleanup_fclose_ FILE *ours = NULL;
-        unsigned line = 0, section_line = 0;
-        bool section_ignored = false;
         int r;
 
         assert(filename);
@@ -314,102 +574,14 @@ int config_parse(const char *unit,
                 }
         }
 
-        fd_warn_permissions(filename, fileno(f));
-
-        for (;;) {
-                _cleanup_free_ char *buf = NULL;
-                bool escaped = false;
-                char *l, *p, *e;
-
-                r = read_line(f, LONG_LINE_MAX, &buf);
-                if (r == 0)
-                        break;
-                if (r == -ENOBUFS) {
-                        if (flags & CONFIG_PARSE_WARN)
-                                log_error_errno(r, "%s:%u: Line too long", filename, line);
-
-                        return r;
-                }
-                if (r < 0) {
-                        if (CONFIG_PARSE_WARN)
-                                log_error_errno(r, "%s:%u: Error while reading configuration file: %m", filename, line);
-
-                        return r;
-                }
-
-                l = buf;
-                if (!(flags & CONFIG_PARSE_REFUSE_BOM)) {
-                        char *q;
-
-                        q = startswith(buf, UTF8_BYTE_ORDER_MARK);
-                        if (q) {
-                                l = q;
-                                flags |= CONFIG_PARSE_REFUSE_BOM;
-                        }
-                }
-
-                if (continuation) {
-                        if (strlen(continuation) + strlen(l) > LONG_LINE_MAX) {
-                                if (flags & CONFIG_PARSE_WARN)
-                                        log_error("%s:%u: Continuation line too long", filename, line);
-                                return -ENOBUFS;
-                        }
-
-                        if (!strextend(&continuation, l, NULL)) {
-                                if (flags & CONFIG_PARSE_WARN)
-                                        log_oom();
-                                return -ENOMEM;
-                        }
-
-                        p = continuation;
-                } else
-                        p = l;
-
-                for (e = p; *e; e++) {
-                        if (escaped)
-                                escaped = false;
-                        else if (*e == '\\')
-                                escaped = true;
-                }
-
-                if (escaped) {
-                        *(e-1) = ' ';
-
-                        if (!continuation) {
-                                continuation = strdup(l);
-                                if (!continuation) {
-                                        if (flags & CONFIG_PARSE_WARN)
-                                                log_oom();
-                                        return -ENOMEM;
-                                }
-                        }
-
-                        continue;
-                }
-
-                r = parse_line(unit,
-                               filename,
-                               ++line,
-                               sections,
-                               lookup,
-                               table,
-                               flags,
-                               &section,
-                               &section_line,
-                               &section_ignored,
-                               p,
-                               userdata);
-                if (r < 0) {
-                        if (flags & CONFIG_PARSE_WARN)
-                                log_warning_errno(r, "%s:%u: Failed to parse file: %m", filename, line);
-                        return r;
-
-                }
-
-                continuation = mfree(continuation);
+        r = config_file_read(filename, f, flags, &cf);
+        if (r < 0) {
+                if (flags & CONFIG_PARSE_WARN)
+                        log_error_errno(r, "Failed to read configuration file '%s': %m", filename);
+                return r;
         }
 
-        return 0;
+        return config_file_parse(unit, cf, sections, lookup, table, flags, userdata);
 }
 
 static int config_parse_many_files(
@@ -24,6 +24,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <sys/stat.h>
 #include <syslog.h>
 
 #include "alloc-util.h"
@@ -101,6 +102,25 @@ int config_parse(
                 ConfigParseFlags flags,
                 void *userdata);
 
+/* config_parse() split up in two steps: reading the file into memory, which may happen in any thread, and then
+ * handing its contents to the parsers */
+typedef struct ConfigFile ConfigFile;
+
+int config_file_read(const char *filename, FILE *f, ConfigParseFlags flags, ConfigFile **ret);
+int config_file_parse(
+                const char *unit,
+                ConfigFile *cf,
+                const char *sections,  /* nulstr */
+                ConfigItemLookup lookup,
+                const void *table,
+                ConfigParseFlags flags,
+                void *userdata);
+ConfigFile *config_file_free(ConfigFile *cf);
+const char *config_file_filename(ConfigFile *cf);
+const struct stat *config_file_stat(ConfigFile *cf);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(ConfigFile*, config_file_free);
+
 int config_parse_many_nulstr(
                 const char *conf_file,      /* possibly NULL */
                 const char *conf_file_dirs, /* nulstr */
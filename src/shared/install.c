@@ -1431,6 +1431,10 @@ static int unit_file_search(
                 if (!path)
                         return -ENOMEM;
 
+                /* Don't bother probing names the index knows are not there */
+                if (unit_file_index_lookup(paths->index, path, NULL) == -ENOENT)
+                        continue;
+
                 r = unit_file_load_or_readlink(c, info, path, paths->root_dir, flags);
 
                 if (r >= 0) {
@@ -1456,6 +1460,9 @@ static int unit_file_search(
                         if (!path)
                                 return -ENOMEM;
 
+                        if (unit_file_index_lookup(paths->index, path, NULL) == -ENOENT)
+                                continue;
+
                         r = unit_file_load_or_readlink(c, info, path, paths->root_dir, flags);
                         if (r >= 0) {
                                 info->path = path;
@@ -1483,6 +1490,11 @@ static int unit_file_search(
                 if (!path)
                         return -ENOMEM;
 
+                if (unit_file_index_lookup(paths->index, path, NULL) == -ENOENT) {
+                        free(path);
+                        continue;
+                }
+
                 r = strv_consume(&dirs, path);
                 if (r < 0)
                         return r;
@@ -1497,6 +1509,11 @@ static int unit_file_search(
                         if (!path)
                                 return -ENOMEM;
 
+                        if (unit_file_index_lookup(paths->index, path, NULL) == -ENOENT) {
+                                free(path);
+                                continue;
+                        }
+
                         r = strv_consume(&dirs, path);
                         if (r < 0)
                                 return r;
@@ -2760,6 +2777,12 @@ int unit_file_get_state(
         if (r < 0)
                 return r;
 
+        /* This is a read-only operation, hence we may use the index to avoid probing for names in all
+         * directories. If it is not available, we just go to disk. */
+        r = lookup_paths_load_index(&paths);
+        if (r < 0)
+                log_debug_errno(r, "Failed to load unit file index, ignoring: %m");
+
         return unit_file_lookup_state(scope, &paths, name, ret);
 }
 
@@ -3170,6 +3193,10 @@ int unit_file_get_list(
         if (r < 0)
                 return r;
 
+        r = lookup_paths_load_index(&paths);
+        if (r < 0)
+                log_debug_errno(r, "Failed to load unit file index, ignoring: %m");
+
         STRV_FOREACH(i, paths.search_path) {
                 _cleanup_closedir_ DIR *d = NULL;
                 struct dirent *de;
@@ -319,6 +319,32 @@ static int acquire_transient_dir(
         return 0;
 }
 
+static int acquire_index_file(
+                UnitFileScope scope,
+                const char *tempdir,
+                char **ret) {
+
+        char *index_file;
+
+        assert(ret);
+        assert(IN_SET(scope, UNIT_FILE_SYSTEM, UNIT_FILE_USER, UNIT_FILE_GLOBAL));
+
+        if (scope == UNIT_FILE_GLOBAL)
+                return -EOPNOTSUPP;
+
+        if (tempdir)
+                index_file = strjoin(tempdir, "/unit-index");
+        else if (scope == UNIT_FILE_SYSTEM)
+                index_file = strdup("/run/systemd/unit-index");
+        else
+                return user_runtime_dir(ret, "/systemd/unit-index");
+
+        if (!index_file)
+                return -ENOMEM;
+        *ret = index_file;
+        return 0;
+}
+
 static int acquire_config_dirs(UnitFileScope scope, char **persistent, char **runtime) {
         _cleanup_free_ char *a = NULL, *b = NULL;
         int r;
@@ -474,7 +500,8 @@ int lookup_paths_init(
                 *persistent_config = NULL, *runtime_config = NULL,
                 *generator = NULL, *generator_early = NULL, *generator_late = NULL,
                 *transient = NULL,
-                *persistent_control = NULL, *runtime_control = NULL;
+                *persistent_control = NULL, *runtime_control = NULL,
+                *index_file = NULL;
         bool append = false; /* Add items from SYSTEMD_UNIT_PATH before normal directories */
         _cleanup_strv_free_ char **paths = NULL;
         const char *e;
@@ -528,6 +555,14 @@ int lookup_paths_init(
         if (r < 0 && r != -EOPNOTSUPP)
                 return r;
 
+        /* The index is about the host's directories, hence don't bother when operating on a different root */
+        if (!root) {
+                /* Note: if XDG_RUNTIME_DIR is not set, this will fail completely with ENXIO */
+                r = acquire_index_file(scope, tempdir, &index_file);
+                if (r < 0 && !IN_SET(r, -EOPNOTSUPP, -ENXIO))
+                        return r;
+        }
+
         /* First priority is whatever has been passed to us via env vars */
         e = getenv("SYSTEMD_UNIT_PATH");
         if (e) {
@@ -685,6 +720,9 @@ int lookup_paths_init(
         p->runtime_control = runtime_control;
         persistent_control = runtime_control = NULL;
 
+        p->index_file = index_file;
+        index_file = NULL;
+
         p->root_dir = root;
         root = NULL;
 
@@ -712,6 +750,9 @@ void lookup_paths_free(LookupPaths *p) {
         p->persistent_control = mfree(p->persistent_control);
         p->runtime_control = mfree(p->runtime_control);
 
+        p->index_file = mfree(p->index_file);
+        p->index = unit_file_index_free(p->index);
+
         p->root_dir = mfree(p->root_dir);
         p->temporary_dir = mfree(p->temporary_dir);
 }
@@ -789,6 +830,27 @@ int lookup_paths_reduce(LookupPaths *p) {
         return 0;
 }
 
+int lookup_paths_load_index(LookupPaths *p) {
+        UnitFileIndex *i;
+        int r;
+
+        assert(p);
+
+        /* (Re-)acquires the index of the search path directories, reading only those directories again that
+         * changed since the index was last updated */
+
+        r = unit_file_index_acquire(p->search_path, p->index_file, &i);
+        if (r < 0)
+                return r;
+
+        log_debug("Loaded unit file index, %i directories changed.", r);
+
+        unit_file_index_free(p->index);
+        p->index = i;
+
+        return 0;
+}
+
 int lookup_paths_mkdir_generator(LookupPaths *p) {
         int r, q;
 
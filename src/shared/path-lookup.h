@@ -26,6 +26,7 @@ typedef struct LookupPaths LookupPaths;
 
 #include "install.h"
 #include "macro.h"
+#include "unit-file-index.h"
 
 typedef enum LookupPathsFlags {
         LOOKUP_PATHS_EXCLUDE_GENERATED = 1,
@@ -60,6 +61,13 @@ struct LookupPaths {
         char *persistent_control;
         char *runtime_control;
 
+        /* Where the index of the search path directories is kept, shared between the service manager and its
+         * clients. NULL if the index shall not be persisted. */
+        char *index_file;
+
+        /* The index itself, if loaded with lookup_paths_load_index(), or NULL */
+        UnitFileIndex *index;
+
         /* The root directory prepended to all items above, or NULL */
         char *root_dir;
 
@@ -72,6 +80,7 @@ bool path_is_user_data_dir(const char *path);
 bool path_is_user_config_dir(const char *path);
 
 int lookup_paths_reduce(LookupPaths *p);
+int lookup_paths_load_index(LookupPaths *p);
 
 int lookup_paths_mkdir_generator(LookupPaths *p);
 void lookup_paths_trim_generator(LookupPaths *p);
@@ -19,20 +19,27 @@
 ***/
 
 #include <errno.h>
+#include <linux/filter.h>
 #include <linux/seccomp.h>
 #include <seccomp.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <sys/mman.h>
 #include <sys/prctl.h>
 #include <sys/shm.h>
 
 #include "af-list.h"
 #include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "hashmap.h"
 #include "macro.h"
+#include "memfd-util.h"
 #include "nsflags.h"
 #include "process-util.h"
 #include "seccomp-util.h"
 #include "set.h"
+#include "stdio-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "util.h"
@@ -248,6 +255,195 @@ finish:
         return r;
 }
 
+/* Compiled filters, keyed by what they filter and the architecture. Compiling a filter with libseccomp is much more
+ * expensive than installing it. The service manager hence compiles the filters of a service before it forks off its
+ * processes, in "compile only" mode, so that the processes find them here and only need to install them. As the key
+ * describes the filter completely, entries never need to be invalidated, we just need to make sure the cache doesn't
+ * grow without bounds. */
+#define FILTER_CACHE_MAX 256U
+
+static Hashmap *filter_cache = NULL;
+static bool compile_only = false;
+
+void seccomp_set_compile_only(bool b) {
+        compile_only = b;
+}
+
+void seccomp_flush_filter_cache(void) {
+        filter_cache = hashmap_free_free_free(filter_cache);
+}
+
+static int seccomp_load_cached(const char *key, uint32_t arch) {
+        _cleanup_free_ char *k = NULL;
+        struct sock_fprog *p;
+
+        /* Returns > 0 if the filter is cached, after installing it unless we only compile, and 0 if it needs to be
+         * built. Returns < 0 only if we may not install filters at all. */
+
+        if (!key || hashmap_isempty(filter_cache))
+                return 0;
+
+        if (asprintf(&k, "%s/%" PRIu32, key, arch) < 0)
+                return 0;
+
+        p = hashmap_get(filter_cache, k);
+        if (!p)
+                return 0;
+
+        if (compile_only)
+                return 1;
+
+        if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, p, 0, 0) < 0) {
+                if (IN_SET(errno, EPERM, EACCES))
+                        return -errno;
+
+                log_debug_errno(errno, "Failed to install cached filter %s for architecture %s, skipping: %m", key, seccomp_arch_to_string(arch));
+        }
+
+        return 1;
+}
+
+static int filter_cache_put(scmp_filter_ctx seccomp, const char *key, uint32_t arch) {
+        _cleanup_free_ struct sock_fprog *p = NULL;
+        _cleanup_close_ int fd = -1;
+        _cleanup_free_ char *k = NULL;
+        uint64_t size;
+        ssize_t n;
+        int r;
+
+        fd = memfd_new("seccomp");
+        if (fd < 0)
+                return fd;
+
+        r = seccomp_export_bpf(seccomp, fd);
+        if (r < 0)
+                return r;
+
+        r = memfd_get_size(fd, &size);
+        if (r < 0)
+                return r;
+
+        if (size == 0 ||
+            size % sizeof(struct sock_filter) != 0 ||
+            size / sizeof(struct sock_filter) > BPF_MAXINSNS)
+                return -EBADMSG;
+
+        /* The program and its instructions in one allocation */
+        p = malloc(sizeof(struct sock_fprog) + size);
+        if (!p)
+                return -ENOMEM;
+
+        p->len = size / sizeof(struct sock_filter);
+        p->filter = (struct sock_filter*) (p + 1);
+
+        n = pread(fd, p->filter, size, 0);
+        if (n < 0)
+                return -errno;
+        if ((uint64_t) n != size)
+                return -EIO;
+
+        if (asprintf(&k, "%s/%" PRIu32, key, arch) < 0)
+                return -ENOMEM;
+
+        if (hashmap_size(filter_cache) >= FILTER_CACHE_MAX)
+                seccomp_flush_filter_cache();
+
+        r = hashmap_ensure_allocated(&filter_cache, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(filter_cache, k, p);
+        if (r < 0)
+                return r;
+
+        k = NULL;
+        p = NULL;
+
+        return 0;
+}
+
+static int seccomp_load_and_cache(scmp_filter_ctx seccomp, const char *key, uint32_t arch) {
+        int r;
+
+        if (!compile_only)
+                return seccomp_load(seccomp);
+
+        if (!key)
+                return 0;
+
+        r = filter_cache_put(seccomp, key, arch);
+        if (r < 0)
+                log_debug_errno(r, "Failed to cache filter %s for architecture %s, ignoring: %m", key, seccomp_arch_to_string(arch));
+
+        return 0;
+}
+
+static int uint64_compare(const void *a, const void *b) {
+        const uint64_t *x = a, *y = b;
+
+        return *x < *y ? -1 : *x > *y ? 1 : 0;
+}
+
+static char *filter_key_build(const char *prefix, uint64_t *values, size_t n) {
+        _cleanup_fclose_ FILE *f = NULL;
+        char *key = NULL;
+        size_t size = 0, i;
+        int r;
+
+        /* Hash tables have no stable order, hence sort the values first, to get the same key for the same filter */
+        qsort_safe(values, n, sizeof(uint64_t), uint64_compare);
+
+        f = open_memstream(&key, &size);
+        if (!f)
+                return NULL;
+
+        fputs(prefix, f);
+        for (i = 0; i < n; i++)
+                fprintf(f, ":%" PRIx64, values[i]);
+
+        r = fflush_and_check(f);
+        f = safe_fclose(f);
+        if (r < 0)
+                return mfree(key);
+
+        return key;
+}
+
+static char *filter_key_raw(uint32_t default_action, Hashmap *set, uint32_t action) {
+        _cleanup_free_ uint64_t *values = NULL;
+        char prefix[sizeof("raw::") + 2 * DECIMAL_STR_MAX(uint32_t)];
+        void *id, *val;
+        Iterator i;
+        size_t n = 0;
+
+        values = new(uint64_t, hashmap_size(set) + 1);
+        if (!values)
+                return NULL;
+
+        HASHMAP_FOREACH_KEY(val, id, set, i)
+                values[n++] = (uint64_t) PTR_TO_INT(id) << 32 | (uint32_t) PTR_TO_INT(val);
+
+        xsprintf(prefix, "raw:%" PRIx32 ":%" PRIx32, default_action, action);
+
+        return filter_key_build(prefix, values, n);
+}
+
+static char *filter_key_address_families(Set *address_families, bool whitelist) {
+        _cleanup_free_ uint64_t *values = NULL;
+        Iterator i;
+        size_t n = 0;
+        void *af;
+
+        values = new(uint64_t, set_size(address_families) + 1);
+        if (!values)
+                return NULL;
+
+        SET_FOREACH(af, address_families, i)
+                values[n++] = (uint64_t) PTR_TO_INT(af);
+
+        return filter_key_build(whitelist ? "af-whitelist" : "af-blacklist", values, n);
+}
+
 static bool is_basic_seccomp_available(void) {
         return prctl(PR_GET_SECCOMP, 0, 0, 0, 0) >= 0;
 }
@@ -869,6 +1065,7 @@ static int seccomp_add_syscall_filter_set(
 }
 
 int seccomp_load_syscall_filter_set(uint32_t default_action, const SyscallFilterSet *set, uint32_t action) {
+        _cleanup_free_ char *key = NULL;
         uint32_t arch;
         int r;
 
@@ -877,11 +1074,20 @@ int seccomp_load_syscall_filter_set(uint32_t default_action, const SyscallFilter
         /* The one-stop solution: allocate a seccomp object, add the specified filter to it, and apply it. Once for
          * earch local arch. */
 
+        if (asprintf(&key, "set:%s:%" PRIx32 ":%" PRIx32, set->name, default_action, action) < 0)
+                key = NULL;
+
         SECCOMP_FOREACH_LOCAL_ARCH(arch) {
                 _cleanup_(seccomp_releasep) scmp_filter_ctx seccomp = NULL;
 
                 log_debug("Operating on architecture: %s", seccomp_arch_to_string(arch));
 
+                r = seccomp_load_cached(key, arch);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        continue;
+
                 r = seccomp_init_for_arch(&seccomp, arch, default_action);
                 if (r < 0)
                         return r;
@@ -892,7 +1098,7 @@ int seccomp_load_syscall_filter_set(uint32_t default_action, const SyscallFilter
                         continue;
                 }
 
-                r = seccomp_load(seccomp);
+                r = seccomp_load_and_cache(seccomp, key, arch);
                 if (IN_SET(r, -EPERM, -EACCES))
                         return r;
                 if (r < 0)
@@ -903,6 +1109,7 @@ int seccomp_load_syscall_filter_set(uint32_t default_action, const SyscallFilter
 }
 
 int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, uint32_t action) {
+        _cleanup_free_ char *key = NULL;
         uint32_t arch;
         int r;
 
@@ -912,6 +1119,8 @@ int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, u
         if (hashmap_isempty(set) && default_action == SCMP_ACT_ALLOW)
                 return 0;
 
+        key = filter_key_raw(default_action, set, action);
+
         SECCOMP_FOREACH_LOCAL_ARCH(arch) {
                 _cleanup_(seccomp_releasep) scmp_filter_ctx seccomp = NULL;
                 Iterator i;
@@ -919,6 +1128,12 @@ int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, u
 
                 log_debug("Operating on architecture: %s", seccomp_arch_to_string(arch));
 
+                r = seccomp_load_cached(key, arch);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        continue;
+
                 r = seccomp_init_for_arch(&seccomp, arch, default_action);
                 if (r < 0)
                         return r;
@@ -940,7 +1155,7 @@ int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, u
                         }
                 }
 
-                r = seccomp_load(seccomp);
+                r = seccomp_load_and_cache(seccomp, key, arch);
                 if (IN_SET(r, -EPERM, -EACCES))
                         return r;
                 if (r < 0)
@@ -951,6 +1166,7 @@ int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, u
 }
 
 int seccomp_restrict_namespaces(unsigned long retain) {
+        char key[sizeof("namespaces:") + DECIMAL_STR_MAX(unsigned long)];
         uint32_t arch;
         int r;
 
@@ -965,12 +1181,20 @@ int seccomp_restrict_namespaces(unsigned long retain) {
         if ((retain & NAMESPACE_FLAGS_ALL) == NAMESPACE_FLAGS_ALL)
                 return 0;
 
+        xsprintf(key, "namespaces:%lu", retain);
+
         SECCOMP_FOREACH_LOCAL_ARCH(arch) {
                 _cleanup_(seccomp_releasep) scmp_filter_ctx seccomp = NULL;
                 unsigned i;
 
                 log_debug("Operating on architecture: %s", seccomp_arch_to_string(arch));
 
+                r = seccomp_load_cached(key, arch);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        continue;
+
                 r = seccomp_init_for_arch(&seccomp, arch, SCMP_ACT_ALLOW);
                 if (r < 0)
                         return r;
@@ -1055,7 +1279,7 @@ int seccomp_restrict_namespaces(unsigned long retain) {
                 if (r < 0)
                         continue;
 
-                r = seccomp_load(seccomp);
+                r = seccomp_load_and_cache(seccomp, key, arch);
                 if (IN_SET(r, -EPERM, -EACCES))
                         return r;
                 if (r < 0)
@@ -1078,6 +1302,12 @@ int seccomp_protect_sysctl(void) {
                         /* No _sysctl syscall */
                         continue;
 
+                r = seccomp_load_cached("sysctl", arch);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        continue;
+
                 r = seccomp_init_for_arch(&seccomp, arch, SCMP_ACT_ALLOW);
                 if (r < 0)
                         return r;
@@ -1092,7 +1322,7 @@ int seccomp_protect_sysctl(void) {
                         continue;
                 }
 
-                r = seccomp_load(seccomp);
+                r = seccomp_load_and_cache(seccomp, "sysctl", arch);
                 if (IN_SET(r, -EPERM, -EACCES))
                         return r;
                 if (r < 0)
@@ -1103,9 +1333,12 @@ int seccomp_protect_sysctl(void) {
 }
 
 int seccomp_restrict_address_families(Set *address_families, bool whitelist) {
+        _cleanup_free_ char *key = NULL;
         uint32_t arch;
         int r;
 
+        key = filter_key_address_families(address_families, whitelist);
+
         SECCOMP_FOREACH_LOCAL_ARCH(arch) {
                 _cleanup_(seccomp_releasep) scmp_filter_ctx seccomp = NULL;
                 bool supported;
@@ -1139,6 +1372,12 @@ int seccomp_restrict_address_families(Set *address_families, bool whitelist) {
                 if (!supported)
                         continue;
 
+                r = seccomp_load_cached(key, arch);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        continue;
+
                 r = seccomp_init_for_arch(&seccomp, arch, SCMP_ACT_ALLOW);
                 if (r < 0)
                         return r;
@@ -1250,7 +1489,7 @@ int seccomp_restrict_address_families(Set *address_families, bool whitelist) {
                         }
                 }
 
-                r = seccomp_load(seccomp);
+                r = seccomp_load_and_cache(seccomp, key, arch);
                 if (IN_SET(r, -EPERM, -EACCES))
                         return r;
                 if (r < 0)
@@ -1282,6 +1521,12 @@ int seccomp_restrict_realtime(void) {
 
                 log_debug("Operating on architecture: %s", seccomp_arch_to_string(arch));
 
+                r = seccomp_load_cached("realtime", arch);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        continue;
+
                 r = seccomp_init_for_arch(&seccomp, arch, SCMP_ACT_ALLOW);
                 if (r < 0)
                         return r;
@@ -1327,7 +1572,7 @@ int seccomp_restrict_realtime(void) {
                         continue;
                 }
 
-                r = seccomp_load(seccomp);
+                r = seccomp_load_and_cache(seccomp, "realtime", arch);
                 if (IN_SET(r, -EPERM, -EACCES))
                         return r;
                 if (r < 0)
@@ -1419,6 +1664,12 @@ int seccomp_memory_deny_write_execute(void) {
                 if (filter_syscall == 0)
                         continue;
 
+                r = seccomp_load_cached("memory-deny-write-execute", arch);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        continue;
+
                 r = seccomp_init_for_arch(&seccomp, arch, SCMP_ACT_ALLOW);
                 if (r < 0)
                         return r;
@@ -1457,7 +1708,7 @@ int seccomp_memory_deny_write_execute(void) {
                                 continue;
                 }
 
-                r = seccomp_load(seccomp);
+                r = seccomp_load_and_cache(seccomp, "memory-deny-write-execute", arch);
                 if (IN_SET(r, -EPERM, -EACCES))
                         return r;
                 if (r < 0)
@@ -1476,6 +1727,10 @@ int seccomp_restrict_archs(Set *archs) {
         /* This installs a filter with no rules, but that restricts the system call architectures to the specified
          * list. */
 
+        /* Cheap to build, hence not cached */
+        if (compile_only)
+                return 0;
+
         seccomp = seccomp_init(SCMP_ACT_ALLOW);
         if (!seccomp)
                 return -ENOMEM;
@@ -1571,15 +1826,24 @@ int seccomp_filter_set_add(Hashmap *filter, bool add, const SyscallFilterSet *se
 }
 
 int seccomp_lock_personality(unsigned long personality) {
+        char key[sizeof("personality:") + DECIMAL_STR_MAX(unsigned long)];
         uint32_t arch;
         int r;
 
         if (personality >= PERSONALITY_INVALID)
                 return -EINVAL;
 
+        xsprintf(key, "personality:%lu", personality);
+
         SECCOMP_FOREACH_LOCAL_ARCH(arch) {
                 _cleanup_(seccomp_releasep) scmp_filter_ctx seccomp = NULL;
 
+                r = seccomp_load_cached(key, arch);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        continue;
+
                 r = seccomp_init_for_arch(&seccomp, arch, SCMP_ACT_ALLOW);
                 if (r < 0)
                         return r;
@@ -1595,7 +1859,7 @@ int seccomp_lock_personality(unsigned long personality) {
                         continue;
                 }
 
-                r = seccomp_load(seccomp);
+                r = seccomp_load_and_cache(seccomp, key, arch);
                 if (IN_SET(r, -EPERM, -EACCES))
                         return r;
                 if (r < 0)
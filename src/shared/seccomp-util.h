@@ -89,6 +89,11 @@ int seccomp_restrict_realtime(void);
 int seccomp_memory_deny_write_execute(void);
 int seccomp_lock_personality(unsigned long personality);
 
+/* In "compile only" mode the functions above build their filters and cache them, but don't install them. Called
+ * again later (e.g. after fork()) they install the cached filters. */
+void seccomp_set_compile_only(bool b);
+void seccomp_flush_filter_cache(void);
+
 extern const uint32_t seccomp_local_archs[];
 
 #define SECCOMP_FOREACH_LOCAL_ARCH(arch) \
@@ -0,0 +1,582 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "def.h"
+#include "dirent-util.h"
+#include "escape.h"
+#include "extract-word.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "hashmap.h"
+#include "log.h"
+#include "mkdir.h"
+#include "parse-util.h"
+#include "path-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "time-util.h"
+#include "unit-file-index.h"
+
+#define UNIT_FILE_INDEX_VERSION 1
+
+/* A directory listing is only trusted if the directory's mtime is older than the listing by at least this much.
+ * Otherwise, the directory might have been changed again within the granularity of the file system timestamps
+ * right after it was read, without the mtime changing. Such directories are simply read again next time. */
+#define RACY_USEC USEC_PER_SEC
+
+typedef enum IndexDirState {
+        INDEX_DIR_UNKNOWN,  /* Not listed (yet), or the directory could not be read */
+        INDEX_DIR_MISSING,  /* The directory does not exist */
+        INDEX_DIR_LISTED,
+} IndexDirState;
+
+typedef struct IndexDir {
+        char *path;
+        IndexDirState state;
+
+        /* Whether the listing was taken from the index file, rather than read from the directory */
+        bool from_file;
+
+        dev_t dev;
+        ino_t ino;
+        nsec_t mtime;
+        usec_t listed;
+
+        /* Maps the names of the directory entries to their symlink targets, or NULL for anything else */
+        Hashmap *entries;
+} IndexDir;
+
+struct UnitFileIndex {
+        IndexDir *dirs;
+        size_t n_dirs;
+};
+
+static void index_dir_reset(IndexDir *d) {
+        assert(d);
+
+        d->entries = hashmap_free_free_free(d->entries);
+        d->state = INDEX_DIR_UNKNOWN;
+        d->from_file = false;
+}
+
+UnitFileIndex *unit_file_index_free(UnitFileIndex *i) {
+        size_t k;
+
+        if (!i)
+                return NULL;
+
+        for (k = 0; k < i->n_dirs; k++) {
+                index_dir_reset(i->dirs + k);
+                free(i->dirs[k].path);
+        }
+
+        free(i->dirs);
+        return mfree(i);
+}
+
+static IndexDir *index_find_dir(UnitFileIndex *i, const char *path) {
+        size_t k;
+
+        assert(i);
+        assert(path);
+
+        for (k = 0; k < i->n_dirs; k++)
+                if (path_equal(i->dirs[k].path, path))
+                        return i->dirs + k;
+
+        return NULL;
+}
+
+static bool index_dir_is_current(IndexDir *d, const struct stat *st) {
+        assert(d);
+        assert(st);
+
+        return d->state == INDEX_DIR_LISTED &&
+                S_ISDIR(st->st_mode) &&
+                st->st_dev == d->dev &&
+                st->st_ino == d->ino &&
+                timespec_load_nsec(&st->st_mtim) == d->mtime &&
+                d->mtime / NSEC_PER_USEC + RACY_USEC < d->listed;
+}
+
+static int index_dir_list(IndexDir *d) {
+        _cleanup_hashmap_free_free_free_ Hashmap *entries = NULL;
+        _cleanup_closedir_ DIR *dir = NULL;
+        struct dirent *de;
+        struct stat st;
+        usec_t listed;
+        int r;
+
+        assert(d);
+
+        index_dir_reset(d);
+
+        /* Take the timestamp first, so that any change made while we read the directory ends up with an mtime
+         * that is either newer, or too close to the timestamp to be trusted */
+        listed = now(CLOCK_REALTIME);
+
+        dir = opendir(d->path);
+        if (!dir) {
+                if (IN_SET(errno, ENOENT, ENOTDIR)) {
+                        d->state = INDEX_DIR_MISSING;
+                        return 0;
+                }
+
+                return -errno;
+        }
+
+        if (fstat(dirfd(dir), &st) < 0)
+                return -errno;
+
+        entries = hashmap_new(&string_hash_ops);
+        if (!entries)
+                return -ENOMEM;
+
+        FOREACH_DIRENT(de, dir, return -errno) {
+                _cleanup_free_ char *name = NULL, *target = NULL;
+
+                name = strdup(de->d_name);
+                if (!name)
+                        return -ENOMEM;
+
+                (void) dirent_ensure_type(dir, de);
+
+                if (de->d_type == DT_LNK) {
+                        r = readlinkat_malloc(dirfd(dir), de->d_name, &target);
+                        if (r == -ENOENT)
+                                continue;
+                        if (r < 0)
+                                return r;
+                }
+
+                r = hashmap_put(entries, name, target);
+                if (r < 0)
+                        return r;
+
+                name = target = NULL;
+        }
+
+        d->entries = entries;
+        entries = NULL;
+
+        d->state = INDEX_DIR_LISTED;
+        d->dev = st.st_dev;
+        d->ino = st.st_ino;
+        d->mtime = timespec_load_nsec(&st.st_mtim);
+        d->listed = listed;
+
+        return 1;
+}
+
+static int index_parse_dir(UnitFileIndex *i, const char *p, IndexDir **ret) {
+        _cleanup_free_ char *path = NULL, *dev = NULL, *ino = NULL, *mtime = NULL, *listed = NULL;
+        uint64_t dev_val, ino_val;
+        IndexDir *d;
+        int r;
+
+        assert(i);
+        assert(p);
+        assert(ret);
+
+        r = extract_many_words(&p, NULL, EXTRACT_CUNESCAPE, &path, &dev, &ino, &mtime, &listed, NULL);
+        if (r < 0)
+                return r;
+        if (r < 5)
+                return -EBADMSG;
+
+        /* Skip directories that are not in our search path, or that are listed twice */
+        d = index_find_dir(i, path);
+        if (!d || d->state != INDEX_DIR_UNKNOWN) {
+                *ret = NULL;
+                return 0;
+        }
+
+        r = safe_atou64(dev, &dev_val);
+        if (r < 0)
+                return r;
+        r = safe_atou64(ino, &ino_val);
+        if (r < 0)
+                return r;
+        r = safe_atou64(mtime, &d->mtime);
+        if (r < 0)
+                return r;
+        r = safe_atou64(listed, &d->listed);
+        if (r < 0)
+                return r;
+
+        d->entries = hashmap_new(&string_hash_ops);
+        if (!d->entries)
+                return -ENOMEM;
+
+        d->dev = (dev_t) dev_val;
+        d->ino = (ino_t) ino_val;
+        d->state = INDEX_DIR_LISTED;
+        d->from_file = true;
+
+        *ret = d;
+        return 0;
+}
+
+static int index_parse_entry(IndexDir *d, const char *p, bool link) {
+        _cleanup_free_ char *name = NULL, *target = NULL;
+        int r;
+
+        assert(p);
+
+        r = extract_many_words(&p, NULL, EXTRACT_CUNESCAPE, &name, &target, NULL);
+        if (r < 0)
+                return r;
+        if (r != (link ? 2 : 1))
+                return -EBADMSG;
+
+        /* Entry of a directory we skip */
+        if (!d)
+                return 0;
+
+        r = hashmap_put(d->entries, name, target);
+        if (r < 0)
+                return r;
+
+        name = target = NULL;
+        return 0;
+}
+
+static int index_read(UnitFileIndex *i, const char *index_file) {
+        _cleanup_fclose_ FILE *f = NULL;
+        IndexDir *d = NULL;
+        bool got_version = false;
+        int r;
+
+        assert(i);
+        assert(index_file);
+
+        f = fopen(index_file, "re");
+        if (!f)
+                return errno == ENOENT ? 0 : -errno;
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL;
+                const char *p;
+
+                r = read_line(f, LONG_LINE_MAX, &line);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                if (isempty(line) || line[0] == '#')
+                        continue;
+
+                if (!got_version) {
+                        if (!streq(line, "VERSION=" STRINGIFY(UNIT_FILE_INDEX_VERSION)))
+                                return -EPROTONOSUPPORT;
+
+                        got_version = true;
+                        continue;
+                }
+
+                p = startswith(line, "DIR=");
+                if (p) {
+                        r = index_parse_dir(i, p, &d);
+                        if (r < 0)
+                                return r;
+                        continue;
+                }
+
+                p = startswith(line, "FILE=");
+                if (p) {
+                        r = index_parse_entry(d, p, false);
+                        if (r < 0)
+                                return r;
+                        continue;
+                }
+
+                p = startswith(line, "LINK=");
+                if (p) {
+                        r = index_parse_entry(d, p, true);
+                        if (r < 0)
+                                return r;
+                        continue;
+                }
+
+                return -EBADMSG;
+        }
+
+        return 0;
+}
+
+static int index_write(UnitFileIndex *i, const char *index_file) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *temp_path = NULL;
+        size_t k;
+        int r;
+
+        assert(i);
+        assert(index_file);
+
+        r = mkdir_parents(index_file, 0755);
+        if (r < 0)
+                return r;
+
+        r = fopen_temporary(index_file, &f, &temp_path);
+        if (r < 0)
+                return r;
+
+        /* The index is shared with unprivileged clients */
+        (void) fchmod(fileno(f), 0644);
+
+        fputs("# This is private data. Do not parse.\n"
+              "VERSION=" STRINGIFY(UNIT_FILE_INDEX_VERSION) "\n", f);
+
+        for (k = 0; k < i->n_dirs; k++) {
+                _cleanup_free_ char *path = NULL;
+                IndexDir *d = i->dirs + k;
+                Iterator it;
+                const char *name;
+                char *target;
+
+                if (d->state != INDEX_DIR_LISTED)
+                        continue;
+
+                path = xescape(d->path, WHITESPACE);
+                if (!path) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                fprintf(f, "DIR=%s %" PRIu64 " %" PRIu64 " " NSEC_FMT " " USEC_FMT "\n",
+                        path, (uint64_t) d->dev, (uint64_t) d->ino, d->mtime, d->listed);
+
+                HASHMAP_FOREACH_KEY(target, name, d->entries, it) {
+                        _cleanup_free_ char *n = NULL, *t = NULL;
+
+                        n = xescape(name, WHITESPACE);
+                        if (!n) {
+                                r = -ENOMEM;
+                                goto fail;
+                        }
+
+                        if (!target) {
+                                fprintf(f, "FILE=%s\n", n);
+                                continue;
+                        }
+
+                        t = xescape(target, WHITESPACE);
+                        if (!t) {
+                                r = -ENOMEM;
+                                goto fail;
+                        }
+
+                        fprintf(f, "LINK=%s %s\n", n, t);
+                }
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(temp_path, index_file) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        return 0;
+
+fail:
+        (void) unlink(temp_path);
+        return r;
+}
+
+static int index_refresh(UnitFileIndex *i) {
+        size_t k;
+        int r, n = 0;
+
+        assert(i);
+
+        /* Lists all directories that are not in the index yet or changed since, and returns how many of them
+         * differ from what the index file had */
+
+        for (k = 0; k < i->n_dirs; k++) {
+                IndexDir *d = i->dirs + k;
+                bool from_file = d->from_file;
+                struct stat st;
+
+                if (d->state == INDEX_DIR_LISTED &&
+                    stat(d->path, &st) >= 0 &&
+                    index_dir_is_current(d, &st))
+                        continue;
+
+                r = index_dir_list(d);
+                if (r == -ENOMEM)
+                        return r;
+                if (r < 0)
+                        log_debug_errno(r, "Failed to read directory %s, not indexing it: %m", d->path);
+
+                if (from_file || d->state == INDEX_DIR_LISTED)
+                        n++;
+        }
+
+        return n;
+}
+
+int unit_file_index_acquire(char **search_path, const char *index_file, UnitFileIndex **ret) {
+        _cleanup_unit_file_index_free_ UnitFileIndex *i = NULL;
+        char **p;
+        int r, n;
+
+        assert(ret);
+
+        /* Returns the index for the specified search path. The listings from index_file are reused as far as
+         * they are still current, everything else is read from disk, and index_file is updated if that turned up
+         * anything new. If index_file is NULL, all directories are read. Returns the number of directories that
+         * had to be read. */
+
+        i = new0(UnitFileIndex, 1);
+        if (!i)
+                return -ENOMEM;
+
+        i->dirs = new0(IndexDir, strv_length(search_path));
+        if (!i->dirs)
+                return -ENOMEM;
+
+        STRV_FOREACH(p, search_path) {
+                IndexDir *d = i->dirs + i->n_dirs;
+
+                d->path = strdup(*p);
+                if (!d->path)
+                        return -ENOMEM;
+
+                i->n_dirs++;
+        }
+
+        if (index_file) {
+                r = index_read(i, index_file);
+                if (r == -ENOMEM)
+                        return r;
+                if (r < 0) {
+                        size_t k;
+
+                        log_debug_errno(r, "Failed to read unit file index %s, ignoring: %m", index_file);
+
+                        for (k = 0; k < i->n_dirs; k++)
+                                index_dir_reset(i->dirs + k);
+                }
+        }
+
+        n = index_refresh(i);
+        if (n < 0)
+                return n;
+
+        if (index_file && n > 0) {
+                r = index_write(i, index_file);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to write unit file index %s, ignoring: %m", index_file);
+        }
+
+        *ret = i;
+        i = NULL;
+
+        return n;
+}
+
+int unit_file_index_lookup(UnitFileIndex *i, const char *path, const char **ret_target) {
+        const char *e, *dir;
+        void *target;
+        IndexDir *d;
+
+        assert(path);
+
+        /* Checks whether the specified path exists, and returns its symlink target, if it is one. Returns
+         * -ENOENT if it does not exist, and -ENODATA if the index has no information about the directory, in
+         * which case the caller has to check on disk. */
+
+        if (!i)
+                return -ENODATA;
+
+        e = strrchr(path, '/');
+        if (!e || e == path || isempty(e + 1))
+                return -ENODATA;
+
+        dir = strndupa(path, e - path);
+
+        d = index_find_dir(i, dir);
+        if (!d || d->state == INDEX_DIR_UNKNOWN)
+                return -ENODATA;
+        if (d->state == INDEX_DIR_MISSING)
+                return -ENOENT;
+
+        target = hashmap_get(d->entries, e + 1);
+        if (!target && !hashmap_contains(d->entries, e + 1))
+                return -ENOENT;
+
+        if (ret_target)
+                *ret_target = target;
+
+        return 1;
+}
+
+int unit_file_index_to_set(UnitFileIndex *i, Set **ret) {
+        _cleanup_set_free_free_ Set *s = NULL;
+        size_t k;
+        int r;
+
+        assert(i);
+        assert(ret);
+
+        /* Returns the paths of all entries of all directories that could be read */
+
+        s = set_new(&string_hash_ops);
+        if (!s)
+                return -ENOMEM;
+
+        for (k = 0; k < i->n_dirs; k++) {
+                IndexDir *d = i->dirs + k;
+                Iterator it;
+                const char *name;
+                void *target;
+
+                if (d->state != INDEX_DIR_LISTED)
+                        continue;
+
+                HASHMAP_FOREACH_KEY(target, name, d->entries, it) {
+                        char *p;
+
+                        p = strjoin(streq(d->path, "/") ? "" : d->path, "/", name);
+                        if (!p)
+                                return -ENOMEM;
+
+                        r = set_consume(s, p);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        *ret = s;
+        s = NULL;
+
+        return 0;
+}
@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "macro.h"
+#include "set.h"
+
+/*
+ * An index of the contents of the unit search path directories: for each directory, the names of the unit files,
+ * aliases and drop-in directories in it, plus the targets of the symlinks among them.
+ *
+ * The index is persisted below /run (see lookup_paths_init()), so that the service manager and systemctl can
+ * share it instead of each probing all directories for each name. Every directory listing is keyed by the
+ * directory's inode and mtime. When the index is acquired, the directories are stat()ed, and only those which
+ * changed since they were listed are read again.
+ */
+
+typedef struct UnitFileIndex UnitFileIndex;
+
+int unit_file_index_acquire(char **search_path, const char *index_file, UnitFileIndex **ret);
+UnitFileIndex *unit_file_index_free(UnitFileIndex *i);
+
+int unit_file_index_lookup(UnitFileIndex *i, const char *path, const char **ret_target);
+int unit_file_index_to_set(UnitFileIndex *i, Set **ret);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(UnitFileIndex*, unit_file_index_free);
+#define _cleanup_unit_file_index_free_ _cleanup_(unit_file_index_freep)
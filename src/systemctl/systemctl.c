@@ -180,6 +180,7 @@ static OutputMode arg_output = OUTPUT_SHORT;
 static bool arg_plain = false;
 static bool arg_firmware_setup = false;
 static bool arg_now = false;
+static bool arg_incremental = false;
 static bool arg_jobs_before = false;
 static bool arg_jobs_after = false;
 
@@ -5102,10 +5103,10 @@ static int print_property(const char *name, sd_bus_message *m, const char *conte
         return 0;
 }
 
-static int show_one(
+static int show_one_reply(
                 const char *verb,
                 sd_bus *bus,
-                const char *path,
+                sd_bus_message *reply,
                 const char *unit,
                 bool show_properties,
                 bool *new_line,
@@ -5117,7 +5118,6 @@ static int show_one(
                 {}
         };
 
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         _cleanup_set_free_ Set *found_properties = NULL;
         _cleanup_(unit_status_info_free) UnitStatusInfo info = {
@@ -5134,23 +5134,9 @@ static int show_one(
         };
         int r;
 
-        assert(path);
+        assert(reply);
         assert(new_line);
 
-        log_debug("Showing one %s", path);
-
-        r = sd_bus_call_method(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
-                        "org.freedesktop.DBus.Properties",
-                        "GetAll",
-                        &error,
-                        &reply,
-                        "s", "");
-        if (r < 0)
-                return log_error_errno(r, "Failed to get properties: %s", bus_error_message(&error, r));
-
         if (unit) {
                 r = bus_message_map_all_properties(reply, property_map, &error, &info);
                 if (r < 0)
@@ -5248,6 +5234,170 @@ static int show_one(
         return r;
 }
 
+static int show_one(
+                const char *verb,
+                sd_bus *bus,
+                const char *path,
+                const char *unit,
+                bool show_properties,
+                bool *new_line,
+                bool *ellipsized) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        int r;
+
+        assert(path);
+        assert(new_line);
+
+        log_debug("Showing one %s", path);
+
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        path,
+                        "org.freedesktop.DBus.Properties",
+                        "GetAll",
+                        &error,
+                        &reply,
+                        "s", "");
+        if (r < 0)
+                return log_error_errno(r, "Failed to get properties: %s", bus_error_message(&error, r));
+
+        return show_one_reply(verb, bus, reply, unit, show_properties, new_line, ellipsized);
+}
+
+/* The bus daemon limits the number of pending replies per connection, hence don't have more calls than this in
+ * flight at the same time */
+#define SHOW_PIPELINE_MAX 64U
+
+typedef struct ShowRequest {
+        char *path;
+        sd_bus_slot *slot;
+        sd_bus_message *reply;
+} ShowRequest;
+
+static void show_request_done(ShowRequest *req) {
+        assert(req);
+
+        req->path = mfree(req->path);
+        req->slot = sd_bus_slot_unref(req->slot);
+        req->reply = sd_bus_message_unref(req->reply);
+}
+
+static int on_show_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        ShowRequest *req = userdata;
+
+        assert(m);
+        assert(req);
+
+        req->reply = sd_bus_message_ref(m);
+        return 0;
+}
+
+static int show_units(
+                const char *verb,
+                sd_bus *bus,
+                char **names,
+                bool show_properties,
+                bool *new_line,
+                bool *ellipsized) {
+
+        ShowRequest *requests;
+        size_t n, n_sent = 0, i;
+        int r = 0, ret = 0;
+
+        assert(bus);
+        assert(new_line);
+
+        /* Like show_one() for each unit, but the calls are pipelined: we send the next calls before waiting for the
+         * reply to the current one, so that the manager works on them while we print the current unit, including
+         * its journal output in case of "status". The output is in the order of the names nonetheless. */
+
+        n = strv_length(names);
+        if (n == 0)
+                return 0;
+
+        requests = new0(ShowRequest, n);
+        if (!requests)
+                return log_oom();
+
+        for (i = 0; i < n; i++) {
+                ShowRequest *req = requests + i;
+
+                for (; n_sent < n && n_sent < i + SHOW_PIPELINE_MAX; n_sent++) {
+                        ShowRequest *next = requests + n_sent;
+
+                        next->path = unit_dbus_path_from_name(names[n_sent]);
+                        if (!next->path) {
+                                r = log_oom();
+                                goto finish;
+                        }
+
+                        r = sd_bus_call_method_async(
+                                        bus,
+                                        &next->slot,
+                                        "org.freedesktop.systemd1",
+                                        next->path,
+                                        "org.freedesktop.DBus.Properties",
+                                        "GetAll",
+                                        on_show_reply,
+                                        next,
+                                        "s", "");
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to get properties: %m");
+                                goto finish;
+                        }
+                }
+
+                log_debug("Showing one %s", req->path);
+
+                while (!req->reply) {
+                        r = sd_bus_process(bus, NULL);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to process bus: %m");
+                                goto finish;
+                        }
+                        if (r > 0)
+                                continue;
+
+                        r = sd_bus_wait(bus, (uint64_t) -1);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to wait for bus: %m");
+                                goto finish;
+                        }
+                }
+
+                if (sd_bus_message_is_method_error(req->reply, NULL)) {
+                        const sd_bus_error *e;
+
+                        e = sd_bus_message_get_error(req->reply);
+                        r = -sd_bus_error_get_errno(e);
+                        log_error_errno(r, "Failed to get properties: %s", bus_error_message(e, r));
+                        goto finish;
+                }
+
+                r = show_one_reply(verb, bus, req->reply, names[i], show_properties, new_line, ellipsized);
+
+                /* Don't keep the replies around, there might be many */
+                show_request_done(req);
+
+                if (r < 0)
+                        goto finish;
+                if (r > 0 && ret == 0)
+                        ret = r;
+        }
+
+        r = ret;
+
+finish:
+        for (i = 0; i < n; i++)
+                show_request_done(requests + i);
+        free(requests);
+
+        return r;
+}
+
 static int get_unit_dbus_path_by_pid(
                 sd_bus *bus,
                 uint32_t pid,
@@ -5291,9 +5441,9 @@ static int show_all(
 
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_free_ UnitInfo *unit_infos = NULL;
-        const UnitInfo *u;
-        unsigned c;
-        int r, ret = 0;
+        _cleanup_free_ char **names = NULL;
+        unsigned c, k;
+        int r;
 
         r = get_unit_list(bus, NULL, NULL, &unit_infos, 0, &reply);
         if (r < 0)
@@ -5305,21 +5455,16 @@ static int show_all(
 
         qsort_safe(unit_infos, c, sizeof(UnitInfo), compare_unit_info);
 
-        for (u = unit_infos; u < unit_infos + c; u++) {
-                _cleanup_free_ char *p = NULL;
+        /* The names point into the reply */
+        names = new(char*, c + 1);
+        if (!names)
+                return log_oom();
 
-                p = unit_dbus_path_from_name(u->id);
-                if (!p)
-                        return log_oom();
+        for (k = 0; k < c; k++)
+                names[k] = (char*) unit_infos[k].id;
+        names[c] = NULL;
 
-                r = show_one(verb, bus, p, u->id, show_properties, new_line, ellipsized);
-                if (r < 0)
-                        return r;
-                else if (r > 0 && ret == 0)
-                        ret = r;
-        }
-
-        return ret;
+        return show_units(verb, bus, names, show_properties, new_line, ellipsized);
 }
 
 static int show_system_status(sd_bus *bus) {
@@ -5465,19 +5610,11 @@ static int show(int argc, char *argv[], void *userdata) {
                         if (r < 0)
                                 return log_error_errno(r, "Failed to expand names: %m");
 
-                        STRV_FOREACH(name, names) {
-                                _cleanup_free_ char *path;
-
-                                path = unit_dbus_path_from_name(*name);
-                                if (!path)
-                                        return log_oom();
-
-                                r = show_one(argv[0], bus, path, *name, show_properties, &new_line, &ellipsized);
-                                if (r < 0)
-                                        return r;
-                                if (r > 0 && ret == 0)
-                                        ret = r;
-                        }
+                        r = show_units(argv[0], bus, names, show_properties, &new_line, &ellipsized);
+                        if (r < 0)
+                                return r;
+                        if (r > 0 && ret == 0)
+                                ret = r;
                 }
         }
 
@@ -5652,6 +5789,7 @@ static int daemon_reload(int argc, char *argv[], void *userdata) {
 
         case ACTION_SYSTEMCTL:
                 method = streq(argv[0], "daemon-reexec") ? "Reexecute" :
+                         arg_incremental ? "ReloadIncremental" :
                                      /* "daemon-reload" */ "Reload";
                 break;
 
@@ -7251,6 +7389,7 @@ static void systemctl_help(void) {
                "     --kill-who=WHO   Who to send signal to\n"
                "  -s --signal=SIGNAL  Which signal to send\n"
                "     --now            Start or stop unit in addition to enabling or disabling it\n"
+               "     --incremental    With daemon-reload, only reload units whose unit files changed\n"
                "     --dry-run        Only print what would be done\n"
                "  -q --quiet          Suppress output\n"
                "     --wait           For (re)start, wait until service stopped again\n"
@@ -7524,6 +7663,7 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                 ARG_PRESET_MODE,
                 ARG_FIRMWARE_SETUP,
                 ARG_NOW,
+                ARG_INCREMENTAL,
                 ARG_MESSAGE,
                 ARG_WAIT,
         };
@@ -7573,6 +7713,7 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                 { "preset-mode",         required_argument, NULL, ARG_PRESET_MODE         },
                 { "firmware-setup",      no_argument,       NULL, ARG_FIRMWARE_SETUP      },
                 { "now",                 no_argument,       NULL, ARG_NOW                 },
+                { "incremental",         no_argument,       NULL, ARG_INCREMENTAL         },
                 { "message",             required_argument, NULL, ARG_MESSAGE             },
                 {}
         };
@@ -7892,6 +8033,10 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                         arg_now = true;
                         break;
 
+                case ARG_INCREMENTAL:
+                        arg_incremental = true;
+                        break;
+
                 case ARG_MESSAGE:
                         if (strv_extend(&arg_wall, optarg) < 0)
                                 return log_oom();
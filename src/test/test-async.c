@@ -27,22 +27,22 @@
 
 static bool test_async = false;
 
-static void *async_func(void *arg) {
+static void async_func(void *arg) {
         test_async = true;
-
-        return NULL;
 }
 
 int main(int argc, char *argv[]) {
         int fd;
         char name[] = "/tmp/test-asynchronous_close.XXXXXX";
 
+        /* Submit the job first, so that the fd number isn't reused for the eventfd of its pool right after
+         * being closed */
+        assert_se(asynchronous_job(async_func, NULL) >= 0);
+
         fd = mkostemp_safe(name);
         assert_se(fd >= 0);
         asynchronous_close(fd);
 
-        assert_se(asynchronous_job(async_func, NULL) >= 0);
-
         assert_se(asynchronous_sync() >= 0);
 
         sleep(1);
@@ -0,0 +1,219 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sd-bus.h"
+#include "sd-id128.h"
+
+#include "alloc-util.h"
+#include "dbus-unit.h"
+#include "dbus.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "manager.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "time-util.h"
+#include "unit.h"
+
+#define N_UNITS 100U
+
+static sd_bus *add_private_bus(Manager *m, int fd) {
+        sd_bus *bus;
+        sd_id128_t id;
+
+        /* Sets up the server side of a direct connection, the same way bus_on_connection() does */
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fd, fd) >= 0);
+        assert_se(sd_bus_set_server(bus, 1, id) >= 0);
+        assert_se(sd_bus_set_anonymous(bus, true) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+        assert_se(sd_bus_attach_event(bus, m->event, SD_EVENT_PRIORITY_NORMAL) >= 0);
+
+        assert_se(set_ensure_allocated(&m->private_buses, NULL) >= 0);
+        assert_se(set_put(m->private_buses, bus) > 0);
+
+        return bus;
+}
+
+static sd_bus *add_client(Manager *m, int fd) {
+        sd_bus *bus;
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fd, fd) >= 0);
+        assert_se(sd_bus_set_anonymous(bus, true) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+        assert_se(sd_bus_attach_event(bus, m->event, SD_EVENT_PRIORITY_NORMAL) >= 0);
+
+        return bus;
+}
+
+static uint64_t n_queued_write(sd_bus *bus) {
+        uint64_t n;
+
+        assert_se(sd_bus_get_n_queued_write(bus, &n) >= 0);
+        return n;
+}
+
+static unsigned n_deferred(Manager *m, sd_bus *bus) {
+        BusDeferredSignals *d;
+
+        d = hashmap_get(m->deferred_signals, bus);
+        return d ? hashmap_size(d->objects[BUS_OBJECT_UNIT]) : 0;
+}
+
+static void test_deferred_signals(Manager *m) {
+        _cleanup_(sd_bus_unrefp) sd_bus *slow_client = NULL, *fast_client = NULL;
+        int slow_fds[2], fast_fds[2];
+        Unit *units[N_UNITS];
+        sd_bus *slow, *fast;
+        uint64_t q_slow, q_fast;
+        usec_t ts;
+        unsigned i;
+
+        log_info("/* %s */", __func__);
+
+        for (i = 0; i < N_UNITS; i++) {
+                char name[sizeof("test-deferred@.service") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "test-deferred@%u.service", i);
+                assert_se(manager_load_unit(m, name, NULL, NULL, &units[i]) >= 0);
+        }
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, slow_fds) >= 0);
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, fast_fds) >= 0);
+
+        slow = add_private_bus(m, slow_fds[0]);
+        fast = add_private_bus(m, fast_fds[0]);
+
+        /* Nobody reads from the slow connection yet: the client of the fast one is attached right away, the one of
+         * the slow one only later. Fill the slow one's write queue up until it counts as busy. */
+        fast_client = add_client(m, fast_fds[1]);
+
+        while (!bus_is_busy(slow))
+                assert_se(sd_bus_emit_signal(slow, "/org/freedesktop/systemd1", "org.freedesktop.systemd1.Manager",
+                                             "Reloading", "b", true) >= 0);
+        assert_se(!bus_is_busy(fast));
+
+        q_slow = n_queued_write(slow);
+        q_fast = n_queued_write(fast);
+
+        /* The fast connection gets its signals right away, and nothing is held back for it, the slow one gets
+         * nothing, but has an entry for each unit */
+        for (i = 0; i < N_UNITS; i++)
+                bus_unit_send_change_signal(units[i]);
+
+        assert_se(n_queued_write(slow) == q_slow);
+        assert_se(n_deferred(m, slow) == N_UNITS);
+        assert_se(n_queued_write(fast) > q_fast);
+        assert_se(n_deferred(m, fast) == 0);
+
+        /* Further changes are coalesced into the held back entries */
+        for (i = 0; i < N_UNITS; i++)
+                bus_unit_send_change_signal(units[i]);
+
+        assert_se(n_queued_write(slow) == q_slow);
+        assert_se(n_deferred(m, slow) == N_UNITS);
+        assert_se(n_deferred(m, fast) == 0);
+
+        /* Nothing goes out while the slow connection is still busy */
+        assert_se(bus_dispatch_deferred_signals(m, UINT_MAX) == 0);
+        assert_se(n_deferred(m, slow) == N_UNITS);
+
+        /* Let the client of the slow connection read everything queued so far */
+        slow_client = add_client(m, slow_fds[1]);
+
+        ts = now(CLOCK_MONOTONIC);
+        while (n_queued_write(slow) > 0) {
+                assert_se(sd_event_run(m->event, 100 * USEC_PER_MSEC) >= 0);
+                assert_se(ts + 2 * USEC_PER_MINUTE >= now(CLOCK_MONOTONIC));
+        }
+
+        /* The budget is honoured */
+        assert_se(bus_dispatch_deferred_signals(m, N_UNITS / 2) == N_UNITS / 2);
+        assert_se(n_deferred(m, slow) == N_UNITS - N_UNITS / 2);
+
+        /* Once the client caught up, the rest is flushed, and the entry for the connection is dropped */
+        assert_se(bus_dispatch_deferred_signals(m, UINT_MAX) == N_UNITS - N_UNITS / 2);
+        assert_se(n_deferred(m, slow) == 0);
+        assert_se(hashmap_isempty(m->deferred_signals));
+
+        /* Unit removal drops what is held back for it */
+        while (!bus_is_busy(slow))
+                assert_se(sd_bus_emit_signal(slow, "/org/freedesktop/systemd1", "org.freedesktop.systemd1.Manager",
+                                             "Reloading", "b", true) >= 0);
+
+        bus_unit_send_change_signal(units[0]);
+        assert_se(n_deferred(m, slow) == 1);
+        bus_drop_deferred_signals(m, BUS_OBJECT_UNIT, units[0]);
+        assert_se(n_deferred(m, slow) == 0);
+
+        /* Let both clients read everything, so that the connections can be closed without blocking */
+        ts = now(CLOCK_MONOTONIC);
+        while (n_queued_write(slow) > 0 || n_queued_write(fast) > 0) {
+                assert_se(sd_event_run(m->event, 100 * USEC_PER_MSEC) >= 0);
+                assert_se(ts + 2 * USEC_PER_MINUTE >= now(CLOCK_MONOTONIC));
+        }
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL, *unit_dir = NULL;
+        Manager *m = NULL;
+        const char *p;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        r = enter_cgroup_subroot();
+        if (r == -ENOMEDIUM) {
+                log_notice_errno(r, "Skipping test: cgroupfs not available");
+                return EXIT_TEST_SKIP;
+        }
+
+        assert_se(mkdtemp_malloc("/tmp/test-bus-deferred-signals.XXXXXX", &unit_dir) >= 0);
+        p = strjoina(unit_dir, "/test-deferred@.service");
+        assert_se(write_string_file(p,
+                                    "[Service]\n"
+                                    "ExecStart=/bin/true\n",
+                                    WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(set_unit_path(unit_dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_MINIMAL, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        test_deferred_signals(m);
+
+        manager_free(m);
+
+        return 0;
+}
@@ -22,9 +22,13 @@
 
 #include "alloc-util.h"
 #include "calendarspec.h"
+#include "env-util.h"
 #include "string-util.h"
+#include "time-util.h"
 #include "util.h"
 
+static bool arg_slow = false;
+
 static void test_one(const char *input, const char *output) {
         CalendarSpec *c;
         _cleanup_free_ char *p = NULL, *q = NULL;
@@ -134,8 +138,51 @@ static void test_hourly_bug_4031(void) {
         calendar_spec_free(c);
 }
 
+static void test_benchmark(unsigned n) {
+        static const char * const specs[] = {
+                "minutely", "hourly", "daily", "weekly", "monthly", "quarterly", "annually",
+                "*:0/15", "Mon..Fri 09:00", "Sat,Sun 10:30", "*-*-1,15 03:00", "*-*~1 23:55",
+                "*-02-29 12:00", "00:00:1/10", "2037-12-31 23:59:59", "Mon *-*-1..7 04:00",
+                "*:*:30 UTC", "daily UTC", "Fri *-*-13 13:13",
+        };
+        _cleanup_free_ CalendarSpec **c = NULL;
+        char buf[FORMAT_TIMESPAN_MAX];
+        usec_t ts, base, u;
+        unsigned k;
+
+        log_info("/* %s(%u) */", __func__, n);
+
+        /* Re-arm many timers, the way all timer units are after the system clock was changed, each from a
+         * different last trigger time */
+
+        assert_se(c = new(CalendarSpec*, n));
+        for (k = 0; k < n; k++)
+                assert_se(calendar_spec_from_string(specs[k % ELEMENTSOF(specs)], c + k) >= 0);
+
+        base = now(CLOCK_REALTIME);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (k = 0; k < n; k++) {
+                assert_se(calendar_spec_next_usec(c[k], base + k * 7 * USEC_PER_MINUTE, &u) >= 0);
+                assert_se(u > base + k * 7 * USEC_PER_MINUTE);
+        }
+        ts = now(CLOCK_MONOTONIC) - ts;
+
+        log_info("%u timers: next elapse calculated in %s", n, format_timespan(buf, sizeof(buf), ts, 1));
+
+        for (k = 0; k < n; k++)
+                calendar_spec_free(c[k]);
+}
+
 int main(int argc, char* argv[]) {
         CalendarSpec *c;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        arg_slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
 
         test_one("Sat,Thu,Mon-Wed,Sat-Sun", "Mon..Thu,Sat,Sun *-*-* 00:00:00");
         test_one("Sat,Thu,Mon..Wed,Sat..Sun", "Mon..Thu,Sat,Sun *-*-* 00:00:00");
@@ -262,6 +309,9 @@ int main(int argc, char* argv[]) {
 
         test_timestamp();
         test_hourly_bug_4031();
+        test_benchmark(10000);
+        if (arg_slow)
+                test_benchmark(100000);
 
         return 0;
 }
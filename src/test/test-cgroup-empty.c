@@ -0,0 +1,178 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "cgroup-util.h"
+#include "env-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "manager.h"
+#include "rm-rf.h"
+#include "service.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "time-util.h"
+#include "unit.h"
+
+static bool arg_slow = false;
+
+static unsigned count_processes(Unit *u) {
+        _cleanup_fclose_ FILE *f = NULL;
+        unsigned n = 0;
+        pid_t pid;
+
+        if (!u->cgroup_path)
+                return 0;
+
+        if (cg_enumerate_processes(SYSTEMD_CGROUP_CONTROLLER, u->cgroup_path, &f) < 0)
+                return 0;
+
+        while (cg_read_pid(f, &pid) > 0)
+                n++;
+
+        return n;
+}
+
+static void run_until(Manager *m, Unit **units, unsigned n, bool (*done)(Unit *u)) {
+        usec_t ts = now(CLOCK_MONOTONIC);
+        unsigned k = 0;
+
+        /* Units are checked in order, each one only once it is done */
+        while (k < n) {
+                if (done(units[k])) {
+                        k++;
+                        continue;
+                }
+
+                assert_se(sd_event_run(m->event, 100 * USEC_PER_MSEC) >= 0);
+
+                if (ts + 2 * USEC_PER_MINUTE < now(CLOCK_MONOTONIC)) {
+                        log_error("Test timeout while waiting for %s", units[k]->id);
+                        exit(EXIT_FAILURE);
+                }
+        }
+}
+
+static bool is_running(Unit *u) {
+        /* Wait for the background process too, so that the group is not empty when the main process is gone */
+        return SERVICE(u)->state == SERVICE_RUNNING && count_processes(u) >= 2;
+}
+
+static bool is_dead(Unit *u) {
+        return IN_SET(SERVICE(u)->state, SERVICE_DEAD, SERVICE_FAILED);
+}
+
+/* Starts many services with a main process and one more process in the same cgroup, then stops all of them and
+ * waits until the manager has noticed that each cgroup is empty: on the unified hierarchy through the inotify watch
+ * on cgroup.events (on_cgroup_inotify_event()), otherwise through the PIDs watched by unit_watch_all_pids(). */
+static void test_cgroup_empty(Manager *m, unsigned n) {
+        _cleanup_free_ Unit **units = NULL;
+        char buf[FORMAT_TIMESPAN_MAX];
+        usec_t ts, setup, teardown;
+        unsigned k;
+        Job *j;
+
+        log_info("/* %s(%u) */", __func__, n);
+
+        assert_se(units = new(Unit*, n));
+
+        ts = now(CLOCK_MONOTONIC);
+
+        for (k = 0; k < n; k++) {
+                char name[sizeof("test-cgroup-empty@.service") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "test-cgroup-empty@%u.service", k);
+                assert_se(manager_load_unit(m, name, NULL, NULL, &units[k]) >= 0);
+                assert_se(manager_add_job(m, JOB_START, units[k], JOB_REPLACE, NULL, &j) >= 0);
+        }
+
+        run_until(m, units, n, is_running);
+        setup = now(CLOCK_MONOTONIC) - ts;
+
+        ts = now(CLOCK_MONOTONIC);
+
+        for (k = 0; k < n; k++)
+                assert_se(manager_add_job(m, JOB_STOP, units[k], JOB_REPLACE, NULL, &j) >= 0);
+
+        run_until(m, units, n, is_dead);
+        teardown = now(CLOCK_MONOTONIC) - ts;
+
+        for (k = 0; k < n; k++)
+                assert_se(count_processes(units[k]) == 0);
+
+        log_info("%u services: started in %s", n, format_timespan(buf, sizeof(buf), setup, 1));
+        log_info("%u services: stopped and found empty in %s (%s)",
+                 n, format_timespan(buf, sizeof(buf), teardown, 1),
+                 m->cgroup_inotify_fd >= 0 ? "inotify" : "watched PIDs");
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL, *unit_dir = NULL;
+        Manager *m = NULL;
+        const char *p;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        arg_slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+
+        /* It is needed otherwise cgroup creation fails */
+        if (getuid() != 0) {
+                log_notice("Skipping test: not root");
+                return EXIT_TEST_SKIP;
+        }
+
+        r = enter_cgroup_subroot();
+        if (r == -ENOMEDIUM) {
+                log_notice_errno(r, "Skipping test: cgroupfs not available");
+                return EXIT_TEST_SKIP;
+        }
+
+        assert_se(mkdtemp_malloc("/tmp/test-cgroup-empty.XXXXXX", &unit_dir) >= 0);
+        p = strjoina(unit_dir, "/test-cgroup-empty@.service");
+        assert_se(write_string_file(p,
+                                    "[Service]\n"
+                                    "ExecStart=/bin/sh -c 'sleep 1000 & exec sleep 1000'\n",
+                                    WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(set_unit_path(unit_dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_MINIMAL, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        test_cgroup_empty(m, 100);
+        if (arg_slow)
+                test_cgroup_empty(m, 5000);
+
+        manager_free(m);
+
+        return 0;
+}
@@ -19,14 +19,19 @@
 ***/
 
 #include "conf-parser.h"
+#include "env-util.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "log.h"
 #include "macro.h"
 #include "string-util.h"
 #include "strv.h"
+#include "time-util.h"
+#include "utf8.h"
 #include "util.h"
 
+static bool arg_slow = false;
+
 static void test_config_parse_path_one(const char *rvalue, const char *expected) {
         _cleanup_free_ char *path = NULL;
 
@@ -274,6 +279,10 @@ static const char* const config_file[] = {
         "[Section]\n"
         "setting1="          /* many continuation lines, together above the limit */
         x1000(x1000("x") x10("abcde") "\\\n") "xxx",
+
+        UTF8_BYTE_ORDER_MARK /* a byte order mark, which is skipped */
+        "[Section]\n"
+        "setting1=1\n",
 };
 
 static void test_config_parse(unsigned i, const char *s) {
@@ -344,15 +353,146 @@ static void test_config_parse(unsigned i, const char *s) {
                 assert_se(r == -ENOBUFS);
                 assert_se(setting1 == NULL);
                 break;
+
+        case 10:
+                assert_se(r == 0);
+                assert_se(streq(setting1, "1"));
+                break;
         }
 }
 
+static void test_config_file(void) {
+        char name[] = "/tmp/test-conf-parser.XXXXXX";
+        _cleanup_(config_file_freep) ConfigFile *cf = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *setting1 = NULL, *setting2 = NULL;
+        unsigned i;
+        int fd;
+
+        const ConfigTableItem items[] = {
+                { "Section", "setting1",  config_parse_string,   0, &setting1},
+                { "Other",   "setting2",  config_parse_string,   0, &setting2},
+                {}
+        };
+
+        static const char s[] =
+                "# comment\n"
+                "[Section]\n"
+                "setting1 = one \\\n"
+                "  two\n"
+                "[X-Ignored]\n"
+                "no assignment here\n"
+                "[Other]\n"
+                "setting2=three\n";
+
+        log_info("/* %s */", __func__);
+
+        fd = mkostemp_safe(name);
+        assert_se(fd >= 0);
+        assert_se((size_t) write(fd, s, strlen(s)) == strlen(s));
+
+        assert_se(lseek(fd, 0, SEEK_SET) == 0);
+        assert_se(f = fdopen(fd, "r"));
+
+        /* Reading and parsing are separate steps, and a file read once may be parsed several times */
+        assert_se(config_file_read(name, f, 0, &cf) == 0);
+        assert_se(streq(config_file_filename(cf), name));
+        assert_se(config_file_stat(cf)->st_size == (off_t) strlen(s));
+
+        for (i = 0; i < 2; i++) {
+                setting1 = mfree(setting1);
+                setting2 = mfree(setting2);
+
+                assert_se(config_file_parse(NULL, cf, "Section\0Other\0", config_item_table_lookup, items, CONFIG_PARSE_WARN, NULL) == 0);
+                assert_se(streq(setting1, "one    two"));
+                assert_se(streq(setting2, "three"));
+        }
+
+        /* Without the section, the line without assignment is an error, after the lines before it were parsed */
+        setting1 = mfree(setting1);
+        setting2 = mfree(setting2);
+        assert_se(config_file_parse(NULL, cf, NULL, config_item_table_lookup, items, 0, NULL) == -EINVAL);
+        assert_se(streq(setting1, "one    two"));
+        assert_se(!setting2);
+
+        unlink(name);
+}
+
+static void test_benchmark(unsigned n) {
+        char name[] = "/tmp/test-conf-parser.XXXXXX";
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *setting1 = NULL, *setting2 = NULL;
+        char buf[FORMAT_TIMESPAN_MAX];
+        unsigned k, setting3 = 0, rounds = 10;
+        bool setting4 = false;
+        usec_t ts, t;
+        int fd;
+
+        const ConfigTableItem items[] = {
+                { "Section", "setting1",  config_parse_string,   0, &setting1},
+                { "Section", "setting2",  config_parse_string,   0, &setting2},
+                { "Section", "setting3",  config_parse_unsigned, 0, &setting3},
+                { "Section", "setting4",  config_parse_bool,     0, &setting4},
+                {}
+        };
+
+        log_info("/* %s(%u) */", __func__, n);
+
+        fd = mkostemp_safe(name);
+        assert_se(fd >= 0);
+        assert_se(f = fdopen(fd, "r+"));
+
+        /* Something that looks like a unit file, n lines long */
+        fputs("[Section]\n", f);
+        for (k = 1; k < n; k++)
+                switch (k % 8) {
+                case 0:
+                        fputs("\n", f);
+                        break;
+                case 1:
+                        fputs("# A comment, explaining the following settings\n", f);
+                        break;
+                case 2:
+                        fprintf(f, "setting1=/usr/lib/systemd/systemd-something --option=%u\n", k);
+                        break;
+                case 3:
+                        fputs("setting2=one.target two.target \\\n", f);
+                        break;
+                case 4:
+                        fputs("         three.service\n", f);
+                        break;
+                case 5:
+                        fprintf(f, "setting3 = %u\n", k);
+                        break;
+                default:
+                        fputs("setting4=yes\n", f);
+                }
+        assert_se(fflush_and_check(f) >= 0);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (k = 0; k < rounds; k++) {
+                rewind(f);
+                assert_se(config_parse(NULL, name, f, "Section\0", config_item_table_lookup, items, CONFIG_PARSE_WARN, NULL) == 0);
+        }
+        t = (now(CLOCK_MONOTONIC) - ts) / rounds;
+
+        assert_se(n < 8 || setting4);
+
+        log_info("%u lines: parsed in %s, %.1f ns per line", n, format_timespan(buf, sizeof(buf), t, 1), (double) t * 1000 / n);
+
+        unlink(name);
+}
+
 int main(int argc, char **argv) {
         unsigned i;
+        int r;
 
         log_parse_environment();
         log_open();
 
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        arg_slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+
         test_config_parse_path();
         test_config_parse_log_level();
         test_config_parse_log_facility();
@@ -369,5 +509,11 @@ int main(int argc, char **argv) {
         for (i = 0; i < ELEMENTSOF(config_file); i++)
                 test_config_parse(i, config_file[i]);
 
+        test_config_file();
+
+        test_benchmark(10000);
+        if (arg_slow)
+                test_benchmark(1000000);
+
         return 0;
 }
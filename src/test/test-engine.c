@@ -19,14 +19,300 @@
 ***/
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
 
+#include "alloc-util.h"
 #include "bus-util.h"
+#include "env-util.h"
+#include "fileio.h"
 #include "manager.h"
 #include "rm-rf.h"
+#include "stdio-util.h"
 #include "test-helper.h"
 #include "tests.h"
+#include "unit-metrics.h"
+
+static bool arg_slow = false;
+
+static size_t unit_dependencies_memory(Unit *u) {
+        UnitDependency d;
+        size_t sz = 0;
+
+        for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
+                sz += unit_dependency_set_memory(u->dependencies[d]);
+
+        return sz;
+}
+
+static void test_dependency_memory(Manager *m, unsigned n_units) {
+        _cleanup_free_ Unit **units = NULL;
+        Unit *sysinit, *multi_user, *shutdown, *other;
+        usec_t t0, t1, t2, t3;
+        size_t sz = 0;
+        unsigned k, n = 0;
+        Iterator i;
+
+        log_info("/* %s(%u) */", __func__, n_units);
+
+        /* Builds the typical dependency graph of a large system: every unit is pulled in by a target, ordered after
+         * another target, and conflicts with shutdown.target. This means the targets have huge sets of reverse
+         * dependencies, while the units have lots of small sets. */
+
+        assert_se(units = new(Unit*, n_units));
+
+        assert_se(manager_load_unit_prepare(m, "bench-sysinit.target", NULL, NULL, &sysinit) >= 0);
+        assert_se(manager_load_unit_prepare(m, "bench-multi-user.target", NULL, NULL, &multi_user) >= 0);
+        assert_se(manager_load_unit_prepare(m, "bench-shutdown.target", NULL, NULL, &shutdown) >= 0);
+
+        for (k = 0; k < n_units; k++) {
+                char name[sizeof("bench-4294967295.service")];
+
+                xsprintf(name, "bench-%u.service", k);
+                assert_se(manager_load_unit_prepare(m, name, NULL, NULL, units + k) >= 0);
+        }
+
+        t0 = now(CLOCK_MONOTONIC);
+
+        for (k = 0; k < n_units; k++) {
+                assert_se(unit_add_two_dependencies(units[k], UNIT_AFTER, UNIT_REQUIRES, sysinit, true, UNIT_DEPENDENCY_DEFAULT) >= 0);
+                assert_se(unit_add_two_dependencies(units[k], UNIT_BEFORE, UNIT_CONFLICTS, shutdown, true, UNIT_DEPENDENCY_DEFAULT) >= 0);
+                assert_se(unit_add_two_dependencies(multi_user, UNIT_AFTER, UNIT_WANTS, units[k], true, UNIT_DEPENDENCY_FILE) >= 0);
+                if (k > 0)
+                        assert_se(unit_add_dependency(units[k], UNIT_AFTER, units[k-1], true, UNIT_DEPENDENCY_FILE) >= 0);
+        }
+
+        t1 = now(CLOCK_MONOTONIC);
+
+        UNIT_DEPENDENCY_SET_FOREACH(other, multi_user->dependencies[UNIT_WANTS], i)
+                if (unit_dependency_set_contains(other->dependencies[UNIT_CONFLICTS], shutdown))
+                        n++;
+        assert_se(n == n_units);
+
+        t2 = now(CLOCK_MONOTONIC);
+
+        for (k = 0; k < n_units; k++)
+                sz += unit_dependencies_memory(units[k]);
+        sz += unit_dependencies_memory(sysinit) + unit_dependencies_memory(multi_user) + unit_dependencies_memory(shutdown);
+
+        log_info("%u units: %zu bytes of dependency data, %zu bytes per unit", n_units, sz, sz / n_units);
+        log_info("adding dependencies: %.1f us/unit, iterating: %.1f ns/unit",
+                 (double) (t1 - t0) / n_units, (double) (t2 - t1) * NSEC_PER_USEC / n_units);
+
+        t2 = now(CLOCK_MONOTONIC);
+
+        for (k = 0; k < n_units; k++)
+                unit_remove_dependencies(units[k], UNIT_DEPENDENCY_DEFAULT|UNIT_DEPENDENCY_FILE);
+        unit_remove_dependencies(multi_user, UNIT_DEPENDENCY_FILE);
+
+        t3 = now(CLOCK_MONOTONIC);
+
+        log_info("removing dependencies: %.1f us/unit", (double) (t3 - t2) / n_units);
+
+        assert_se(unit_dependency_set_isempty(sysinit->dependencies[UNIT_REQUIRED_BY]));
+        assert_se(unit_dependency_set_isempty(shutdown->dependencies[UNIT_CONFLICTED_BY]));
+        assert_se(unit_dependency_set_isempty(multi_user->dependencies[UNIT_WANTS]));
+}
+
+static void test_transaction(Manager *m, unsigned n_units) {
+        _cleanup_free_ Unit **units = NULL;
+        usec_t t0, t1, t2, t3;
+        Unit *top;
+        unsigned k;
+        Job *j;
+
+        log_info("/* %s(%u) */", __func__, n_units);
+
+        /* A target that pulls in many units and is ordered after them, with the units ordered after each other in
+         * one long chain, the way a big target on a large system looks like. Each unit requires the target, hence
+         * stopping it propagates to all of them, but as they are not running, all of those jobs are redundant. */
+
+        assert_se(units = new(Unit*, n_units));
+
+        assert_se(manager_load_unit_prepare(m, "bench-transaction.target", NULL, NULL, &top) >= 0);
+        for (k = 0; k < n_units; k++) {
+                char name[sizeof("bench-transaction-4294967295.target")];
+
+                xsprintf(name, "bench-transaction-%u.target", k);
+                assert_se(manager_load_unit_prepare(m, name, NULL, NULL, units + k) >= 0);
+        }
+
+        /* There are no unit files for these, pretend they were loaded */
+        manager_dispatch_load_queue(m);
+        top->load_state = UNIT_LOADED;
+        for (k = 0; k < n_units; k++)
+                units[k]->load_state = UNIT_LOADED;
+
+        for (k = 0; k < n_units; k++) {
+                assert_se(unit_add_two_dependencies(top, UNIT_AFTER, UNIT_WANTS, units[k], true, UNIT_DEPENDENCY_FILE) >= 0);
+                assert_se(unit_add_dependency(units[k], UNIT_REQUIRES, top, true, UNIT_DEPENDENCY_FILE) >= 0);
+                if (k > 0)
+                        assert_se(unit_add_dependency(units[k], UNIT_AFTER, units[k-1], true, UNIT_DEPENDENCY_FILE) >= 0);
+        }
+
+        manager_clear_jobs(m);
+
+        t0 = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job(m, JOB_START, top, JOB_REPLACE, NULL, &j) == 0);
+        t1 = now(CLOCK_MONOTONIC);
+
+        assert_se(hashmap_size(m->jobs) == n_units + 1);
+        manager_clear_jobs(m);
+
+        t2 = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job(m, JOB_STOP, top, JOB_REPLACE, NULL, &j) == 0);
+        t3 = now(CLOCK_MONOTONIC);
+
+        assert_se(hashmap_size(m->jobs) == 1);
+        manager_clear_jobs(m);
+
+        log_info("%u units: start transaction %.1f ms, stop transaction %.1f ms",
+                 n_units, (double) (t1 - t0) / USEC_PER_MSEC, (double) (t3 - t2) / USEC_PER_MSEC);
+}
+
+static void test_metrics(Manager *m, const char *runtime_dir) {
+        const UnitMetricsHeader *header;
+        const UnitMetricsEntry *e;
+        _cleanup_free_ char *buf = NULL;
+        const char *path, *id, *prev = NULL;
+        unsigned n_units = 0, k;
+        bool found = false;
+        const char *key;
+        Iterator i;
+        size_t size;
+        usec_t ts;
+        Unit *u;
+
+        log_info("/* %s */", __func__);
+
+        path = strjoina(runtime_dir, "/metrics");
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(manager_write_metrics(m, path) >= 0);
+        ts = now(CLOCK_MONOTONIC) - ts;
+
+        assert_se(read_full_file(path, &buf, &size) >= 0);
+        assert_se(size >= sizeof(UnitMetricsHeader));
+
+        header = (const UnitMetricsHeader*) buf;
+        assert_se(memcmp(header->signature, UNIT_METRICS_SIGNATURE, sizeof(header->signature)) == 0);
+        assert_se(le32toh(header->version) == UNIT_METRICS_VERSION);
+        assert_se(le32toh(header->entry_size) == sizeof(UnitMetricsEntry));
+        assert_se(le64toh(header->strings_offset) + le64toh(header->strings_size) == size);
+
+        FLAT_HASHMAP_FOREACH_KEY(u, key, m->units, i)
+                if (u->id == key)
+                        n_units++;
+
+        assert_se(le32toh(header->n_entries) == n_units);
+
+        for (k = 0; k < n_units; k++) {
+                e = (const UnitMetricsEntry*) (buf + le64toh(header->entries_offset) + k * le32toh(header->entry_size));
+                id = buf + le64toh(e->id_offset);
+
+                /* Sorted by name, and referring to the units' current state */
+                assert_se(!prev || strcmp(prev, id) < 0);
+                prev = id;
+
+                assert_se(u = manager_get_unit(m, id));
+                assert_se(e->load_state == u->load_state);
+                assert_se(e->active_state == unit_active_state(u));
+                assert_se(streq(buf + le64toh(e->sub_state_offset), unit_sub_state_to_string(u)));
+
+                if (streq(id, "a.service")) {
+                        assert_se(le32toh(e->n_restarts) == 0);
+                        assert_se(le64toh(e->memory_current) == UINT64_MAX);
+                        found = true;
+                }
+        }
+
+        assert_se(found);
+
+        log_info("%u units: metrics table of %zu bytes written in %.1f ms",
+                 n_units, size, (double) ts / USEC_PER_MSEC);
+}
+
+static void backdate(const char *path) {
+        struct timespec ts[2];
+
+        /* Pretend the file was written a while ago, so that it is not considered racily changed */
+        timespec_store(&ts[0], now(CLOCK_REALTIME) - 10 * USEC_PER_SEC);
+        ts[1] = ts[0];
+        assert_se(utimensat(AT_FDCWD, path, ts, AT_SYMLINK_NOFOLLOW) >= 0);
+}
+
+static void write_unit_file(const char *dir, const char *name, const char *contents) {
+        const char *p;
+
+        p = strjoina(dir, "/", name);
+        assert_se(write_string_file(p, contents, WRITE_STRING_FILE_CREATE) >= 0);
+        backdate(p);
+}
+
+static void test_reload_incremental(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        Unit *one, *two, *three;
+        Manager *m = NULL;
+        const char *p;
+        Job *j;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/tmp/test-engine-reload.XXXXXX", &dir) >= 0);
+
+        write_unit_file(dir, "one.service", "[Unit]\nDescription=One\n[Service]\nExecStart=/bin/true\n");
+        write_unit_file(dir, "two.service", "[Unit]\nDescription=Two\n[Service]\nExecStart=/bin/true\n");
+        write_unit_file(dir, "three.service", "[Unit]\nDescription=Three\n[Service]\nExecStart=/bin/true\n");
+        p = strjoina(dir, "/three.service.d");
+        assert_se(mkdir(p, 0755) >= 0);
+        write_unit_file(p, "override.conf", "[Unit]\nDescription=Three, overridden\n");
+        backdate(p);
+
+        assert_se(set_unit_path(dir) >= 0);
+        assert_se(manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_MINIMAL, &m) >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        assert_se(manager_load_unit(m, "one.service", NULL, NULL, &one) >= 0);
+        assert_se(manager_load_unit(m, "two.service", NULL, NULL, &two) >= 0);
+        assert_se(manager_load_unit(m, "three.service", NULL, NULL, &three) >= 0);
+        assert_se(streq(unit_description(three), "Three, overridden"));
+
+        /* Nothing changed yet */
+        assert_se(manager_reload_incremental(m) == 0);
+
+        /* Units with a job may not be unloaded */
+        assert_se(unit_may_unload(two));
+        assert_se(manager_add_job(m, JOB_START, two, JOB_REPLACE, NULL, &j) == 0);
+        assert_se(!unit_may_unload(two));
+        manager_clear_jobs(m);
+        assert_se(unit_may_unload(two));
+
+        /* File timestamps come from a coarse clock, make sure the edits are not older than the loading */
+        usleep(50 * USEC_PER_MSEC);
+
+        /* Edit a fragment and a drop-in, only those units are reloaded, in place */
+        p = strjoina(dir, "/one.service");
+        assert_se(write_string_file(p, "[Unit]\nDescription=One, edited\n[Service]\nExecStart=/bin/true\n", 0) >= 0);
+        p = strjoina(dir, "/three.service.d/override.conf");
+        assert_se(write_string_file(p, "[Unit]\nDescription=Three, edited\n", 0) >= 0);
+
+        assert_se(manager_reload_incremental(m) == 2);
+
+        assert_se(manager_get_unit(m, "one.service") == one);
+        assert_se(manager_get_unit(m, "three.service") == three);
+        assert_se(one->load_state == UNIT_LOADED);
+        assert_se(three->load_state == UNIT_LOADED);
+        assert_se(streq(unit_description(one), "One, edited"));
+        assert_se(streq(unit_description(two), "Two"));
+        assert_se(streq(unit_description(three), "Three, edited"));
+
+        /* Now everything is up to date again */
+        assert_se(manager_reload_incremental(m) == 0);
+
+        manager_free(m);
+}
 
 int main(int argc, char *argv[]) {
         _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
@@ -38,6 +324,9 @@ int main(int argc, char *argv[]) {
         Job *j;
         int r;
 
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        arg_slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+
         r = enter_cgroup_subroot();
         if (r == -ENOMEDIUM) {
                 log_notice_errno(r, "Skipping test: cgroupfs not available");
@@ -116,34 +405,40 @@ int main(int argc, char *argv[]) {
         assert_se(manager_add_job(m, JOB_START, h, JOB_FAIL, NULL, &j) == 0);
         manager_dump_jobs(m, stdout, "\t");
 
-        assert_se(!hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
-        assert_se(!hashmap_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
-        assert_se(!hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
-        assert_se(!hashmap_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(!unit_dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
+        assert_se(!unit_dependency_set_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(!unit_dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
+        assert_se(!unit_dependency_set_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
 
         assert_se(unit_add_dependency(a, UNIT_PROPAGATES_RELOAD_TO, b, true, UNIT_DEPENDENCY_UDEV) == 0);
         assert_se(unit_add_dependency(a, UNIT_PROPAGATES_RELOAD_TO, c, true, UNIT_DEPENDENCY_PROC_SWAP) == 0);
 
-        assert_se(hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
-        assert_se(hashmap_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
-        assert_se(hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
-        assert_se(hashmap_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(unit_dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
+        assert_se(unit_dependency_set_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(unit_dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
+        assert_se(unit_dependency_set_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
 
         unit_remove_dependencies(a, UNIT_DEPENDENCY_UDEV);
 
-        assert_se(!hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
-        assert_se(!hashmap_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
-        assert_se(hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
-        assert_se(hashmap_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(!unit_dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
+        assert_se(!unit_dependency_set_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(unit_dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
+        assert_se(unit_dependency_set_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
 
         unit_remove_dependencies(a, UNIT_DEPENDENCY_PROC_SWAP);
 
-        assert_se(!hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
-        assert_se(!hashmap_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
-        assert_se(!hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
-        assert_se(!hashmap_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(!unit_dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
+        assert_se(!unit_dependency_set_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(!unit_dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
+        assert_se(!unit_dependency_set_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+
+        test_dependency_memory(m, arg_slow ? 20000 : 1000);
+        test_transaction(m, arg_slow ? 20000 : 1000);
+        test_metrics(m, runtime_dir);
 
         manager_free(m);
 
+        test_reload_incremental();
+
         return 0;
 }
@@ -36,6 +36,7 @@
 #include "log.h"
 #include "macro.h"
 #include "rm-rf.h"
+#include "stdio-util.h"
 #include "string-util.h"
 #include "strv.h"
 
@@ -134,9 +135,9 @@ static void test_execute_directory(bool gather_stdout) {
         assert_se(chmod(mask2e, 0755) == 0);
 
         if (gather_stdout)
-                execute_directories(dirs, DEFAULT_TIMEOUT_USEC, ignore_stdout, ignore_stdout_args, NULL);
+                execute_directories(dirs, DEFAULT_TIMEOUT_USEC, ignore_stdout, ignore_stdout_args, NULL, NULL, NULL);
         else
-                execute_directories(dirs, DEFAULT_TIMEOUT_USEC, NULL, NULL, NULL);
+                execute_directories(dirs, DEFAULT_TIMEOUT_USEC, NULL, NULL, NULL, NULL, NULL);
 
         assert_se(chdir(template_lo) == 0);
         assert_se(access("it_works", F_OK) >= 0);
@@ -201,7 +202,7 @@ static void test_execution_order(void) {
         assert_se(chmod(override, 0755) == 0);
         assert_se(chmod(masked, 0755) == 0);
 
-        execute_directories(dirs, DEFAULT_TIMEOUT_USEC, ignore_stdout, ignore_stdout_args, NULL);
+        execute_directories(dirs, DEFAULT_TIMEOUT_USEC, ignore_stdout, ignore_stdout_args, NULL, NULL, NULL);
 
         assert_se(read_full_file(output, &contents, NULL) >= 0);
         assert_se(streq(contents, "30-override\n80-foo\n90-bar\nlast\n"));
@@ -284,7 +285,7 @@ static void test_stdout_gathering(void) {
         assert_se(chmod(name2, 0755) == 0);
         assert_se(chmod(name3, 0755) == 0);
 
-        r = execute_directories(dirs, DEFAULT_TIMEOUT_USEC, gather_stdout, args, NULL);
+        r = execute_directories(dirs, DEFAULT_TIMEOUT_USEC, gather_stdout, args, NULL, NULL, NULL);
         assert_se(r >= 0);
 
         log_info("got: %s", output);
@@ -341,7 +342,7 @@ static void test_environment_gathering(void) {
         assert_se(chmod(name2, 0755) == 0);
         assert_se(chmod(name3, 0755) == 0);
 
-        r = execute_directories(dirs, DEFAULT_TIMEOUT_USEC, gather_environment, args, NULL);
+        r = execute_directories(dirs, DEFAULT_TIMEOUT_USEC, gather_environment, args, NULL, NULL, NULL);
         assert_se(r >= 0);
 
         STRV_FOREACH(p, env)
@@ -353,6 +354,67 @@ static void test_environment_gathering(void) {
         assert_se(endswith(strv_env_get(env, "PATH"), ":/no/such/file"));
 }
 
+static void test_timing(bool serial) {
+        char template[] = "/tmp/test-exec-util.XXXXXXX";
+        const char *dirs[] = {template, NULL};
+        ExecTiming *timings = NULL;
+        size_t n_timings = 0, i;
+        bool seen[70] = {};
+        unsigned k;
+        usec_t begin;
+        const char *p;
+
+        log_info("/* %s(%s) */", __func__, yes_no(serial));
+
+        assert_se(mkdtemp(template));
+
+        /* More binaries than the parallel pool has room for, so that some of them have to wait for a slot */
+        for (k = 0; k < ELEMENTSOF(seen); k++) {
+                char name[16], script[32];
+
+                xsprintf(name, "/%02u-exit", k);
+                xsprintf(script, "#!/bin/sh\nexit %u\n", k);
+
+                p = strjoina(template, name);
+                assert_se(write_string_file(p, script, WRITE_STRING_FILE_CREATE) == 0);
+                assert_se(chmod(p, 0755) == 0);
+        }
+
+        /* A mask is not run, and hence gets no timing record */
+        p = strjoina(template, "/99-masked");
+        assert_se(symlink("/dev/null", p) == 0);
+
+        begin = now(CLOCK_MONOTONIC);
+
+        if (serial)
+                assert_se(execute_directories(dirs, DEFAULT_TIMEOUT_USEC, ignore_stdout, ignore_stdout_args, NULL,
+                                              &timings, &n_timings) >= 0);
+        else
+                assert_se(execute_directories(dirs, DEFAULT_TIMEOUT_USEC, NULL, NULL, NULL,
+                                              &timings, &n_timings) >= 0);
+
+        assert_se(n_timings == ELEMENTSOF(seen));
+
+        for (i = 0; i < n_timings; i++) {
+                assert_se(sscanf(basename(timings[i].path), "%u-exit", &k) == 1);
+                assert_se(k < ELEMENTSOF(seen));
+                assert_se(!seen[k]);
+                assert_se(timings[i].status == (int) k);
+                assert_se(timings[i].start >= begin);
+                assert_se(timings[i].start + timings[i].duration <= now(CLOCK_MONOTONIC));
+
+                /* Serial execution goes in order */
+                if (serial)
+                        assert_se(k == i);
+
+                seen[k] = true;
+        }
+
+        exec_timing_free_many(timings, n_timings);
+
+        (void) rm_rf(template, REMOVE_ROOT|REMOVE_PHYSICAL);
+}
+
 int main(int argc, char *argv[]) {
         log_set_max_level(LOG_DEBUG);
         log_parse_environment();
@@ -363,6 +425,8 @@ int main(int argc, char *argv[]) {
         test_execution_order();
         test_stdout_gathering();
         test_environment_gathering();
+        test_timing(true);
+        test_timing(false);
 
         return 0;
 }
@@ -19,14 +19,17 @@
 ***/
 
 #include <fcntl.h>
+#include <sys/resource.h>
 #include <unistd.h>
 
 #include "alloc-util.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "macro.h"
+#include "process-util.h"
 #include "random-util.h"
 #include "string-util.h"
+#include "time-util.h"
 #include "util.h"
 
 static void test_close_many(void) {
@@ -155,12 +158,67 @@ static void test_acquire_data_fd(void) {
         test_acquire_data_fd_one(ACQUIRE_NO_DEV_NULL|ACQUIRE_NO_MEMFD|ACQUIRE_NO_PIPE|ACQUIRE_NO_TMPFILE);
 }
 
+static void test_close_all_fds(unsigned n) {
+        pid_t pid;
+
+        /* Runs in a child, since this closes all of our fds */
+
+        pid = fork();
+        assert_se(pid >= 0);
+
+        if (pid == 0) {
+                _cleanup_free_ int *fds = NULL;
+                char buf[FORMAT_TIMESPAN_MAX];
+                struct rlimit rl;
+                int keep[4];
+                unsigned i;
+                usec_t ts;
+
+                assert_se(getrlimit(RLIMIT_NOFILE, &rl) >= 0);
+                rl.rlim_cur = MAX(rl.rlim_cur, MIN(rl.rlim_max, (rlim_t) n + 64));
+                assert_se(setrlimit(RLIMIT_NOFILE, &rl) >= 0);
+                if (rl.rlim_cur < n + 64)
+                        n = rl.rlim_cur - 64;
+
+                assert_se(fds = new(int, n));
+                for (i = 0; i < n; i++)
+                        assert_se((fds[i] = open("/dev/null", O_RDONLY|O_CLOEXEC)) >= 0);
+
+                /* Unsorted, with a duplicate, and an fd that will be kept anyway */
+                keep[0] = fds[n - 1];
+                keep[1] = fds[n / 2];
+                keep[2] = fds[n / 2];
+                keep[3] = STDERR_FILENO;
+
+                ts = now(CLOCK_MONOTONIC);
+                assert_se(close_all_fds(keep, ELEMENTSOF(keep)) >= 0);
+                log_info("Closed %u fds in %s", n - 2, format_timespan(buf, sizeof(buf), now(CLOCK_MONOTONIC) - ts, 1));
+
+                for (i = 0; i < n; i++)
+                        if (i == n - 1 || i == n / 2)
+                                assert_se(fcntl(fds[i], F_GETFD) >= 0);
+                        else
+                                assert_se(fcntl(fds[i], F_GETFD) < 0 && errno == EBADF);
+
+                assert_se(fcntl(STDERR_FILENO, F_GETFD) >= 0);
+
+                assert_se(close_all_fds(NULL, 0) >= 0);
+                assert_se(fcntl(fds[n - 1], F_GETFD) < 0 && errno == EBADF);
+                assert_se(fcntl(STDERR_FILENO, F_GETFD) >= 0);
+
+                _exit(EXIT_SUCCESS);
+        }
+
+        assert_se(wait_for_terminate_and_warn("test-close-all-fds", pid, true) == 0);
+}
+
 int main(int argc, char *argv[]) {
         test_close_many();
         test_close_nointr();
         test_same_fd();
         test_open_serialization_fd();
         test_acquire_data_fd();
+        test_close_all_fds(1000);
 
         return 0;
 }
@@ -0,0 +1,190 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "alloc-util.h"
+#include "env-util.h"
+#include "flat-hashmap.h"
+#include "hashmap.h"
+#include "log.h"
+#include "random-util.h"
+#include "string-util.h"
+#include "util.h"
+
+static bool arg_slow = false;
+
+static void test_flat_hashmap_put_get(void) {
+        _cleanup_flat_hashmap_free_ FlatHashmap *m = NULL;
+        char *val = (char*) "val", *other = (char*) "other";
+        void *rkey;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(!flat_hashmap_get(NULL, "key"));
+        assert_se(!flat_hashmap_contains(NULL, "key"));
+        assert_se(flat_hashmap_size(NULL) == 0);
+
+        assert_se(m = flat_hashmap_new(&string_hash_ops));
+        assert_se(flat_hashmap_isempty(m));
+        assert_se(!flat_hashmap_get(m, "key"));
+
+        assert_se(flat_hashmap_put(m, "key", val) == 1);
+        assert_se(flat_hashmap_put(m, "key", val) == 0);
+        assert_se(flat_hashmap_put(m, "key", other) == -EEXIST);
+        assert_se(flat_hashmap_get(m, "key") == val);
+        assert_se(flat_hashmap_contains(m, "key"));
+        assert_se(flat_hashmap_size(m) == 1);
+
+        assert_se(flat_hashmap_update(m, "key", other) == 0);
+        assert_se(flat_hashmap_get(m, "key") == other);
+        assert_se(flat_hashmap_update(m, "nokey", other) == -ENOENT);
+
+        assert_se(flat_hashmap_replace(m, "key", val) == 0);
+        assert_se(flat_hashmap_replace(m, "key2", other) == 1);
+        assert_se(flat_hashmap_get2(m, "key2", &rkey) == other);
+        assert_se(streq(rkey, "key2"));
+        assert_se(flat_hashmap_size(m) == 2);
+
+        assert_se(!flat_hashmap_remove_value(m, "key", other));
+        assert_se(flat_hashmap_remove_value(m, "key", val) == val);
+        assert_se(!flat_hashmap_contains(m, "key"));
+        assert_se(flat_hashmap_remove2(m, "key2", &rkey) == other);
+        assert_se(streq(rkey, "key2"));
+        assert_se(!flat_hashmap_remove(m, "key2"));
+        assert_se(flat_hashmap_isempty(m));
+}
+
+static void test_flat_hashmap_iterate(void) {
+        _cleanup_flat_hashmap_free_ FlatHashmap *m = NULL;
+        unsigned i, n = 0, sum = 0;
+        Iterator it;
+        const void *k;
+        void *v;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(m = flat_hashmap_new(NULL));
+
+        for (i = 1; i <= 100; i++)
+                assert_se(flat_hashmap_put(m, UINT_TO_PTR(i), UINT_TO_PTR(i * 2)) == 1);
+
+        FLAT_HASHMAP_FOREACH_KEY(v, k, m, it) {
+                assert_se(PTR_TO_UINT(v) == PTR_TO_UINT(k) * 2);
+                sum += PTR_TO_UINT(k);
+                n++;
+        }
+        assert_se(n == 100);
+        assert_se(sum == 5050);
+
+        /* Removing the current entry while iterating is allowed */
+        FLAT_HASHMAP_FOREACH_KEY(v, k, m, it)
+                if (PTR_TO_UINT(k) % 2 == 0)
+                        assert_se(flat_hashmap_remove(m, k) == v);
+        assert_se(flat_hashmap_size(m) == 50);
+
+        n = 0;
+        while ((v = flat_hashmap_steal_first(m))) {
+                assert_se(PTR_TO_UINT(v) % 4 == 2);
+                n++;
+        }
+        assert_se(n == 50);
+        assert_se(flat_hashmap_isempty(m));
+        assert_se(!flat_hashmap_first(m));
+
+        FLAT_HASHMAP_FOREACH(v, m, it)
+                assert_not_reached("empty map iterated");
+}
+
+static void test_flat_hashmap_reserve(void) {
+        _cleanup_flat_hashmap_free_ FlatHashmap *m = NULL;
+        unsigned i, n;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(m = flat_hashmap_new(NULL));
+
+        assert_se(flat_hashmap_reserve(m, 1000) == 0);
+        n = flat_hashmap_buckets(m);
+        assert_se(n >= 1000);
+
+        /* Reserved space must be sufficient, no resizing may happen */
+        for (i = 1; i <= 1000; i++)
+                assert_se(flat_hashmap_put(m, UINT_TO_PTR(i), UINT_TO_PTR(i)) == 1);
+        assert_se(flat_hashmap_buckets(m) == n);
+
+        assert_se(flat_hashmap_reserve(m, UINT_MAX) == -ENOMEM);
+}
+
+static void test_flat_hashmap_random(void) {
+        _cleanup_flat_hashmap_free_ FlatHashmap *f = NULL;
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        unsigned i, n = arg_slow ? 1000000 : 20000, range = 2000;
+        Iterator it;
+        void *v;
+
+        log_info("/* %s (%s) */", __func__, arg_slow ? "slow" : "fast");
+
+        /* Run random operations on both a FlatHashmap and a Hashmap, and compare the results. The key range is
+         * small, so that there's plenty of churn and tombstones. */
+
+        assert_se(f = flat_hashmap_new(NULL));
+        assert_se(h = hashmap_new(NULL));
+
+        for (i = 0; i < n; i++) {
+                unsigned k = random_u64() % range + 1;
+
+                switch (random_u64() % 4) {
+
+                case 0:
+                case 1:
+                        assert_se(flat_hashmap_put(f, UINT_TO_PTR(k), UINT_TO_PTR(k)) ==
+                                  hashmap_put(h, UINT_TO_PTR(k), UINT_TO_PTR(k)));
+                        break;
+
+                case 2:
+                        assert_se(flat_hashmap_remove(f, UINT_TO_PTR(k)) == hashmap_remove(h, UINT_TO_PTR(k)));
+                        break;
+
+                case 3:
+                        assert_se(flat_hashmap_get(f, UINT_TO_PTR(k)) == hashmap_get(h, UINT_TO_PTR(k)));
+                        break;
+                }
+
+                assert_se(flat_hashmap_size(f) == hashmap_size(h));
+        }
+
+        FLAT_HASHMAP_FOREACH(v, f, it)
+                assert_se(hashmap_remove(h, v) == v);
+        assert_se(hashmap_isempty(h));
+}
+
+int main(int argc, char *argv[]) {
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        arg_slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+
+        test_flat_hashmap_put_get();
+        test_flat_hashmap_iterate();
+        test_flat_hashmap_reserve();
+        test_flat_hashmap_random();
+
+        return 0;
+}
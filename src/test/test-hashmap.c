@@ -18,9 +18,18 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include "alloc-util.h"
+#include "env-util.h"
+#include "flat-hashmap.h"
 #include "hashmap.h"
+#include "log.h"
+#include "string-util.h"
+#include "strv.h"
+#include "time-util.h"
 #include "util.h"
 
+static bool arg_slow = false;
+
 void test_hashmap_funcs(void);
 void test_ordered_hashmap_funcs(void);
 
@@ -57,7 +66,129 @@ static void test_string_compare_func(void) {
         assert_se(string_compare_func("fred", "fred") == 0);
 }
 
+static void test_string_hashmap_benchmark(void) {
+        _cleanup_hashmap_free_ Hashmap *m = NULL;
+        _cleanup_strv_free_ char **names = NULL;
+        unsigned n = arg_slow ? 100000 : 1000, rounds = 10, i, j;
+        usec_t t;
+
+        log_info("/* %s (%s) */", __func__, arg_slow ? "slow" : "fast");
+
+        /* Unit names and cgroup paths are the typical string keys hashed over and over again in PID1 */
+        names = new0(char*, n + 1);
+        assert_se(names);
+        for (i = 0; i < n; i++)
+                assert_se(asprintf(names + i, "/system.slice/benchmark-%u.service", i) >= 0);
+
+        assert_se(m = hashmap_new(&string_hash_ops));
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++)
+                assert_se(hashmap_put(m, names[i], names[i]) == 1);
+        t = now(CLOCK_MONOTONIC) - t;
+        log_info("hashmap_put(): %u entries, %.1f ns/op", n, (double) t * NSEC_PER_USEC / n);
+
+        t = now(CLOCK_MONOTONIC);
+        for (j = 0; j < rounds; j++)
+                for (i = 0; i < n; i++)
+                        assert_se(hashmap_get(m, names[i]) == names[i]);
+        t = now(CLOCK_MONOTONIC) - t;
+        log_info("hashmap_get(): %u entries, %.1f ns/op", n, (double) t * NSEC_PER_USEC / (n * rounds));
+
+        /* Look for the last entry, so that the whole list is walked */
+        t = now(CLOCK_MONOTONIC);
+        for (j = 0; j < rounds; j++)
+                assert_se(strv_find(names, names[n - 1]) == names[n - 1]);
+        t = now(CLOCK_MONOTONIC) - t;
+        log_info("strv_find(): %u entries, %.1f ns/entry", n, (double) t * NSEC_PER_USEC / (n * rounds));
+}
+
+static void test_flat_hashmap_benchmark(void) {
+        _cleanup_flat_hashmap_free_ FlatHashmap *f = NULL;
+        _cleanup_hashmap_free_ Hashmap *m = NULL;
+        _cleanup_strv_free_ char **names = NULL, **lookup = NULL, **missing = NULL;
+        unsigned n = arg_slow ? 100000 : 1000, rounds = 10, i, j;
+        usec_t t;
+
+        log_info("/* %s (%s) */", __func__, arg_slow ? "slow" : "fast");
+
+        /* Compare Hashmap and FlatHashmap with unit names as keys. Lookups are done with copies of the keys, as
+         * in real life, so that the key comparison function has to do actual work. */
+        names = new0(char*, n + 1);
+        lookup = new0(char*, n + 1);
+        missing = new0(char*, n + 1);
+        assert_se(names && lookup && missing);
+        for (i = 0; i < n; i++) {
+                assert_se(asprintf(names + i, "benchmark-%u.service", i) >= 0);
+                assert_se(lookup[i] = strdup(names[i]));
+                assert_se(asprintf(missing + i, "benchmark-%u.socket", i) >= 0);
+        }
+
+        assert_se(m = hashmap_new(&string_hash_ops));
+        assert_se(f = flat_hashmap_new(&string_hash_ops));
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++)
+                assert_se(hashmap_put(m, names[i], names[i]) == 1);
+        t = now(CLOCK_MONOTONIC) - t;
+        log_info("hashmap_put():           %6.1f ns/op", (double) t * NSEC_PER_USEC / n);
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++)
+                assert_se(flat_hashmap_put(f, names[i], names[i]) == 1);
+        t = now(CLOCK_MONOTONIC) - t;
+        log_info("flat_hashmap_put():      %6.1f ns/op", (double) t * NSEC_PER_USEC / n);
+
+        t = now(CLOCK_MONOTONIC);
+        for (j = 0; j < rounds; j++)
+                for (i = 0; i < n; i++)
+                        assert_se(hashmap_get(m, lookup[i]) == names[i]);
+        t = now(CLOCK_MONOTONIC) - t;
+        log_info("hashmap_get(), hit:      %6.1f ns/op", (double) t * NSEC_PER_USEC / (n * rounds));
+
+        t = now(CLOCK_MONOTONIC);
+        for (j = 0; j < rounds; j++)
+                for (i = 0; i < n; i++)
+                        assert_se(flat_hashmap_get(f, lookup[i]) == names[i]);
+        t = now(CLOCK_MONOTONIC) - t;
+        log_info("flat_hashmap_get(), hit: %6.1f ns/op", (double) t * NSEC_PER_USEC / (n * rounds));
+
+        t = now(CLOCK_MONOTONIC);
+        for (j = 0; j < rounds; j++)
+                for (i = 0; i < n; i++)
+                        assert_se(!hashmap_get(m, missing[i]));
+        t = now(CLOCK_MONOTONIC) - t;
+        log_info("hashmap_get(), miss:     %6.1f ns/op", (double) t * NSEC_PER_USEC / (n * rounds));
+
+        t = now(CLOCK_MONOTONIC);
+        for (j = 0; j < rounds; j++)
+                for (i = 0; i < n; i++)
+                        assert_se(!flat_hashmap_get(f, missing[i]));
+        t = now(CLOCK_MONOTONIC) - t;
+        log_info("flat_hashmap_get(), miss:%6.1f ns/op", (double) t * NSEC_PER_USEC / (n * rounds));
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++)
+                assert_se(hashmap_remove(m, lookup[i]) == names[i]);
+        t = now(CLOCK_MONOTONIC) - t;
+        log_info("hashmap_remove():        %6.1f ns/op", (double) t * NSEC_PER_USEC / n);
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++)
+                assert_se(flat_hashmap_remove(f, lookup[i]) == names[i]);
+        t = now(CLOCK_MONOTONIC) - t;
+        log_info("flat_hashmap_remove():   %6.1f ns/op", (double) t * NSEC_PER_USEC / n);
+}
+
 int main(int argc, const char *argv[]) {
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        arg_slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+
         test_hashmap_funcs();
         test_ordered_hashmap_funcs();
 
@@ -65,4 +196,6 @@ int main(int argc, const char *argv[]) {
         test_uint64_compare_func();
         test_trivial_compare_func();
         test_string_compare_func();
+        test_string_hashmap_benchmark();
+        test_flat_hashmap_benchmark();
 }
@@ -0,0 +1,188 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+
+#include "env-util.h"
+#include "log.h"
+#include "mount-table.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "time-util.h"
+#include "util.h"
+
+static bool arg_slow = false;
+
+static void scan(MountTable *t, unsigned n_added, unsigned n_removed) {
+        assert_se(mount_table_end(t) >= 0);
+        assert_se(t->n_added == n_added);
+        assert_se(t->n_removed == n_removed);
+}
+
+static void test_changes(void) {
+        _cleanup_mount_table_free_ MountTable *t = NULL;
+        MountEntry *e;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(t = mount_table_new());
+        assert_se(!mount_table_find_where(t, "/"));
+        assert_se(!mount_table_has_what(t, "/dev/sda1"));
+
+        mount_table_begin(t);
+        assert_se(mount_table_add(t, 20, "/dev/sda1", "/", "rw", "ext4") == 1);
+        assert_se(mount_table_add(t, 21, "tmpfs", "/tmp", "rw", "tmpfs") == 1);
+        assert_se(mount_table_add(t, 22, "/dev/sda2", "/srv/with\\040space", "rw", "xfs") == 1);
+        scan(t, 3, 0);
+        assert_se(mount_table_size(t) == 3);
+
+        /* Nothing changed */
+        mount_table_begin(t);
+        assert_se(mount_table_add(t, 20, "/dev/sda1", "/", "rw", "ext4") == 0);
+        assert_se(mount_table_add(t, 21, "tmpfs", "/tmp", "rw", "tmpfs") == 0);
+        assert_se(mount_table_add(t, 22, "/dev/sda2", "/srv/with\\040space", "rw", "xfs") == 0);
+        scan(t, 0, 0);
+
+        /* A remount is reported as removal of the old entry and addition of the new one */
+        mount_table_begin(t);
+        assert_se(mount_table_add(t, 20, "/dev/sda1", "/", "rw", "ext4") == 0);
+        assert_se(mount_table_add(t, 21, "tmpfs", "/tmp", "ro", "tmpfs") == 1);
+        assert_se(mount_table_add(t, 22, "/dev/sda2", "/srv/with\\040space", "rw", "xfs") == 0);
+        scan(t, 1, 1);
+        assert_se(streq(t->removed[0]->options, "rw"));
+        assert_se(t->added[0] == mount_table_find_where(t, "/tmp"));
+        assert_se(streq(t->added[0]->options, "ro"));
+
+        /* Over-mount /tmp, with the same device as / */
+        mount_table_begin(t);
+        assert_se(mount_table_add(t, 20, "/dev/sda1", "/", "rw", "ext4") == 0);
+        assert_se(mount_table_add(t, 21, "tmpfs", "/tmp", "ro", "tmpfs") == 0);
+        assert_se(mount_table_add(t, 22, "/dev/sda2", "/srv/with\\040space", "rw", "xfs") == 0);
+        assert_se(mount_table_add(t, 23, "/dev/sda1", "/tmp", "rw", "ext4") == 1);
+        scan(t, 1, 0);
+        assert_se(e = mount_table_find_where(t, "/tmp"));
+        assert_se(e->id == 23);
+
+        /* Unmount / (in theory), the device is still in use on /tmp */
+        mount_table_begin(t);
+        assert_se(mount_table_add(t, 21, "tmpfs", "/tmp", "ro", "tmpfs") == 0);
+        assert_se(mount_table_add(t, 22, "/dev/sda2", "/srv/with\\040space", "rw", "xfs") == 0);
+        assert_se(mount_table_add(t, 23, "/dev/sda1", "/tmp", "rw", "ext4") == 0);
+        scan(t, 0, 1);
+        assert_se(t->removed[0]->id == 20);
+        assert_se(!mount_table_find_where(t, "/"));
+        assert_se(mount_table_has_what(t, "/dev/sda1"));
+
+        /* Unmount the lower /tmp, and reuse its ID for a new mount */
+        mount_table_begin(t);
+        assert_se(mount_table_add(t, 21, "/dev/sda3", "/home", "rw", "ext4") == 1);
+        assert_se(mount_table_add(t, 22, "/dev/sda2", "/srv/with\\040space", "rw", "xfs") == 0);
+        assert_se(mount_table_add(t, 23, "/dev/sda1", "/tmp", "rw", "ext4") == 0);
+        scan(t, 1, 1);
+        assert_se(streq(t->removed[0]->where, "/tmp"));
+        assert_se(e = mount_table_find_where(t, "/tmp"));
+        assert_se(e->id == 23);
+        assert_se(e = mount_table_find_where(t, "/home"));
+        assert_se(e->id == 21);
+        assert_se(!mount_table_has_what(t, "tmpfs"));
+
+        /* Unmount everything */
+        mount_table_begin(t);
+        scan(t, 0, 3);
+        assert_se(mount_table_size(t) == 0);
+        assert_se(!mount_table_find_where(t, "/tmp"));
+        assert_se(!mount_table_has_what(t, "/dev/sda1"));
+
+        /* A cleared table reports everything as new */
+        mount_table_begin(t);
+        assert_se(mount_table_add(t, 20, "/dev/sda1", "/", "rw", "ext4") == 1);
+        scan(t, 1, 0);
+        mount_table_clear(t);
+        mount_table_begin(t);
+        assert_se(mount_table_add(t, 20, "/dev/sda1", "/", "rw", "ext4") == 1);
+        scan(t, 1, 0);
+}
+
+static void fill(MountTable *t, unsigned n, unsigned changed) {
+        unsigned k;
+
+        mount_table_begin(t);
+
+        for (k = 0; k < n; k++) {
+                char what[DECIMAL_STR_MAX(unsigned) + 16], where[DECIMAL_STR_MAX(unsigned) + 32];
+
+                xsprintf(what, "/dev/loop%u", k);
+                xsprintf(where, "/var/lib/machines/mnt\\040%u", k);
+
+                assert_se(mount_table_add(t, k + 1, what, where,
+                                          k == changed ? "ro,relatime" : "rw,relatime",
+                                          "ext4") >= 0);
+        }
+
+        assert_se(mount_table_end(t) >= 0);
+}
+
+static void test_benchmark(unsigned n) {
+        _cleanup_mount_table_free_ MountTable *t = NULL;
+        unsigned k, rounds = arg_slow ? 100 : 10;
+        char buf[FORMAT_TIMESPAN_MAX];
+        usec_t ts, full, incremental;
+
+        log_info("/* %s(%u) */", __func__, n);
+
+        assert_se(t = mount_table_new());
+
+        /* Compare scans of a table in which each time one entry is remounted read-only, and the one from the
+         * previous round back read-write: once from scratch, i.e. processing all entries, and once incrementally. */
+
+        ts = now(CLOCK_MONOTONIC);
+        for (k = 0; k < rounds; k++) {
+                mount_table_clear(t);
+                fill(t, n, k);
+                assert_se(t->n_added == n);
+        }
+        full = (now(CLOCK_MONOTONIC) - ts) / rounds;
+
+        ts = now(CLOCK_MONOTONIC);
+        for (k = 0; k < rounds; k++) {
+                fill(t, n, rounds + k);
+                assert_se(t->n_added == 2);
+                assert_se(t->n_removed == 2);
+        }
+        incremental = (now(CLOCK_MONOTONIC) - ts) / rounds;
+
+        log_info("%u mounts: full scan %s", n, format_timespan(buf, sizeof(buf), full, 1));
+        log_info("%u mounts: incremental scan %s", n, format_timespan(buf, sizeof(buf), incremental, 1));
+}
+
+int main(int argc, char *argv[]) {
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        arg_slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+
+        test_changes();
+        test_benchmark(10000);
+        if (arg_slow)
+                test_benchmark(100000);
+
+        return 0;
+}
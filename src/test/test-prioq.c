@@ -49,6 +49,8 @@ static void test_unsigned(void) {
         q = prioq_new(trivial_compare_func);
         assert_se(q);
 
+        assert_se(prioq_reserve(q, ELEMENTSOF(buffer)) >= 0);
+
         for (i = 0; i < ELEMENTSOF(buffer); i++) {
                 unsigned u;
 
@@ -24,6 +24,7 @@
 #include <sys/eventfd.h>
 #include <sys/mman.h>
 #include <sys/personality.h>
+#include <sys/prctl.h>
 #include <sys/shm.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -38,6 +39,7 @@
 #include "seccomp-util.h"
 #include "set.h"
 #include "string-util.h"
+#include "time-util.h"
 #include "util.h"
 #include "virt.h"
 
@@ -676,6 +678,81 @@ static void test_filter_sets_ordered(void) {
         }
 }
 
+static void test_filter_cache(void) {
+        pid_t pid;
+
+        if (!is_seccomp_available())
+                return;
+        if (geteuid() != 0)
+                return;
+
+        pid = fork();
+        assert_se(pid >= 0);
+
+        if (pid == 0) {
+                static const int sets[] = {
+                        SYSCALL_FILTER_SET_CPU_EMULATION,
+                        SYSCALL_FILTER_SET_DEBUG,
+                        SYSCALL_FILTER_SET_KEYRING,
+                        SYSCALL_FILTER_SET_MODULE,
+                        SYSCALL_FILTER_SET_MOUNT,
+                        SYSCALL_FILTER_SET_OBSOLETE,
+                        SYSCALL_FILTER_SET_RAW_IO,
+                        SYSCALL_FILTER_SET_REBOOT,
+                        SYSCALL_FILTER_SET_SWAP,
+                };
+                _cleanup_hashmap_free_ Hashmap *s = NULL;
+                char buf[FORMAT_TIMESPAN_MAX];
+                usec_t ts, compile, install;
+                unsigned k;
+
+                assert_se(s = hashmap_new(NULL));
+                for (k = 0; k < ELEMENTSOF(sets); k++)
+                        assert_se(seccomp_filter_set_add(s, true, syscall_filter_sets + sets[k]) >= 0);
+#if SCMP_SYS(access) >= 0
+                assert_se(hashmap_put(s, UINT32_TO_PTR(__NR_access + 1), INT_TO_PTR(-1)) >= 0);
+#else
+                assert_se(hashmap_put(s, UINT32_TO_PTR(__NR_faccessat + 1), INT_TO_PTR(-1)) >= 0);
+#endif
+
+                /* In compile only mode nothing is installed */
+                seccomp_set_compile_only(true);
+
+                ts = now(CLOCK_MONOTONIC);
+                assert_se(seccomp_load_syscall_filter_set_raw(SCMP_ACT_ALLOW, s, SCMP_ACT_ERRNO(EUCLEAN)) >= 0);
+                compile = now(CLOCK_MONOTONIC) - ts;
+
+                assert_se(seccomp_restrict_realtime() >= 0);
+
+                seccomp_set_compile_only(false);
+
+                assert_se(prctl(PR_GET_SECCOMP, 0, 0, 0, 0) == 0);
+                assert_se(access("/", F_OK) >= 0);
+
+                /* Now the cached filters are installed */
+                ts = now(CLOCK_MONOTONIC);
+                assert_se(seccomp_load_syscall_filter_set_raw(SCMP_ACT_ALLOW, s, SCMP_ACT_ERRNO(EUCLEAN)) >= 0);
+                install = now(CLOCK_MONOTONIC) - ts;
+
+                assert_se(prctl(PR_GET_SECCOMP, 0, 0, 0, 0) == 2);
+                assert_se(access("/", F_OK) < 0);
+                assert_se(errno == EUCLEAN);
+
+                assert_se(seccomp_restrict_realtime() >= 0);
+                assert_se(sched_setscheduler(0, SCHED_FIFO, &(struct sched_param) { .sched_priority = 1 }) < 0);
+                assert_se(errno == EPERM);
+
+                log_info("%u system calls: compiled in %s", hashmap_size(s), format_timespan(buf, sizeof(buf), compile, 1));
+                log_info("%u system calls: installed from cache in %s", hashmap_size(s), format_timespan(buf, sizeof(buf), install, 1));
+
+                seccomp_flush_filter_cache();
+
+                _exit(EXIT_SUCCESS);
+        }
+
+        assert_se(wait_for_terminate_and_warn("filtercacheseccomp", pid, true) == EXIT_SUCCESS);
+}
+
 int main(int argc, char *argv[]) {
 
         log_set_max_level(LOG_DEBUG);
@@ -694,6 +771,7 @@ int main(int argc, char *argv[]) {
         test_load_syscall_filter_set_raw();
         test_lock_personality();
         test_filter_sets_ordered();
+        test_filter_cache();
 
         return 0;
 }
@@ -0,0 +1,239 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "env-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "io-util.h"
+#include "log.h"
+#include "serialize.h"
+#include "string-util.h"
+#include "time-util.h"
+#include "util.h"
+
+static bool arg_slow = false;
+
+static const char state[] =
+        "current-job-id=42\n"
+        "taint-usr=no\n"
+        "env=FOO=bar\\nbaz\n"
+        "\n"
+        "foo.service\n"
+        "  state=running  \n"
+        "empty=\n"
+        "job\n"
+        "job-id=7\n"
+        "\n"
+        "state=dead\n"
+        "\n"
+        "bar.service\n"
+        "\n";
+
+static const char *const items[] = {
+        "current-job-id", "42",
+        "taint-usr", "no",
+        "env", "FOO=bar\\nbaz",
+        "", "",
+        "foo.service", "",
+        "state", "running",
+        "empty", "",
+        "job", "",
+        "job-id", "7",
+        "", "",
+        "state", "dead",
+        "", "",
+        "bar.service", "",
+        "", "",
+        NULL
+};
+
+static int open_state(bool binary, FILE **ret) {
+        _cleanup_close_ int fd = -1;
+        _cleanup_fclose_ FILE *f = NULL;
+
+        fd = open_serialization_fd("test-serialize");
+        assert_se(fd >= 0);
+
+        if (binary) {
+                assert_se(serialize_open_binary(fd, &f) >= 0);
+                fputs(state, f);
+                assert_se(fclose(f) == 0);
+                f = NULL;
+        } else
+                assert_se(loop_write(fd, state, strlen(state), false) >= 0);
+
+        assert_se(lseek(fd, 0, SEEK_SET) == 0);
+        assert_se(f = fdopen(fd, "re"));
+        fd = -1;
+
+        *ret = f;
+        f = NULL;
+
+        return 0;
+}
+
+static void test_read(bool binary) {
+        _cleanup_deserializer_free_ Deserializer *d = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        const char *key, *value;
+        unsigned i;
+
+        log_info("/* %s(%s) */", __func__, binary ? "binary" : "text");
+
+        assert_se(open_state(binary, &f) >= 0);
+        assert_se(deserializer_new(f, &d) >= 0);
+        assert_se(deserializer_is_binary(d) == binary);
+
+        for (i = 0; items[i]; i += 2) {
+                assert_se(deserializer_read(d, &key, &value) > 0);
+                assert_se(streq(key, items[i]));
+                assert_se(streq(value, items[i+1]));
+        }
+
+        assert_se(deserializer_read(d, &key, &value) == 0);
+}
+
+static void test_bad_magic(void) {
+        _cleanup_deserializer_free_ Deserializer *d = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        static const char bad[] = { 0, 'S', 'D', 'S', 'T', 'A', 'T', 'E', SERIALIZE_BINARY_VERSION + 1 };
+        _cleanup_close_ int fd = -1;
+
+        log_info("/* %s */", __func__);
+
+        fd = open_serialization_fd("test-serialize");
+        assert_se(fd >= 0);
+        assert_se(loop_write(fd, bad, sizeof(bad), false) >= 0);
+        assert_se(lseek(fd, 0, SEEK_SET) == 0);
+        assert_se(f = fdopen(fd, "re"));
+        fd = -1;
+
+        assert_se(deserializer_new(f, &d) == -EPROTONOSUPPORT);
+}
+
+static void test_benchmark_one(unsigned n_units, bool binary) {
+        _cleanup_deserializer_free_ Deserializer *d = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_close_ int fd = -1;
+        const char *key, *value;
+        unsigned i, n_items = 0;
+        usec_t t0, t1, t2;
+        off_t size;
+
+        fd = open_serialization_fd("test-serialize");
+        assert_se(fd >= 0);
+
+        t0 = now(CLOCK_MONOTONIC);
+
+        if (binary)
+                assert_se(serialize_open_binary(fd, &f) >= 0);
+        else
+                assert_se(f = fdopen(fcntl(fd, F_DUPFD_CLOEXEC, 3), "we"));
+
+        /* Roughly what a service unit serializes */
+        for (i = 0; i < n_units; i++) {
+                fprintf(f, "unit-%u.service\n", i);
+                fputs("state=running\n"
+                      "result=success\n"
+                      "reload-result=success\n"
+                      "main-pid-known=yes\n"
+                      "bus-name-good=no\n"
+                      "bus-name-owner=\n"
+                      "main-exec-status-start=179632 36279734592\n"
+                      "main-exec-status-pid=1234\n"
+                      "state-change-timestamp=1516718227138273 36279752038\n"
+                      "inactive-exit-timestamp=1516718227116418 36279730183\n"
+                      "active-enter-timestamp=1516718227138273 36279752038\n"
+                      "condition-timestamp=1516718227115543 36279729307\n"
+                      "assert-timestamp=1516718227115546 36279729310\n"
+                      "condition-result=yes\n"
+                      "assert-result=yes\n"
+                      "transient=no\n"
+                      "exported-invocation-id=yes\n"
+                      "exported-log-level-max=no\n"
+                      "exported-log-extra-fields=no\n"
+                      "cpu-usage-base=0\n"
+                      "cpu-usage-last=84936000\n", f);
+                fprintf(f, "main-pid=%u\n"
+                        "cgroup=/system.slice/unit-%u.service\n"
+                        "cgroup-realized=yes\n"
+                        "cgroup-bpf-realized=0\n"
+                        "invocation-id=1ea8a6c1a4a44a2c9c7d1e1c4a1a5a%02x\n"
+                        "ip-accounting-ingress-bytes=0\n"
+                        "ip-accounting-egress-bytes=0\n"
+                        "\n", i + 1000, i, i % 256);
+        }
+
+        assert_se(fclose(f) == 0);
+        f = NULL;
+
+        t1 = now(CLOCK_MONOTONIC);
+
+        size = lseek(fd, 0, SEEK_END);
+        assert_se(size > 0);
+        assert_se(lseek(fd, 0, SEEK_SET) == 0);
+        assert_se(f = fdopen(fd, "re"));
+        fd = -1;
+
+        assert_se(deserializer_new(f, &d) >= 0);
+        while (deserializer_read(d, &key, &value) > 0)
+                n_items++;
+        assert_se(n_items == n_units * 30);
+
+        t2 = now(CLOCK_MONOTONIC);
+
+        log_info("%6u units, %s: %7.1f ms write, %7.1f ms read, %5.1f MiB",
+                 n_units, binary ? "binary" : "text  ",
+                 (double) (t1 - t0) / USEC_PER_MSEC, (double) (t2 - t1) / USEC_PER_MSEC,
+                 (double) size / 1024 / 1024);
+}
+
+static void test_benchmark(void) {
+        static const unsigned n_units[] = { 1000, 10000, 30000 };
+        unsigned i;
+
+        log_info("/* %s */", __func__);
+
+        for (i = 0; i < ELEMENTSOF(n_units); i++) {
+                if (!arg_slow && n_units[i] > 1000)
+                        break;
+
+                test_benchmark_one(n_units[i], false);
+                test_benchmark_one(n_units[i], true);
+        }
+}
+
+int main(int argc, char *argv[]) {
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        arg_slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+
+        test_read(false);
+        test_read(true);
+        test_bad_magic();
+        test_benchmark();
+
+        return 0;
+}
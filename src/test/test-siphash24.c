@@ -18,11 +18,16 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include "env-util.h"
+#include "log.h"
 #include "siphash24.h"
+#include "time-util.h"
 #include "util.h"
 
 #define ITERATIONS 10000000ULL
 
+static bool arg_slow = false;
+
 static void do_test(const uint8_t *in, size_t len, const uint8_t *key) {
         struct siphash state = {};
         uint64_t out;
@@ -103,6 +108,35 @@ static void test_short_hashes(void) {
         }
 }
 
+static void test_benchmark(void) {
+        const uint8_t key[16] = { 0x22, 0x24, 0x41, 0x22, 0x55, 0x77, 0x88, 0x07,
+                                  0x23, 0x09, 0x23, 0x14, 0x0c, 0x33, 0x0e, 0x0f};
+        static const size_t lengths[] = { 8, 24, 64, 256 };
+        unsigned long long n = arg_slow ? ITERATIONS : ITERATIONS / 1000;
+        uint8_t buf[256];
+        unsigned k;
+
+        for (k = 0; k < sizeof buf; k++)
+                buf[k] = k;
+
+        for (k = 0; k < ELEMENTSOF(lengths); k++) {
+                uint64_t sum = 0;
+                unsigned long long i;
+                usec_t t;
+
+                t = now(CLOCK_MONOTONIC);
+                for (i = 0; i < n; i++) {
+                        /* Vary the input a bit, so that the compiler can't hoist the call out of the loop */
+                        buf[0] = i;
+                        sum += siphash24(buf, lengths[k], key);
+                }
+                t = now(CLOCK_MONOTONIC) - t;
+
+                log_info("siphash24, %3zu bytes: %6.1f ns/hash (%016" PRIx64 ")",
+                         lengths[k], (double) t * NSEC_PER_USEC / n, sum);
+        }
+}
+
 /* see https://131002.net/siphash/siphash.pdf, Appendix A */
 int main(int argc, char *argv[]) {
         const uint8_t in[15]  = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
@@ -110,6 +144,13 @@ int main(int argc, char *argv[]) {
         const uint8_t key[16] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
                                   0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
         uint8_t in_buf[20];
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        arg_slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
 
         /* Test with same input but different alignments. */
         memcpy(in_buf, in, sizeof(in));
@@ -122,4 +163,5 @@ int main(int argc, char *argv[]) {
         do_test(in_buf + 4, sizeof(in), key);
 
         test_short_hashes();
+        test_benchmark();
 }
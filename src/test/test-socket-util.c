@@ -355,7 +355,7 @@ static void test_in_addr_ifindex_from_string_auto(void) {
         assert_se(in_addr_ifindex_from_string_auto("fe80::19%thisinterfacecantexist", &family, &ua, &ifindex) == -ENODEV);
 }
 
-static void *connect_thread(void *arg) {
+static void connect_thread(void *arg) {
         union sockaddr_union *sa = arg;
         _cleanup_close_ int fd = -1;
 
@@ -363,8 +363,6 @@ static void *connect_thread(void *arg) {
         assert_se(fd >= 0);
 
         assert_se(connect(fd, &sa->sa, sizeof(sa->in)) == 0);
-
-        return NULL;
 }
 
 static void test_nameinfo_pretty(void) {
@@ -0,0 +1,243 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "manager.h"
+#include "rm-rf.h"
+#include "service.h"
+#include "socket-util.h"
+#include "socket.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "time-util.h"
+#include "unit.h"
+
+#define N_WORKERS 3U
+
+static void run_until(Manager *m, bool (*done)(Socket *s, Unit **workers), Socket *s, Unit **workers) {
+        usec_t ts = now(CLOCK_MONOTONIC);
+
+        while (!done(s, workers)) {
+                assert_se(sd_event_run(m->event, 100 * USEC_PER_MSEC) >= 0);
+                assert_se(ts + 2 * USEC_PER_MINUTE >= now(CLOCK_MONOTONIC));
+        }
+}
+
+static bool is_running(Unit *u) {
+        return SERVICE(u)->state == SERVICE_RUNNING && SERVICE(u)->main_pid > 0;
+}
+
+static bool is_dead(Unit *u) {
+        return IN_SET(SERVICE(u)->state, SERVICE_DEAD, SERVICE_FAILED) && !u->job;
+}
+
+static bool pool_running(Socket *s, Unit **workers) {
+        unsigned i;
+
+        for (i = 0; i < N_WORKERS; i++)
+                if (!is_running(workers[i]))
+                        return false;
+
+        return s->state == SOCKET_RUNNING;
+}
+
+static bool workers_dead(Socket *s, Unit **workers) {
+        unsigned i;
+
+        for (i = 0; i < N_WORKERS; i++)
+                if (!is_dead(workers[i]))
+                        return false;
+
+        return true;
+}
+
+static bool pool_gone(Socket *s, Unit **workers) {
+        return workers_dead(s, workers) && s->state == SOCKET_LISTENING;
+}
+
+static bool socket_failed(Socket *s, Unit **workers) {
+        return s->state == SOCKET_FAILED;
+}
+
+static void connect_and_accept(Socket *s, const char *path) {
+        union sockaddr_union sa = {
+                .un.sun_family = AF_UNIX,
+        };
+        _cleanup_close_ int fd = -1, cfd = -1;
+
+        /* Connects to the socket, which triggers the pool, and then takes the connection off the queue, like a
+         * worker would do, so that it doesn't trigger the socket again once it returns to listening */
+
+        strncpy(sa.un.sun_path, path, sizeof(sa.un.sun_path));
+
+        fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+        assert_se(fd >= 0);
+        assert_se(connect(fd, &sa.sa, SOCKADDR_UN_LEN(sa.un)) >= 0);
+
+        assert_se(s->ports);
+        cfd = accept4(s->ports->fd, NULL, NULL, SOCK_CLOEXEC);
+        assert_se(cfd >= 0);
+}
+
+static void kill_and_wait_for_restart(Manager *m, Socket *s, Unit *w) {
+        usec_t ts = now(CLOCK_MONOTONIC);
+        pid_t pid;
+
+        pid = SERVICE(w)->main_pid;
+        assert_se(pid > 0);
+        assert_se(kill(pid, SIGKILL) >= 0);
+
+        while (!is_running(w) || SERVICE(w)->main_pid == pid) {
+                assert_se(sd_event_run(m->event, 100 * USEC_PER_MSEC) >= 0);
+                assert_se(ts + 2 * USEC_PER_MINUTE >= now(CLOCK_MONOTONIC));
+        }
+}
+
+static void test_socket_workers(Manager *m, const char *path) {
+        Unit *u, *workers[N_WORKERS];
+        unsigned i;
+        Socket *s;
+        usec_t ts;
+        pid_t pid;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(manager_load_unit(m, "test-workers.socket", NULL, NULL, &u) >= 0);
+        assert_se(u->load_state == UNIT_LOADED);
+        s = SOCKET(u);
+
+        /* The pool is hooked up at load time */
+        for (i = 0; i < N_WORKERS; i++) {
+                char name[sizeof("test-workers@worker.service") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "test-workers@worker%u.service", i);
+                workers[i] = manager_get_unit(m, name);
+                assert_se(workers[i]);
+                assert_se(unit_dependency_set_contains(u->dependencies[UNIT_TRIGGERS], workers[i]));
+        }
+
+        assert_se(manager_add_job(m, JOB_START, u, JOB_REPLACE, NULL, NULL) >= 0);
+        ts = now(CLOCK_MONOTONIC);
+        while (s->state != SOCKET_LISTENING) {
+                assert_se(sd_event_run(m->event, 100 * USEC_PER_MSEC) >= 0);
+                assert_se(ts + 2 * USEC_PER_MINUTE >= now(CLOCK_MONOTONIC));
+        }
+
+        for (i = 0; i < N_WORKERS; i++)
+                assert_se(is_dead(workers[i]));
+
+        /* The first connection starts the whole pool */
+        connect_and_accept(s, path);
+        run_until(m, pool_running, s, workers);
+
+        /* A worker that goes away while the others are still running is replaced */
+        pid = SERVICE(workers[1])->main_pid;
+        kill_and_wait_for_restart(m, s, workers[0]);
+        assert_se(SERVICE(workers[1])->main_pid == pid);
+        assert_se(s->state == SOCKET_RUNNING);
+
+        /* Once the whole pool is gone, the socket goes back to listening, without starting the pool again */
+        for (i = 0; i < N_WORKERS; i++)
+                assert_se(manager_add_job(m, JOB_STOP, workers[i], JOB_REPLACE, NULL, NULL) >= 0);
+        run_until(m, pool_gone, s, workers);
+
+        /* And the next connection starts it anew */
+        connect_and_accept(s, path);
+        run_until(m, pool_running, s, workers);
+
+        /* That was the third trigger, which is the configured limit, hence replacing a worker once more fails the
+         * socket */
+        assert_se(kill(SERVICE(workers[0])->main_pid, SIGKILL) >= 0);
+        run_until(m, socket_failed, s, workers);
+        assert_se(s->result == SOCKET_FAILURE_TRIGGER_LIMIT_HIT);
+
+        /* Clean up what's left of the pool */
+        for (i = 0; i < N_WORKERS; i++)
+                if (!is_dead(workers[i]))
+                        assert_se(manager_add_job(m, JOB_STOP, workers[i], JOB_REPLACE, NULL, NULL) >= 0);
+        run_until(m, workers_dead, s, workers);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL, *unit_dir = NULL;
+        _cleanup_free_ char *contents = NULL;
+        Manager *m = NULL;
+        const char *p, *path;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        /* It is needed otherwise cgroup creation fails */
+        if (getuid() != 0) {
+                log_notice("Skipping test: not root");
+                return EXIT_TEST_SKIP;
+        }
+
+        r = enter_cgroup_subroot();
+        if (r == -ENOMEDIUM) {
+                log_notice_errno(r, "Skipping test: cgroupfs not available");
+                return EXIT_TEST_SKIP;
+        }
+
+        assert_se(mkdtemp_malloc("/tmp/test-socket-workers.XXXXXX", &unit_dir) >= 0);
+        path = strjoina(unit_dir, "/socket");
+
+        assert_se(asprintf(&contents,
+                           "[Socket]\n"
+                           "ListenStream=%s\n"
+                           "Accept=yes\n"
+                           "Workers=%u\n"
+                           "TriggerLimitIntervalSec=1h\n"
+                           "TriggerLimitBurst=3\n",
+                           path, N_WORKERS) >= 0);
+        p = strjoina(unit_dir, "/test-workers.socket");
+        assert_se(write_string_file(p, contents, WRITE_STRING_FILE_CREATE) >= 0);
+
+        p = strjoina(unit_dir, "/test-workers@.service");
+        assert_se(write_string_file(p,
+                                    "[Service]\n"
+                                    "ExecStart=/bin/sleep 1000\n",
+                                    WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(set_unit_path(unit_dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_MINIMAL, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        test_socket_workers(m, path);
+
+        manager_free(m);
+
+        return 0;
+}
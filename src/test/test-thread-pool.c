@@ -0,0 +1,181 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "async.h"
+#include "fd-util.h"
+#include "log.h"
+#include "macro.h"
+#include "thread-pool.h"
+#include "time-util.h"
+
+#define N_JOBS 1000U
+
+static void increment(void *userdata) {
+        unsigned *counter = userdata;
+
+        __sync_fetch_and_add(counter, 1);
+}
+
+static void test_fire_and_forget(void) {
+        _cleanup_thread_pool_free_ ThreadPool *p = NULL;
+        ThreadPoolStats stats;
+        unsigned counter = 0, i;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(thread_pool_new(&p, 4) >= 0);
+
+        for (i = 0; i < N_JOBS; i++)
+                assert_se(thread_pool_submit(p, increment, &counter, NULL) >= 0);
+
+        thread_pool_get_stats(p, &stats);
+        assert_se(stats.n_submitted == N_JOBS);
+        assert_se(stats.n_threads <= 4);
+        assert_se(stats.n_spawned <= 4);
+
+        /* Freeing the pool waits for all queued jobs to be executed */
+        p = thread_pool_free(p);
+        assert_se(counter == N_JOBS);
+}
+
+static void sleep_and_increment(void *userdata) {
+        usleep(10 * USEC_PER_MSEC);
+        increment(userdata);
+}
+
+static void test_join(void) {
+        _cleanup_thread_pool_free_ ThreadPool *p = NULL;
+        ThreadJob *jobs[8];
+        unsigned counter = 0, i;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(thread_pool_new(&p, 1) >= 0);
+
+        for (i = 0; i < ELEMENTSOF(jobs); i++)
+                assert_se(thread_pool_submit(p, sleep_and_increment, &counter, jobs + i) >= 0);
+
+        /* Jobs are run in order by the single worker, hence once the last one finished, all others must have
+         * finished too */
+        assert_se(thread_job_join(jobs[ELEMENTSOF(jobs) - 1]) >= 0);
+        assert_se(counter == ELEMENTSOF(jobs));
+
+        for (i = 0; i < ELEMENTSOF(jobs) - 1; i++)
+                assert_se(thread_job_join(jobs[i]) >= 0);
+}
+
+static void test_default_fork(void) {
+        ThreadPool *p;
+        ThreadJob *j;
+        unsigned counter = 0;
+        siginfo_t si = {};
+        pid_t pid;
+
+        log_info("/* %s */", __func__);
+
+        p = thread_pool_default();
+        assert_se(p);
+        assert_se(thread_pool_default() == p);
+
+        assert_se(thread_pool_submit(p, increment, &counter, &j) >= 0);
+        assert_se(thread_job_join(j) >= 0);
+        assert_se(counter == 1);
+
+        pid = fork();
+        assert_se(pid >= 0);
+
+        if (pid == 0) {
+                ThreadPool *q;
+
+                /* The worker threads are not inherited, hence the child must not use the parent's pool */
+                assert_se(thread_pool_submit(p, increment, &counter, NULL) == -ECHILD);
+
+                q = thread_pool_default();
+                assert_se(q);
+                assert_se(thread_pool_submit(q, increment, &counter, &j) >= 0);
+                assert_se(thread_job_join(j) >= 0);
+                assert_se(counter == 2);
+
+                _exit(EXIT_SUCCESS);
+        }
+
+        assert_se(waitid(P_PID, pid, &si, WEXITED) >= 0);
+        assert_se(si.si_code == CLD_EXITED);
+        assert_se(si.si_status == EXIT_SUCCESS);
+}
+
+static void block_on_pipe(void *userdata) {
+        char c;
+
+        /* Returns once the write end is closed */
+        assert_se(read(PTR_TO_FD(userdata), &c, 1) == 0);
+}
+
+static void test_sync_lane(void) {
+        _cleanup_close_pair_ int blocker[2] = { -1, -1 }, p[2] = { -1, -1 };
+        struct pollfd pfd = {};
+        ThreadPoolStats stats;
+        unsigned i;
+
+        log_info("/* %s */", __func__);
+
+        /* Occupy all threads of the default pool and queue even more, asynchronous_close() must still go
+         * through right away */
+
+        assert_se(pipe2(blocker, O_CLOEXEC) >= 0);
+        assert_se(pipe2(p, O_CLOEXEC) >= 0);
+
+        for (i = 0; i < 64; i++)
+                assert_se(asynchronous_job(block_on_pipe, FD_TO_PTR(blocker[0])) >= 0);
+
+        p[1] = asynchronous_close(p[1]);
+
+        pfd.fd = p[0];
+        pfd.events = POLLIN;
+        assert_se(poll(&pfd, 1, 10 * MSEC_PER_SEC) == 1);
+        assert_se(pfd.revents & POLLHUP);
+
+        /* Release the blocked jobs, they must be done before the read end goes away */
+        blocker[1] = safe_close(blocker[1]);
+        for (;;) {
+                thread_pool_get_stats(thread_pool_default(), &stats);
+                if (stats.n_queued == 0 && stats.n_threads == stats.n_idle)
+                        break;
+
+                usleep(10 * USEC_PER_MSEC);
+        }
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        test_fire_and_forget();
+        test_join();
+        test_default_fork();
+        test_sync_lane();
+
+        return 0;
+}
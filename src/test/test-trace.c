@@ -0,0 +1,159 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "log.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "trace.h"
+#include "util.h"
+
+static void test_trace_add(void) {
+        Trace t = {};
+        const TraceEvent *e;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(trace_size(&t) == 0);
+        assert_se(!trace_get(&t, 0));
+
+        trace_add(&t, TRACE_MANAGER, "load", "foo.service", 10, 5);
+        trace_add(&t, TRACE_JOB, "job-wait", "foo.service", 20, 1);
+        trace_add(&t, TRACE_MANAGER, "coldplug", NULL, 30, 2);
+
+        assert_se(trace_size(&t) == 3);
+        assert_se(hashmap_size(t.objects) == 1);
+
+        assert_se(e = trace_get(&t, 0));
+        assert_se(e->category == TRACE_MANAGER);
+        assert_se(streq(e->name, "load"));
+        assert_se(streq(e->object, "foo.service"));
+        assert_se(e->begin == 10);
+        assert_se(e->duration == 5);
+
+        assert_se(e = trace_get(&t, 1));
+        assert_se(e->category == TRACE_JOB);
+        assert_se(e->object == trace_get(&t, 0)->object);
+
+        assert_se(e = trace_get(&t, 2));
+        assert_se(!e->object);
+        assert_se(!trace_get(&t, 3));
+
+        trace_done(&t);
+        assert_se(trace_size(&t) == 0);
+}
+
+static void test_trace_wrap(void) {
+        Trace t = {};
+        const TraceEvent *e;
+        unsigned k;
+
+        log_info("/* %s */", __func__);
+
+        /* Once the ring is full, the oldest events are dropped, and so are the objects only they referred to */
+
+        for (k = 0; k < TRACE_EVENTS_MAX * 2 + 3; k++) {
+                char object[DECIMAL_STR_MAX(unsigned) + 10];
+
+                xsprintf(object, "%u.service", k);
+                trace_add(&t, TRACE_MANAGER, "load", object, k, 1);
+        }
+
+        assert_se(trace_size(&t) == TRACE_EVENTS_MAX);
+        assert_se(hashmap_size(t.objects) == TRACE_EVENTS_MAX);
+
+        assert_se(e = trace_get(&t, 0));
+        assert_se(e->begin == TRACE_EVENTS_MAX + 3);
+        assert_se(e = trace_get(&t, TRACE_EVENTS_MAX - 1));
+        assert_se(e->begin == TRACE_EVENTS_MAX * 2 + 2);
+        assert_se(endswith(e->object, ".service"));
+
+        for (k = 0; k < TRACE_EVENTS_MAX; k++)
+                trace_add(&t, TRACE_JOB, "job-run", "bar.service", k, 1);
+
+        assert_se(trace_size(&t) == TRACE_EVENTS_MAX);
+        assert_se(hashmap_size(t.objects) == 1);
+
+        trace_done(&t);
+}
+
+static void test_trace_pinned(void) {
+        Trace t = {};
+        const TraceEvent *e;
+        unsigned k;
+
+        log_info("/* %s */", __func__);
+
+        /* Pinned events survive the ring wrapping around, however many unit events follow */
+
+        trace_add_pinned(&t, TRACE_MANAGER, "generators", NULL, 1, 1);
+        trace_add_pinned(&t, TRACE_GENERATOR, "generator", "foo-generator", 1, 1);
+        trace_add_pinned(&t, TRACE_MANAGER, "coldplug", NULL, 2, 1);
+
+        for (k = 0; k < TRACE_EVENTS_MAX * 2; k++)
+                trace_add(&t, TRACE_MANAGER, "load", "foo-generator", 10 + k, 1);
+
+        assert_se(trace_size(&t) == 3 + TRACE_EVENTS_MAX);
+        assert_se(hashmap_size(t.objects) == 1);
+
+        assert_se(e = trace_get(&t, 0));
+        assert_se(streq(e->name, "generators"));
+        assert_se(e = trace_get(&t, 1));
+        assert_se(e->category == TRACE_GENERATOR);
+        assert_se(streq(e->object, "foo-generator"));
+        assert_se(e = trace_get(&t, 2));
+        assert_se(streq(e->name, "coldplug"));
+        assert_se(e = trace_get(&t, 3));
+        assert_se(e->begin == 10 + TRACE_EVENTS_MAX);
+        assert_se(!trace_get(&t, 3 + TRACE_EVENTS_MAX));
+
+        /* Once the pinned buffer is full, further pinned events go into the ring */
+        for (k = 3; k < TRACE_PINNED_MAX + 1; k++)
+                trace_add_pinned(&t, TRACE_MANAGER, "enumerate", NULL, k, 1);
+
+        assert_se(t.n_pinned == TRACE_PINNED_MAX);
+        assert_se(trace_size(&t) == TRACE_PINNED_MAX + TRACE_EVENTS_MAX);
+        assert_se(e = trace_get(&t, trace_size(&t) - 1));
+        assert_se(streq(e->name, "enumerate"));
+        assert_se(e->begin == TRACE_PINNED_MAX);
+
+        trace_done(&t);
+        assert_se(trace_size(&t) == 0);
+}
+
+static void test_trace_category(void) {
+        TraceCategory c;
+
+        log_info("/* %s */", __func__);
+
+        for (c = 0; c < _TRACE_CATEGORY_MAX; c++)
+                assert_se(trace_category_from_string(trace_category_to_string(c)) == c);
+
+        assert_se(trace_category_from_string("foo") == _TRACE_CATEGORY_INVALID);
+}
+
+int main(int argc, char *argv[]) {
+        log_parse_environment();
+        log_open();
+
+        test_trace_add();
+        test_trace_wrap();
+        test_trace_pinned();
+        test_trace_category();
+
+        return 0;
+}
@@ -0,0 +1,175 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "env-util.h"
+#include "hashmap.h"
+#include "log.h"
+#include "random-util.h"
+#include "unit-dependency-set.h"
+#include "util.h"
+
+/* The set never dereferences the units, hence we can use fake pointers as keys */
+#define UNIT(i) ((Unit*) UINT_TO_PTR(((i) + 1) * 64))
+#define DATA(i) UINT_TO_PTR((i) + 1)
+
+static bool arg_slow = false;
+
+static void test_put_get(void) {
+        _cleanup_unit_dependency_set_free_ UnitDependencySet *s = NULL;
+        void *data;
+        Unit *u;
+        Iterator i;
+        unsigned n = 0;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(!unit_dependency_set_get(NULL, UNIT(1)));
+        assert_se(!unit_dependency_set_remove(NULL, UNIT(1)));
+        assert_se(unit_dependency_set_size(NULL) == 0);
+        assert_se(!unit_dependency_set_first(NULL));
+        assert_se(unit_dependency_set_update(NULL, UNIT(1), DATA(1)) == -ENOENT);
+
+        assert_se(unit_dependency_set_put(&s, UNIT(1), DATA(1)) == 1);
+        assert_se(unit_dependency_set_put(&s, UNIT(1), DATA(1)) == 0);
+        assert_se(unit_dependency_set_put(&s, UNIT(1), DATA(2)) == -EEXIST);
+        assert_se(unit_dependency_set_put(&s, UNIT(2), DATA(2)) == 1);
+        assert_se(unit_dependency_set_put(&s, UNIT(3), DATA(3)) == 1);
+        assert_se(unit_dependency_set_size(s) == 3);
+        assert_se(unit_dependency_set_first(s) == UNIT(1));
+
+        assert_se(unit_dependency_set_update(s, UNIT(2), DATA(20)) == 0);
+        assert_se(unit_dependency_set_get(s, UNIT(2)) == DATA(20));
+        assert_se(unit_dependency_set_update(s, UNIT(4), DATA(4)) == -ENOENT);
+
+        /* Replacing a unit overrides any entry of the new unit */
+        assert_se(unit_dependency_set_remove_and_replace(s, UNIT(4), UNIT(1), DATA(4)) == -ENOENT);
+        assert_se(unit_dependency_set_remove_and_replace(s, UNIT(3), UNIT(1), DATA(30)) == 0);
+        assert_se(!unit_dependency_set_contains(s, UNIT(3)));
+        assert_se(unit_dependency_set_get(s, UNIT(1)) == DATA(30));
+        assert_se(unit_dependency_set_remove_and_replace(s, UNIT(2), UNIT(5), DATA(50)) == 0);
+        assert_se(unit_dependency_set_get(s, UNIT(5)) == DATA(50));
+        assert_se(unit_dependency_set_size(s) == 2);
+
+        /* Removing the current entry while iterating is allowed */
+        UNIT_DEPENDENCY_SET_FOREACH_DATA(data, u, s, i) {
+                assert_se(unit_dependency_set_remove(s, u) == data);
+                n++;
+        }
+        assert_se(n == 2);
+        assert_se(unit_dependency_set_isempty(s));
+}
+
+static void test_move(void) {
+        _cleanup_unit_dependency_set_free_ UnitDependencySet *s = NULL, *t = NULL;
+        unsigned k;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(unit_dependency_set_move(&s, &t) == 0);
+        assert_se(!s && !t);
+
+        for (k = 0; k < 10; k++)
+                assert_se(unit_dependency_set_put(&t, UNIT(k), DATA(k)) == 1);
+
+        /* An unallocated destination simply takes over the other set */
+        assert_se(unit_dependency_set_move(&s, &t) == 0);
+        assert_se(!t);
+        assert_se(unit_dependency_set_size(s) == 10);
+
+        for (k = 5; k < 50; k++)
+                assert_se(unit_dependency_set_put(&t, UNIT(k), DATA(k + 100)) == 1);
+
+        /* Entries already in the destination are left behind, with the destination's data kept */
+        assert_se(unit_dependency_set_reserve(&s, unit_dependency_set_size(t)) == 0);
+        assert_se(unit_dependency_set_move(&s, &t) == 0);
+        assert_se(unit_dependency_set_size(s) == 50);
+        assert_se(unit_dependency_set_size(t) == 5);
+
+        for (k = 0; k < 50; k++)
+                assert_se(unit_dependency_set_get(s, UNIT(k)) == (k < 10 ? DATA(k) : DATA(k + 100)));
+        for (k = 5; k < 10; k++)
+                assert_se(unit_dependency_set_get(t, UNIT(k)) == DATA(k + 100));
+}
+
+static void test_random(unsigned range) {
+        _cleanup_unit_dependency_set_free_ UnitDependencySet *s = NULL;
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        unsigned k, n = arg_slow ? 1000000 : 20000;
+        Iterator i;
+        void *data;
+        Unit *u;
+
+        log_info("/* %s(%u) */", __func__, range);
+
+        /* Run random operations on both a UnitDependencySet and a Hashmap, and compare the results. With a large
+         * key range this covers the hash index, with a small one the linear search. */
+
+        assert_se(h = hashmap_new(NULL));
+
+        for (k = 0; k < n; k++) {
+                unsigned j = random_u64() % range, l = random_u64() % range;
+
+                switch (random_u64() % 6) {
+
+                case 0:
+                case 1:
+                        assert_se(unit_dependency_set_put(&s, UNIT(j), DATA(j)) == hashmap_put(h, UNIT(j), DATA(j)));
+                        break;
+
+                case 2:
+                        assert_se(unit_dependency_set_remove(s, UNIT(j)) == hashmap_remove(h, UNIT(j)));
+                        break;
+
+                case 3:
+                        assert_se(unit_dependency_set_get(s, UNIT(j)) == hashmap_get(h, UNIT(j)));
+                        break;
+
+                case 4:
+                        assert_se(unit_dependency_set_update(s, UNIT(j), DATA(l)) == hashmap_update(h, UNIT(j), DATA(l)));
+                        break;
+
+                case 5:
+                        assert_se(unit_dependency_set_remove_and_replace(s, UNIT(j), UNIT(l), DATA(l)) ==
+                                  hashmap_remove_and_replace(h, UNIT(j), UNIT(l), DATA(l)));
+                        break;
+                }
+
+                assert_se(unit_dependency_set_size(s) == hashmap_size(h));
+        }
+
+        UNIT_DEPENDENCY_SET_FOREACH_DATA(data, u, s, i)
+                assert_se(hashmap_remove(h, u) == data);
+        assert_se(hashmap_isempty(h));
+}
+
+int main(int argc, char *argv[]) {
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        arg_slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+
+        test_put_get();
+        test_move();
+        test_random(8);
+        test_random(2000);
+
+        return 0;
+}
@@ -0,0 +1,177 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fileio.h"
+#include "fs-util.h"
+#include "log.h"
+#include "rm-rf.h"
+#include "set.h"
+#include "string-util.h"
+#include "strv.h"
+#include "time-util.h"
+#include "unit-file-index.h"
+
+static void backdate(const char *path) {
+        struct timespec ts[2];
+
+        /* Move the mtime out of the window in which the index does not trust it */
+        timespec_store(ts, now(CLOCK_REALTIME) - USEC_PER_HOUR);
+        ts[1] = ts[0];
+
+        assert_se(utimensat(AT_FDCWD, path, ts, AT_SYMLINK_NOFOLLOW) >= 0);
+}
+
+static void check_lookups(UnitFileIndex *i, const char *a, const char *c) {
+        const char *p, *target;
+
+        p = strjoina(a, "/foo.service");
+        assert_se(unit_file_index_lookup(i, p, &target) == 1);
+        assert_se(!target);
+
+        p = strjoina(a, "/alias service.service");
+        assert_se(unit_file_index_lookup(i, p, &target) == 1);
+        assert_se(streq(target, "foo.service"));
+
+        p = strjoina(a, "/foo.service.d");
+        assert_se(unit_file_index_lookup(i, p, NULL) == 1);
+
+        p = strjoina(a, "/nope.service");
+        assert_se(unit_file_index_lookup(i, p, NULL) == -ENOENT);
+
+        p = strjoina(c, "/foo.service");
+        assert_se(unit_file_index_lookup(i, p, NULL) == -ENOENT);
+
+        assert_se(unit_file_index_lookup(i, "/somewhere/else.service", NULL) == -ENODATA);
+        assert_se(unit_file_index_lookup(NULL, "/somewhere/else.service", NULL) == -ENODATA);
+}
+
+static void test_unit_file_index(void) {
+        char template[] = "/tmp/test-unit-file-index.XXXXXX";
+        _cleanup_strv_free_ char **search_path = NULL;
+        _cleanup_set_free_free_ Set *s = NULL;
+        const char *a, *b, *c, *index_file, *p;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp(template));
+
+        a = strjoina(template, "/a");
+        b = strjoina(template, "/b");
+        c = strjoina(template, "/c");
+        index_file = strjoina(template, "/run/unit-index");
+        assert_se(search_path = strv_new(a, b, c, NULL));
+
+        assert_se(mkdir(a, 0755) >= 0);
+        assert_se(mkdir(b, 0755) >= 0);
+
+        p = strjoina(a, "/foo.service");
+        assert_se(touch(p) >= 0);
+        p = strjoina(a, "/alias service.service");
+        assert_se(symlink("foo.service", p) >= 0);
+        p = strjoina(a, "/foo.service.d");
+        assert_se(mkdir(p, 0755) >= 0);
+        p = strjoina(b, "/bar.service");
+        assert_se(touch(p) >= 0);
+
+        backdate(a);
+        backdate(b);
+
+        {
+                _cleanup_unit_file_index_free_ UnitFileIndex *i = NULL;
+
+                /* Nothing to reuse, but a and b are read and the index file is written */
+                assert_se(unit_file_index_acquire(search_path, index_file, &i) == 2);
+                check_lookups(i, a, c);
+
+                assert_se(unit_file_index_to_set(i, &s) >= 0);
+                assert_se(set_size(s) == 4);
+                p = strjoina(b, "/bar.service");
+                assert_se(set_contains(s, p));
+        }
+
+        {
+                _cleanup_unit_file_index_free_ UnitFileIndex *i = NULL;
+
+                /* Everything comes from the index file */
+                assert_se(unit_file_index_acquire(search_path, index_file, &i) == 0);
+                check_lookups(i, a, c);
+        }
+
+        p = strjoina(b, "/baz.service");
+        assert_se(touch(p) >= 0);
+
+        {
+                _cleanup_unit_file_index_free_ UnitFileIndex *i = NULL;
+
+                /* b changed, and is read again. Its new mtime is too recent to be trusted for now. */
+                assert_se(unit_file_index_acquire(search_path, index_file, &i) == 1);
+                assert_se(unit_file_index_lookup(i, p, NULL) == 1);
+
+                i = unit_file_index_free(i);
+                assert_se(unit_file_index_acquire(search_path, index_file, &i) == 1);
+                check_lookups(i, a, c);
+        }
+
+        backdate(b);
+
+        {
+                _cleanup_unit_file_index_free_ UnitFileIndex *i = NULL;
+
+                assert_se(unit_file_index_acquire(search_path, index_file, &i) == 1);
+                i = unit_file_index_free(i);
+                assert_se(unit_file_index_acquire(search_path, index_file, &i) == 0);
+                assert_se(unit_file_index_lookup(i, p, NULL) == 1);
+        }
+
+        assert_se(write_string_file(index_file, "VERSION=1\nFILE=foo.service\n", WRITE_STRING_FILE_CREATE) >= 0);
+
+        {
+                _cleanup_unit_file_index_free_ UnitFileIndex *i = NULL;
+
+                /* A broken index is ignored, and replaced */
+                assert_se(unit_file_index_acquire(search_path, index_file, &i) == 2);
+                check_lookups(i, a, c);
+
+                i = unit_file_index_free(i);
+                assert_se(unit_file_index_acquire(search_path, index_file, &i) == 0);
+                check_lookups(i, a, c);
+        }
+
+        {
+                _cleanup_unit_file_index_free_ UnitFileIndex *i = NULL;
+
+                /* Without an index file, everything is read */
+                assert_se(unit_file_index_acquire(search_path, NULL, &i) == 2);
+                check_lookups(i, a, c);
+        }
+
+        assert_se(rm_rf(template, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+}
+
+int main(int argc, char *argv[]) {
+        log_parse_environment();
+        log_open();
+
+        test_unit_file_index();
+
+        return 0;
+}